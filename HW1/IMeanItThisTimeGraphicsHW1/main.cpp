@@ -1,6 +1,5 @@
-#include <GL/glew.h>
-#include <GL/freeglut.h>
 #include "glsupport.h"
+#include <GL/freeglut.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -130,7 +129,9 @@ int main(int argc, char** argv)
 	glutInitWindowSize(500, 500);
 	glutCreateWindow("CS-6533");
 
+#ifndef CS6533_NO_GLEW
 	glewInit();
+#endif
 
 	glutDisplayFunc(display);
 	glutReshapeFunc(reshape);
@@ -6,6 +6,12 @@
 
 #ifdef __APPLE__
     #include <glut.h>
+#elif defined(CS6533_NO_GLEW)
+    // Linux libGL exports every entry point itself, so no loader is needed
+    #define GL_GLEXT_PROTOTYPES
+    #include <GL/gl.h>
+    #include <GL/glext.h>
+    #include <GL/glut.h>
 #else
     #include <GL/glew.h>
     #include <GL/glut.h>
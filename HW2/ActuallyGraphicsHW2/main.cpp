@@ -1,6 +1,5 @@
-#include <GL/glew.h>
-#include <GL/freeglut.h>
 #include "glsupport.h"
+#include <GL/freeglut.h>
 #include "geometrymaker.h"
 #include "cvec.h"
 #include "matrix4.h"
@@ -70,7 +69,7 @@ struct Entity {
 		return modelViewMatrix;
 	}
 
-	void Draw(Matrix4 &eyeInverse, GLuint positionAttribute, GLuint normalAttribute, GLuint modelViewMatrixLoc, GLuint normalMatrixLoc) {
+	void Draw(const Matrix4 &eyeInverse, GLuint positionAttribute, GLuint normalAttribute, GLuint modelViewMatrixLoc, GLuint normalMatrixLoc) {
 
 		//GET PARENT DATA
 		Matrix4 parModel;
@@ -250,7 +249,9 @@ int main(int argc, char** argv)
 	glutInitWindowSize(750, 750);
 	glutCreateWindow("CS-6533");
 
+#ifndef CS6533_NO_GLEW
 	glewInit();
+#endif
 
 	glutDisplayFunc(display);
 	glutReshapeFunc(reshape);
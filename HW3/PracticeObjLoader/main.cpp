@@ -1,7 +1,5 @@
-#include <GL/glew.h>
-#include <GL/freeglut.h>
-
 #include "glsupport.h"
+#include <GL/freeglut.h>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
@@ -109,7 +107,7 @@ struct Entity {
 		return modelViewMatrix;
 	}
 
-	void Draw(Matrix4 &eyeInverse, GLuint positionAttribute, GLuint texCoordAttribute, GLuint normalAttribute, GLuint binormalAttribute, GLuint tangentAttribute, GLuint modelViewMatrixLoc, GLuint normalMatrixloc) {
+	void Draw(const Matrix4 &eyeInverse, GLuint positionAttribute, GLuint texCoordAttribute, GLuint normalAttribute, GLuint binormalAttribute, GLuint tangentAttribute, GLuint modelViewMatrixLoc, GLuint normalMatrixloc) {
 
 		//GET PARENT DATA
 		Matrix4 parModel;
@@ -376,7 +374,9 @@ int main(int argc, char** argv)
 	glutInitWindowSize(750, 750);
 	glutCreateWindow("CS-6533");
 
+#ifndef CS6533_NO_GLEW
 	glewInit();
+#endif
 
 	glutDisplayFunc(display);
 	glutReshapeFunc(reshape);
@@ -291,17 +291,15 @@ inline Matrix4 normalMatrix(const Matrix4& m) {
 }
 
 inline Matrix4 transFact(const Matrix4& m) {
-	// ==========================================
-	// TODO: fill in your own implementation here
-	// ==========================================
+  // Translation part of an affine matrix
+  return Matrix4::makeTranslation(Cvec3(m(0, 3), m(1, 3), m(2, 3)));
 }
 
 inline Matrix4 linFact(const Matrix4& m) {
-	// ==========================================
-	// TODO: fill in your own implementation here
-	// ==========================================
-	
-	
+  // Linear part of an affine matrix
+  Matrix4 r = m;
+  r(0, 3) = r(1, 3) = r(2, 3) = 0;
+  return r;
 }
 
 #endif
@@ -0,0 +1,79 @@
+#include "animation.h"
+
+#include <cmath>
+
+// Entities posed per chunk of AnimationSystem::update; each costs a few
+// hundred nanoseconds, so fewer than this aren't worth waking a thread for
+static const int ANIMATION_PARALLEL_GRAIN = 256;
+
+double AnimationClip::duration() const {
+	double end = 0.0;
+	if (!translation.empty()) {
+		end = std::max(end, translation.times.back());
+	}
+	if (!rotation.empty()) {
+		end = std::max(end, rotation.times.back());
+	}
+	if (!scale.empty()) {
+		end = std::max(end, scale.times.back());
+	}
+	return end;
+}
+
+void AnimationSystem::play(Entity* entity, const AnimationClip* clip, double startTime, double speed) {
+	Playback playback;
+	playback.entity = entity;
+	playback.clip = clip;
+	playback.startTime = startTime;
+	playback.speed = speed;
+	playback.translationCursor = playback.rotationCursor = playback.scaleCursor = 0;
+	for (int i = 0; i < playbacks_.size(); i++) {
+		if (playbacks_[i].entity == entity) {
+			playbacks_[i] = playback;
+			return;
+		}
+	}
+	playbacks_.push_back(playback);
+}
+
+void AnimationSystem::stop(Entity* entity) {
+	for (int i = 0; i < playbacks_.size(); i++) {
+		if (playbacks_[i].entity == entity) {
+			playbacks_.erase(playbacks_.begin() + i);
+			return;
+		}
+	}
+}
+
+void AnimationSystem::pose(Playback& playback, double time) {
+	const AnimationClip& clip = *playback.clip;
+	double clipTime = (time - playback.startTime) * playback.speed;
+	if (clip.looping) {
+		const double duration = clip.duration();
+		if (duration > 0.0) {
+			clipTime = std::fmod(clipTime, duration);
+			if (clipTime < 0.0) {
+				clipTime += duration;
+			}
+		}
+	}
+
+	Transform& transform = playback.entity->transform;
+	if (!clip.translation.empty()) {
+		transform.translation = clip.translation.sample(clipTime, playback.translationCursor, clip.looping);
+	}
+	if (!clip.rotation.empty()) {
+		transform.rotation = clip.rotation.sample(clipTime, playback.rotationCursor, clip.looping);
+	}
+	if (!clip.scale.empty()) {
+		transform.scale = clip.scale.sample(clipTime, playback.scaleCursor, clip.looping);
+	}
+}
+
+void AnimationSystem::update(double time) {
+	pool_.parallelFor((int)playbacks_.size(), ANIMATION_PARALLEL_GRAIN, [this, time](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			pose(playbacks_[i], time);
+		}
+	});
+}
@@ -0,0 +1,159 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "cvec.h"
+#include "quat.h"
+#include "scene.h"
+#include "parallel.h"
+
+//--------------------------------------------------------------------------------
+// Keyframe animation of entity transforms. An AnimationClip holds translation,
+// rotation and scale tracks; AnimationSystem plays clips on entities and
+// poses all of them once per frame, split across a ThreadPool. Every playing
+// track remembers the segment it sampled last, so the next sample starts from
+// there instead of searching the keys again.
+//--------------------------------------------------------------------------------
+
+enum KeyframeInterpolation {
+	KEYFRAME_STEP,        // hold each key until the next one
+	KEYFRAME_LINEAR,      // lerp, or slerp for rotations
+	KEYFRAME_CATMULL_ROM  // interpolateCatmullRom through the keys either side
+};
+
+inline Cvec3 interpolateLinear(const Cvec3& a, const Cvec3& b, double t) {
+	return a * (1 - t) + b * t;
+}
+
+inline Quat interpolateLinear(const Quat& a, const Quat& b, double t) {
+	return slerp(a, b, t);
+}
+
+// Keys in increasing time order. Between two keys the value follows the
+// track's interpolation; before the first and after the last it holds.
+// Catmull-Rom treats the keys as evenly spaced, and for rotations adjacent
+// keys should be less than 90 degrees apart so the spline knows which way
+// to turn.
+template <typename Value>
+struct KeyframeTrack {
+	std::vector<double> times;
+	std::vector<Value> values;
+	KeyframeInterpolation interpolation;
+
+	// Catmull-Rom control points d and e of segment i at 2i and 2i + 1,
+	// worked out as keys are added so sampling only evaluates the Bezier
+	// curve. Segments at the ends repeat their end key as the neighbour.
+	std::vector<Value> controlPoints;
+
+	KeyframeTrack() : interpolation(KEYFRAME_LINEAR) {}
+
+	void addKey(double time, const Value& value) {
+		assert(times.empty() || time > times.back());
+		times.push_back(time);
+		values.push_back(value);
+		// The new key is a neighbour of the last two segments
+		const int last = size() - 1;
+		controlPoints.resize(2 * std::max(last, 0));
+		for (int i = std::max(last - 2, 0); i < last; i++) {
+			catmullRomControlPoints(values[std::max(i - 1, 0)], values[i], values[i + 1], values[std::min(i + 2, last)],
+				controlPoints[2 * i], controlPoints[2 * i + 1]);
+		}
+	}
+
+	int size() const { return (int)times.size(); }
+	bool empty() const { return times.empty(); }
+
+	// The segment [times[i], times[i + 1]) holding time, for a time inside the
+	// track. cursor is the segment this returned last; playing forward that is
+	// the answer, or the one after it, and only a jump falls back to a binary
+	// search.
+	int findSegment(double time, int& cursor) const {
+		const int last = size() - 2;
+		int i = std::min(std::max(cursor, 0), last);
+		if (times[i] <= time) {
+			if (i == last || time < times[i + 1]) {
+				return cursor = i;
+			}
+			if (i + 1 == last || time < times[i + 2]) {
+				return cursor = i + 1;
+			}
+		}
+		i = (int)(std::upper_bound(times.begin(), times.end(), time) - times.begin()) - 1;
+		return cursor = std::min(std::max(i, 0), last);
+	}
+
+	// looping wraps the Catmull-Rom neighbours of the first and last segments
+	// around, for a track whose last key repeats its first
+	Value sample(double time, int& cursor, bool looping) const {
+		assert(!empty());
+		if (size() == 1 || time <= times.front()) {
+			return values.front();
+		}
+		if (time >= times.back()) {
+			return values.back();
+		}
+		const int i = findSegment(time, cursor);
+		if (interpolation == KEYFRAME_STEP) {
+			return values[i];
+		}
+		const double t = (time - times[i]) / (times[i + 1] - times[i]);
+		if (interpolation == KEYFRAME_LINEAR) {
+			return interpolateLinear(values[i], values[i + 1], t);
+		}
+		const int last = size() - 1;
+		if (looping && (i == 0 || i + 1 == last)) {
+			const int before = i > 0 ? i - 1 : last - 1;
+			const int after = i + 2 <= last ? i + 2 : 1;
+			return interpolateCatmullRom(values[before], values[i], values[i + 1], values[after], t);
+		}
+		return interpolateBezier(values[i], controlPoints[2 * i], controlPoints[2 * i + 1], values[i + 1], t);
+	}
+};
+
+// Tracks left empty don't touch that part of the transform. A looping clip
+// repeats every duration() seconds.
+struct AnimationClip {
+	KeyframeTrack<Cvec3> translation;
+	KeyframeTrack<Quat> rotation;
+	KeyframeTrack<Cvec3> scale;
+	bool looping;
+
+	AnimationClip() : looping(false) {}
+
+	// Time of the last key in any track
+	double duration() const;
+};
+
+class AnimationSystem {
+	struct Playback {
+		Entity* entity;
+		const AnimationClip* clip;
+		double startTime, speed;
+		int translationCursor, rotationCursor, scaleCursor;
+	};
+
+	ThreadPool& pool_;
+	std::vector<Playback> playbacks_;
+
+	static void pose(Playback& playback, double time);
+
+public:
+	explicit AnimationSystem(ThreadPool& pool = ThreadPool::shared()) : pool_(pool) {}
+
+	// Plays clip on entity from startTime, on update's clock, at speed times
+	// real time, replacing whatever the entity played before. The clip must
+	// outlive the playback.
+	void play(Entity* entity, const AnimationClip* clip, double startTime = 0.0, double speed = 1.0);
+	void stop(Entity* entity);
+
+	int playingCount() const { return (int)playbacks_.size(); }
+
+	// Sets the transform of every playing entity for time in seconds. Each
+	// entity is written by one thread, so no two playbacks may share one.
+	void update(double time);
+};
+
+#endif
@@ -0,0 +1,56 @@
+#version 140
+
+attribute vec4 position;
+attribute vec2 texCoord;
+
+attribute vec4 normal;
+attribute vec4 binormal;
+attribute vec4 tangent;
+
+struct Light {
+	vec3 lightPosition;
+	float shadowFarPlane; // 0 when the light casts no shadow
+	vec3 lightColor;
+	vec3 specularLightColor;
+};
+
+// Set once a frame, see uniforms.h
+layout(std140) uniform FrameUniforms {
+	mat4 projectionMatrix;
+	mat4 eyeToWorldMatrix;
+	mat4 cascadeMatrices[4];
+	Light lights[3];
+	vec4 cascadeSplits;
+	vec3 sunDirection; // eye space, pointing towards the light
+	vec3 sunColor;
+	int cascadeCount; // directional light with cascaded shadows off when 0
+};
+
+// ObjectUniforms of every draw in the batch, 8 texels each, see multidraw.h
+uniform samplerBuffer objectData;
+
+// Position of the draw in the batch, from its baseInstance
+attribute float drawIndex;
+
+varying vec3 varyingPosition;
+varying vec2 varyingTexCoord;
+
+varying mat3 varyingTBNMatrix;
+
+mat4 objectMatrix(int first)
+{
+	return mat4(texelFetch(objectData, first), texelFetch(objectData, first + 1), texelFetch(objectData, first + 2), texelFetch(objectData, first + 3));
+}
+
+void main()
+{
+	int first = int(drawIndex) * 8;
+	mat4 modelViewMatrix = objectMatrix(first);
+	mat4 normalMatrix = objectMatrix(first + 4);
+
+	varyingTexCoord = texCoord;
+	vec4 p = modelViewMatrix * position;
+	varyingPosition = p.xyz;
+	varyingTBNMatrix = mat3(normalize((normalMatrix * tangent).xyz), normalize((normalMatrix * binormal).xyz), normalize((normalMatrix * normal).xyz));
+	gl_Position = projectionMatrix * modelViewMatrix * position;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+uniform float bloomThreshold;
+uniform float bloomIntensity;
+
+vec3 bloomBrightPass(vec2 uv) {
+	return max(screenTap(uv).rgb - vec3(bloomThreshold), 0.0);
+}
+
+// Gaussian-weighted glow of everything above the threshold, sampled on a
+// sparse 7x7 grid so the kernel covers a wide radius in one pass
+vec4 bloom(vec2 uv) {
+	vec4 color = screenTap(uv);
+	vec3 glow = vec3(0.0);
+	float totalWeight = 0.0;
+	for (int x = -3; x <= 3; x++) {
+		for (int y = -3; y <= 3; y++) {
+			float weight = exp(-float(x * x + y * y) / 8.0);
+			glow += bloomBrightPass(uv + vec2(float(x), float(y)) * texelSize * 2.0) * weight;
+			totalWeight += weight;
+		}
+	}
+	color.rgb += glow / totalWeight * bloomIntensity;
+	return color;
+}
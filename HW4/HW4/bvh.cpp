@@ -0,0 +1,489 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <queue>
+
+// Centroid bins per axis when looking for the best split
+static const int BVH_BINS = 16;
+
+// Leaves only split further when the heuristic says so, up to this size
+static const int BVH_MAX_LEAF_SIZE = 8;
+
+// Cost of visiting an inner node relative to testing one item, for the
+// surface area heuristic
+static const float BVH_TRAVERSAL_COST = 1.0f;
+
+static float surfaceArea(const Cvec3f& boxMin, const Cvec3f& boxMax) {
+	const Cvec3f d = boxMax - boxMin;
+	if (d[0] < 0 || d[1] < 0 || d[2] < 0) {
+		return 0.0f;
+	}
+	return 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+}
+
+static void growBox(Cvec3f& boxMin, Cvec3f& boxMax, const Cvec3f& otherMin, const Cvec3f& otherMax) {
+	for (int i = 0; i < 3; i++) {
+		boxMin[i] = std::min(boxMin[i], otherMin[i]);
+		boxMax[i] = std::max(boxMax[i], otherMax[i]);
+	}
+}
+
+static double distance2ToBox(const Cvec3& p, const Cvec3f& boxMin, const Cvec3f& boxMax) {
+	double d2 = 0;
+	for (int i = 0; i < 3; i++) {
+		const double d = std::max(std::max(boxMin[i] - p[i], p[i] - boxMax[i]), 0.0);
+		d2 += d * d;
+	}
+	return d2;
+}
+
+static Cvec3f toCvec3f(const Cvec3& v) {
+	return Cvec3f(float(v[0]), float(v[1]), float(v[2]));
+}
+
+int Bvh::allocatePair() {
+	if (!freePairs_.empty()) {
+		const int pair = freePairs_.back();
+		freePairs_.pop_back();
+		return pair;
+	}
+	const int pair = (int)nodes_.size();
+	nodes_.resize(pair + 2);
+	builtArea_.resize(pair + 2);
+	return pair;
+}
+
+void Bvh::build(const std::vector<Cvec3f>& boxMin, const std::vector<Cvec3f>& boxMax) {
+	itemMin_.resize(boxMin.size());
+	itemMax_.resize(boxMin.size());
+	itemCenter_.resize(boxMin.size());
+	itemRadius_.resize(boxMin.size());
+	for (int i = 0; i < boxMin.size(); i++) {
+		setItemBounds(i, boxMin[i], boxMax[i]);
+	}
+	buildTree();
+}
+
+void Bvh::build(const std::vector<Entity*>& entities) {
+	itemMin_.resize(entities.size());
+	itemMax_.resize(entities.size());
+	itemCenter_.resize(entities.size());
+	itemRadius_.resize(entities.size());
+	setItemBounds(entities);
+	buildTree();
+}
+
+void Bvh::buildTree() {
+	items_.resize(itemMin_.size());
+	for (int i = 0; i < items_.size(); i++) {
+		items_[i] = i;
+	}
+	// Slot 1 is never used, so that pairs start at odd indices
+	nodes_.assign(2, Node());
+	builtArea_.assign(2, 0.0f);
+	freePairs_.clear();
+	buildNode(0, 0, (int)items_.size());
+	updateLeafBounds();
+}
+
+void Bvh::updateLeafBounds() {
+	leafBounds_.resize((int)items_.size());
+	for (int i = 0; i < items_.size(); i++) {
+		setLeafBounds(i);
+	}
+}
+
+void Bvh::buildNode(int node, int first, int count) {
+	Cvec3f boxMin(FLT_MAX), boxMax(-FLT_MAX), centerMin(FLT_MAX), centerMax(-FLT_MAX);
+	for (int i = first; i < first + count; i++) {
+		const int item = items_[i];
+		growBox(boxMin, boxMax, itemMin_[item], itemMax_[item]);
+		const Cvec3f center = (itemMin_[item] + itemMax_[item]) * 0.5f;
+		growBox(centerMin, centerMax, center, center);
+	}
+	nodes_[node].boxMin = boxMin;
+	nodes_[node].boxMax = boxMax;
+	nodes_[node].first = first;
+	nodes_[node].count = count;
+	builtArea_[node] = surfaceArea(boxMin, boxMax);
+	if (count <= 1) {
+		return;
+	}
+
+	// Cheapest split between bins over all three axes, against the cost of
+	// leaving this a leaf
+	const float area = std::max(builtArea_[node], FLT_MIN);
+	float bestCost = (float)count;
+	int bestAxis = -1, bestSplit = 0;
+	for (int axis = 0; axis < 3; axis++) {
+		const float extent = centerMax[axis] - centerMin[axis];
+		if (extent <= 0.0f) {
+			continue;
+		}
+		const float scale = BVH_BINS / extent;
+		int binCount[BVH_BINS] = {};
+		Cvec3f binMin[BVH_BINS], binMax[BVH_BINS];
+		for (int b = 0; b < BVH_BINS; b++) {
+			binMin[b] = Cvec3f(FLT_MAX);
+			binMax[b] = Cvec3f(-FLT_MAX);
+		}
+		for (int i = first; i < first + count; i++) {
+			const int item = items_[i];
+			const float center = (itemMin_[item][axis] + itemMax_[item][axis]) * 0.5f;
+			const int b = std::min((int)((center - centerMin[axis]) * scale), BVH_BINS - 1);
+			binCount[b]++;
+			growBox(binMin[b], binMax[b], itemMin_[item], itemMax_[item]);
+		}
+		// Right side areas and counts swept from the top, left side from the bottom
+		float rightArea[BVH_BINS];
+		int rightCount[BVH_BINS];
+		Cvec3f sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+		int sweepCount = 0;
+		for (int b = BVH_BINS - 1; b > 0; b--) {
+			growBox(sweepMin, sweepMax, binMin[b], binMax[b]);
+			sweepCount += binCount[b];
+			rightArea[b] = surfaceArea(sweepMin, sweepMax);
+			rightCount[b] = sweepCount;
+		}
+		sweepMin = Cvec3f(FLT_MAX);
+		sweepMax = Cvec3f(-FLT_MAX);
+		sweepCount = 0;
+		for (int split = 1; split < BVH_BINS; split++) {
+			growBox(sweepMin, sweepMax, binMin[split - 1], binMax[split - 1]);
+			sweepCount += binCount[split - 1];
+			if (sweepCount == 0 || rightCount[split] == 0) {
+				continue;
+			}
+			const float cost = BVH_TRAVERSAL_COST + (surfaceArea(sweepMin, sweepMax) * sweepCount + rightArea[split] * rightCount[split]) / area;
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	int leftCount;
+	if (bestAxis >= 0) {
+		const float split = centerMin[bestAxis] + bestSplit * (centerMax[bestAxis] - centerMin[bestAxis]) / BVH_BINS;
+		const int* middle = &*std::partition(items_.begin() + first, items_.begin() + first + count, [this, bestAxis, split](int item) {
+			return (itemMin_[item][bestAxis] + itemMax_[item][bestAxis]) * 0.5f < split;
+		});
+		leftCount = (int)(middle - &items_[first]);
+	}
+	else if (count > BVH_MAX_LEAF_SIZE) {
+		// Nothing worth splitting by area, but too many to keep: halve along
+		// the widest spread of centers
+		int axis = 0;
+		for (int i = 1; i < 3; i++) {
+			if (centerMax[i] - centerMin[i] > centerMax[axis] - centerMin[axis]) {
+				axis = i;
+			}
+		}
+		leftCount = count / 2;
+		std::nth_element(items_.begin() + first, items_.begin() + first + leftCount, items_.begin() + first + count, [this, axis](int a, int b) {
+			return itemMin_[a][axis] + itemMax_[a][axis] < itemMin_[b][axis] + itemMax_[b][axis];
+		});
+	}
+	else {
+		return;
+	}
+	// Bin edges can round the other way from the partition; fall back to halves
+	if (leftCount == 0 || leftCount == count) {
+		leftCount = count / 2;
+	}
+
+	const int pair = allocatePair();
+	nodes_[node].first = pair;
+	nodes_[node].count = 0;
+	buildNode(pair, first, leftCount);
+	buildNode(pair + 1, first + leftCount, count - leftCount);
+}
+
+void Bvh::setItemBounds(int item, const Cvec3f& boxMin, const Cvec3f& boxMax) {
+	setItemBounds(item, (boxMin + boxMax) * 0.5f, norm(boxMax - boxMin) * 0.5f, boxMin, boxMax);
+}
+
+void Bvh::setItemBounds(int item, const Cvec3f& center, float radius, const Cvec3f& boxMin, const Cvec3f& boxMax) {
+	itemMin_[item] = boxMin;
+	itemMax_[item] = boxMax;
+	itemCenter_[item] = center;
+	itemRadius_[item] = radius;
+}
+
+void Bvh::setItemBounds(const std::vector<Entity*>& entities) {
+	for (int i = 0; i < entities.size(); i++) {
+		setItemBounds(i, toCvec3f(entities[i]->worldCenter), float(entities[i]->worldRadius),
+			toCvec3f(entities[i]->worldMin), toCvec3f(entities[i]->worldMax));
+	}
+}
+
+void Bvh::refitNode(int node) {
+	Cvec3f boxMin(FLT_MAX), boxMax(-FLT_MAX);
+	const int first = nodes_[node].first, count = nodes_[node].count;
+	if (count > 0) {
+		for (int i = first; i < first + count; i++) {
+			growBox(boxMin, boxMax, itemMin_[items_[i]], itemMax_[items_[i]]);
+			setLeafBounds(i);
+		}
+	}
+	else {
+		refitNode(first);
+		refitNode(first + 1);
+		growBox(boxMin, boxMax, nodes_[first].boxMin, nodes_[first].boxMax);
+		growBox(boxMin, boxMax, nodes_[first + 1].boxMin, nodes_[first + 1].boxMax);
+	}
+	nodes_[node].boxMin = boxMin;
+	nodes_[node].boxMax = boxMax;
+}
+
+void Bvh::refit() {
+	if (!items_.empty()) {
+		refitNode(0);
+	}
+}
+
+// Frees the nodes below node and finds the range of items under it
+void Bvh::releaseChildren(int node, int& first, int& count) {
+	if (nodes_[node].count > 0) {
+		first = std::min(first, nodes_[node].first);
+		count += nodes_[node].count;
+		return;
+	}
+	const int pair = nodes_[node].first;
+	releaseChildren(pair, first, count);
+	releaseChildren(pair + 1, first, count);
+	freePairs_.push_back(pair);
+}
+
+int Bvh::rebuildDegradedNode(int node, float maxGrowth) {
+	if (nodes_[node].count > 0) {
+		return 0;
+	}
+	if (surfaceArea(nodes_[node].boxMin, nodes_[node].boxMax) > maxGrowth * builtArea_[node]) {
+		int first = INT_MAX, count = 0;
+		releaseChildren(node, first, count);
+		buildNode(node, first, count);
+		return 1;
+	}
+	const int pair = nodes_[node].first;
+	return rebuildDegradedNode(pair, maxGrowth) + rebuildDegradedNode(pair + 1, maxGrowth);
+}
+
+int Bvh::rebuildDegraded(float maxGrowth) {
+	const int rebuilt = items_.empty() ? 0 : rebuildDegradedNode(0, maxGrowth);
+	// Rebuilt subtrees reorder their items
+	if (rebuilt > 0) {
+		updateLeafBounds();
+	}
+	return rebuilt;
+}
+
+void Bvh::appendItems(int node, std::vector<int>& out) const {
+	// Every subtree's items are contiguous, so no need to walk it
+	int first = node, last = node;
+	while (nodes_[first].count == 0) {
+		first = nodes_[first].first;
+	}
+	while (nodes_[last].count == 0) {
+		last = nodes_[last].first + 1;
+	}
+	out.insert(out.end(), items_.begin() + nodes_[first].first, items_.begin() + nodes_[last].first + nodes_[last].count);
+}
+
+// Which of the planes in mask the box still straddles, or -1 when it is
+// outside one of them
+static int classifyBox(const float planes[6][4], int mask, const Cvec3f& boxMin, const Cvec3f& boxMax) {
+	for (int p = 0; p < 6; p++) {
+		if ((mask & (1 << p)) == 0) {
+			continue;
+		}
+		float farthest = planes[p][3], nearest = planes[p][3];
+		for (int j = 0; j < 3; j++) {
+			const bool positive = planes[p][j] >= 0;
+			farthest += planes[p][j] * (positive ? boxMax[j] : boxMin[j]);
+			nearest += planes[p][j] * (positive ? boxMin[j] : boxMax[j]);
+		}
+		if (farthest < 0) {
+			return -1;
+		}
+		if (nearest >= 0) {
+			mask &= ~(1 << p);
+		}
+	}
+	return mask;
+}
+
+void Bvh::cull(const Frustum& frustum, std::vector<int>& visible) const {
+	if (items_.empty()) {
+		return;
+	}
+	float planes[6][4];
+	frustum.toFloat(planes);
+	// Planes a node is wholly inside of are not tested again below it
+	std::vector<std::pair<int, int> > stack(1, std::make_pair(0, 63));
+	std::vector<unsigned char> leafVisible(BVH_MAX_LEAF_SIZE);
+	while (!stack.empty()) {
+		const Node& node = nodes_[stack.back().first];
+		const int mask = classifyBox(planes, stack.back().second, node.boxMin, node.boxMax);
+		const int index = stack.back().first;
+		stack.pop_back();
+		if (mask < 0) {
+			continue;
+		}
+		if (mask == 0) {
+			appendItems(index, visible);
+		}
+		else if (node.count > 0) {
+			leafVisible.resize(node.count);
+			leafBounds_.cullRange(planes, node.first, node.first + node.count, leafVisible.data());
+			for (int i = 0; i < node.count; i++) {
+				if (leafVisible[i]) {
+					visible.push_back(items_[node.first + i]);
+				}
+			}
+		}
+		else {
+			stack.push_back(std::make_pair(node.first, mask));
+			stack.push_back(std::make_pair(node.first + 1, mask));
+		}
+	}
+}
+
+// Where the ray enters the box within [0, maxT], or -1 if it misses
+static double rayEntersBox(const Cvec3& origin, const Cvec3& inverseDirection, double maxT, const Cvec3f& boxMin, const Cvec3f& boxMax) {
+	double enter = 0.0, exit = maxT;
+	for (int i = 0; i < 3; i++) {
+		if (std::isinf(inverseDirection[i])) {
+			// Parallel to this slab
+			if (origin[i] < boxMin[i] || origin[i] > boxMax[i]) {
+				return -1.0;
+			}
+			continue;
+		}
+		double a = (boxMin[i] - origin[i]) * inverseDirection[i], b = (boxMax[i] - origin[i]) * inverseDirection[i];
+		if (a > b) {
+			std::swap(a, b);
+		}
+		enter = std::max(enter, a);
+		exit = std::min(exit, b);
+		if (enter > exit) {
+			return -1.0;
+		}
+	}
+	return enter;
+}
+
+int Bvh::raycast(const Cvec3& origin, const Cvec3& direction, double maxT, double& t) const {
+	if (items_.empty()) {
+		return -1;
+	}
+	const Cvec3 inverseDirection(1.0 / direction[0], 1.0 / direction[1], 1.0 / direction[2]);
+	int hit = -1;
+	double best = maxT;
+	// Nodes with where the ray enters them; the nearer child is visited first
+	std::vector<std::pair<int, double> > stack;
+	const double rootEnter = rayEntersBox(origin, inverseDirection, best, nodes_[0].boxMin, nodes_[0].boxMax);
+	if (rootEnter >= 0) {
+		stack.push_back(std::make_pair(0, rootEnter));
+	}
+	while (!stack.empty()) {
+		const int index = stack.back().first;
+		const double enter = stack.back().second;
+		stack.pop_back();
+		if (enter > best) {
+			continue;
+		}
+		const Node& node = nodes_[index];
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				const int item = items_[i];
+				const double itemEnter = rayEntersBox(origin, inverseDirection, best, itemMin_[item], itemMax_[item]);
+				if (itemEnter >= 0 && (hit < 0 || itemEnter < best)) {
+					hit = item;
+					best = itemEnter;
+				}
+			}
+			continue;
+		}
+		const double left = rayEntersBox(origin, inverseDirection, best, nodes_[node.first].boxMin, nodes_[node.first].boxMax);
+		const double right = rayEntersBox(origin, inverseDirection, best, nodes_[node.first + 1].boxMin, nodes_[node.first + 1].boxMax);
+		const bool leftFirst = left >= 0 && (right < 0 || left <= right);
+		if (leftFirst) {
+			if (right >= 0) {
+				stack.push_back(std::make_pair(node.first + 1, right));
+			}
+			stack.push_back(std::make_pair(node.first, left));
+		}
+		else {
+			if (left >= 0) {
+				stack.push_back(std::make_pair(node.first, left));
+			}
+			if (right >= 0) {
+				stack.push_back(std::make_pair(node.first + 1, right));
+			}
+		}
+	}
+	t = best;
+	return hit;
+}
+
+void Bvh::queryRange(const Cvec3& center, double radius, std::vector<int>& out) const {
+	if (items_.empty()) {
+		return;
+	}
+	const double radius2 = radius * radius;
+	std::vector<int> stack(1, 0);
+	while (!stack.empty()) {
+		const Node& node = nodes_[stack.back()];
+		stack.pop_back();
+		if (distance2ToBox(center, node.boxMin, node.boxMax) > radius2) {
+			continue;
+		}
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				if (distance2ToBox(center, itemMin_[items_[i]], itemMax_[items_[i]]) <= radius2) {
+					out.push_back(items_[i]);
+				}
+			}
+		}
+		else {
+			stack.push_back(node.first);
+			stack.push_back(node.first + 1);
+		}
+	}
+}
+
+int Bvh::nearest(const Cvec3& point, double& distance) const {
+	if (items_.empty()) {
+		return -1;
+	}
+	// Closest node first; stops once no node left can hold anything closer
+	typedef std::pair<double, int> Candidate;
+	std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate> > open;
+	open.push(Candidate(distance2ToBox(point, nodes_[0].boxMin, nodes_[0].boxMax), 0));
+	int best = -1;
+	double best2 = DBL_MAX;
+	while (!open.empty() && open.top().first < best2) {
+		const Node& node = nodes_[open.top().second];
+		open.pop();
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				const double d2 = distance2ToBox(point, itemMin_[items_[i]], itemMax_[items_[i]]);
+				if (d2 < best2) {
+					best2 = d2;
+					best = items_[i];
+				}
+			}
+		}
+		else {
+			open.push(Candidate(distance2ToBox(point, nodes_[node.first].boxMin, nodes_[node.first].boxMax), node.first));
+			open.push(Candidate(distance2ToBox(point, nodes_[node.first + 1].boxMin, nodes_[node.first + 1].boxMax), node.first + 1));
+		}
+	}
+	distance = std::sqrt(best2);
+	return best;
+}
@@ -0,0 +1,93 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+
+#include "cvec.h"
+#include "culling.h"
+
+//--------------------------------------------------------------------------------
+// Bounding volume hierarchy over axis-aligned boxes, one per item (e.g. the
+// world box of each entity), for frustum culling, ray picking and proximity
+// queries without visiting every item.
+//
+// build() splits with a binned surface area heuristic. When items move,
+// setItemBounds() and refit() grow the existing boxes to fit without changing
+// the tree; rebuildDegraded() then rebuilds just the subtrees whose boxes have
+// grown too far past their size at build time. Adding or removing items
+// needs a new build().
+//--------------------------------------------------------------------------------
+
+class Bvh {
+	struct Node {
+		Cvec3f boxMin, boxMax;
+		int first; // leaf: first of its entries in items_; inner: left child, the right is first + 1
+		int count; // items in a leaf, 0 for an inner node
+	};
+
+	std::vector<Node> nodes_;       // root at 0, children in pairs from 1
+	std::vector<float> builtArea_;  // surface area of each node when it was built
+	std::vector<int> freePairs_;    // child pairs released by rebuildDegraded()
+	std::vector<int> items_;        // item ids, each leaf's and each subtree's contiguous
+	std::vector<Cvec3f> itemMin_, itemMax_;
+	std::vector<Cvec3f> itemCenter_;
+	std::vector<float> itemRadius_;
+	FrustumCuller leafBounds_;      // item bounds in the order of items_, for culling leaves
+
+	int allocatePair();
+	void buildTree();
+	void updateLeafBounds();
+	void setLeafBounds(int i) {
+		const int item = items_[i];
+		leafBounds_.set(i, itemCenter_[item], itemRadius_[item], itemMin_[item], itemMax_[item]);
+	}
+	void buildNode(int node, int first, int count);
+	void releaseChildren(int node, int& first, int& count);
+	void refitNode(int node);
+	int rebuildDegradedNode(int node, float maxGrowth);
+	void appendItems(int node, std::vector<int>& out) const;
+
+public:
+	// Items are numbered by their position in boxMin and boxMax; each gets
+	// the sphere around its box
+	void build(const std::vector<Cvec3f>& boxMin, const std::vector<Cvec3f>& boxMax);
+
+	// Builds over the world boxes and spheres of entities, which need a
+	// current updateWorld()
+	void build(const std::vector<Entity*>& entities);
+
+	int itemCount() const { return (int)itemMin_.size(); }
+	int nodeCount() const { return (int)nodes_.size() - 2 * (int)freePairs_.size(); }
+
+	// New bounds for one item, taken into the tree by the next refit(). The
+	// sphere is the one around the box unless given.
+	void setItemBounds(int item, const Cvec3f& boxMin, const Cvec3f& boxMax);
+	void setItemBounds(int item, const Cvec3f& center, float radius, const Cvec3f& boxMin, const Cvec3f& boxMax);
+	void setItemBounds(const std::vector<Entity*>& entities);
+
+	// Fits every node around its children again, keeping the tree as it is
+	void refit();
+
+	// Rebuilds each largest subtree whose surface area is more than maxGrowth
+	// times what it was at build, and returns how many were rebuilt. Call
+	// after refit().
+	int rebuildDegraded(float maxGrowth = 2.0f);
+
+	// Appends the items whose boxes are at least partly inside frustum. Leaves
+	// the frustum cuts through test their items with FrustumCuller, which
+	// also needs the bounding sphere inside.
+	void cull(const Frustum& frustum, std::vector<int>& visible) const;
+
+	// The item whose box origin + t direction hits first for 0 <= t <= maxT,
+	// or -1. t is set to where the ray enters that box.
+	int raycast(const Cvec3& origin, const Cvec3& direction, double maxT, double& t) const;
+
+	// Appends the items whose boxes come within radius of center
+	void queryRange(const Cvec3& center, double radius, std::vector<int>& out) const;
+
+	// The item whose box is closest to point, or -1 when there are none.
+	// distance is 0 for a point inside the box.
+	int nearest(const Cvec3& point, double& distance) const;
+};
+
+#endif
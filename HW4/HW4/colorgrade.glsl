@@ -0,0 +1,10 @@
+uniform float colorGradeSaturation;
+uniform float colorGradeContrast;
+uniform float colorGradeGamma;
+
+vec3 colorGrade(vec3 color) {
+	float luma = dot(color, vec3(0.2126, 0.7152, 0.0722));
+	color = mix(vec3(luma), color, colorGradeSaturation);
+	color = (color - 0.5) * colorGradeContrast + 0.5;
+	return pow(max(color, 0.0), vec3(1.0 / colorGradeGamma));
+}
@@ -0,0 +1,166 @@
+#include "culling.h"
+
+#include <cmath>
+
+Frustum Frustum::fromMatrix(const Matrix4& m) {
+	// Each plane is the bottom row plus or minus one of the others
+	Frustum frustum;
+	for (int i = 0; i < 6; i++) {
+		const int row = i / 2;
+		const double sign = i % 2 == 0 ? 1.0 : -1.0;
+		Cvec4 plane;
+		for (int j = 0; j < 4; j++) {
+			plane[j] = m(3, j) + sign * m(row, j);
+		}
+		frustum.planes[i] = plane / norm(Cvec3(plane[0], plane[1], plane[2]));
+	}
+	return frustum;
+}
+
+void Frustum::toFloat(float out[6][4]) const {
+	for (int i = 0; i < 6; i++) {
+		for (int j = 0; j < 4; j++) {
+			out[i][j] = float(planes[i][j]);
+		}
+	}
+}
+
+bool Frustum::intersectsSphere(const Cvec3& center, double radius) const {
+	for (int i = 0; i < 6; i++) {
+		const Cvec4& p = planes[i];
+		if (p[0] * center[0] + p[1] * center[1] + p[2] * center[2] + p[3] < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Frustum::intersectsBox(const Cvec3& boxMin, const Cvec3& boxMax) const {
+	// Only the corner farthest along the normal needs testing
+	for (int i = 0; i < 6; i++) {
+		const Cvec4& p = planes[i];
+		double d = p[3];
+		for (int j = 0; j < 3; j++) {
+			d += p[j] * (p[j] >= 0 ? boxMax[j] : boxMin[j]);
+		}
+		if (d < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void FrustumCuller::clear() {
+	centers_.clear();
+	boxMin_.clear();
+	boxMax_.clear();
+	radii_.clear();
+	visible_.clear();
+	visibleCount_ = 0;
+}
+
+int FrustumCuller::add(const Cvec3& center, double radius, const Cvec3& boxMin, const Cvec3& boxMax) {
+	return add(Cvec3f(float(center[0]), float(center[1]), float(center[2])), float(radius),
+		Cvec3f(float(boxMin[0]), float(boxMin[1]), float(boxMin[2])), Cvec3f(float(boxMax[0]), float(boxMax[1]), float(boxMax[2])));
+}
+
+int FrustumCuller::add(const Cvec3f& center, float radius, const Cvec3f& boxMin, const Cvec3f& boxMax) {
+	centers_.push_back(center);
+	boxMin_.push_back(boxMin);
+	boxMax_.push_back(boxMax);
+	radii_.push_back(radius);
+	visible_.push_back(1);
+	return size() - 1;
+}
+
+void FrustumCuller::resize(int size) {
+	centers_.resize(size);
+	boxMin_.resize(size);
+	boxMax_.resize(size);
+	radii_.resize(size);
+	visible_.resize(size, 1);
+}
+
+void FrustumCuller::set(int index, const Cvec3f& center, float radius, const Cvec3f& boxMin, const Cvec3f& boxMax) {
+	centers_.set(index, center);
+	boxMin_.set(index, boxMin);
+	boxMax_.set(index, boxMax);
+	radii_[index] = radius;
+}
+
+void FrustumCuller::setBounds(const std::vector<Entity*>& entities) {
+	clear();
+	for (int i = 0; i < entities.size(); i++) {
+		add(entities[i]->worldCenter, entities[i]->worldRadius, entities[i]->worldMin, entities[i]->worldMax);
+	}
+}
+
+int FrustumCuller::cull(const Frustum& frustum) {
+	float planes[6][4];
+	frustum.toFloat(planes);
+	test(planes, 0, size(), visible_.data(), true);
+	visibleCount_ = 0;
+	for (int i = 0; i < size(); i++) {
+		visibleCount_ += visible_[i];
+	}
+	return visibleCount_;
+}
+
+void FrustumCuller::test(const float planes[6][4], int begin, int end, unsigned char* visible, bool parallel) const {
+	const float *cx = centers_.component(0), *cy = centers_.component(1), *cz = centers_.component(2);
+	const float *minX = boxMin_.component(0), *minY = boxMin_.component(1), *minZ = boxMin_.component(2);
+	const float *maxX = boxMax_.component(0), *maxY = boxMax_.component(1), *maxZ = boxMax_.component(2);
+	const float* radii = radii_.data();
+	// The box corner to test against each plane: max where the normal is
+	// positive, min where it isn't
+	const float* cornerX[6], * cornerY[6], * cornerZ[6];
+	for (int i = 0; i < 6; i++) {
+		cornerX[i] = planes[i][0] >= 0 ? maxX : minX;
+		cornerY[i] = planes[i][1] >= 0 ? maxY : minY;
+		cornerZ[i] = planes[i][2] >= 0 ? maxZ : minZ;
+	}
+
+	const auto kernel = [&](int rangeBegin, int rangeEnd) {
+		int i = rangeBegin;
+#if CVEC_SIMD
+		__m128 nx[6], ny[6], nz[6], offset[6];
+		for (int p = 0; p < 6; p++) {
+			nx[p] = _mm_set1_ps(planes[p][0]);
+			ny[p] = _mm_set1_ps(planes[p][1]);
+			nz[p] = _mm_set1_ps(planes[p][2]);
+			offset[p] = _mm_set1_ps(planes[p][3]);
+		}
+		const __m128 signBit = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+		for (; i + 4 <= rangeEnd; i += 4) {
+			const __m128 x = _mm_loadu_ps(cx + i), y = _mm_loadu_ps(cy + i), z = _mm_loadu_ps(cz + i);
+			const __m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(radii + i), signBit);
+			__m128 inside = _mm_cmpeq_ps(x, x);
+			for (int p = 0; p < 6; p++) {
+				const __m128 sphere = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], x), _mm_mul_ps(ny[p], y)), _mm_add_ps(_mm_mul_ps(nz[p], z), offset[p]));
+				const __m128 box = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], _mm_loadu_ps(cornerX[p] + i)), _mm_mul_ps(ny[p], _mm_loadu_ps(cornerY[p] + i))),
+					_mm_add_ps(_mm_mul_ps(nz[p], _mm_loadu_ps(cornerZ[p] + i)), offset[p]));
+				inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(sphere, negativeRadius), _mm_cmpge_ps(box, zero)));
+			}
+			const int mask = _mm_movemask_ps(inside);
+			for (int k = 0; k < 4; k++) {
+				visible[i + k - begin] = (mask >> k) & 1;
+			}
+		}
+#endif
+		for (; i < rangeEnd; i++) {
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++) {
+				const float sphere = planes[p][0] * cx[i] + planes[p][1] * cy[i] + planes[p][2] * cz[i] + planes[p][3];
+				const float box = planes[p][0] * cornerX[p][i] + planes[p][1] * cornerY[p][i] + planes[p][2] * cornerZ[p][i] + planes[p][3];
+				inside = sphere >= -radii[i] && box >= 0;
+			}
+			visible[i - begin] = inside;
+		}
+	};
+	if (parallel) {
+		soaFor(end - begin, [&](int first, int last) { kernel(begin + first, begin + last); });
+	}
+	else {
+		kernel(begin, end);
+	}
+}
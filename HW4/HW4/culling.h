@@ -0,0 +1,78 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+
+#include "cvec.h"
+#include "cvecsoa.h"
+#include "matrix4.h"
+#include "scene.h"
+
+//--------------------------------------------------------------------------------
+// View frustum culling. A Frustum is the six planes of a projection times view
+// matrix; FrustumCuller keeps the world bounds of many entities as
+// structure-of-arrays and tests them against it, four at a time with SSE.
+// An entity is visible when both its bounding sphere and its box are at least
+// partly inside every plane.
+//--------------------------------------------------------------------------------
+
+struct Frustum {
+	// (normal, offset) with dot(normal, p) + offset >= 0 inside; unit normals,
+	// so the value is a distance. Left, right, bottom, top, near, far.
+	Cvec4 planes[6];
+
+	// From a world (or any space) to clip space matrix, with clip space the GL
+	// -w <= x, y, z <= w
+	static Frustum fromMatrix(const Matrix4& clipFromWorld);
+
+	// The planes in float, as FrustumCuller tests them
+	void toFloat(float planes[6][4]) const;
+
+	bool intersectsSphere(const Cvec3& center, double radius) const;
+	bool intersectsBox(const Cvec3& boxMin, const Cvec3& boxMax) const;
+};
+
+class FrustumCuller {
+	Cvec3fArray centers_, boxMin_, boxMax_;
+	std::vector<float> radii_;
+	std::vector<unsigned char> visible_;
+	int visibleCount_;
+
+	// The test behind cull(), setting visible[i - begin] for [begin, end)
+	void test(const float planes[6][4], int begin, int end, unsigned char* visible, bool parallel) const;
+
+public:
+	FrustumCuller() : visibleCount_(0) {}
+
+	void clear();
+
+	// Returns the index the bounds are tested under
+	int add(const Cvec3& center, double radius, const Cvec3& boxMin, const Cvec3& boxMax);
+	int add(const Cvec3f& center, float radius, const Cvec3f& boxMin, const Cvec3f& boxMax);
+
+	// Makes room for size bounds, to be given with set()
+	void resize(int size);
+	void set(int index, const Cvec3f& center, float radius, const Cvec3f& boxMin, const Cvec3f& boxMax);
+
+	// Replaces the bounds with the world bounds of entities, in order. Their
+	// updateWorld() must be current.
+	void setBounds(const std::vector<Entity*>& entities);
+
+	int size() const { return centers_.size(); }
+
+	// Tests every bounds against frustum and returns how many are visible
+	int cull(const Frustum& frustum);
+
+	// Tests only bounds [begin, end), setting visible[i - begin] for each
+	// rather than what isVisible() reports, e.g. for one leaf of a Bvh.
+	// planes are the frustum's, converted once by the caller.
+	void cullRange(const float planes[6][4], int begin, int end, unsigned char* visible) const {
+		test(planes, begin, end, visible, false);
+	}
+
+	// From the last cull()
+	bool isVisible(int index) const { return visible_[index] != 0; }
+	int visibleCount() const { return visibleCount_; }
+};
+
+#endif
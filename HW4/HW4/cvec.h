@@ -1,51 +1,178 @@
 #ifndef VEC_H
 #define VEC_H
 
+#include <algorithm>
 #include <cmath>
 #include <cassert>
 
+// SSE versions of dot and normalize for Cvec4f. Cvec3f keeps the scalar
+// code: loading 12 bytes into a register and back costs more than SSE saves
+// on dot, cross or normalize. The SSE dot has to know when it is being constant
+// evaluated, which gcc/clang 9 and VS 2019 16.5 can tell. Define CVEC_NO_SIMD
+// to use the plain loops everywhere.
+#if !defined(CVEC_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && \
+    ((defined(__GNUC__) && __GNUC__ >= 9) || (defined(__clang__) && __clang_major__ >= 9) || (defined(_MSC_VER) && _MSC_VER >= 1925))
+#define CVEC_SIMD 1
+#include <xmmintrin.h>
+#else
+#define CVEC_SIMD 0
+#endif
+
+
+static constexpr double CS175_PI = 3.14159265358979323846264338327950288;
+static constexpr double CS175_EPS = 1e-8;
+static constexpr double CS175_EPS2 = CS175_EPS * CS175_EPS;
+static constexpr double CS175_EPS3 = CS175_EPS * CS175_EPS * CS175_EPS;
+
+// std::abs only became constexpr in C++23
+template <typename T>
+constexpr T constexprAbs(const T x) {
+  return x < 0 ? -x : x;
+}
+
+// Everything below that doesn't need std::sqrt is constexpr, so constant
+// vectors, matrices and quaternions can be computed at compile time.
+
+
+template <typename T, int n> class Cvec;
+
+// Expression templates: +, -, unary - and scalar * and / on Cvecs build
+// lightweight expression objects instead of vectors, and the whole expression
+// is evaluated in one pass when it is assigned to (or used to construct) a
+// Cvec. So "side0 * deltaV1 - side1 * deltaV0" writes each component once
+// with no intermediate vectors. Expressions hold references to the Cvecs they
+// were built from; don't keep one around past the full expression.
+template <typename E, typename T, int n>
+class CvecExpr {
+public:
+  constexpr const E& self() const {
+    return static_cast<const E&>(*this);
+  }
+
+  constexpr T operator [] (const int i) const {
+    return self()[i];
+  }
 
-static const double CS175_PI = 3.14159265358979323846264338327950288;
-static const double CS175_EPS = 1e-8;
-static const double CS175_EPS2 = CS175_EPS * CS175_EPS;
-static const double CS175_EPS3 = CS175_EPS * CS175_EPS * CS175_EPS;
+  constexpr T operator () (const int i) const {
+    return self()[i];
+  }
+};
 
+// Cvecs are held by reference, nested expressions by value so a temporary
+// subexpression survives as long as the expression containing it
+template <typename E>
+struct CvecOperand {
+  typedef const E type;
+};
 
 template <typename T, int n>
-class Cvec {
-  T d_[n];
+struct CvecOperand<Cvec<T, n> > {
+  typedef const Cvec<T, n>& type;
+};
+
+// Keeps the scalar argument of * and / out of template argument deduction, so
+// e.g. Cvec3f * 0.5 converts the 0.5 as it always has
+template <typename T>
+struct CvecScalar {
+  typedef T type;
+};
+
+template <typename L, typename R, typename T, int n>
+class CvecSum : public CvecExpr<CvecSum<L, R, T, n>, T, n> {
+  typename CvecOperand<L>::type a_;
+  typename CvecOperand<R>::type b_;
+
+public:
+  constexpr CvecSum(const L& a, const R& b) : a_(a), b_(b) {}
+
+  constexpr T operator [] (const int i) const {
+    return a_[i] + b_[i];
+  }
+};
+
+template <typename L, typename R, typename T, int n>
+class CvecDifference : public CvecExpr<CvecDifference<L, R, T, n>, T, n> {
+  typename CvecOperand<L>::type a_;
+  typename CvecOperand<R>::type b_;
 
 public:
-  Cvec() {
+  constexpr CvecDifference(const L& a, const R& b) : a_(a), b_(b) {}
+
+  constexpr T operator [] (const int i) const {
+    return a_[i] - b_[i];
+  }
+};
+
+template <typename E, typename T, int n>
+class CvecScaled : public CvecExpr<CvecScaled<E, T, n>, T, n> {
+  typename CvecOperand<E>::type v_;
+  const T a_;
+
+public:
+  constexpr CvecScaled(const E& v, const T a) : v_(v), a_(a) {}
+
+  constexpr T operator [] (const int i) const {
+    return v_[i] * a_;
+  }
+};
+
+// Cvec4f sits on a 16-byte boundary so it loads as one SSE register. Cvec3f
+// stays 12 bytes: vertex layouts are built from it.
+template <typename T, int n>
+struct CvecAlignment {
+  static constexpr int value = alignof(T);
+};
+
+template <>
+struct CvecAlignment<float, 4> {
+  static constexpr int value = 16;
+};
+
+template <typename T, int n>
+class Cvec : public CvecExpr<Cvec<T, n>, T, n> {
+  alignas(CvecAlignment<T, n>::value) T d_[n];
+
+public:
+  constexpr Cvec() : d_() {
     for (int i = 0; i < n; ++i) {
       d_[i] = 0;
     }
   }
 
-  Cvec(const T& t) {
+  constexpr Cvec(const T& t) : d_() {
     for (int i = 0; i < n; ++i) {
       d_[i] = t;
     }
   }
 
-  Cvec(const T& t0, const T& t1) {
-    assert(n == 2); // better to use static_assert from c++11
+  constexpr Cvec(const T& t0, const T& t1) : d_() {
+    static_assert(n == 2, "Cvec(t0, t1) makes a 2-component vector");
     d_[0] = t0, d_[1] = t1;
   }
 
-  Cvec(const T& t0, const T& t1, const T& t2) {
-    assert(n == 3); // better to use static_assert from c++11
+  constexpr Cvec(const T& t0, const T& t1, const T& t2) : d_() {
+    static_assert(n == 3, "Cvec(t0, t1, t2) makes a 3-component vector");
     d_[0] = t0, d_[1] = t1, d_[2] = t2;
   }
 
-  Cvec(const T& t0, const T& t1, const T& t2, const T& t3) {
-    assert(n == 4); // better to use static_assert from c++11
+  constexpr Cvec(const T& t0, const T& t1, const T& t2, const T& t3) : d_() {
+    static_assert(n == 4, "Cvec(t0, t1, t2, t3) makes a 4-component vector");
     d_[0] = t0, d_[1] = t1, d_[2] = t2, d_[3] = t3;
   }
 
+  // Evaluates an expression built from Cvecs of this type
+  template <typename E>
+  constexpr Cvec(const CvecExpr<E, T, n>& e) : d_() {
+    const E& expr = e.self();
+    for (int i = 0; i < n; ++i) {
+      d_[i] = expr[i];
+    }
+  }
+
   // either truncate if m < n, or extend with extendValue
-  template<int m>
-  explicit Cvec(const Cvec<T, m>& v, const T& extendValue = T(0)) {
+  template<typename E, int m>
+  constexpr explicit Cvec(const CvecExpr<E, T, m>& e, const T& extendValue = T(0)) : d_() {
+    const E& v = e.self();
     for (int i = 0; i < std::min(m, n); ++i) {
       d_[i] = v[i];
     }
@@ -54,48 +181,59 @@ public:
     }
   }
 
-  T& operator [] (const int i) {
-    return d_[i];
+  // Components are only ever combined with the same component of another
+  // vector, so assigning an expression that reads this vector is safe
+  template <typename E>
+  constexpr Cvec& operator = (const CvecExpr<E, T, n>& e) {
+    const E& expr = e.self();
+    for (int i = 0; i < n; ++i) {
+      d_[i] = expr[i];
+    }
+    return *this;
   }
 
-  const T& operator [] (const int i) const {
+  constexpr T& operator [] (const int i) {
     return d_[i];
   }
 
-  T& operator () (const int i) {
+  constexpr const T& operator [] (const int i) const {
     return d_[i];
   }
 
-  const T& operator () (const int i) const {
+  constexpr T& operator () (const int i) {
     return d_[i];
   }
 
-  Cvec operator - () const {
-    return Cvec(*this) *= -1;
+  constexpr const T& operator () (const int i) const {
+    return d_[i];
   }
 
-  Cvec& operator += (const Cvec& v) {
+  template <typename E>
+  constexpr Cvec& operator += (const CvecExpr<E, T, n>& e) {
+    const E& v = e.self();
     for (int i = 0; i < n; ++i) {
       d_[i] += v[i];
     }
     return *this;
   }
 
-  Cvec& operator -= (const Cvec& v) {
+  template <typename E>
+  constexpr Cvec& operator -= (const CvecExpr<E, T, n>& e) {
+    const E& v = e.self();
     for (int i = 0; i < n; ++i) {
       d_[i] -= v[i];
     }
     return *this;
   }
 
-  Cvec& operator *= (const T a) {
+  constexpr Cvec& operator *= (const T a) {
     for (int i = 0; i < n; ++i) {
       d_[i] *= a;
     }
     return *this;
   }
 
-  Cvec& operator /= (const T a) {
+  constexpr Cvec& operator /= (const T a) {
     const T inva(1/a);
     for (int i = 0; i < n; ++i) {
       d_[i] *= inva;
@@ -103,61 +241,146 @@ public:
     return *this;
   }
 
-  Cvec operator + (const Cvec& v) const {
-    return Cvec(*this) += v;
-  }
-
-  Cvec operator - (const Cvec& v) const {
-    return Cvec(*this) -= v;
-  }
-
-  Cvec operator * (const T a) const {
-    return Cvec(*this) *= a;
-  }
-
-  Cvec operator / (const T a) const {
-    return Cvec(*this) /= a;
-  }
-
   // Normalize self and returns self
   Cvec& normalize() {
     assert(dot(*this, *this) > CS175_EPS2);
-    return *this /= std::sqrt(dot(*this, *this));
+    return *this *= invNorm(*this);
   }
 };
 
-template<typename T>
-inline Cvec<T,3> cross(const Cvec<T,3>& a, const Cvec<T,3>& b) {
-  return Cvec<T,3>(a(1)*b(2)-a(2)*b(1), a(2)*b(0)-a(0)*b(2), a(0)*b(1)-a(1)*b(0));
+template <typename L, typename R, typename T, int n>
+inline constexpr CvecSum<L, R, T, n> operator + (const CvecExpr<L, T, n>& a, const CvecExpr<R, T, n>& b) {
+  return CvecSum<L, R, T, n>(a.self(), b.self());
 }
 
-template<typename T, int n>
-inline T dot(const Cvec<T,n>& a, const Cvec<T,n>& b) {
+template <typename L, typename R, typename T, int n>
+inline constexpr CvecDifference<L, R, T, n> operator - (const CvecExpr<L, T, n>& a, const CvecExpr<R, T, n>& b) {
+  return CvecDifference<L, R, T, n>(a.self(), b.self());
+}
+
+template <typename E, typename T, int n>
+inline constexpr CvecScaled<E, T, n> operator - (const CvecExpr<E, T, n>& v) {
+  return CvecScaled<E, T, n>(v.self(), T(-1));
+}
+
+template <typename E, typename T, int n>
+inline constexpr CvecScaled<E, T, n> operator * (const CvecExpr<E, T, n>& v, const typename CvecScalar<T>::type a) {
+  return CvecScaled<E, T, n>(v.self(), a);
+}
+
+template <typename E, typename T, int n>
+inline constexpr CvecScaled<E, T, n> operator / (const CvecExpr<E, T, n>& v, const typename CvecScalar<T>::type a) {
+  return CvecScaled<E, T, n>(v.self(), T(1)/a);
+}
+
+template<typename A, typename B, typename T>
+inline constexpr Cvec<T,3> cross(const CvecExpr<A,T,3>& a, const CvecExpr<B,T,3>& b) {
+  const Cvec<T,3> u(a), v(b);
+  return Cvec<T,3>(u(1)*v(2)-u(2)*v(1), u(2)*v(0)-u(0)*v(2), u(0)*v(1)-u(1)*v(0));
+}
+
+template<typename A, typename B, typename T, int n>
+inline constexpr T dot(const CvecExpr<A,T,n>& a, const CvecExpr<B,T,n>& b) {
+  const A& u = a.self();
+  const B& v = b.self();
   T r(0);
   for (int i = 0; i < n; ++i) {
-    r += a(i)*b(i);
+    r += u[i]*v[i];
   }
   return r;
 }
 
-template<typename T, int n>
-inline T norm2(const Cvec<T, n>& v) {
+template<typename E, typename T, int n>
+inline constexpr T norm2(const CvecExpr<E, T, n>& v) {
   return dot(v, v);
 }
 
-template<typename T, int n>
-inline T norm(const Cvec<T, n>& v) {
+template<typename E, typename T, int n>
+inline T norm(const CvecExpr<E, T, n>& v) {
   return std::sqrt(dot(v, v));
 }
 
+// 1 / norm(v)
+template<typename T, int n>
+inline T invNorm(const Cvec<T, n>& v) {
+  return T(1) / std::sqrt(dot(v, v));
+}
+
 // Return a normalized vector without modifying the input (unlike the member
 // function version v.normalize() ).
+template<typename E, typename T, int n>
+inline Cvec<T, n> normalize(const CvecExpr<E, T, n>& v) {
+  Cvec<T, n> r(v);
+  return r.normalize();
+}
+
+// Catmull-Rom splines through a sequence of keys: the segment between v1 and
+// v2, with v0 and v3 the keys either side, is the Bezier curve with control
+// points v1, d = v1 + (v2-v0)/6, e = v2 - (v3-v1)/6 and v2. Same construction
+// as the quaternion versions in quat.h.
 template<typename T, int n>
-inline Cvec<T, n> normalize(const Cvec<T,n>& v) {
+inline constexpr void catmullRomControlPoints(const Cvec<T, n>& v0, const Cvec<T, n>& v1, const Cvec<T, n>& v2, const Cvec<T, n>& v3,
+                                              Cvec<T, n>& d, Cvec<T, n>& e) {
+  d = (v2 - v0) / 6 + v1;
+  e = -(v3 - v1) / 6 + v2;
+}
+
+template<typename T, int n>
+inline constexpr Cvec<T, n> interpolateBezier(const Cvec<T, n>& v1, const Cvec<T, n>& d, const Cvec<T, n>& e, const Cvec<T, n>& v2,
+                                              const typename CvecScalar<T>::type t) {
+  const T s = 1 - t;
+  return v1 * (s * s * s) + d * (3 * s * s * t) + e * (3 * s * t * t) + v2 * (t * t * t);
+}
+
+template<typename T, int n>
+inline constexpr Cvec<T, n> interpolateCatmullRom(const Cvec<T, n>& v0, const Cvec<T, n>& v1, const Cvec<T, n>& v2, const Cvec<T, n>& v3,
+                                                  const typename CvecScalar<T>::type t) {
+  Cvec<T, n> d, e;
+  catmullRomControlPoints(v0, v1, v2, v3, d, e);
+  return interpolateBezier(v1, d, e, v2, t);
+}
+
+#if CVEC_SIMD
+
+inline __m128 cvecLoad(const Cvec<float, 4>& v) {
+  return _mm_load_ps(&v[0]);
+}
+
+// Sum of the four lanes, in every lane
+inline __m128 cvecHorizontalSum(const __m128 x) {
+  const __m128 pairs = _mm_add_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_add_ps(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// rsqrtps is good to 12 bits; one Newton-Raphson step brings it to about 23,
+// i.e. within a couple of ulps of 1/sqrt
+inline __m128 cvecInvSqrt(const __m128 x) {
+  const __m128 y = _mm_rsqrt_ps(x);
+  const __m128 halfXyy = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), _mm_mul_ps(y, y));
+  return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), halfXyy));
+}
+
+inline constexpr float dot(const Cvec<float, 4>& a, const Cvec<float, 4>& b) {
+  if (__builtin_is_constant_evaluated()) {
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+  }
+  return _mm_cvtss_f32(cvecHorizontalSum(_mm_mul_ps(cvecLoad(a), cvecLoad(b))));
+}
+
+inline float invNorm(const Cvec<float, 4>& v) {
+  return _mm_cvtss_f32(cvecInvSqrt(_mm_set_ss(dot(v, v))));
+}
+
+inline Cvec<float, 4> normalize(const Cvec<float, 4>& v) {
   assert(dot(v, v) > CS175_EPS2);
-  return v / norm(v);
+  const __m128 x = cvecLoad(v);
+  Cvec<float, 4> r;
+  _mm_store_ps(&r[0], _mm_mul_ps(x, cvecInvSqrt(cvecHorizontalSum(_mm_mul_ps(x, x)))));
+  return r;
 }
 
+#endif
+
 // element of type double precision float
 typedef Cvec <double, 2> Cvec2;
 typedef Cvec <double, 3> Cvec3;
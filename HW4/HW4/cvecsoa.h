@@ -0,0 +1,329 @@
+#ifndef CVECSOA_H
+#define CVECSOA_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "cvec.h"
+#include "parallel.h"
+
+//--------------------------------------------------------------------------------
+// Structure-of-arrays storage for Cvecs: one contiguous stream per component,
+// so a pass over positions or normals reads only those floats rather than
+// every 56 byte vertex. The bulk kernels below run in vectorizable loops over
+// the streams and split large arrays across ThreadPool::shared().
+//
+// gather/scatter convert from and to an interleaved vertex array, e.g.
+//   Cvec3fArray normals;
+//   gather(vertices, &VertexPNTBTG::n, normals);
+//   normalizeAll(normals);
+//   scatter(normals, &VertexPNTBTG::n, vertices);
+//--------------------------------------------------------------------------------
+
+// Below this many elements a kernel stays on the calling thread
+static const int SOA_PARALLEL_GRAIN = 32768;
+
+template <typename T, int n>
+class CvecArray {
+	std::vector<T> c_[n];
+
+public:
+	CvecArray() {}
+	explicit CvecArray(int size) { resize(size); }
+
+	int size() const { return (int)c_[0].size(); }
+
+	void resize(int size) {
+		for (int i = 0; i < n; i++) {
+			c_[i].resize(size);
+		}
+	}
+
+	void clear() { resize(0); }
+
+	void push_back(const Cvec<T, n>& v) {
+		for (int i = 0; i < n; i++) {
+			c_[i].push_back(v[i]);
+		}
+	}
+
+	// Stream of component i, size() long
+	T* component(int i) { return c_[i].data(); }
+	const T* component(int i) const { return c_[i].data(); }
+
+	Cvec<T, n> get(int index) const {
+		Cvec<T, n> v;
+		for (int i = 0; i < n; i++) {
+			v[i] = c_[i][index];
+		}
+		return v;
+	}
+
+	void set(int index, const Cvec<T, n>& v) {
+		for (int i = 0; i < n; i++) {
+			c_[i][index] = v[i];
+		}
+	}
+};
+
+typedef CvecArray<float, 2> Cvec2fArray;
+typedef CvecArray<float, 3> Cvec3fArray;
+typedef CvecArray<float, 4> Cvec4fArray;
+
+// Runs kernel(begin, end) over [0, count), in parallel once count is large
+template <typename Kernel>
+inline void soaFor(int count, const Kernel& kernel) {
+	if (count < 2 * SOA_PARALLEL_GRAIN) {
+		kernel(0, count);
+	}
+	else {
+		ThreadPool::shared().parallelFor(count, SOA_PARALLEL_GRAIN, kernel);
+	}
+}
+
+// Interleaved <-> SoA ---------------------------------------------------------
+
+// Copies one Cvec member of every element of vertices into out
+template <typename Vertex, typename T, int n>
+void gather(const std::vector<Vertex>& vertices, Cvec<T, n> Vertex::*member, CvecArray<T, n>& out) {
+	out.resize((int)vertices.size());
+	T* o[n];
+	for (int i = 0; i < n; i++) {
+		o[i] = out.component(i);
+	}
+	const Vertex* v = vertices.data();
+	soaFor((int)vertices.size(), [=](int begin, int end) {
+		for (int j = begin; j < end; j++) {
+			const Cvec<T, n>& c = v[j].*member;
+			for (int i = 0; i < n; i++) {
+				o[i][j] = c[i];
+			}
+		}
+	});
+}
+
+// Writes in back into one member of each vertex; vertices must be as long
+template <typename Vertex, typename T, int n>
+void scatter(const CvecArray<T, n>& in, Cvec<T, n> Vertex::*member, std::vector<Vertex>& vertices) {
+	assert(vertices.size() == in.size());
+	const T* s[n];
+	for (int i = 0; i < n; i++) {
+		s[i] = in.component(i);
+	}
+	Vertex* v = vertices.data();
+	soaFor(in.size(), [=](int begin, int end) {
+		for (int j = begin; j < end; j++) {
+			Cvec<T, n>& c = v[j].*member;
+			for (int i = 0; i < n; i++) {
+				c[i] = s[i][j];
+			}
+		}
+	});
+}
+
+// Packs the array into n-wide vectors, e.g. for a tightly packed vertex stream
+template <typename T, int n>
+void scatter(const CvecArray<T, n>& in, std::vector<Cvec<T, n> >& out) {
+	out.resize(in.size());
+	const T* s[n];
+	for (int i = 0; i < n; i++) {
+		s[i] = in.component(i);
+	}
+	Cvec<T, n>* o = out.data();
+	soaFor(in.size(), [=](int begin, int end) {
+		for (int j = begin; j < end; j++) {
+			for (int i = 0; i < n; i++) {
+				o[j][i] = s[i][j];
+			}
+		}
+	});
+}
+
+// Unpacks n-wide vectors, e.g. positions generated on their own
+template <typename T, int n>
+void gather(const std::vector<Cvec<T, n> >& in, CvecArray<T, n>& out) {
+	out.resize((int)in.size());
+	T* o[n];
+	for (int i = 0; i < n; i++) {
+		o[i] = out.component(i);
+	}
+	const Cvec<T, n>* s = in.data();
+	soaFor((int)in.size(), [=](int begin, int end) {
+		for (int j = begin; j < end; j++) {
+			for (int i = 0; i < n; i++) {
+				o[i][j] = s[j][i];
+			}
+		}
+	});
+}
+
+// Kernels -------------------------------------------------------------------------
+
+inline void normalizeAll(Cvec3fArray& v) {
+	float* x = v.component(0);
+	float* y = v.component(1);
+	float* z = v.component(2);
+	soaFor(v.size(), [=](int begin, int end) {
+		int i = begin;
+#if CVEC_SIMD
+		for (; i + 4 <= end; i += 4) {
+			const __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+			const __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+			const __m128 s = cvecInvSqrt(len2);
+			_mm_storeu_ps(x + i, _mm_mul_ps(vx, s));
+			_mm_storeu_ps(y + i, _mm_mul_ps(vy, s));
+			_mm_storeu_ps(z + i, _mm_mul_ps(vz, s));
+		}
+#endif
+		for (; i < end; i++) {
+			const float s = 1.0f / std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+			x[i] *= s;
+			y[i] *= s;
+			z[i] *= s;
+		}
+	});
+}
+
+// out[i] = dot(a[i], b[i]); out must hold a.size() floats
+inline void dotAll(const Cvec3fArray& a, const Cvec3fArray& b, float* out) {
+	assert(a.size() == b.size());
+	const float *ax = a.component(0), *ay = a.component(1), *az = a.component(2);
+	const float *bx = b.component(0), *by = b.component(1), *bz = b.component(2);
+	soaFor(a.size(), [=](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			out[i] = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i];
+		}
+	});
+}
+
+// out[i] = cross(a[i], b[i]); out may be a or b
+inline void crossAll(const Cvec3fArray& a, const Cvec3fArray& b, Cvec3fArray& out) {
+	assert(a.size() == b.size());
+	out.resize(a.size());
+	const float *ax = a.component(0), *ay = a.component(1), *az = a.component(2);
+	const float *bx = b.component(0), *by = b.component(1), *bz = b.component(2);
+	float *ox = out.component(0), *oy = out.component(1), *oz = out.component(2);
+	soaFor(a.size(), [=](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			const float x = ay[i] * bz[i] - az[i] * by[i];
+			const float y = az[i] * bx[i] - ax[i] * bz[i];
+			const float z = ax[i] * by[i] - ay[i] * bx[i];
+			ox[i] = x;
+			oy[i] = y;
+			oz[i] = z;
+		}
+	});
+}
+
+// out[i] = a[i] + (b[i] - a[i]) * t; out may be a or b
+template <typename T, int n>
+void lerpAll(const CvecArray<T, n>& a, const CvecArray<T, n>& b, const T t, CvecArray<T, n>& out) {
+	assert(a.size() == b.size());
+	out.resize(a.size());
+	for (int c = 0; c < n; c++) {
+		const T* s = a.component(c);
+		const T* e = b.component(c);
+		T* o = out.component(c);
+		soaFor(a.size(), [=](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				o[i] = s[i] + (e[i] - s[i]) * t;
+			}
+		});
+	}
+}
+
+// Lowest and highest of s[begin, end), which must not be empty
+template <typename T>
+inline void rangeMinMax(const T* s, int begin, int end, T& low, T& high) {
+	T l = s[begin], h = s[begin];
+	for (int i = begin; i < end; i++) {
+		l = s[i] < l ? s[i] : l;
+		h = s[i] > h ? s[i] : h;
+	}
+	low = l;
+	high = h;
+}
+
+#if CVEC_SIMD
+// Compilers won't vectorize a float min/max reduction without -ffast-math
+inline void rangeMinMax(const float* s, int begin, int end, float& low, float& high) {
+	if (end - begin < 8) {
+		rangeMinMax<float>(s, begin, end, low, high);
+		return;
+	}
+	__m128 l = _mm_loadu_ps(s + begin), h = l;
+	int i = begin + 4;
+	for (; i + 4 <= end; i += 4) {
+		const __m128 x = _mm_loadu_ps(s + i);
+		l = _mm_min_ps(l, x);
+		h = _mm_max_ps(h, x);
+	}
+	// The last, partial group overlaps the one before it
+	const __m128 x = _mm_loadu_ps(s + end - 4);
+	l = _mm_min_ps(l, x);
+	h = _mm_max_ps(h, x);
+	l = _mm_min_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 3, 0, 1)));
+	l = _mm_min_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 0, 3, 2)));
+	h = _mm_max_ps(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(2, 3, 0, 1)));
+	h = _mm_max_ps(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(1, 0, 3, 2)));
+	low = _mm_cvtss_f32(l);
+	high = _mm_cvtss_f32(h);
+}
+#endif
+
+// Component-wise bounds of a non-empty array
+template <typename T, int n>
+void minMax(const CvecArray<T, n>& v, Cvec<T, n>& minCorner, Cvec<T, n>& maxCorner) {
+	assert(v.size() > 0);
+	for (int c = 0; c < n; c++) {
+		const T* s = v.component(c);
+		const int count = v.size();
+		const int chunks = std::max((count + SOA_PARALLEL_GRAIN - 1) / SOA_PARALLEL_GRAIN, 1);
+		std::vector<T> lows(chunks, s[0]), highs(chunks, s[0]);
+		T* lo = lows.data();
+		T* hi = highs.data();
+		soaFor(count, [=](int begin, int end) {
+			// Chunks start on multiples of the grain, see soaFor
+			rangeMinMax(s, begin, end, lo[begin / SOA_PARALLEL_GRAIN], hi[begin / SOA_PARALLEL_GRAIN]);
+		});
+		minCorner[c] = *std::min_element(lows.begin(), lows.end());
+		maxCorner[c] = *std::max_element(highs.begin(), highs.end());
+	}
+}
+
+// Largest squared distance from center to any element
+inline float maxDistance2(const Cvec3fArray& v, const Cvec3f& center) {
+	const float *x = v.component(0), *y = v.component(1), *z = v.component(2);
+	const float cx = center[0], cy = center[1], cz = center[2];
+	const int chunks = std::max((v.size() + SOA_PARALLEL_GRAIN - 1) / SOA_PARALLEL_GRAIN, 1);
+	std::vector<float> partial(chunks, 0.0f);
+	float* p = partial.data();
+	soaFor(v.size(), [=](int begin, int end) {
+		float m = 0.0f;
+		int i = begin;
+#if CVEC_SIMD
+		const __m128 vcx = _mm_set1_ps(cx), vcy = _mm_set1_ps(cy), vcz = _mm_set1_ps(cz);
+		__m128 vm = _mm_setzero_ps();
+		for (; i + 4 <= end; i += 4) {
+			const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), vcx);
+			const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), vcy);
+			const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i), vcz);
+			vm = _mm_max_ps(vm, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		}
+		vm = _mm_max_ps(vm, _mm_shuffle_ps(vm, vm, _MM_SHUFFLE(2, 3, 0, 1)));
+		vm = _mm_max_ps(vm, _mm_shuffle_ps(vm, vm, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_cvtss_f32(vm);
+#endif
+		for (; i < end; i++) {
+			const float dx = x[i] - cx, dy = y[i] - cy, dz = z[i] - cz;
+			const float d = dx * dx + dy * dy + dz * dz;
+			m = d > m ? d : m;
+		}
+		p[begin / SOA_PARALLEL_GRAIN] = m;
+	});
+	return *std::max_element(partial.begin(), partial.end());
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <algorithm>
+#include <cmath>
+
+// Picks a render scale that keeps the GPU frame time near a target. Fill cost
+// goes with the pixel count, i.e. with scale squared, so the scale is moved by
+// the square root of the time ratio. Frame times are smoothed, small errors are
+// ignored and the scale moves in fixed steps, so the resolution does not
+// oscillate from one frame to the next.
+class DynamicResolution {
+	double targetMs_;
+	float minScale_, maxScale_;
+	float scale_;
+	double smoothedMs_;
+	int framesSinceChange_;
+
+public:
+	bool enabled;
+
+	DynamicResolution(double targetMs = 16.0, float minScale = 0.5f, float maxScale = 1.0f)
+		: targetMs_(targetMs), minScale_(minScale), maxScale_(maxScale), scale_(maxScale), smoothedMs_(0.0), framesSinceChange_(0), enabled(false) {}
+
+	void setTargetMs(double targetMs) { targetMs_ = targetMs; }
+	double targetMs() const { return targetMs_; }
+	double smoothedMs() const { return smoothedMs_; }
+
+	// Feed the measured GPU time of the last frame; returns the scale to use
+	float update(double gpuFrameMs) {
+		if (!enabled) {
+			scale_ = maxScale_;
+			smoothedMs_ = gpuFrameMs;
+			return scale_;
+		}
+		if (gpuFrameMs <= 0.0) {
+			return scale_;
+		}
+
+		smoothedMs_ = smoothedMs_ <= 0.0 ? gpuFrameMs : smoothedMs_ * 0.9 + gpuFrameMs * 0.1;
+		framesSinceChange_++;
+
+		// Timings lag a couple of frames behind, give a change time to show up
+		const double ratio = targetMs_ / smoothedMs_;
+		if (framesSinceChange_ < 8 || (ratio > 0.95 && ratio < 1.1)) {
+			return scale_;
+		}
+
+		const float step = 1.0f / 32.0f;
+		float wanted = scale_ * (float)std::sqrt(ratio);
+		wanted = std::floor(wanted / step + 0.5f) * step;
+		// Drop quickly when over budget, climb back slowly
+		wanted = std::max(wanted, scale_ - 4 * step);
+		wanted = std::min(wanted, scale_ + step);
+		wanted = std::min(std::max(wanted, minScale_), maxScale_);
+
+		if (wanted != scale_) {
+			scale_ = wanted;
+			framesSinceChange_ = 0;
+		}
+		return scale_;
+	}
+
+	float scale() const { return scale_; }
+};
+
+#endif
@@ -1,3 +1,5 @@
+#version 140
+
 varying vec2 varyingTexCoord;
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
@@ -8,16 +10,60 @@ varying mat3 varyingTBNMatrix;
 
 struct Light {
 	vec3 lightPosition;
+	float shadowFarPlane; // 0 when the light casts no shadow
 	vec3 lightColor;
 	vec3 specularLightColor;
 };
 
-uniform Light lights[3];
+// Set once a frame, see uniforms.h
+layout(std140) uniform FrameUniforms {
+	mat4 projectionMatrix;
+	mat4 eyeToWorldMatrix;
+	mat4 cascadeMatrices[4];
+	Light lights[3];
+	vec4 cascadeSplits;
+	vec3 sunDirection; // eye space, pointing towards the light
+	vec3 sunColor;
+	int cascadeCount; // directional light with cascaded shadows off when 0
+};
+
+// Set for every draw
+layout(std140) uniform ObjectUniforms {
+	mat4 modelViewMatrix;
+	mat4 normalMatrix;
+};
+
+uniform samplerCube shadowMap0;
+uniform samplerCube shadowMap1;
+uniform samplerCube shadowMap2;
+uniform sampler2D cascadeShadowMap;
 
 float attenuate(float dist, float a, float b) {
 	return 1.0 / (1.0 + a * dist + b * dist * dist);
 }
 
+// Point light shadow maps store distance to the light over the far plane
+float pointShadow(samplerCube shadowMap, Light light) {
+	if (light.shadowFarPlane <= 0.0) {
+		return 1.0;
+	}
+	vec3 fromLight = varyingPosition - light.lightPosition;
+	vec3 direction = (eyeToWorldMatrix * vec4(fromLight, 0.0)).xyz;
+	float current = length(fromLight) / light.shadowFarPlane;
+	return current - 0.005 > textureCube(shadowMap, direction).r ? 0.0 : 1.0;
+}
+
+float cascadeShadow() {
+	float depth = -varyingPosition.z;
+	for (int i = 0; i < 4; i++) {
+		if (i < cascadeCount && depth < cascadeSplits[i]) {
+			vec4 p = cascadeMatrices[i] * vec4(varyingPosition, 1.0);
+			return p.z - 0.002 > texture2D(cascadeShadowMap, p.xy).r ? 0.0 : 1.0;
+		}
+	}
+	return 1.0;
+}
+
 void main() {
 	vec3 diffuseColor = vec3(0.0, 0.0, 0.0);
 	vec3 specularColor = vec3(0.0, 0.0, 0.0);
@@ -25,10 +71,15 @@ void main() {
 	vec3 textureNormal = normalize((texture2D(normalTexture, varyingTexCoord).xyz * 2.0) - 1.0);
 	textureNormal = normalize(varyingTBNMatrix * textureNormal);
 
+	float shadows[3];
+	shadows[0] = pointShadow(shadowMap0, lights[0]);
+	shadows[1] = pointShadow(shadowMap1, lights[1]);
+	shadows[2] = pointShadow(shadowMap2, lights[2]);
+
 	for(int i = 0; i < 3; i++) {
 		vec3 lightDirection = -normalize(varyingPosition - lights[i].lightPosition);
 		float diffuse = max(0.0, dot(textureNormal, lightDirection));
-		float attenuation = attenuate(distance(varyingPosition, lights[i].lightPosition) / 5.0, 1.0, 0.5);
+		float attenuation = attenuate(distance(varyingPosition, lights[i].lightPosition) / 5.0, 1.0, 0.5) * shadows[i];
 		diffuseColor += (lights[i].lightColor * diffuse) * attenuation;
 
 		vec3 v = normalize(-varyingPosition);
@@ -37,6 +88,15 @@ void main() {
 		specularColor += lights[i].specularLightColor * specular * attenuation;
 	}
 
+	if (cascadeCount > 0) {
+		float sunShadow = cascadeShadow();
+		float diffuse = max(0.0, dot(textureNormal, sunDirection));
+		diffuseColor += sunColor * diffuse * sunShadow;
+
+		vec3 h = normalize(normalize(-varyingPosition) + sunDirection);
+		specularColor += sunColor * pow(max(0.0, dot(h, textureNormal)), 64.0) * sunShadow;
+	}
+
 	vec3 intensity = (texture2D(diffuseTexture, varyingTexCoord).xyz * diffuseColor) + (specularColor * texture2D(specularTexture, varyingTexCoord).x);
     gl_FragColor = vec4(intensity.xyz, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "framebuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+void SceneFramebuffer::init(int w, int h) {
+	glGenFramebuffers(1, &frameBuffer);
+	glGenTextures(1, &colorTexture);
+	glGenTextures(1, &depthTexture);
+
+	// Linear filtering so the screen pass can upscale a reduced render size
+	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	resize(w, h);
+}
+
+void SceneFramebuffer::resize(int w, int h) {
+	width = std::max(w, 1);
+	height = std::max(h, 1);
+
+	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		throw std::runtime_error("scene framebuffer is incomplete");
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	allocateMultisampleStorage();
+	setRenderScale(renderScale);
+}
+
+int SceneFramebuffer::setSamples(int count) {
+	GLint maxSamples = 1;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	count = std::min(std::max(count, 1), (int)maxSamples);
+	if (count != samples) {
+		samples = count;
+		allocateMultisampleStorage();
+	}
+	return samples;
+}
+
+void SceneFramebuffer::allocateMultisampleStorage() {
+	if (samples <= 1) {
+		if (multisampleFrameBuffer != 0) {
+			glDeleteFramebuffers(1, &multisampleFrameBuffer);
+			glDeleteRenderbuffers(1, &multisampleColorBuffer);
+			glDeleteRenderbuffers(1, &multisampleDepthBuffer);
+			multisampleFrameBuffer = multisampleColorBuffer = multisampleDepthBuffer = 0;
+		}
+		return;
+	}
+
+	if (multisampleFrameBuffer == 0) {
+		glGenFramebuffers(1, &multisampleFrameBuffer);
+		glGenRenderbuffers(1, &multisampleColorBuffer);
+		glGenRenderbuffers(1, &multisampleDepthBuffer);
+	}
+
+	// Formats match the resolve textures, which glBlitFramebuffer requires for depth
+	glBindRenderbuffer(GL_RENDERBUFFER, multisampleColorBuffer);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA16F, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, multisampleDepthBuffer);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, multisampleFrameBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, multisampleColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, multisampleDepthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		throw std::runtime_error("multisampled scene framebuffer is incomplete");
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SceneFramebuffer::setRenderScale(float scale) {
+	renderScale = std::min(std::max(scale, 0.01f), 1.0f);
+	renderWidth = std::max((int)std::floor(width * renderScale + 0.5f), 1);
+	renderHeight = std::max((int)std::floor(height * renderScale + 0.5f), 1);
+}
+
+void SceneFramebuffer::bind() const {
+	glBindFramebuffer(GL_FRAMEBUFFER, samples > 1 ? multisampleFrameBuffer : frameBuffer);
+	glViewport(0, 0, renderWidth, renderHeight);
+}
+
+void SceneFramebuffer::resolve() const {
+	if (samples <= 1) {
+		return;
+	}
+	// Depth is resolved too so later passes can read depthTexture either way
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, multisampleFrameBuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameBuffer);
+	glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, renderWidth, renderHeight, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
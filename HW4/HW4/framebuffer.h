@@ -0,0 +1,54 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "glsupport.h"
+
+// The offscreen target the scene is drawn into: an RGBA16F color texture and a
+// depth texture. Storage follows the window size; the scene is rendered into
+// the lower-left renderWidth x renderHeight corner, so changing the render
+// scale every frame never reallocates anything.
+//
+// With more than one sample the scene is drawn into multisampled renderbuffers
+// instead, and resolve() blits them down into colorTexture/depthTexture.
+struct SceneFramebuffer {
+	GLuint frameBuffer;
+	GLuint colorTexture;
+	GLuint depthTexture;
+	int width, height;
+	int renderWidth, renderHeight;
+	float renderScale;
+
+	int samples;
+	GLuint multisampleFrameBuffer;
+	GLuint multisampleColorBuffer;
+	GLuint multisampleDepthBuffer;
+
+	SceneFramebuffer() : frameBuffer(0), colorTexture(0), depthTexture(0), width(0), height(0), renderWidth(0), renderHeight(0), renderScale(1.0f),
+		samples(1), multisampleFrameBuffer(0), multisampleColorBuffer(0), multisampleDepthBuffer(0) {}
+
+	// Needs a current GL context
+	void init(int w, int h);
+
+	// Reallocates storage for a new window size, keeping the GL handles
+	void resize(int w, int h);
+
+	// Fraction of the storage size actually rendered, clamped to (0, 1]
+	void setRenderScale(float scale);
+
+	// Sample count for the scene pass; 1 turns multisampling off. Clamped to
+	// GL_MAX_SAMPLES. Returns the count actually used.
+	int setSamples(int count);
+
+	// Binds the framebuffer to draw the scene into, with the viewport set to
+	// the render size
+	void bind() const;
+
+	// Makes colorTexture/depthTexture hold the rendered scene. A no-op unless
+	// multisampling is on.
+	void resolve() const;
+
+private:
+	void allocateMultisampleStorage();
+};
+
+#endif
@@ -0,0 +1,43 @@
+#define FXAA_REDUCE_MIN (1.0 / 128.0)
+#define FXAA_REDUCE_MUL (1.0 / 8.0)
+#define FXAA_SPAN_MAX 8.0
+
+// Lottes' FXAA, low quality preset: blur along the local edge direction found
+// from the luma of the four diagonal neighbours
+vec4 fxaa(vec2 uv) {
+	vec3 rgbNW = screenTap(uv + vec2(-1.0, -1.0) * texelSize).rgb;
+	vec3 rgbNE = screenTap(uv + vec2(1.0, -1.0) * texelSize).rgb;
+	vec3 rgbSW = screenTap(uv + vec2(-1.0, 1.0) * texelSize).rgb;
+	vec3 rgbSE = screenTap(uv + vec2(1.0, 1.0) * texelSize).rgb;
+	vec4 colorM = screenTap(uv);
+
+	vec3 luma = vec3(0.299, 0.587, 0.114);
+	float lumaNW = dot(rgbNW, luma);
+	float lumaNE = dot(rgbNE, luma);
+	float lumaSW = dot(rgbSW, luma);
+	float lumaSE = dot(rgbSE, luma);
+	float lumaM = dot(colorM.rgb, luma);
+	float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+	float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+	vec2 dir;
+	dir.x = -((lumaNW + lumaNE) - (lumaSW + lumaSE));
+	dir.y = ((lumaNW + lumaSW) - (lumaNE + lumaSE));
+
+	float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * (0.25 * FXAA_REDUCE_MUL), FXAA_REDUCE_MIN);
+	float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);
+	dir = clamp(dir * rcpDirMin, vec2(-FXAA_SPAN_MAX), vec2(FXAA_SPAN_MAX)) * texelSize;
+
+	vec3 rgbA = 0.5 * (
+		screenTap(uv + dir * (1.0 / 3.0 - 0.5)).rgb +
+		screenTap(uv + dir * (2.0 / 3.0 - 0.5)).rgb);
+	vec3 rgbB = rgbA * 0.5 + 0.25 * (
+		screenTap(uv + dir * -0.5).rgb +
+		screenTap(uv + dir * 0.5).rgb);
+
+	float lumaB = dot(rgbB, luma);
+	if (lumaB < lumaMin || lumaB > lumaMax) {
+		return vec4(rgbA, colorM.a);
+	}
+	return vec4(rgbB, colorM.a);
+}
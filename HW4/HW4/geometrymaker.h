@@ -2,8 +2,12 @@
 #define GEOMETRYMAKER_H
 
 #include <cmath>
+#include <iterator>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 #include "cvec.h"
+#include "parallel.h"
 
 
 using namespace std;
@@ -20,7 +24,7 @@ struct GenericVertex {
   Cvec2f tex;
   Cvec3f tangent, binormal;
 
-  GenericVertex(
+  constexpr GenericVertex(
     float x, float y, float z,
     float nx, float ny, float nz,
     float tu, float tv,
@@ -30,18 +34,59 @@ struct GenericVertex {
   {}
 };
 
-inline void getPlaneVbIbLen(int& vbLen, int& ibLen) {
+// How the make* functions store a vertex into a layout. The default goes
+// through a GenericVertex and the layout's operator = (const GenericVertex&);
+// specialize it to write the layout's own fields directly, e.g.
+//   template<> struct VertexWriter<VertexPN> {
+//     static constexpr void write(VertexPN& v, const Cvec3f& pos, const Cvec3f& normal,
+//       const Cvec2f&, const Cvec3f&, const Cvec3f&) { v.p = pos; v.n = normal; }
+//   };
+template<typename Vertex>
+struct VertexWriter {
+  static constexpr void write(Vertex& v, const Cvec3f& pos, const Cvec3f& normal, const Cvec2f& tex,
+                              const Cvec3f& tangent, const Cvec3f& binormal) {
+    v = GenericVertex(pos[0], pos[1], pos[2], normal[0], normal[1], normal[2], tex[0], tex[1],
+                      tangent[0], tangent[1], tangent[2], binormal[0], binormal[1], binormal[2]);
+  }
+};
+
+// Positions alone, e.g. for bounds or a depth-only stream
+template<>
+struct VertexWriter<Cvec3f> {
+  static constexpr void write(Cvec3f& v, const Cvec3f& pos, const Cvec3f&, const Cvec2f&,
+                              const Cvec3f&, const Cvec3f&) {
+    v = pos;
+  }
+};
+
+// Writes one vertex at vtxIter in the layout it points to. Output iterators
+// without a value type (e.g. back_inserter) get a GenericVertex.
+template<typename VtxOutIter>
+constexpr void writeVertex(VtxOutIter& vtxIter, const Cvec3f& pos, const Cvec3f& normal, const Cvec2f& tex,
+                           const Cvec3f& tangent, const Cvec3f& binormal) {
+  typedef typename std::iterator_traits<VtxOutIter>::value_type Vertex;
+  if constexpr (std::is_void<Vertex>::value) {
+    *vtxIter = GenericVertex(pos[0], pos[1], pos[2], normal[0], normal[1], normal[2], tex[0], tex[1],
+                             tangent[0], tangent[1], tangent[2], binormal[0], binormal[1], binormal[2]);
+  }
+  else {
+    VertexWriter<Vertex>::write(*vtxIter, pos, normal, tex, tangent, binormal);
+  }
+}
+
+inline constexpr void getPlaneVbIbLen(int& vbLen, int& ibLen) {
   vbLen = 4;
   ibLen = 6;
 }
 
 template<typename VtxOutIter, typename IdxOutIter>
-void makePlane(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
+constexpr void makePlane(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
   float h = size / 2.0;
-  *vtxIter = GenericVertex(    -h, 0, -h, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, -1);
-  *(++vtxIter) = GenericVertex(-h, 0,  h, 0, 1, 0, 0, 1, 1, 0, 0, 0, 0, -1);
-  *(++vtxIter) = GenericVertex( h, 0,  h, 0, 1, 0, 1, 1, 1, 0, 0, 0, 0, -1);
-  *(++vtxIter) = GenericVertex( h, 0, -h, 0, 1, 0, 1, 0, 1, 0, 0, 0, 0, -1);
+  const Cvec3f n(0, 1, 0), t(1, 0, 0), b(0, 0, -1);
+  writeVertex(vtxIter, Cvec3f(-h, 0, -h), n, Cvec2f(0, 0), t, b);
+  writeVertex(++vtxIter, Cvec3f(-h, 0,  h), n, Cvec2f(0, 1), t, b);
+  writeVertex(++vtxIter, Cvec3f( h, 0,  h), n, Cvec2f(1, 1), t, b);
+  writeVertex(++vtxIter, Cvec3f( h, 0, -h), n, Cvec2f(1, 0), t, b);
   *idxIter = 0;
   *(++idxIter) = 1;
   *(++idxIter) = 2;
@@ -50,19 +95,16 @@ void makePlane(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
   *(++idxIter) = 3;
 }
 
-inline void getCubeVbIbLen(int& vbLen, int& ibLen) {
+inline constexpr void getCubeVbIbLen(int& vbLen, int& ibLen) {
   vbLen = 24;
   ibLen = 36;
 }
 
 template<typename VtxOutIter, typename IdxOutIter>
-void makeCube(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
+constexpr void makeCube(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
   float h = size / 2.0;
 #define DEFV(x, y, z, nx, ny, nz, tu, tv) { \
-    *vtxIter = GenericVertex(x h, y h, z h, \
-                             nx, ny, nz, tu, tv, \
-                             tan[0], tan[1], tan[2], \
-                             bin[0], bin[1], bin[2]); \
+    writeVertex(vtxIter, Cvec3f(x h, y h, z h), Cvec3f(nx, ny, nz), Cvec2f(tu, tv), tan, bin); \
     ++vtxIter; \
 }
   Cvec3f tan(0, 1, 0), bin(0, 0, 1);
@@ -118,6 +160,29 @@ void makeCube(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
   }
 }
 
+// Fixed-size vertex and index tables, so the plane and cube can be generated
+// at compile time, e.g.
+//   static constexpr BakedGeometry<VertexPNTBTG, 24, 36> cube = bakeCube<VertexPNTBTG>(1.0f);
+template<typename Vertex, int vbLen, int ibLen>
+struct BakedGeometry {
+  Vertex vertices[vbLen];
+  unsigned short indices[ibLen];
+};
+
+template<typename Vertex>
+constexpr BakedGeometry<Vertex, 4, 6> bakePlane(float size) {
+  BakedGeometry<Vertex, 4, 6> g{};
+  makePlane(size, g.vertices, g.indices);
+  return g;
+}
+
+template<typename Vertex>
+constexpr BakedGeometry<Vertex, 24, 36> bakeCube(float size) {
+  BakedGeometry<Vertex, 24, 36> g{};
+  makeCube(size, g.vertices, g.indices);
+  return g;
+}
+
 inline void getSphereVbIbLen(int slices, int stacks, int& vbLen, int& ibLen) {
   assert(slices > 1);
   assert(stacks >= 2);
@@ -125,43 +190,38 @@ inline void getSphereVbIbLen(int slices, int stacks, int& vbLen, int& ibLen) {
   ibLen = slices * stacks * 6;
 }
 
+// Slices firstSlice to lastSlice - 1 of the slices + 1 columns of vertices
+// makeSphere() writes, with vtxIter and idxIter at where those start, i.e.
+// (stacks + 1) * firstSlice vertices and 6 * stacks * firstSlice indices in.
+// Ranges that don't overlap can be written at the same time.
 template<typename VtxOutIter, typename IdxOutIter>
-void makeSphere(float radius, int slices, int stacks, VtxOutIter vtxIter, IdxOutIter idxIter) {
+void makeSphereSlices(float radius, int slices, int stacks, int firstSlice, int lastSlice, VtxOutIter vtxIter, IdxOutIter idxIter) {
   using namespace std;
   assert(slices > 1);
   assert(stacks >= 2);
+  assert(0 <= firstSlice && firstSlice <= lastSlice && lastSlice <= slices + 1);
 
   const double radPerSlice = 2 * CS175_PI / slices;
   const double radPerStack = CS175_PI / stacks;
 
-    vector<double> longSin(slices+1), longCos(slices+1);
   vector<double> latSin(stacks+1), latCos(stacks+1);
-    
-  for (int i = 0; i < slices + 1; ++i) {
-    longSin[i] = sin(radPerSlice * i);
-    longCos[i] = cos(radPerSlice * i);
-  }
   for (int i = 0; i < stacks + 1; ++i) {
     latSin[i] = sin(radPerStack * i);
     latCos[i] = cos(radPerStack * i);
   }
 
-  for (int i = 0; i < slices + 1; ++i) {
+  for (int i = firstSlice; i < lastSlice; ++i) {
+    const double longSin = sin(radPerSlice * i), longCos = cos(radPerSlice * i);
     for (int j = 0; j < stacks + 1; ++j) {
-      float x = longCos[i] * latSin[j];
-      float y = longSin[i] * latSin[j];
+      float x = longCos * latSin[j];
+      float y = longSin * latSin[j];
       float z = latCos[j];
 
       Cvec3f n(x, y, z);
-      Cvec3f t(-longSin[i], longCos[i], 0);
+      Cvec3f t(-longSin, longCos, 0);
       Cvec3f b = cross(n, t);
 
-      *vtxIter = GenericVertex(
-        x * radius, y * radius, z * radius,
-        x, y, z,
-        1.0/slices*i, 1.0/stacks*j,
-        t[0], t[1], t[2],
-        b[0], b[1], b[2]);
+      writeVertex(vtxIter, n * radius, n, Cvec2f(1.0/slices*i, 1.0/stacks*j), t, b);
       ++vtxIter;
 
       if (i < slices && j < stacks ) {
@@ -178,5 +238,269 @@ void makeSphere(float radius, int slices, int stacks, VtxOutIter vtxIter, IdxOut
   }
 }
 
+template<typename VtxOutIter, typename IdxOutIter>
+void makeSphere(float radius, int slices, int stacks, VtxOutIter vtxIter, IdxOutIter idxIter) {
+  makeSphereSlices(radius, slices, stacks, 0, slices + 1, vtxIter, idxIter);
+}
+
+// A flat size x size square in the XZ plane facing +Y, like makePlane but
+// cut into cellsX x cellsZ squares, texture coordinates going 0 to 1 across
+inline void getGridVbIbLen(int cellsX, int cellsZ, int& vbLen, int& ibLen) {
+  assert(cellsX >= 1);
+  assert(cellsZ >= 1);
+  vbLen = (cellsX + 1) * (cellsZ + 1);
+  ibLen = cellsX * cellsZ * 6;
+}
+
+// Rows firstRow to lastRow - 1 of the cellsZ + 1 rows of vertices makeGrid()
+// writes, with vtxIter and idxIter at where those start, i.e.
+// (cellsX + 1) * firstRow vertices and 6 * cellsX * firstRow indices in
+template<typename VtxOutIter, typename IdxOutIter>
+constexpr void makeGridRows(float size, int cellsX, int cellsZ, int firstRow, int lastRow, VtxOutIter vtxIter, IdxOutIter idxIter) {
+  assert(0 <= firstRow && firstRow <= lastRow && lastRow <= cellsZ + 1);
+  const float h = size / 2.0;
+  const Cvec3f n(0, 1, 0), t(1, 0, 0), b(0, 0, -1);
+  for (int z = firstRow; z < lastRow; ++z) {
+    const float v = float(z) / cellsZ;
+    for (int x = 0; x < cellsX + 1; ++x) {
+      const float u = float(x) / cellsX;
+      writeVertex(vtxIter, Cvec3f(-h + size * u, 0, -h + size * v), n, Cvec2f(u, v), t, b);
+      ++vtxIter;
+
+      if (x < cellsX && z < cellsZ) {
+        *idxIter = (cellsX+1) * z + x;
+        *++idxIter = (cellsX+1) * (z + 1) + x;
+        *++idxIter = (cellsX+1) * (z + 1) + x + 1;
+
+        *++idxIter = (cellsX+1) * z + x;
+        *++idxIter = (cellsX+1) * (z + 1) + x + 1;
+        *++idxIter = (cellsX+1) * z + x + 1;
+        ++idxIter;
+      }
+    }
+  }
+}
+
+template<typename VtxOutIter, typename IdxOutIter>
+constexpr void makeGrid(float size, int cellsX, int cellsZ, VtxOutIter vtxIter, IdxOutIter idxIter) {
+  makeGridRows(size, cellsX, cellsZ, 0, cellsZ + 1, vtxIter, idxIter);
+}
+
+// About this many vertices per task when generating in parallel
+static const int GEOMETRY_PARALLEL_GRAIN = 4096;
+
+// makeSphere() and makeGrid() split across pool, writing straight into
+// vertices and indices, e.g. mapped buffer memory. Every task writes only
+// its own part and never reads any of it back.
+template<typename Vertex, typename Index>
+void makeSphereParallel(float radius, int slices, int stacks, Vertex* vertices, Index* indices,
+                        ThreadPool& pool = ThreadPool::shared()) {
+  pool.parallelFor(slices + 1, std::max(GEOMETRY_PARALLEL_GRAIN / (stacks + 1), 1), [=](int begin, int end) {
+    makeSphereSlices(radius, slices, stacks, begin, end, vertices + (stacks + 1) * begin, indices + 6 * stacks * begin);
+  });
+}
+
+template<typename Vertex, typename Index>
+void makeGridParallel(float size, int cellsX, int cellsZ, Vertex* vertices, Index* indices,
+                      ThreadPool& pool = ThreadPool::shared()) {
+  pool.parallelFor(cellsZ + 1, std::max(GEOMETRY_PARALLEL_GRAIN / (cellsX + 1), 1), [=](int begin, int end) {
+    makeGridRows(size, cellsX, cellsZ, begin, end, vertices + (cellsX + 1) * begin, indices + 6 * cellsX * begin);
+  });
+}
+
+
+
+// Spheres with better spread triangles than makeSphere(), which crowds them
+// at the poles. For the same largest deviation from the true sphere an
+// icosphere needs about half the triangles; a cube sphere about as many, but
+// evenly sized and with a whole texture per face. Both keep the orientation
+// and tangent conventions of makeSphere().
+
+// Unit icosphere as makeIcosphere() writes it: subdividing an icosahedron
+// with its poles on the z axis, then giving vertices where the texture wraps
+// around a second copy with u past 1, and every triangle at a pole its own
+// pole vertex, with u between the other two
+struct IcosphereMesh {
+  vector<Cvec3f> normals;
+  vector<Cvec2f> texCoords;
+  vector<int> indices;
+};
+
+inline void buildIcosphere(int subdivisions, IcosphereMesh& mesh) {
+  using namespace std;
+  assert(subdivisions >= 0);
+  vector<Cvec3f>& normals = mesh.normals;
+  vector<int>& indices = mesh.indices;
+  normals.clear();
+  indices.clear();
+
+  // North pole, the upper ring at longitudes 0, 72, ..., the lower ring
+  // halfway between them and the south pole
+  const double ringZ = 1.0 / std::sqrt(5.0), ringR = 2.0 / std::sqrt(5.0);
+  normals.push_back(Cvec3f(0, 0, 1));
+  for (int i = 0; i < 10; ++i) {
+    const double longitude = CS175_PI / 5 * i;
+    normals.push_back(Cvec3f(ringR * cos(longitude), ringR * sin(longitude), (i & 1) ? -ringZ : ringZ));
+  }
+  normals.push_back(Cvec3f(0, 0, -1));
+  for (int i = 0; i < 5; ++i) {
+    const int up = 1 + 2 * i, down = up + 1, nextUp = 1 + (up + 1) % 10, nextDown = nextUp + 1;
+    const int faces[] = {0, up, nextUp,  up, down, nextUp,  nextUp, down, nextDown,  11, nextDown, down};
+    indices.insert(indices.end(), faces, faces + 12);
+  }
+
+  // Each triangle into four, through the midpoints of its edges
+  for (int level = 0; level < subdivisions; ++level) {
+    unordered_map<long long, int> midpoints;
+    const auto midpoint = [&](int a, int b) {
+      const long long key = (long long)min(a, b) << 32 | max(a, b);
+      const auto found = midpoints.find(key);
+      if (found != midpoints.end()) {
+        return found->second;
+      }
+      normals.push_back(normalize(normals[a] + normals[b]));
+      midpoints[key] = (int)normals.size() - 1;
+      return (int)normals.size() - 1;
+    };
+    vector<int> coarse;
+    coarse.swap(indices);
+    for (size_t i = 0; i < coarse.size(); i += 3) {
+      const int a = coarse[i], b = coarse[i + 1], c = coarse[i + 2];
+      const int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+      const int faces[] = {a, ab, ca,  ab, b, bc,  ca, bc, c,  ab, bc, ca};
+      indices.insert(indices.end(), faces, faces + 12);
+    }
+  }
+
+  vector<Cvec2f>& texCoords = mesh.texCoords;
+  texCoords.resize(normals.size());
+  for (size_t i = 0; i < normals.size(); ++i) {
+    double u = atan2((double)normals[i][1], (double)normals[i][0]) / (2 * CS175_PI);
+    u = u < 0 ? u + 1 : u;
+    texCoords[i] = Cvec2f(u > 1 - 1e-6 ? 0 : u, acos(min(max((double)normals[i][2], -1.0), 1.0)) / CS175_PI);
+  }
+
+  const int poleNorth = 0, poleSouth = 11;
+  vector<int> wrapped(normals.size(), -1);
+  bool poleUsed[2] = {false, false};
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    int* corner = &indices[i];
+    float uMin = 2, uMax = -1;
+    for (int k = 0; k < 3; ++k) {
+      if (corner[k] != poleNorth && corner[k] != poleSouth) {
+        uMin = min(uMin, texCoords[corner[k]][0]);
+        uMax = max(uMax, texCoords[corner[k]][0]);
+      }
+    }
+    if (uMax - uMin > 0.5f) {
+      for (int k = 0; k < 3; ++k) {
+        if (corner[k] != poleNorth && corner[k] != poleSouth && texCoords[corner[k]][0] < 0.5f) {
+          if (wrapped[corner[k]] < 0) {
+            wrapped[corner[k]] = (int)normals.size();
+            normals.push_back(normals[corner[k]]);
+            texCoords.push_back(texCoords[corner[k]] + Cvec2f(1, 0));
+          }
+          corner[k] = wrapped[corner[k]];
+        }
+      }
+    }
+    for (int k = 0; k < 3; ++k) {
+      if (corner[k] == poleNorth || corner[k] == poleSouth) {
+        bool& used = poleUsed[corner[k] == poleSouth];
+        const float u = (texCoords[corner[(k + 1) % 3]][0] + texCoords[corner[(k + 2) % 3]][0]) * 0.5f;
+        if (used) {
+          normals.push_back(normals[corner[k]]);
+          texCoords.push_back(Cvec2f(u, texCoords[corner[k]][1]));
+          corner[k] = (int)normals.size() - 1;
+        }
+        else {
+          texCoords[corner[k]][0] = u;
+          used = true;
+        }
+      }
+    }
+  }
+}
+
+inline void getIcosphereVbIbLen(int subdivisions, int& vbLen, int& ibLen) {
+  // Only the texture seam needs the mesh itself
+  IcosphereMesh mesh;
+  buildIcosphere(subdivisions, mesh);
+  vbLen = (int)mesh.normals.size();
+  ibLen = (int)mesh.indices.size();
+}
+
+template<typename VtxOutIter, typename IdxOutIter>
+void makeIcosphere(float radius, const IcosphereMesh& mesh, VtxOutIter vtxIter, IdxOutIter idxIter) {
+  for (size_t i = 0; i < mesh.normals.size(); ++i) {
+    const Cvec3f& n = mesh.normals[i];
+    const double longitude = 2 * CS175_PI * mesh.texCoords[i][0];
+    const Cvec3f t(-sin(longitude), cos(longitude), 0);
+    writeVertex(vtxIter, n * radius, n, mesh.texCoords[i], t, cross(n, t));
+    ++vtxIter;
+  }
+  for (size_t i = 0; i < mesh.indices.size(); ++i) {
+    *idxIter = mesh.indices[i];
+    ++idxIter;
+  }
+}
+
+template<typename VtxOutIter, typename IdxOutIter>
+void makeIcosphere(float radius, int subdivisions, VtxOutIter vtxIter, IdxOutIter idxIter) {
+  IcosphereMesh mesh;
+  buildIcosphere(subdivisions, mesh);
+  makeIcosphere(radius, mesh, vtxIter, idxIter);
+}
+
+// A cube with each face cut into cells x cells squares, blown up onto the
+// sphere with the mapping that spreads the cells most evenly. Every face
+// has its own vertices and the whole 0 to 1 texture square.
+inline void getCubeSphereVbIbLen(int cells, int& vbLen, int& ibLen) {
+  assert(cells >= 1);
+  vbLen = 6 * (cells + 1) * (cells + 1);
+  ibLen = 6 * cells * cells * 6;
+}
+
+template<typename VtxOutIter, typename IdxOutIter>
+void makeCubeSphere(float radius, int cells, VtxOutIter vtxIter, IdxOutIter idxIter) {
+  // Face normal and the directions u and v go in; v grows away from
+  // the binormal as it does in makeSphere()
+  static const float faces[6][2][3] = {
+    {{1, 0, 0}, {0, 1, 0}}, {{0, 1, 0}, {-1, 0, 0}}, {{-1, 0, 0}, {0, -1, 0}},
+    {{0, -1, 0}, {1, 0, 0}}, {{0, 0, 1}, {1, 0, 0}}, {{0, 0, -1}, {1, 0, 0}}
+  };
+  const int side = cells + 1;
+  for (int f = 0; f < 6; ++f) {
+    const Cvec3f normal(faces[f][0][0], faces[f][0][1], faces[f][0][2]);
+    const Cvec3f uAxis(faces[f][1][0], faces[f][1][1], faces[f][1][2]);
+    const Cvec3f vAxis = cross(normal, uAxis);
+    for (int j = 0; j < side; ++j) {
+      for (int i = 0; i < side; ++i) {
+        const float s = float(i) / cells, t = float(j) / cells;
+        const Cvec3f c = normal + uAxis * (2 * s - 1) + vAxis * (2 * t - 1);
+        const float x2 = c[0] * c[0], y2 = c[1] * c[1], z2 = c[2] * c[2];
+        const Cvec3f n(c[0] * std::sqrt(1 - y2 / 2 - z2 / 2 + y2 * z2 / 3),
+                       c[1] * std::sqrt(1 - z2 / 2 - x2 / 2 + z2 * x2 / 3),
+                       c[2] * std::sqrt(1 - x2 / 2 - y2 / 2 + x2 * y2 / 3));
+        const Cvec3f tangent = normalize(uAxis - n * dot(n, uAxis));
+        writeVertex(vtxIter, n * radius, n, Cvec2f(s, 1 - t), tangent, cross(n, tangent));
+        ++vtxIter;
+
+        if (i < cells && j < cells) {
+          const int corner = side * side * f + side * j + i;
+          *idxIter = corner;
+          *++idxIter = corner + 1;
+          *++idxIter = corner + side + 1;
+
+          *++idxIter = corner;
+          *++idxIter = corner + side + 1;
+          *++idxIter = corner + side;
+          ++idxIter;
+        }
+      }
+    }
+  }
+}
+
 
 #endif
@@ -0,0 +1,176 @@
+#include "geometrypool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "cvec.h"
+#include "scene.h"
+
+int RangeAllocator::allocate(int count) {
+	for (auto range = free_.begin(); range != free_.end(); ++range) {
+		if (range->second < count) {
+			continue;
+		}
+		const int first = range->first;
+		const int left = range->second - count;
+		free_.erase(range);
+		if (left > 0) {
+			free_[first + count] = left;
+		}
+		used_ += count;
+		return first;
+	}
+	return -1;
+}
+
+void RangeAllocator::free(int first, int count) {
+	used_ -= count;
+	// Merged with whichever neighbours are free too
+	auto next = free_.lower_bound(first);
+	if (next != free_.end() && next->first == first + count) {
+		count += next->second;
+		next = free_.erase(next);
+	}
+	if (next != free_.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == first) {
+			previous->second += count;
+			return;
+		}
+	}
+	free_[first] = count;
+}
+
+void RangeAllocator::reset(int capacity, int used) {
+	capacity_ = capacity;
+	used_ = used;
+	free_.clear();
+	if (used < capacity) {
+		free_[used] = capacity - used;
+	}
+}
+
+int RangeAllocator::largestFreeRange() const {
+	int largest = 0;
+	for (const auto& range : free_) {
+		largest = std::max(largest, range.second);
+	}
+	return largest;
+}
+
+GeometryArena::GeometryArena(int initialCapacity, const std::vector<int>& strides)
+	: strides_(strides), initialCapacity_(initialCapacity) {}
+
+void GeometryArena::relocate(int capacity) {
+	std::vector<GLuint> buffers(strides_.size());
+	glGenBuffers((GLsizei)buffers.size(), &buffers[0]);
+	for (int i = 0; i < buffers.size(); i++) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[i]);
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)strides_[i] * capacity, NULL, GL_STATIC_DRAW);
+	}
+
+	// In the order they sit in, so meshes allocated together stay together
+	std::vector<int> live;
+	for (int handle = 0; handle < ranges_.size(); handle++) {
+		if (ranges_[handle].count > 0) {
+			live.push_back(handle);
+		}
+	}
+	std::sort(live.begin(), live.end(), [this](int a, int b) { return ranges_[a].first < ranges_[b].first; });
+
+	int packed = 0;
+	for (int handle : live) {
+		Range& range = ranges_[handle];
+		for (int i = 0; i < buffers.size(); i++) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buffers_[i]);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[i]);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+				(GLintptr)strides_[i] * range.first, (GLintptr)strides_[i] * packed, (GLsizeiptr)strides_[i] * range.count);
+		}
+		range.first = packed;
+		packed += range.count;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (!buffers_.empty()) {
+		glDeleteBuffers((GLsizei)buffers_.size(), &buffers_[0]);
+	}
+	buffers_ = buffers;
+	allocator_.reset(capacity, packed);
+}
+
+int GeometryArena::allocate(int count) {
+	if (buffers_.empty()) {
+		relocate(std::max(initialCapacity_, count));
+	}
+	int first = count > 0 ? allocator_.allocate(count) : 0;
+	if (first < 0) {
+		// Compacting is enough when only the gaps are too small
+		const int free = allocator_.capacity() - allocator_.used();
+		relocate(free >= count ? allocator_.capacity() : std::max(allocator_.capacity() * 2, allocator_.used() + count));
+		first = allocator_.allocate(count);
+		assert(first >= 0);
+	}
+
+	Range range = { first, count };
+	if (!freeHandles_.empty()) {
+		const int handle = freeHandles_.back();
+		freeHandles_.pop_back();
+		ranges_[handle] = range;
+		return handle;
+	}
+	ranges_.push_back(range);
+	return (int)ranges_.size() - 1;
+}
+
+void GeometryArena::free(int handle) {
+	Range& range = ranges_[handle];
+	assert(range.count >= 0);
+	if (range.count > 0) {
+		allocator_.free(range.first, range.count);
+	}
+	range.count = -1;
+	freeHandles_.push_back(handle);
+}
+
+void GeometryArena::write(int handle, int i, const void* data) {
+	const Range& range = ranges_[handle];
+	if (range.count == 0) {
+		return;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffers_[i]);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)strides_[i] * range.first, (GLsizeiptr)strides_[i] * range.count, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void* GeometryArena::map(int handle, int i) {
+	const Range& range = ranges_[handle];
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffers_[i]);
+	// Only this range is thrown away; the rest of the buffer may be in use
+	return glMapBufferRange(GL_COPY_WRITE_BUFFER, (GLintptr)strides_[i] * range.first, (GLsizeiptr)strides_[i] * range.count,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+bool GeometryArena::unmap(int i) {
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffers_[i]);
+	const GLboolean kept = glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return kept == GL_TRUE;
+}
+
+void GeometryArena::defragment() {
+	if (!buffers_.empty() && allocator_.largestFreeRange() < allocator_.capacity() - allocator_.used()) {
+		relocate(allocator_.capacity());
+	}
+}
+
+// Enough for the monks and their levels of detail before growing
+GeometryPool::GeometryPool()
+	: vertices(1 << 16, { (int)sizeof(VertexPNTBTG), (int)sizeof(Cvec3f) }), indices(1 << 18, { (int)sizeof(unsigned short) }) {}
+
+GeometryPool& GeometryPool::shared() {
+	static GeometryPool pool;
+	return pool;
+}
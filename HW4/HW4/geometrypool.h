@@ -0,0 +1,118 @@
+#ifndef GEOMETRYPOOL_H
+#define GEOMETRYPOOL_H
+
+#include <map>
+#include <vector>
+
+#include "glsupport.h"
+
+//--------------------------------------------------------------------------------
+// Vertex and index storage shared by every Geometry. Instead of buffers of
+// their own, meshes get ranges of a few large ones and are drawn with
+// glDrawElementsBaseVertex, so going from one mesh to the next binds nothing
+// new and a batch can draw many with one call. Ranges are handed out first
+// fit from a free list that merges neighbours as they are freed. When nothing
+// fits, the storage is compacted if that makes room, and doubled otherwise.
+//--------------------------------------------------------------------------------
+
+// First fit free list over [0, capacity), in whatever unit its owner counts
+class RangeAllocator {
+	std::map<int, int> free_; // first -> count, never two touching
+	int capacity_, used_;
+
+public:
+	RangeAllocator() : capacity_(0), used_(0) {}
+
+	// First of count free units, or -1 when no free range is long enough
+	int allocate(int count);
+
+	// Gives back count units from first, as allocate() returned them
+	void free(int first, int count);
+
+	// Frees everything, then takes [0, used) as a single allocation, e.g.
+	// after its owner packed what was live to the front
+	void reset(int capacity, int used);
+
+	int capacity() const { return capacity_; }
+	int used() const { return used_; }
+	int freeRangeCount() const { return (int)free_.size(); }
+	int largestFreeRange() const;
+};
+
+// Ranges of one or more buffers that are allocated together, each with its
+// own element size, e.g. vertices and a packed copy of their positions. A
+// range is known by a handle, which stays valid when defragment() moves it.
+class GeometryArena {
+	struct Range {
+		int first, count; // count -1 once freed
+	};
+	std::vector<Range> ranges_;
+	std::vector<int> freeHandles_;
+	RangeAllocator allocator_;
+	std::vector<int> strides_;
+	std::vector<GLuint> buffers_;
+	int initialCapacity_;
+
+	// Packs every live range to the front of new buffers holding capacity
+	// elements
+	void relocate(int capacity);
+
+public:
+	// One buffer per stride in bytes; they are created on the first allocate()
+	GeometryArena(int initialCapacity, const std::vector<int>& strides);
+
+	// A handle to count elements in every buffer, making room if need be.
+	// Needs a current GL context.
+	int allocate(int count);
+
+	void free(int handle);
+
+	int first(int handle) const { return ranges_[handle].first; }
+	int count(int handle) const { return ranges_[handle].count; }
+
+	// Buffer i, e.g. to bind for drawing; changes when the arena grows or
+	// compacts
+	GLuint buffer(int i = 0) const { return buffers_.empty() ? 0 : buffers_[i]; }
+
+	// Copies the range's elements in buffer i from data
+	void write(int handle, int i, const void* data);
+
+	// The range's elements in buffer i, write only, until unmap(i); NULL
+	// when the map fails
+	void* map(int handle, int i);
+
+	// False if the contents were lost while mapped
+	bool unmap(int i);
+
+	// Packs the live ranges together, leaving a single free range at the end
+	void defragment();
+
+	int capacity() const { return allocator_.capacity(); }
+	int used() const { return allocator_.used(); }
+	int freeRangeCount() const { return allocator_.freeRangeCount(); }
+	int stride(int i) const { return strides_[i]; }
+
+private:
+	GeometryArena(const GeometryArena&);
+	GeometryArena& operator = (const GeometryArena&);
+};
+
+// The buffers of the vertex arena
+static const int GEOMETRY_VERTEX_DATA = 0;
+static const int GEOMETRY_POSITION_DATA = 1;
+
+class GeometryPool {
+public:
+	// VertexPNTBTG and Cvec3f positions, GEOMETRY_VERTEX_DATA and
+	// GEOMETRY_POSITION_DATA, in step
+	GeometryArena vertices;
+	// unsigned short, relative to the first vertex of the mesh they index
+	GeometryArena indices;
+
+	GeometryPool();
+
+	// What every Geometry allocates from
+	static GeometryPool& shared();
+};
+
+#endif
@@ -3,6 +3,8 @@
 #include <string>
 #include <iostream>
 #include <stdexcept>
+#include <cstdio>
+#include <algorithm>
 
 #include "glsupport.h"
 #define STB_IMAGE_IMPLEMENTATION
@@ -64,14 +66,17 @@ static void printInfoLog(GLuint obj, const string& filename) {
 void readAndCompileSingleShader(GLuint shaderHandle, const char *fn) {
   vector<char> source;
   readTextFile(fn, source);
+  compileSingleShaderSource(shaderHandle, string(source.begin(), source.end()), fn);
+}
 
-  const char *ptrs[] = {&source[0]};
+void compileSingleShaderSource(GLuint shaderHandle, const string& source, const char *sourceName) {
+  const char *ptrs[] = {source.c_str()};
   const GLint lens[] = {(GLint)source.size()};
   glShaderSource(shaderHandle, 1, ptrs, lens);   // load the shader sources
 
   glCompileShader(shaderHandle);
 
-  printInfoLog(shaderHandle, fn);
+  printInfoLog(shaderHandle, sourceName);
 
   GLint compiled = 0;
   glGetShaderiv(shaderHandle, GL_COMPILE_STATUS, &compiled);
@@ -85,7 +90,7 @@ void readAndCompileSingleShader(GLuint shaderHandle, const char *fn) {
     glGetShaderInfoLog(shaderHandle, maxLength, &maxLength, &errorLog[0]);
 
     // Provide the infolog in whatever manor you deem best.
-    cerr << &errorLog[0];
+    cerr << "##### Log [" << sourceName << "]:\n" << &errorLog[0];
 
     // Exit with failure.
     glDeleteShader(shaderHandle); // Don't leak the shader.
@@ -94,6 +99,20 @@ void readAndCompileSingleShader(GLuint shaderHandle, const char *fn) {
   checkGlErrors(__FILE__, __LINE__);
 }
 
+string readTextFileToString(const char *fn) {
+  vector<char> data;
+  readTextFile(fn, data);
+  return string(data.begin(), data.end());
+}
+
+bool hasGlVersion(int major, int minor) {
+  const char *version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+  int ctxMajor = 0, ctxMinor = 0;
+  if (version == nullptr || sscanf(version, "%d.%d", &ctxMajor, &ctxMinor) != 2)
+    return false;
+  return ctxMajor > major || (ctxMajor == major && ctxMinor >= minor);
+}
+
 void linkShader(GLuint programHandle, GLuint vs, GLuint fs) {
   glAttachShader(programHandle, vs);
   glAttachShader(programHandle, fs);
@@ -148,4 +167,83 @@ GLuint loadGLTexture(const char *filePath) {
     glBindTexture(GL_TEXTURE_2D, 0);
     stbi_image_free(image);
     return retTexture;
-}
\ No newline at end of file
+}
+
+// PNG chunks are checksummed with the zlib CRC-32
+static unsigned long pngCrc(const unsigned char* data, size_t length, unsigned long crc) {
+  crc = ~crc & 0xffffffffUL;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (0xedb88320UL & (0UL - (crc & 1)));
+  }
+  return ~crc & 0xffffffffUL;
+}
+
+static void appendBigEndian(vector<unsigned char>& out, unsigned long value) {
+  out.push_back((value >> 24) & 0xff);
+  out.push_back((value >> 16) & 0xff);
+  out.push_back((value >> 8) & 0xff);
+  out.push_back(value & 0xff);
+}
+
+static void appendPngChunk(vector<unsigned char>& out, const char* type, const vector<unsigned char>& data) {
+  appendBigEndian(out, (unsigned long)data.size());
+  const size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  appendBigEndian(out, pngCrc(&out[start], out.size() - start, 0));
+}
+
+bool writePngFile(const char* fileName, int width, int height, const unsigned char* rgba) {
+  // Filter type 0 per row, rows flipped so the image is top row first
+  const size_t rowBytes = (size_t)width * 4;
+  vector<unsigned char> raw;
+  raw.reserve((rowBytes + 1) * height);
+  for (int y = height - 1; y >= 0; y--) {
+    raw.push_back(0);
+    raw.insert(raw.end(), rgba + y * rowBytes, rgba + (y + 1) * rowBytes);
+  }
+
+  // zlib stream of stored (uncompressed) deflate blocks: bigger files, but
+  // no compressor to depend on and nothing lossy for image comparisons
+  vector<unsigned char> zlib;
+  zlib.push_back(0x78);
+  zlib.push_back(0x01);
+  unsigned long a = 1, b = 0;
+  for (size_t i = 0; i < raw.size(); i++) {
+    a = (a + raw[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  size_t offset = 0;
+  do {
+    const size_t length = min(raw.size() - offset, (size_t)65535);
+    zlib.push_back(offset + length == raw.size() ? 1 : 0);
+    zlib.push_back(length & 0xff);
+    zlib.push_back((length >> 8) & 0xff);
+    zlib.push_back(~length & 0xff);
+    zlib.push_back((~length >> 8) & 0xff);
+    zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+    offset += length;
+  } while (offset < raw.size());
+  appendBigEndian(zlib, (b << 16) | a);
+
+  vector<unsigned char> header;
+  appendBigEndian(header, width);
+  appendBigEndian(header, height);
+  header.push_back(8); // bit depth
+  header.push_back(6); // RGBA
+  header.push_back(0);
+  header.push_back(0);
+  header.push_back(0);
+
+  const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  vector<unsigned char> png(signature, signature + 8);
+  appendPngChunk(png, "IHDR", header);
+  appendPngChunk(png, "IDAT", zlib);
+  appendPngChunk(png, "IEND", vector<unsigned char>());
+
+  ofstream out(fileName, ios::binary);
+  out.write(reinterpret_cast<const char*>(&png[0]), png.size());
+  return (bool)out;
+}
@@ -3,9 +3,16 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <string>
 
 #ifdef __APPLE__
     #include <glut.h>
+#elif defined(CS6533_NO_GLEW)
+    // Linux libGL exports every entry point itself, so no loader is needed
+    #define GL_GLEXT_PROTOTYPES
+    #include <GL/gl.h>
+    #include <GL/glext.h>
+    #include <GL/glut.h>
 #else
     #include <GL/glew.h>
     #include <GL/glut.h>
@@ -13,6 +20,10 @@
 
 GLuint loadGLTexture(const char *filePath);
 
+// Writes 8 bit RGBA pixels, bottom row first as glReadPixels returns them, to
+// an uncompressed PNG file. Returns false if the file can't be written
+bool writePngFile(const char* fileName, int width, int height, const unsigned char* rgba);
+
 // Check if there has been an error inside OpenGL and if yes, print the error and
 // through a runtime_error exception.
 void checkGlErrors(const char* filename, int lineno);
@@ -32,6 +43,16 @@ void linkShader(GLuint programHandle, GLuint vertexShaderHandle, GLuint fragment
 // shader. Throws runtime_error on error
 void readAndCompileSingleShader(GLuint shaderHandle, const char* shaderFileName);
 
+// Compiles shader source that is already in memory (e.g. assembled from several
+// files). sourceName is only used in error messages. Throws runtime_error on error
+void compileSingleShaderSource(GLuint shaderHandle, const std::string& source, const char* sourceName);
+
+// Reads a whole text file into a string, throws runtime_error on error
+std::string readTextFileToString(const char* fileName);
+
+// True if the current context reports at least the given GL version
+bool hasGlVersion(int major, int minor);
+
 // Classes inheriting Noncopyable will not have default compiler generated copy
 // constructor and assignment operator
 class Noncopyable {
@@ -0,0 +1,74 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include "glsupport.h"
+
+// Measures GPU time of the commands between begin() and end() with
+// GL_TIME_ELAPSED queries. Two queries alternate between frames and a result
+// is only read once the driver reports it available, so the CPU never waits
+// on the GPU; lastMs() therefore lags a frame or two behind.
+class GpuTimer {
+	GLuint queries_[2];
+	bool issued_[2];
+	int current_;
+	double lastMs_;
+	bool supported_;
+
+public:
+	GpuTimer() : current_(0), lastMs_(0.0), supported_(false) {
+		queries_[0] = queries_[1] = 0;
+		issued_[0] = issued_[1] = false;
+	}
+
+	// Needs a current GL context. Timer queries are core in 3.3; on older
+	// contexts the timer silently reports 0.
+	void init() {
+		supported_ = hasGlVersion(3, 3);
+		if (supported_) {
+			glGenQueries(2, queries_);
+		}
+		issued_[0] = issued_[1] = false;
+		lastMs_ = 0.0;
+	}
+
+	void destroy() {
+		if (supported_) {
+			glDeleteQueries(2, queries_);
+		}
+		supported_ = false;
+	}
+
+	void begin() {
+		if (!supported_) {
+			return;
+		}
+		if (issued_[current_]) {
+			GLint available = 0;
+			glGetQueryObjectiv(queries_[current_], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) {
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(queries_[current_], GL_QUERY_RESULT, &elapsed);
+				// Mesa's llvmpipe answers the first query of a context with a
+				// raw timestamp; no real frame takes ten seconds
+				if (elapsed < 10000000000ull) {
+					lastMs_ = elapsed / 1.0e6;
+				}
+			}
+		}
+		glBeginQuery(GL_TIME_ELAPSED, queries_[current_]);
+	}
+
+	void end() {
+		if (!supported_) {
+			return;
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+		issued_[current_] = true;
+		current_ ^= 1;
+	}
+
+	double lastMs() const { return lastMs_; }
+	bool supported() const { return supported_; }
+};
+
+#endif
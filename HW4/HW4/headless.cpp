@@ -0,0 +1,80 @@
+#include "headless.h"
+
+#if defined(__linux__) && !defined(CS6533_NO_EGL)
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+bool HeadlessContext::create(std::string& error) {
+	// Surfaceless Mesa needs neither a GPU nor an X server. Fall back to the
+	// default display, which covers drivers that lack the extension.
+	EGLDisplay display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != NULL) {
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+			error = "no EGL display could be initialized";
+			return false;
+		}
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		error = "EGL display does not support desktop OpenGL";
+		eglTerminate(display);
+		return false;
+	}
+
+	// Contexts without a config need EGL_KHR_no_config_context; otherwise
+	// pick any config that can do desktop GL
+	EGLConfig config = (EGLConfig)0;
+	const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if (extensions == NULL || std::string(extensions).find("EGL_KHR_no_config_context") == std::string::npos) {
+		const EGLint attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		EGLint count = 0;
+		if (!eglChooseConfig(display, attributes, &config, 1, &count) || count == 0) {
+			error = "no EGL config supports desktop OpenGL";
+			eglTerminate(display);
+			return false;
+		}
+	}
+
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	if (context == EGL_NO_CONTEXT) {
+		error = "eglCreateContext failed";
+		eglTerminate(display);
+		return false;
+	}
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		error = "eglMakeCurrent without a surface failed";
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		return false;
+	}
+	display_ = display;
+	context_ = context;
+	return true;
+}
+
+void HeadlessContext::destroy() {
+	if (context_ != 0) {
+		eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display_, context_);
+		eglTerminate(display_);
+		display_ = context_ = 0;
+	}
+}
+
+#else
+
+bool HeadlessContext::create(std::string& error) {
+	error = "headless rendering needs EGL, which this platform build does not use";
+	return false;
+}
+
+void HeadlessContext::destroy() {
+}
+
+#endif
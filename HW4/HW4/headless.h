@@ -0,0 +1,31 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <string>
+
+//--------------------------------------------------------------------------------
+// A GL context with no window, for rendering frames unattended (benchmarks,
+// image regression runs). Backed by EGL, which Mesa provides even without a
+// GPU or display server (llvmpipe). Render into framebuffer objects; there is
+// no default framebuffer to draw to.
+//--------------------------------------------------------------------------------
+
+class HeadlessContext {
+	void* display_;
+	void* context_;
+
+public:
+	HeadlessContext() : display_(0), context_(0) {}
+	~HeadlessContext() { destroy(); }
+
+	// Creates a desktop GL context and makes it current. Returns false and
+	// fills in error if that is not possible on this platform.
+	bool create(std::string& error);
+	void destroy();
+
+private:
+	HeadlessContext(const HeadlessContext&);
+	HeadlessContext& operator = (const HeadlessContext&);
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "cvec.h"
+#include "scene.h"
+
+// Picks each entity's level of detail from how large the error of a level
+// would look on screen: its object space error, scaled to the world, at the
+// distance of the nearest point of the entity's bounding sphere. The
+// coarsest level whose error stays under pixelThreshold pixels is drawn.
+// Switching to a coarser level waits until that error is hysteresis times
+// further under the threshold, so an entity sitting at a switching distance
+// doesn't flip between two levels every frame.
+class LodSelector {
+	Cvec3 eyePosition_;
+	double pixelsPerUnit_; // pixels covered by one unit at distance one
+
+public:
+	double pixelThreshold;
+	double hysteresis;
+
+	LodSelector(double pixelThreshold = 1.0, double hysteresis = 0.25)
+		: pixelsPerUnit_(0.0), pixelThreshold(pixelThreshold), hysteresis(hysteresis) {}
+
+	// fovy in degrees, of a viewport viewportHeight pixels high
+	void setView(const Cvec3& eyePosition, double fovy, int viewportHeight) {
+		eyePosition_ = eyePosition;
+		pixelsPerUnit_ = viewportHeight / (2.0 * std::tan(fovy * 0.5 * CS175_PI / 180.0));
+	}
+
+	// The level for entity, given the one it drew last frame. Needs a
+	// current updateWorld().
+	int select(const Entity& entity, int current) const {
+		const Geometry& geometry = entity.geometry;
+		const int last = geometry.lodCount() - 1;
+		current = std::min(std::max(current, 0), last);
+		if (last == 0) {
+			return 0;
+		}
+		// Inside the sphere everything is close enough to need the full mesh
+		const double distance = norm(entity.worldCenter - eyePosition_) - entity.worldRadius;
+		if (distance <= CS175_EPS) {
+			return 0;
+		}
+		const double scale = geometry.boundsRadius > 0 ? entity.worldRadius / geometry.boundsRadius : 1.0;
+		const double pixelsPerError = scale * pixelsPerUnit_ / distance;
+
+		int level = 0;
+		for (int i = last; i > 0; i--) {
+			if (geometry.lodError(i) * pixelsPerError <= pixelThreshold) {
+				level = i;
+				break;
+			}
+		}
+		while (level > current && geometry.lodError(level) * pixelsPerError > pixelThreshold * (1.0 - hysteresis)) {
+			level--;
+		}
+		return level;
+	}
+
+	// Sets lod of every entity
+	void update(const std::vector<Entity*>& entities) const {
+		for (int i = 0; i < entities.size(); i++) {
+			entities[i]->lod = select(*entities[i], entities[i]->lod);
+		}
+	}
+};
+
+#endif
@@ -1,174 +1,94 @@
-#include <GL/glew.h>
-#include <GL/freeglut.h>
-
 #include "glsupport.h"
-
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#include <GL/freeglut.h>
 
 #include "matrix4.h"
 #include "quat.h"
 #include "cvec.h"
 #include "geometrymaker.h"
+#include "scene.h"
+#include "objloader.h"
+#include "postprocess.h"
+#include "framebuffer.h"
+#include "dynamicresolution.h"
+#include "profiler.h"
+#include "shadows.h"
+#include "headless.h"
+#include "animation.h"
+#include "culling.h"
+#include "bvh.h"
+#include "occlusion.h"
+#include "simplify.h"
+#include "lod.h"
+#include "terrain.h"
+#include "uniforms.h"
+#include "multidraw.h"
 #include <vector>
-
-struct Entity;
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 
 //GLOBALS
 GLuint program;
 
 GLuint positionAttribute, texCoordAttribute;
 GLuint normalAttribute, binormalAttribute, tangentAttribute;
-GLuint modelViewMatrixLoc, projectionMatrixLoc, normalMatrixLoc;
 
 GLuint diffuseTexture, specularTexture, normalTexture;
 GLuint diffuseTexUniformLoc, specularTexUniformLoc, normalTextureLoc;
+GLuint shadowMapLoc0, shadowMapLoc1, shadowMapLoc2, cascadeShadowMapLoc;
+
+// FrameUniforms and every drawn entity's ObjectUniforms, uploaded together
+// once a frame
+UniformRing uniformRing;
+
+// Static entities drawn with a single glMultiDrawElementsIndirect, with
+// --multidraw or 'i' where OpenGL 4.3 is there; batchvertex.glsl in place of
+// vertex.glsl reads their matrices
+GLuint batchProgram = 0;
+GLuint batchPositionAttribute, batchTexCoordAttribute;
+GLuint batchNormalAttribute, batchBinormalAttribute, batchTangentAttribute, batchDrawIndexAttribute;
+MultiDrawBatch staticBatch;
+bool multiDrawEnabled = false;
+
+int windowWidth = 750, windowHeight = 750;
+
+SceneFramebuffer sceneFramebuffer;
+PostProcessChain postProcessChain;
+DynamicResolution dynamicResolution(1000.0 / 60.0);
+Profiler profiler;
+bool showProfilerOverlay = false;
+
+// Rendering without a window: see runHeadless()
+bool headless = false;
+ShadowMapSystem shadowMaps;
+bool sunEnabled = false;
 
-GLuint lightPosLoc0, lightColorLoc0, specLightColLoc0;
-GLuint lightPosLoc1, lightColorLoc1, specLightColLoc1;
-GLuint lightPosLoc2, lightColorLoc2, specLightColLoc2;
-
-GLfloat screenTriangleUVs[] = {
-	1.0f, 1.0f,
-	1.0f, 0.0f,
-	0.0f, 0.0f,
-
-	0.0f, 0.0f,
-	0.0f, 1.0f,
-	1.0f, 1.0f
-};
-
-GLfloat screenTrianglePositions[] = {
-	1.0f, 1.0f,
-	1.0f, -1.0f,
-	-1.0f, -1.0f,
-
-	-1.0f, -1.0f,
-	-1.0f, 1.0f,
-	1.0f, 1.0f
-};
-
-GLuint frameBuffer;
-GLuint frameBufferTexture;
-GLuint screenTrianglesProgram;
-GLuint screenFramebufferUniform;
-GLuint screenTrianglesPositionBuffer;
-GLuint screenTrianglesUVBuffer;
-GLuint screenTrianglesTexCoordAttribute, screenTrianglesPositionAttribute;
-GLuint depthBufferTexture;
-
-//STRUCTS
-struct VertexPNTBTG {
-	Cvec3f p, n, b, tg;
-	Cvec2f t;
-
-	VertexPNTBTG() {};
-	VertexPNTBTG(float x, float y, float z, float nx, float ny, float nz) : p(x, y, z), n(nx, ny, nz) {}
-
-	VertexPNTBTG& operator = (const GenericVertex& v) {
-		p = v.pos;
-		n = v.normal;
-		t = v.tex;
-		b = v.binormal;
-		tg = v.tangent;
-		return *this;
-	}
-};
-
-struct Transform {
-	Cvec3 translation;
-	Quat rotation;
-	Cvec3 scale;
-
-	Transform() : scale(1.0, 1.0, 1.0) {}
-
-	Matrix4 createMatrix() {
-		Matrix4 transformMatrix;
-		transformMatrix = transformMatrix.makeTranslation(translation) * quatToMatrix(rotation) * transformMatrix.makeScale(scale);
-		return transformMatrix;
-	}
-};
-
-struct Geometry {
-	GLuint vertexVBO;
-	GLuint indexBO;
-	int numIndeces;
-
-	void Draw(GLuint positionAttribute, GLuint texCoordAttribute, GLuint normalAttribute, GLuint binormalAttribute, GLuint tangentAttribute) {
-
-		//BIND BUFFER OBJECTS AND DRAW
-		glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
-		glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, p));
-		glEnableVertexAttribArray(positionAttribute);
-
-		glVertexAttribPointer(texCoordAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, t));
-		glEnableVertexAttribArray(texCoordAttribute);
-
-		glVertexAttribPointer(normalAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, n));
-		glEnableVertexAttribArray(normalAttribute);
-
-		glVertexAttribPointer(binormalAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, b));
-		glEnableVertexAttribArray(binormalAttribute);
-
-		glVertexAttribPointer(tangentAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, tg));
-		glEnableVertexAttribArray(tangentAttribute);
-
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBO);
-		glDrawElements(GL_TRIANGLES, numIndeces, GL_UNSIGNED_SHORT, 0);
-
-		glDisableVertexAttribArray(positionAttribute);
-		glDisableVertexAttribArray(texCoordAttribute);
-		glDisableVertexAttribArray(normalAttribute);
-		glDisableVertexAttribArray(binormalAttribute);
-		glDisableVertexAttribArray(tangentAttribute);
-	}
-};
-
-struct Entity {
-	Transform transform;
-	Geometry geometry;
-	Entity *parent;
-
-	Matrix4 getModelViewMatrix() {
-		Matrix4 modelViewMatrix = transform.createMatrix();
-		if (parent != nullptr) {
-			return parent->getModelViewMatrix() * modelViewMatrix;
-		}
-		return modelViewMatrix;
-	}
-
-	void Draw(Matrix4 &eyeInverse, GLuint positionAttribute, GLuint texCoordAttribute, GLuint normalAttribute, GLuint binormalAttribute, GLuint tangentAttribute, GLuint modelViewMatrixLoc, GLuint normalMatrixloc) {
-
-		//GET PARENT DATA
-		Matrix4 parModel;
-		if (parent != nullptr) {
-			parModel = parent->getModelViewMatrix();
-		}
-
-		//CREATE MODELVIEW MATRIX
-
-		Matrix4 modelMatrix = parModel * getModelViewMatrix();
-		Matrix4 modelViewMatrix = eyeInverse * modelMatrix;
-		//CREATE NORMAL MATRIX
-
-		Matrix4 normMatrix = normalMatrix(modelViewMatrix);
+Entity obj, obj2;
 
-		//SET MODELVIEW AND NORMAL MATRICES TO UNIFORMS LOCATIONS
+// Entity bounds for culling and picking; built the first frame, then refit
+Bvh sceneBvh;
+std::vector<int> visibleEntities;
+Matrix4 worldFromClip;
 
-		GLfloat glmatrix[16];
-		modelViewMatrix.writeToColumnMajorMatrix(glmatrix);
-		glUniformMatrix4fv(modelViewMatrixLoc, 1, false, glmatrix);
+// Hi-Z culling against the previous frame's depth, toggled with 'o'
+OcclusionCuller occlusionCuller;
+bool occlusionCulling = false;
 
-		GLfloat glmatrixNormal[16];
-		normMatrix.writeToColumnMajorMatrix(glmatrixNormal);
-		glUniformMatrix4fv(normalMatrixLoc, 1, false, glmatrixNormal);
+// Simplified meshes for distant entities, toggled with 'l'
+LodSelector lodSelector;
+bool lodEnabled = false;
 
-		geometry.Draw(positionAttribute, texCoordAttribute, normalAttribute, binormalAttribute, tangentAttribute);
-	}
-};
+// Ground under the monks, with --terrain or --heightmap; its chunks follow
+// 'l' too
+Terrain terrain;
+bool terrainEnabled = false;
+const char* heightmapPath = NULL;
 
-Entity obj, obj2;
+// obj turns about Y at 15 degrees a second
+AnimationSystem animations;
+AnimationClip spinClip;
 
 //OTHER FUNCS
 void initLocations() {
@@ -180,197 +100,409 @@ void initLocations() {
 	binormalAttribute = glGetAttribLocation(program, "binormal");
 	tangentAttribute = glGetAttribLocation(program, "tangent");
 
-	modelViewMatrixLoc = glGetUniformLocation(program, "modelViewMatrix");
-	projectionMatrixLoc = glGetUniformLocation(program, "projectionMatrix");
-	normalMatrixLoc = glGetUniformLocation(program, "normalMatrix");
-
 	diffuseTexUniformLoc = glGetUniformLocation(program, "diffuseTexture");
 	specularTexUniformLoc = glGetUniformLocation(program, "specularTexture");
 	normalTextureLoc = glGetUniformLocation(program, "normalTexture");
 
-	lightPosLoc0 = glGetUniformLocation(program, "lights[0].lightPosition");
-	lightColorLoc0 = glGetUniformLocation(program, "lights[0].lightColor");
-	specLightColLoc0 = glGetUniformLocation(program, "lights[0].specularLightColor");
-
-	lightPosLoc1 = glGetUniformLocation(program, "lights[1].lightPosition");
-	lightColorLoc1 = glGetUniformLocation(program, "lights[1].lightColor");
-	specLightColLoc1 = glGetUniformLocation(program, "lights[1].specularLightColor");
-
-	lightPosLoc2 = glGetUniformLocation(program, "lights[2].lightPosition");
-	lightColorLoc2 = glGetUniformLocation(program, "lights[2].lightColor");
-	specLightColLoc2 = glGetUniformLocation(program, "lights[2].specularLightColor");
+	shadowMapLoc0 = glGetUniformLocation(program, "shadowMap0");
+	shadowMapLoc1 = glGetUniformLocation(program, "shadowMap1");
+	shadowMapLoc2 = glGetUniformLocation(program, "shadowMap2");
+	cascadeShadowMapLoc = glGetUniformLocation(program, "cascadeShadowMap");
 
-	glUseProgram(screenTrianglesProgram);
-	screenFramebufferUniform = glGetUniformLocation(screenTrianglesProgram, "screenFramebuffer");
-	screenTrianglesTexCoordAttribute = glGetAttribLocation(screenTrianglesProgram, "texCoord");
-	screenTrianglesPositionAttribute = glGetAttribLocation(screenTrianglesProgram, "position");
+	bindUniformBlocks(program);
 }
 
-void loadObjFile(const std::string &fileName, std::vector<VertexPNTBTG> &outVertices, std::vector<unsigned short> &outIndices) {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string err;
-	bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), NULL, true);
-	if (ret) {
-		for (int i = 0; i < shapes.size(); i++) {
-			for (int j = 0; j < shapes[i].mesh.indices.size(); j++) {
-				unsigned int vertexOffest = shapes[i].mesh.indices[j].vertex_index * 3;
-				unsigned int normalOffest = shapes[i].mesh.indices[j].normal_index * 3;
-				unsigned int texOffset = shapes[i].mesh.indices[j].texcoord_index * 2;
-				VertexPNTBTG v;
-				v.p[0] = attrib.vertices[vertexOffest];
-				v.p[1] = attrib.vertices[vertexOffest + 1];
-				v.p[2] = attrib.vertices[vertexOffest + 2];
-				v.n[0] = attrib.normals[normalOffest];
-				v.n[1] = attrib.normals[normalOffest + 1];
-				v.n[2] = attrib.normals[normalOffest + 2];
-				v.t[0] = attrib.texcoords[texOffset];
-				v.t[1] = 1.0 - attrib.texcoords[texOffset + 1];
-				outVertices.push_back(v);
-				outIndices.push_back(outVertices.size() - 1);
-			}
-		}
-	}
-	else {
-		std::cout << err << std::endl;
-		assert(false);
+// The batch program shares fragment.glsl, so its samplers go on the same units
+void initBatchProgram() {
+	batchProgram = glCreateProgram();
+	readAndCompileShader(batchProgram, "batchvertex.glsl", "fragment.glsl");
+	glUseProgram(batchProgram);
+	batchPositionAttribute = glGetAttribLocation(batchProgram, "position");
+	batchTexCoordAttribute = glGetAttribLocation(batchProgram, "texCoord");
+	batchNormalAttribute = glGetAttribLocation(batchProgram, "normal");
+	batchBinormalAttribute = glGetAttribLocation(batchProgram, "binormal");
+	batchTangentAttribute = glGetAttribLocation(batchProgram, "tangent");
+	batchDrawIndexAttribute = glGetAttribLocation(batchProgram, "drawIndex");
+
+	const char* samplers[] = { "diffuseTexture", "specularTexture", "normalTexture", "objectData", "shadowMap0", "shadowMap1", "shadowMap2", "cascadeShadowMap" };
+	for (int i = 0; i < 8; i++) {
+		glUniform1i(glGetUniformLocation(batchProgram, samplers[i]), i);
 	}
+	bindUniformBlocks(batchProgram);
+	glUseProgram(program);
+	staticBatch.init();
 }
 
-void calculateFaceTangent(const Cvec3f &v1, const Cvec3f &v2, const Cvec3f &v3, const Cvec2f &texCoord1, const Cvec2f &texCoord2, const Cvec2f &texCoord3, Cvec3f &tangent, Cvec3f &binormal) {
-	Cvec3f side0 = v1 - v2;
-	Cvec3f side1 = v3 - v1;
-	Cvec3f normal = cross(side1, side0);
-	normalize(normal);
-	float deltaV0 = texCoord1[1] - texCoord2[1];
-	float deltaV1 = texCoord3[1] - texCoord1[1];
-	tangent = side0 * deltaV1 - side1 * deltaV0;
-	normalize(tangent);
-
-	float deltaU0 = texCoord1[0] - texCoord2[0];
-	float deltaU1 = texCoord3[0] - texCoord1[0];
-
-	binormal = side0 * deltaU1 - side1 * deltaU0;
-	normalize(binormal);
-	Cvec3f tangentCross = cross(tangent, binormal);
-
-	if (dot(tangentCross, normal) < 0.0f) {
-		tangent = tangent * -1;
+// Profiler summary in the top-left corner of the window
+void drawProfilerOverlay() {
+	glUseProgram(0);
+	glColor3f(1.0f, 1.0f, 0.4f);
+	std::vector<std::string> lines = profiler.summaryLines();
+	for (int i = 0; i < lines.size(); i++) {
+		glWindowPos2i(8, windowHeight - 16 - 14 * i);
+		glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)lines[i].c_str());
 	}
 }
 
-void fillVertexBTG(std::vector<VertexPNTBTG> &outVertices) {
-	for (int i = 0; i < outVertices.size(); i += 3) {
-		Cvec3f tangent;
-		Cvec3f binormal;
-
-		calculateFaceTangent(outVertices[i].p, outVertices[i + 1].p, outVertices[i + 2].p, outVertices[i].t, outVertices[i + 1].t, outVertices[i + 2].t, tangent, binormal);
-
-		outVertices[i].tg = tangent;
-		outVertices[i + 1].tg = tangent;
-		outVertices[i + 2].tg = tangent;
-
-		outVertices[i].b = binormal;
-		outVertices[i + 1].b = binormal;
-		outVertices[i + 2].b = binormal;
+// Textures the scene can render without, replaced by a single texel of the
+// given color when the file is missing (e.g. on a build server)
+GLuint loadGLTextureOrFlat(const char* fileName, unsigned char r, unsigned char g, unsigned char b) {
+	if (std::ifstream(fileName)) {
+		return loadGLTexture(fileName);
 	}
+	std::cout << "WARN: " << fileName << " not found, using a flat texture instead" << std::endl;
+	const unsigned char texel[4] = { r, g, b, 255 };
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
 }
 
 //THE JUICY STUFF
-void display(void) {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	float timeElapsed = glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
-	float angle = timeElapsed * 15.0;
-	
-	glUseProgram(program);
-	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
-	glViewport(0, 0, 750, 750);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// Draws one frame of the scene at the given time in seconds and leaves the
+// finished image in outputFramebuffer
+void renderFrame(float timeElapsed, GLuint outputFramebuffer) {
 	
+	double gpuFrameMs = profiler.lastGpuMs("shadows") + profiler.lastGpuMs("scene") + profiler.lastGpuMs("resolve") + profiler.lastGpuMs("post-process");
+	sceneFramebuffer.setRenderScale(dynamicResolution.update(gpuFrameMs));
+
 	//EYE MATRIX
 	Matrix4 eyeMatrix;
 	eyeMatrix = eyeMatrix.makeTranslation(Cvec3(0.0, 12.0, 20.0));
 	eyeMatrix = eyeMatrix * eyeMatrix.makeXRotation(-15.0);
 
-	//LIGHTS
-	Cvec4 lightPosition0 = Cvec4(0.0, 10.0, 2.0, 1.0);
-	lightPosition0 = inv(eyeMatrix) * lightPosition0;
+	double aspectRatio = (double)windowWidth / windowHeight;
 
-	glUniform3f(lightPosLoc0, lightPosition0[0], lightPosition0[1], lightPosition0[2]);
-	glUniform3f(lightColorLoc0, 1.0, 0.3, 0.3);
-	glUniform3f(specLightColLoc0, 0.5, 0.0, 1.0);
+	//ENTITY TRANSFORMS, final before the shadow maps are brought up to date
+	profiler.beginSection("animation", false);
+	animations.update(timeElapsed);
+	profiler.endSection();
 
+	Quat r2 = Quat::makeYRotation(180.0);
+	obj2.transform.rotation = r2;
+	obj2.transform.translation = Cvec3(0.0, 0.0, -5.0);
 
-	Cvec4 lightPosition1 = Cvec4(5.0, 15.0, 3.0, 1.0);
-	lightPosition1 = inv(eyeMatrix) * lightPosition1;
+	//SHADOWS
+	shadowMaps.setPointLightPosition(0, Cvec3(0.0, 10.0, 2.0));
+	shadowMaps.setPointLightPosition(1, Cvec3(5.0, 15.0, 3.0));
+	shadowMaps.setPointLightPosition(2, Cvec3(-5.0, 13.0, -1.0));
+
+	std::vector<Entity*> entities;
+	entities.push_back(&obj);
+	entities.push_back(&obj2);
+	if (terrainEnabled) {
+		terrain.uploadGenerated(4);
+		terrain.appendEntities(entities);
+	}
+	for (int i = 0; i < entities.size(); i++) {
+		entities[i]->updateWorld();
+	}
 
-	glUniform3f(lightPosLoc1, lightPosition1[0], lightPosition1[1], lightPosition1[2]);
-	glUniform3f(lightColorLoc1, 0.0, 1.0, 1.0);
-	glUniform3f(specLightColLoc1, 0.0, 0.0, 1.0);
+	ShadowCamera shadowCamera;
+	shadowCamera.eyeMatrix = eyeMatrix;
+	shadowCamera.fovy = 45.0;
+	shadowCamera.aspectRatio = aspectRatio;
+	shadowCamera.zNear = 0.1;
+	shadowCamera.zFar = 100.0;
 
+	profiler.beginSection("shadows");
+	shadowMaps.update(entities, shadowCamera);
+	profiler.endSection();
 
-	Cvec4 lightPosition2 = Cvec4(-5.0, 13.0, -1.0, 1.0);
-	lightPosition2 = inv(eyeMatrix) * lightPosition2;
+	glUseProgram(program);
+	sceneFramebuffer.bind();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	profiler.beginSection("scene");
 
-	glUniform3f(lightPosLoc2, lightPosition2[0], lightPosition2[1], lightPosition2[2]);
-	glUniform3f(lightColorLoc2, 1.0, 1.0, 1.0);
-	glUniform3f(specLightColLoc2, 0.5, 0.5, 0.8);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, diffuseTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, specularTexture);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, normalTexture);
+
+	for (int i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE4 + i);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, shadowMaps.pointShadowMap(i));
+	}
+
+	// Everything the shaders need for the frame, in one block
+	FrameUniforms frameUniforms;
+	std::memset(&frameUniforms, 0, sizeof(frameUniforms));
+	eyeMatrix.writeToColumnMajorMatrix(frameUniforms.eyeToWorldMatrix);
+
+	int cascadeCount = shadowMaps.cascadeCount();
+	frameUniforms.cascadeCount = cascadeCount;
+	if (cascadeCount > 0) {
+		Cvec4 sunDirection = inv(eyeMatrix) * Cvec4(-shadowMaps.sunDirection(), 0.0);
+		for (int j = 0; j < 3; j++) {
+			frameUniforms.sunDirection[j] = sunDirection[j];
+		}
+		frameUniforms.sunColor[0] = 0.4;
+		frameUniforms.sunColor[1] = 0.4;
+		frameUniforms.sunColor[2] = 0.35;
+
+		for (int i = 0; i < cascadeCount; i++) {
+			shadowMaps.cascadeMatrix(i, eyeMatrix).writeToColumnMajorMatrix(frameUniforms.cascadeMatrices[i]);
+			frameUniforms.cascadeSplits[i] = shadowMaps.cascadeSplit(i);
+		}
+
+		glActiveTexture(GL_TEXTURE7);
+		glBindTexture(GL_TEXTURE_2D, shadowMaps.cascadeShadowMap());
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	//LIGHTS
+	const Cvec3 lightPositions[] = { Cvec3(0.0, 10.0, 2.0), Cvec3(5.0, 15.0, 3.0), Cvec3(-5.0, 13.0, -1.0) };
+	const Cvec3 lightColors[] = { Cvec3(1.0, 0.3, 0.3), Cvec3(0.0, 1.0, 1.0), Cvec3(1.0, 1.0, 1.0) };
+	const Cvec3 specularLightColors[] = { Cvec3(0.5, 0.0, 1.0), Cvec3(0.0, 0.0, 1.0), Cvec3(0.5, 0.5, 0.8) };
+	for (int i = 0; i < 3; i++) {
+		Cvec4 lightPosition = inv(eyeMatrix) * Cvec4(lightPositions[i], 1.0);
+		FrameUniforms::Light& light = frameUniforms.lights[i];
+		for (int j = 0; j < 3; j++) {
+			light.lightPosition[j] = lightPosition[j];
+			light.lightColor[j] = lightColors[i][j];
+			light.specularLightColor[j] = specularLightColors[i][j];
+		}
+		light.shadowFarPlane = shadowMaps.pointShadowFarPlane(i);
+	}
 
 	//PROJECTION MATRIX
 	Matrix4 projectionMatrix;
-	projectionMatrix = projectionMatrix.makeProjection(45.0, 1.0, -0.1, -100.0);
-
-	GLfloat glmatrixProjection[16];
-	projectionMatrix.writeToColumnMajorMatrix(glmatrixProjection);
-	glUniformMatrix4fv(projectionMatrixLoc, 1, false, glmatrixProjection);
+	projectionMatrix = projectionMatrix.makeProjection(45.0, aspectRatio, -0.1, -100.0);
+	projectionMatrix.writeToColumnMajorMatrix(frameUniforms.projectionMatrix);
+	const int frameUniformsOffset = uniformRing.stage(&frameUniforms, sizeof(frameUniforms));
+
+	//CULL AND DRAW, nothing is sent to the GPU for entities outside the view
+	Matrix4 eyeInverse = inv(eyeMatrix);
+	if (sceneBvh.itemCount() != entities.size()) {
+		sceneBvh.build(entities);
+	}
+	else {
+		sceneBvh.setItemBounds(entities);
+		sceneBvh.refit();
+		sceneBvh.rebuildDegraded();
+	}
+	visibleEntities.clear();
+	sceneBvh.cull(Frustum::fromMatrix(projectionMatrix * eyeInverse), visibleEntities);
+	if (occlusionCulling) {
+		occlusionCuller.update();
+		visibleEntities.erase(std::remove_if(visibleEntities.begin(), visibleEntities.end(), [&entities](int i) {
+			return occlusionCuller.isOccluded(entities[i]->worldMin, entities[i]->worldMax);
+		}), visibleEntities.end());
+	}
+	// In entity order, as the BVH returns them grouped by where they are
+	std::sort(visibleEntities.begin(), visibleEntities.end());
+	if (lodEnabled) {
+		lodSelector.setView(Cvec3(eyeMatrix(0, 3), eyeMatrix(1, 3), eyeMatrix(2, 3)), 45.0, sceneFramebuffer.renderHeight);
+		lodSelector.update(entities);
+	}
+	else {
+		for (int i = 0; i < entities.size(); i++) {
+			entities[i]->lod = 0;
+		}
+	}
+	if (terrainEnabled) {
+		// Keeps neighbouring chunks within a level of each other
+		if (lodEnabled) {
+			terrain.selectLods(lodSelector);
+		}
+		else {
+			terrain.clearLods();
+		}
+	}
+	// All the matrices go up in one upload with the frame's block; each draw
+	// then only points the object block at its own. Static entities join the
+	// batch instead, which carries their matrices itself.
+	std::vector<int> objectUniformsOffsets(visibleEntities.size());
+	staticBatch.begin();
+	for (int i = 0; i < visibleEntities.size(); i++) {
+		const Entity& entity = *entities[visibleEntities[i]];
+		if (multiDrawEnabled && entity.isStatic) {
+			staticBatch.add(entity, eyeInverse);
+			objectUniformsOffsets[i] = -1;
+			continue;
+		}
+		ObjectUniforms objectUniforms;
+		entity.getObjectUniforms(eyeInverse, objectUniforms);
+		objectUniformsOffsets[i] = uniformRing.stage(&objectUniforms, sizeof(objectUniforms));
+	}
+	const int uniformsStart = uniformRing.upload();
+	uniformRing.bindRange(UNIFORM_BINDING_FRAME, uniformsStart + frameUniformsOffset, sizeof(FrameUniforms));
+	for (int i = 0; i < visibleEntities.size(); i++) {
+		if (objectUniformsOffsets[i] < 0) {
+			continue;
+		}
+		uniformRing.bindRange(UNIFORM_BINDING_OBJECT, uniformsStart + objectUniformsOffsets[i], sizeof(ObjectUniforms));
+		entities[visibleEntities[i]]->Draw(positionAttribute, texCoordAttribute, normalAttribute, binormalAttribute, tangentAttribute);
+	}
+	if (staticBatch.drawCount() > 0) {
+		glUseProgram(batchProgram);
+		staticBatch.draw(batchPositionAttribute, batchTexCoordAttribute, batchNormalAttribute, batchBinormalAttribute, batchTangentAttribute,
+			batchDrawIndexAttribute, 3);
+		glUseProgram(program);
+	}
+	worldFromClip = inv(projectionMatrix * eyeInverse);
 
-	Quat r1 = Quat::makeYRotation(angle);
-	obj.transform.rotation = r1;
-	obj.Draw(inv(eyeMatrix), positionAttribute, texCoordAttribute, normalAttribute, binormalAttribute, tangentAttribute, modelViewMatrixLoc, normalMatrixLoc);
+	profiler.endSection();
 
-	Quat r2 = Quat::makeYRotation(180.0);
-	obj2.transform.rotation = r2;
-	obj2.transform.translation = Cvec3(0.0, 0.0, -5.0);
-	obj2.Draw(inv(eyeMatrix), positionAttribute, texCoordAttribute, normalAttribute, binormalAttribute, tangentAttribute, modelViewMatrixLoc, normalMatrixLoc);
+	profiler.beginSection("resolve");
+	sceneFramebuffer.resolve();
+	if (occlusionCulling) {
+		occlusionCuller.capture(sceneFramebuffer, projectionMatrix * eyeInverse);
+	}
+	profiler.endSection();
 
 	//////////////////////////////////////////////////////////////////////////
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, 750, 750);
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+	glViewport(0, 0, windowWidth, windowHeight);
 	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
-	glUseProgram(screenTrianglesProgram);
-
-	glUniform1i(screenFramebufferUniform, 0);
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, frameBufferTexture);
-
-	glBindBuffer(GL_ARRAY_BUFFER, screenTrianglesPositionBuffer);
-	glVertexAttribPointer(screenTrianglesPositionAttribute, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(screenTrianglesPositionAttribute);
+	// The chain times its own stages on the GPU, which a query around it would collide with
+	profiler.beginSection("post-process", false);
+	postProcessChain.render(sceneFramebuffer.colorTexture, sceneFramebuffer.width, sceneFramebuffer.height,
+		sceneFramebuffer.renderWidth, sceneFramebuffer.renderHeight, windowWidth, windowHeight, outputFramebuffer);
+	profiler.endSection();
+	profiler.recordGpuMs("post-process", postProcessChain.lastGpuMs());
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, screenTrianglesUVBuffer);
-	glVertexAttribPointer(screenTrianglesTexCoordAttribute, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(screenTrianglesTexCoordAttribute);
+void display(void) {
+	profiler.beginFrame();
+	renderFrame(glutGet(GLUT_ELAPSED_TIME) / 1000.0f, 0);
 
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glDisableVertexAttribArray(screenTrianglesPositionAttribute);
-	glDisableVertexAttribArray(screenTrianglesTexCoordAttribute);
+	if (showProfilerOverlay) {
+		drawProfilerOverlay();
+	}
 	
 	//////////////////////////////////////////////////////////////////////////
 
+	profiler.beginSection("swap", false);
 	glutSwapBuffers();
+	profiler.endSection();
+	profiler.endFrame();
 }
 
 void reshape(int w, int h) {
-	glViewport(0, 0, w, h);
+	windowWidth = std::max(w, 1);
+	windowHeight = std::max(h, 1);
+	glViewport(0, 0, windowWidth, windowHeight);
+	sceneFramebuffer.resize(windowWidth, windowHeight);
 }
 
 void idle(void) {
 	glutPostRedisplay();
 }
 
+// A left click prints the entity under the cursor, going by world boxes
+void mouse(int button, int state, int x, int y) {
+	if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN) {
+		return;
+	}
+	const double ndcX = 2.0 * (x + 0.5) / windowWidth - 1.0;
+	const double ndcY = 1.0 - 2.0 * (y + 0.5) / windowHeight;
+	Cvec4 nearPoint = worldFromClip * Cvec4(ndcX, ndcY, -1.0, 1.0);
+	Cvec4 farPoint = worldFromClip * Cvec4(ndcX, ndcY, 1.0, 1.0);
+	const Cvec3 origin = Cvec3(nearPoint) / nearPoint[3];
+	const Cvec3 direction = Cvec3(farPoint) / farPoint[3] - origin;
+	double t;
+	const int hit = sceneBvh.raycast(origin, direction, 1.0, t);
+	if (hit < 0) {
+		std::cout << "picked nothing" << std::endl;
+		return;
+	}
+	const Cvec3 point = origin + direction * t;
+	std::cout << "picked entity " << hit << " at (" << point[0] << ", " << point[1] << ", " << point[2] << ")" << std::endl;
+}
+
+void keyboard(unsigned char key, int x, int y) {
+	const char* passNames[] = { "bloom", "tonemap", "colorGrade", "fxaa" };
+	if (key >= '1' && key <= '4') {
+		const char* name = passNames[key - '1'];
+		postProcessChain.setEnabled(name, !postProcessChain.isEnabled(name));
+		std::cout << name << (postProcessChain.isEnabled(name) ? " on" : " off") << std::endl;
+	}
+	else if (key == 'd') {
+		dynamicResolution.enabled = !dynamicResolution.enabled;
+		std::cout << "dynamic resolution" << (dynamicResolution.enabled ? " on" : " off") << std::endl;
+	}
+	else if (key == 'm') {
+		// Cycles 1, 2, 4, 8 samples, wrapping early once setSamples() clamps
+		// to what the device supports and the count stops growing
+		const int samples = sceneFramebuffer.samples;
+		if (samples >= 8 || sceneFramebuffer.setSamples(samples * 2) <= samples) {
+			sceneFramebuffer.setSamples(1);
+		}
+		std::cout << "MSAA " << sceneFramebuffer.samples << "x" << std::endl;
+	}
+	else if (key == 'c') {
+		sunEnabled = !sunEnabled;
+		shadowMaps.setDirectionalLight(Cvec3(-0.3, -1.0, -0.2), sunEnabled ? 3 : 0);
+		std::cout << "cascaded sun" << (sunEnabled ? " on" : " off") << std::endl;
+	}
+	else if (key == 't') {
+		profiler.print(std::cout);
+		std::cout << "shadows: " << shadowMaps.passesRenderedLastUpdate() << " passes re-rendered" << std::endl;
+		std::cout << "culling: " << visibleEntities.size() << " of " << sceneBvh.itemCount() << " entities drawn" << std::endl;
+		if (lodEnabled) {
+			std::cout << "lod:";
+			for (Entity* entity : { &obj, &obj2 }) {
+				std::cout << " " << entity->lod << " (" << entity->geometry.lodIndexCount(entity->lod) / 3 << " triangles)";
+			}
+			std::cout << std::endl;
+		}
+		if (terrainEnabled) {
+			std::cout << "terrain: " << terrain.uploadedChunkCount() << " of " << terrain.chunkCount() << " chunks, "
+				<< terrain.triangleCount() << " triangles" << std::endl;
+		}
+		if (multiDrawEnabled) {
+			std::cout << "multi-draw: " << staticBatch.drawCount() << " static entities in one call" << std::endl;
+		}
+		const GeometryPool& geometryPool = GeometryPool::shared();
+		std::cout << "geometry pool: " << geometryPool.vertices.used() << " of " << geometryPool.vertices.capacity() << " vertices, "
+			<< geometryPool.indices.used() << " of " << geometryPool.indices.capacity() << " indices, "
+			<< geometryPool.vertices.freeRangeCount() + geometryPool.indices.freeRangeCount() << " free ranges" << std::endl;
+		if (occlusionCulling) {
+			std::cout << "occlusion: " << occlusionCuller.occludedCount() << " of " << occlusionCuller.testedCount() << " tested entities hidden" << std::endl;
+		}
+		std::cout << "scene: " << sceneFramebuffer.renderWidth << "x" << sceneFramebuffer.renderHeight
+			<< " (scale " << sceneFramebuffer.renderScale << ", " << sceneFramebuffer.samples << "x MSAA)" << std::endl;
+		postProcessChain.printTimings(std::cout);
+	}
+	else if (key == 'o') {
+		occlusionCulling = !occlusionCulling;
+		occlusionCuller.invalidate();
+		std::cout << "occlusion culling" << (occlusionCulling ? " on" : " off") << std::endl;
+	}
+	else if (key == 'l') {
+		lodEnabled = !lodEnabled;
+		std::cout << "levels of detail" << (lodEnabled ? " on" : " off") << std::endl;
+	}
+	else if (key == 'i') {
+		if (batchProgram == 0) {
+			std::cout << "multi-draw needs OpenGL 4.3" << std::endl;
+		}
+		else {
+			multiDrawEnabled = !multiDrawEnabled;
+			std::cout << "multi-draw" << (multiDrawEnabled ? " on" : " off") << std::endl;
+		}
+	}
+	else if (key == 'p') {
+		showProfilerOverlay = !showProfilerOverlay;
+	}
+	else if (key == 'j') {
+		if (profiler.writeChromeTrace("profile.json")) {
+			std::cout << "wrote profile.json" << std::endl;
+		}
+		else {
+			std::cout << "could not write profile.json" << std::endl;
+		}
+	}
+}
+
 void init() {
 	glClearDepth(0.0f);
 	glEnable(GL_TEXTURE_2D);
@@ -378,14 +510,12 @@ void init() {
 	glCullFace(GL_BACK);
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_GREATER);
-	glReadBuffer(GL_BACK);
+	if (!headless) {
+		glReadBuffer(GL_BACK);
+	}
 	glEnable(GL_LIGHTING);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glutInitDisplayMode(GLUT_DOUBLE|GLUT_RGBA|GLUT_DEPTH);
-
-	screenTrianglesProgram = glCreateProgram();
-	readAndCompileShader(screenTrianglesProgram, "trivertex.glsl", "trifragment.glsl");
 
 	program = glCreateProgram();
 	readAndCompileShader(program, "vertex.glsl", "fragment.glsl");
@@ -397,100 +527,262 @@ void init() {
 	std::vector<unsigned short> ind0, ind1;
 
 	loadObjFile("Monk_Giveaway_Fixed.obj", vert0, ind0);
-	diffuseTexture = loadGLTexture("Monk_D.tga");
-	specularTexture = loadGLTexture("Monk_S.tga");
-	normalTexture = loadGLTexture("Monk_N.tga");
+	diffuseTexture = loadGLTextureOrFlat("Monk_D.tga", 180, 180, 180);
+	specularTexture = loadGLTextureOrFlat("Monk_S.tga", 128, 128, 128);
+	normalTexture = loadGLTextureOrFlat("Monk_N.tga", 128, 128, 255);
 
+	// Bound to their units every frame in renderFrame(), since the render
+	// targets created below bind textures of their own
 	glUniform1i(diffuseTexUniformLoc, 0);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, diffuseTexture);
-
 	glUniform1i(specularTexUniformLoc, 1);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, specularTexture);
-
 	glUniform1i(normalTextureLoc, 2);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, normalTexture);
+	glUniform1i(shadowMapLoc0, 4);
+	glUniform1i(shadowMapLoc1, 5);
+	glUniform1i(shadowMapLoc2, 6);
+	glUniform1i(cascadeShadowMapLoc, 7);
 
 	fillVertexBTG(vert0);
 
-	glGenBuffers(1, &obj.geometry.vertexVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, obj.geometry.vertexVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(VertexPNTBTG) * vert0.size(), vert0.data(), GL_STATIC_DRAW);
-
-	glGenBuffers(1, &obj.geometry.indexBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj.geometry.indexBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned short) * ind0.size(), ind0.data(), GL_STATIC_DRAW);
+	// Simplified once, for both monks
+	std::vector<MeshLod> monkLods;
+	buildLodChain(vert0, ind0, 4, 0.5f, monkLods);
 
-	obj.geometry.numIndeces = ind0.size();
+	obj.geometry.upload(vert0, ind0);
+	for (int i = 0; i < monkLods.size(); i++) {
+		obj.geometry.uploadLod(monkLods[i].vertices, monkLods[i].indices, monkLods[i].error);
+	}
 	obj.parent = nullptr;
 
 	loadObjFile("Monk_Giveaway_Fixed.obj", vert1, ind1);
 	fillVertexBTG(vert1);
 
-	glGenBuffers(1, &obj2.geometry.vertexVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, obj2.geometry.vertexVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(VertexPNTBTG) * vert1.size(), vert1.data(), GL_STATIC_DRAW);
+	// Its coarser levels are the same pool ranges as obj's, uploaded once;
+	// only one of the two may release() them
+	obj2.geometry.upload(vert1, ind1);
+	obj2.geometry.lods = obj.geometry.lods;
+	obj2.parent = &obj;
 
-	glGenBuffers(1, &obj2.geometry.indexBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj2.geometry.indexBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned short) * ind1.size(), ind1.data(), GL_STATIC_DRAW);
+	if (terrainEnabled) {
+		// Hills rising away from a flat middle for the monks to stand on
+		Heightfield heightfield;
+		heightfield.generate(257, 257, [](float x, float z) {
+			const float r = std::sqrt((x - 0.5f) * (x - 0.5f) + (z - 0.5f) * (z - 0.5f));
+			const float rise = std::min(std::max((r - 0.1f) / 0.3f, 0.0f), 1.0f);
+			return rise * rise * (3 - 2 * rise) * (0.6f + 0.25f * std::sin(x * 17.0f) * std::cos(z * 11.0f) + 0.15f * std::sin(x * 41.0f + z * 29.0f));
+		});
+		if (heightmapPath != NULL) {
+			try {
+				heightfield.load(heightmapPath);
+			}
+			catch (const std::runtime_error& e) {
+				std::cerr << e.what() << ", using the built in one" << std::endl;
+			}
+		}
+		terrain.init(heightfield, 8, 8, 0.25f, 8.0f);
+		terrain.root.transform.translation = Cvec3(0.0, -0.05, 0.0);
+		// Every headless frame draws all of it, so runs match
+		if (headless) {
+			terrain.finishGenerating();
+		}
+	}
 
-	obj2.geometry.numIndeces = ind1.size();
-	obj2.parent = &obj;
+	// A key every 60 degrees keeps the spline's turns unambiguous; the last
+	// key closes the loop
+	spinClip.rotation.interpolation = KEYFRAME_CATMULL_ROM;
+	for (int i = 0; i <= 6; i++) {
+		spinClip.rotation.addKey(i * 4.0, Quat::makeYRotation(i * 60.0));
+	}
+	spinClip.looping = true;
+	animations.play(&obj, &spinClip);
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	
-	glUseProgram(screenTrianglesProgram);
-
-	glGenBuffers(1, &screenTrianglesPositionBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, screenTrianglesPositionBuffer);
-	glBufferData(GL_ARRAY_BUFFER, 12*sizeof(GLfloat), screenTrianglePositions, GL_STATIC_DRAW);
-
-	glGenBuffers(1, &screenTrianglesUVBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, screenTrianglesUVBuffer);
-	glBufferData(GL_ARRAY_BUFFER, 12*sizeof(GLfloat), screenTriangleUVs, GL_STATIC_DRAW);
-
-	glGenFramebuffers(1, &frameBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
-
-	glGenTextures(1, &frameBufferTexture);
-	glBindTexture(GL_TEXTURE_2D, frameBufferTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 750, 750, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	postProcessChain.init("trivertex.glsl", "trifragment.glsl");
+	postProcessChain.addPass("bloom", "bloom.glsl", POSTPROCESS_NEIGHBORHOOD);
+	postProcessChain.setParameter("bloom", "bloomThreshold", 1.0f);
+	postProcessChain.setParameter("bloom", "bloomIntensity", 0.6f);
+	postProcessChain.addPass("tonemap", "tonemap.glsl", POSTPROCESS_POINTWISE, true);
+	postProcessChain.setParameter("tonemap", "tonemapExposure", 1.0f);
+	postProcessChain.addPass("colorGrade", "colorgrade.glsl", POSTPROCESS_POINTWISE);
+	postProcessChain.setParameter("colorGrade", "colorGradeSaturation", 1.1f);
+	postProcessChain.setParameter("colorGrade", "colorGradeContrast", 1.05f);
+	postProcessChain.setParameter("colorGrade", "colorGradeGamma", 1.0f);
+	postProcessChain.addPass("fxaa", "fxaa.glsl", POSTPROCESS_NEIGHBORHOOD);
+
+	sceneFramebuffer.init(windowWidth, windowHeight);
+	uniformRing.init(64 * 1024);
+	if (MultiDrawBatch::supported()) {
+		initBatchProgram();
+	}
+	else if (multiDrawEnabled) {
+		std::cerr << "multi-draw needs OpenGL 4.3, drawing one entity at a time" << std::endl;
+		multiDrawEnabled = false;
+	}
+	occlusionCuller.init();
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	shadowMaps.init(512, 1024, "shadowvertex.glsl", "shadowfragment.glsl");
+	for (int i = 0; i < 3; i++) {
+		shadowMaps.addPointLight(30.0);
+	}
+}
 
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frameBufferTexture, 0);
+// Renders a fixed number of frames into an offscreen target with no window,
+// stepping the animation 1/60 s per frame so every run draws the same images.
+// Each frame ends with glFinish, so its CPU time covers the GPU work too.
+int runHeadless(int frames, int samples, const char* dumpPrefix, const char* tracePath) {
+	HeadlessContext context;
+	std::string error;
+	if (!context.create(error)) {
+		std::cerr << "headless: " << error << std::endl;
+		return 1;
+	}
+#ifndef CS6533_NO_GLEW
+	glewInit();
+#endif
+	std::cout << "headless: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
 
-	glGenTextures(1, &depthBufferTexture);
-	glBindTexture(GL_TEXTURE_2D, depthBufferTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 750, 750, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, NULL);
+	init();
+	sceneFramebuffer.setSamples(samples);
+
+	GLuint outputFramebuffer, outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, windowWidth, windowHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glGenFramebuffers(1, &outputFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, outputTexture, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "headless: output framebuffer is incomplete" << std::endl;
+		return 1;
+	}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	std::vector<unsigned char> pixels(windowWidth * windowHeight * 4);
+	for (int frame = 0; frame < frames; frame++) {
+		profiler.beginFrame();
+		renderFrame(frame / 60.0f, outputFramebuffer);
+		profiler.beginSection("finish", false);
+		glFinish();
+		profiler.endSection();
+		profiler.endFrame();
+
+		// Results of timer queries lag a frame or two behind
+		double gpuMs = profiler.lastGpuMs("shadows") + profiler.lastGpuMs("scene") + profiler.lastGpuMs("resolve") + profiler.lastGpuMs("post-process");
+		std::printf("frame %4d  cpu %8.3f ms  gpu %8.3f ms  scale %.3f\n", frame, profiler.lastFrameMs(), gpuMs, sceneFramebuffer.renderScale);
+
+		if (dumpPrefix != NULL) {
+			char fileName[1024];
+			std::snprintf(fileName, sizeof(fileName), "%s%04d.png", dumpPrefix, frame);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, outputFramebuffer);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glReadPixels(0, 0, windowWidth, windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+			// A window ignores alpha, so the dump does too
+			for (int i = 3; i < pixels.size(); i += 4) {
+				pixels[i] = 255;
+			}
+			if (!writePngFile(fileName, windowWidth, windowHeight, &pixels[0])) {
+				std::cerr << "headless: could not write " << fileName << std::endl;
+				return 1;
+			}
+		}
+	}
+	checkGlErrors(__FILE__, __LINE__);
 
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 750, 750);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthBufferTexture, 0);
+	profiler.print(std::cout);
+	if (tracePath != NULL && !profiler.writeChromeTrace(tracePath)) {
+		std::cerr << "headless: could not write " << tracePath << std::endl;
+		return 1;
+	}
+	return 0;
+}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+void printUsage(const char* program) {
+	std::cout << "usage: " << program << " [--headless FRAMES] [--size WIDTHxHEIGHT] [--msaa SAMPLES]\n"
+		<< "       [--dynamic-resolution] [--occlusion] [--lod] [--terrain] [--heightmap IMAGE]\n"
+		<< "       [--multidraw]\n"
+		<< "       [--dump PREFIX] [--trace FILE.json]\n"
+		<< "  --headless renders FRAMES frames without a window and prints their timings;\n"
+		<< "  --dump writes each of them to PREFIX0000.png, PREFIX0001.png, ...\n";
 }
 
 int main(int argc, char** argv)
 {
+	int headlessFrames = 0, samples = 1;
+	const char* dumpPrefix = NULL;
+	const char* tracePath = NULL;
+	bool dynamicResolutionFlag = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--headless" && hasValue) {
+			headless = true;
+			headlessFrames = std::atoi(argv[++i]);
+		}
+		else if (arg == "--size" && hasValue && std::sscanf(argv[i + 1], "%dx%d", &windowWidth, &windowHeight) == 2) {
+			i++;
+		}
+		else if (arg == "--msaa" && hasValue) {
+			samples = std::atoi(argv[++i]);
+		}
+		else if (arg == "--dynamic-resolution") {
+			dynamicResolutionFlag = true;
+		}
+		else if (arg == "--occlusion") {
+			occlusionCulling = true;
+		}
+		else if (arg == "--lod") {
+			lodEnabled = true;
+		}
+		else if (arg == "--terrain") {
+			terrainEnabled = true;
+		}
+		else if (arg == "--heightmap" && hasValue) {
+			terrainEnabled = true;
+			heightmapPath = argv[++i];
+		}
+		else if (arg == "--multidraw") {
+			multiDrawEnabled = true;
+		}
+		else if (arg == "--dump" && hasValue) {
+			dumpPrefix = argv[++i];
+		}
+		else if (arg == "--trace" && hasValue) {
+			tracePath = argv[++i];
+		}
+		else if (arg.compare(0, 2, "--") != 0) {
+			// Leave anything else (e.g. -display) to glutInit
+			continue;
+		}
+		else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	windowWidth = std::max(windowWidth, 1);
+	windowHeight = std::max(windowHeight, 1);
+
+	if (headless) {
+		dynamicResolution.enabled = dynamicResolutionFlag;
+		return runHeadless(headlessFrames, samples, dumpPrefix, tracePath);
+	}
+
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-	glutInitWindowSize(750, 750);
+	glutInitWindowSize(windowWidth, windowHeight);
 	glutCreateWindow("CS-6533");
 
+#ifndef CS6533_NO_GLEW
 	glewInit();
+#endif
 
 	glutDisplayFunc(display);
 	glutReshapeFunc(reshape);
 	glutIdleFunc(idle);
+	glutKeyboardFunc(keyboard);
+	glutMouseFunc(mouse);
 
 	init();
+	sceneFramebuffer.setSamples(samples);
+	dynamicResolution.enabled = dynamicResolutionFlag;
 	glutMainLoop();
 	return 0;
 }
\ No newline at end of file
@@ -8,31 +8,32 @@
 
 // Forward declaration of Matrix4 and transpose since those are used below
 class Matrix4;
-Matrix4 transpose(const Matrix4& m);
+constexpr Matrix4 transpose(const Matrix4& m);
 
 // A 4x4 Matrix.
-// To get the element at ith row and jth column, use a(i,j)
+// To get the element at ith row and jth column, use a(i,j). Everything but
+// the angle-based rotations and the fovy projection is constexpr.
 class Matrix4 {
   double d_[16]; // layout is row-major
 
 public:
-  double &operator () (const int row, const int col) {
+  constexpr double &operator () (const int row, const int col) {
     return d_[(row << 2) + col];
   }
 
-  const double &operator () (const int row, const int col) const {
+  constexpr const double &operator () (const int row, const int col) const {
     return d_[(row << 2) + col];
   }
 
-  double& operator [] (const int i) {
+  constexpr double& operator [] (const int i) {
     return d_[i];
   }
 
-  const double& operator [] (const int i) const {
+  constexpr const double& operator [] (const int i) const {
     return d_[i];
   }
 
-  Matrix4() {
+  constexpr Matrix4() : d_() {
     for (int i = 0; i < 16; ++i) {
       d_[i] = 0;
     }
@@ -41,14 +42,14 @@ public:
     }
   }
 
-  Matrix4(const double a) {
+  constexpr Matrix4(const double a) : d_() {
     for (int i = 0; i < 16; ++i) {
       d_[i] = a;
     }
   }
 
   template <class T>
-  Matrix4& readFromColumnMajorMatrix(const T m[]) {
+  constexpr Matrix4& readFromColumnMajorMatrix(const T m[]) {
     for (int i = 0; i < 16; ++i) {
       d_[i] = m[i];
     }
@@ -56,51 +57,51 @@ public:
   }
 
   template <class T>
-  void writeToColumnMajorMatrix(T m[]) const {
+  constexpr void writeToColumnMajorMatrix(T m[]) const {
     Matrix4 t = transpose(*this);
     for (int i = 0; i < 16; ++i) {
       m[i] = T(t.d_[i]);
     }
   }
 
-  Matrix4& operator += (const Matrix4& m) {
+  constexpr Matrix4& operator += (const Matrix4& m) {
     for (int i = 0; i < 16; ++i) {
       d_[i] += m.d_[i];
     }
     return *this;
   }
 
-  Matrix4& operator -= (const Matrix4& m) {
+  constexpr Matrix4& operator -= (const Matrix4& m) {
     for (int i = 0; i < 16; ++i) {
       d_[i] -= m.d_[i];
     }
     return *this;
   }
 
-  Matrix4& operator *= (const double a) {
+  constexpr Matrix4& operator *= (const double a) {
     for (int i = 0; i < 16; ++i) {
       d_[i] *= a;
     }
     return *this;
   }
 
-  Matrix4& operator *= (const Matrix4& a) {
+  constexpr Matrix4& operator *= (const Matrix4& a) {
     return *this = *this * a;
   }
 
-  Matrix4 operator + (const Matrix4& a) const {
+  constexpr Matrix4 operator + (const Matrix4& a) const {
     return Matrix4(*this) += a;
   }
 
-  Matrix4 operator - (const Matrix4& a) const {
+  constexpr Matrix4 operator - (const Matrix4& a) const {
     return Matrix4(*this) -= a;
   }
 
-  Matrix4 operator * (const double a) const {
+  constexpr Matrix4 operator * (const double a) const {
     return Matrix4(*this) *= a;
   }
 
-  Cvec4 operator * (const Cvec4& v) const {
+  constexpr Cvec4 operator * (const Cvec4& v) const {
     Cvec4 r(0);
     for (int i = 0; i < 4; ++i) {
       for (int j = 0; j < 4; ++j) {
@@ -110,7 +111,7 @@ public:
     return r;
   }
 
-  Matrix4 operator * (const Matrix4& m) const {
+  constexpr Matrix4 operator * (const Matrix4& m) const {
     Matrix4 r(0);
     for (int i = 0; i < 4; ++i) {
       for (int j = 0; j < 4; ++j) {
@@ -135,7 +136,7 @@ public:
     return makeZRotation(std::cos(ang * CS175_PI/180), std::sin(ang * CS175_PI/180));
   }
 
-  static Matrix4 makeXRotation(const double c, const double s) {
+  static constexpr Matrix4 makeXRotation(const double c, const double s) {
     Matrix4 r;
     r(1,1) = r(2,2) = c;
     r(1,2) = -s;
@@ -143,7 +144,7 @@ public:
     return r;
   }
 
-  static Matrix4 makeYRotation(const double c, const double s) {
+  static constexpr Matrix4 makeYRotation(const double c, const double s) {
     Matrix4 r;
     r(0,0) = r(2,2) = c;
     r(0,2) = s;
@@ -151,7 +152,7 @@ public:
     return r;
   }
 
-  static Matrix4 makeZRotation(const double c, const double s) {
+  static constexpr Matrix4 makeZRotation(const double c, const double s) {
     Matrix4 r;
     r(0,0) = r(1,1) = c;
     r(0,1) = -s;
@@ -159,7 +160,7 @@ public:
     return r;
   }
 
-  static Matrix4 makeTranslation(const Cvec3& t) {
+  static constexpr Matrix4 makeTranslation(const Cvec3& t) {
     Matrix4 r;
     for (int i = 0; i < 3; ++i) {
       r(i,3) = t[i];
@@ -167,7 +168,7 @@ public:
     return r;
   }
 
-  static Matrix4 makeScale(const Cvec3& s) {
+  static constexpr Matrix4 makeScale(const Cvec3& s) {
     Matrix4 r;
     for (int i = 0; i < 3; ++i) {
       r(i,i) = s[i];
@@ -175,23 +176,23 @@ public:
     return r;
   }
 
-  static Matrix4 makeProjection(
+  static constexpr Matrix4 makeProjection(
     const double top, const double bottom,
     const double left, const double right,
     const double nearClip, const double farClip) {
     Matrix4 r(0);
     // 1st row
-    if (std::abs(right - left) > CS175_EPS) {
+    if (constexprAbs(right - left) > CS175_EPS) {
       r(0,0) = -2.0 * nearClip / (right - left);
       r(0,2) = (right+left) / (right - left);
     }
     // 2nd row
-    if (std::abs(top - bottom) > CS175_EPS) {
+    if (constexprAbs(top - bottom) > CS175_EPS) {
       r(1,1) = -2.0 * nearClip / (top - bottom);
       r(1,2) = (top + bottom) / (top - bottom);
     }
     // 3rd row
-    if (std::abs(farClip - nearClip) > CS175_EPS) {
+    if (constexprAbs(farClip - nearClip) > CS175_EPS) {
       r(2,2) = (farClip+nearClip) / (farClip - nearClip);
       r(2,3) = -2.0 * farClip * nearClip / (farClip - nearClip);
     }
@@ -232,11 +233,11 @@ public:
 
 };
 
-inline bool isAffine(const Matrix4& m) {
-  return std::abs(m[15]-1) + std::abs(m[14]) + std::abs(m[13]) + std::abs(m[12]) < CS175_EPS;
+inline constexpr bool isAffine(const Matrix4& m) {
+  return constexprAbs(m[15]-1) + constexprAbs(m[14]) + constexprAbs(m[13]) + constexprAbs(m[12]) < CS175_EPS;
 }
 
-inline double norm2(const Matrix4& m) {
+inline constexpr double norm2(const Matrix4& m) {
   double r = 0;
   for (int i = 0; i < 16; ++i) {
     r += m[i]*m[i];
@@ -245,7 +246,7 @@ inline double norm2(const Matrix4& m) {
 }
 
 // computes inverse of affine matrix. assumes last row is [0,0,0,1]
-inline Matrix4 inv(const Matrix4& m) {
+inline constexpr Matrix4 inv(const Matrix4& m) {
   Matrix4 r;                                              // default constructor initializes it to identity
   assert(isAffine(m));
   double det = m(0,0)*(m(1,1)*m(2,2) - m(1,2)*m(2,1)) +
@@ -253,7 +254,7 @@ inline Matrix4 inv(const Matrix4& m) {
                m(0,2)*(m(1,0)*m(2,1) - m(1,1)*m(2,0));
 
   // check non-singular matrix
-  assert(std::abs(det) > CS175_EPS3);
+  assert(constexprAbs(det) > CS175_EPS3);
 
   // "rotation part"
   r(0,0) =  (m(1,1) * m(2,2) - m(1,2) * m(2,1)) / det;
@@ -274,7 +275,7 @@ inline Matrix4 inv(const Matrix4& m) {
   return r;
 }
 
-inline Matrix4 transpose(const Matrix4& m) {
+inline constexpr Matrix4 transpose(const Matrix4& m) {
   Matrix4 r(0);
   for (int i = 0; i < 4; ++i) {
     for (int j = 0; j < 4; ++j) {
@@ -284,24 +285,22 @@ inline Matrix4 transpose(const Matrix4& m) {
   return r;
 }
 
-inline Matrix4 normalMatrix(const Matrix4& m) {
+inline constexpr Matrix4 normalMatrix(const Matrix4& m) {
   Matrix4 invm = inv(m);
   invm(0, 3) = invm(1, 3) = invm(2, 3) = 0;
   return transpose(invm);
 }
 
-inline Matrix4 transFact(const Matrix4& m) {
-	// ==========================================
-	// TODO: fill in your own implementation here
-	// ==========================================
+inline constexpr Matrix4 transFact(const Matrix4& m) {
+  // Translation part of an affine matrix
+  return Matrix4::makeTranslation(Cvec3(m(0, 3), m(1, 3), m(2, 3)));
 }
 
-inline Matrix4 linFact(const Matrix4& m) {
-	// ==========================================
-	// TODO: fill in your own implementation here
-	// ==========================================
-	
-	
+inline constexpr Matrix4 linFact(const Matrix4& m) {
+  // Linear part of an affine matrix
+  Matrix4 r = m;
+  r(0, 3) = r(1, 3) = r(2, 3) = 0;
+  return r;
 }
 
 #endif
@@ -0,0 +1,104 @@
+#include "multidraw.h"
+
+#include <algorithm>
+#include <cstddef>
+
+MultiDrawBatch::MultiDrawBatch()
+	: commandBuffer_(0), drawIndexBuffer_(0), objectBuffer_(0), objectTexture_(0), drawIndexCapacity_(0) {}
+
+bool MultiDrawBatch::supported() {
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	return major > 4 || (major == 4 && minor >= 3);
+}
+
+void MultiDrawBatch::init() {
+	glGenBuffers(1, &commandBuffer_);
+	glGenBuffers(1, &drawIndexBuffer_);
+	glGenBuffers(1, &objectBuffer_);
+	glGenTextures(1, &objectTexture_);
+}
+
+void MultiDrawBatch::begin() {
+	commands_.clear();
+	objects_.clear();
+}
+
+void MultiDrawBatch::add(const Entity& entity, const Matrix4& eyeInverse) {
+	const Geometry& geometry = entity.geometry;
+	const int lod = entity.lod;
+	DrawElementsIndirectCommand command;
+	command.count = geometry.lodIndexCount(lod);
+	command.instanceCount = 1;
+	command.firstIndex = geometry.firstIndex(lod);
+	command.baseVertex = geometry.baseVertex(lod);
+	command.baseInstance = (GLuint)commands_.size();
+	commands_.push_back(command);
+
+	objects_.push_back(ObjectUniforms());
+	entity.getObjectUniforms(eyeInverse, objects_.back());
+}
+
+void MultiDrawBatch::draw(GLuint positionAttribute, GLuint texCoordAttribute, GLuint normalAttribute, GLuint binormalAttribute, GLuint tangentAttribute,
+	GLuint drawIndexAttribute, int objectDataUnit) {
+	const int count = (int)commands_.size();
+	if (count == 0) {
+		return;
+	}
+
+	// Instance i of every draw reads element baseInstance of this; it only
+	// ever needs to grow
+	if (count > drawIndexCapacity_) {
+		drawIndexCapacity_ = std::max(count, drawIndexCapacity_ * 2);
+		std::vector<GLfloat> drawIndices(drawIndexCapacity_);
+		for (int i = 0; i < drawIndexCapacity_; i++) {
+			drawIndices[i] = (GLfloat)i;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer_);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * drawIndexCapacity_, &drawIndices[0], GL_STATIC_DRAW);
+	}
+
+	// Fresh storage each frame, so the previous frame's draws needn't finish first
+	glBindBuffer(GL_TEXTURE_BUFFER, objectBuffer_);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(ObjectUniforms) * count, &objects_[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0 + objectDataUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, objectTexture_);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, objectBuffer_);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer_);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * count, &commands_[0], GL_STREAM_DRAW);
+
+	const GeometryPool& pool = GeometryPool::shared();
+	glBindBuffer(GL_ARRAY_BUFFER, pool.vertices.buffer(GEOMETRY_VERTEX_DATA));
+	glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, p));
+	glEnableVertexAttribArray(positionAttribute);
+	glVertexAttribPointer(texCoordAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, t));
+	glEnableVertexAttribArray(texCoordAttribute);
+	glVertexAttribPointer(normalAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, n));
+	glEnableVertexAttribArray(normalAttribute);
+	glVertexAttribPointer(binormalAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, b));
+	glEnableVertexAttribArray(binormalAttribute);
+	glVertexAttribPointer(tangentAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, tg));
+	glEnableVertexAttribArray(tangentAttribute);
+
+	glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer_);
+	glVertexAttribPointer(drawIndexAttribute, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), 0);
+	glVertexAttribDivisor(drawIndexAttribute, 1);
+	glEnableVertexAttribArray(drawIndexAttribute);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indices.buffer());
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, 0, count, 0);
+
+	// The divisor belongs to the attribute index, which other programs reuse
+	glVertexAttribDivisor(drawIndexAttribute, 0);
+	glDisableVertexAttribArray(drawIndexAttribute);
+	glDisableVertexAttribArray(positionAttribute);
+	glDisableVertexAttribArray(texCoordAttribute);
+	glDisableVertexAttribArray(normalAttribute);
+	glDisableVertexAttribArray(binormalAttribute);
+	glDisableVertexAttribArray(tangentAttribute);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
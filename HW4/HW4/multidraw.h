@@ -0,0 +1,62 @@
+#ifndef MULTIDRAW_H
+#define MULTIDRAW_H
+
+#include <vector>
+
+#include "glsupport.h"
+#include "matrix4.h"
+#include "scene.h"
+
+//--------------------------------------------------------------------------------
+// Draws many entities with one glMultiDrawElementsIndirect. All geometry
+// lives in the buffers of GeometryPool::shared(), so every draw is just a
+// command with its mesh's offsets into those. Each command's baseInstance is
+// its position in the batch, which batchvertex.glsl reads through an
+// instanced attribute to find the entity's matrices in a texture buffer.
+// Needs OpenGL 4.3.
+//--------------------------------------------------------------------------------
+
+// As glMultiDrawElementsIndirect reads them
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+class MultiDrawBatch {
+	GLuint commandBuffer_, drawIndexBuffer_, objectBuffer_, objectTexture_;
+	int drawIndexCapacity_;
+	std::vector<DrawElementsIndirectCommand> commands_;
+	std::vector<ObjectUniforms> objects_;
+
+public:
+	MultiDrawBatch();
+
+	// Needs a current GL context
+	void init();
+
+	// True if the context can draw batches
+	static bool supported();
+
+	// Starts collecting a new set of draws
+	void begin();
+
+	// Adds entity at its current level of detail, with the world matrix from
+	// the last updateWorld()
+	void add(const Entity& entity, const Matrix4& eyeInverse);
+
+	int drawCount() const { return (int)commands_.size(); }
+
+	// Draws everything added since begin() with the current program, whose
+	// objectData sampler reads objectDataUnit
+	void draw(GLuint positionAttribute, GLuint texCoordAttribute, GLuint normalAttribute, GLuint binormalAttribute, GLuint tangentAttribute,
+		GLuint drawIndexAttribute, int objectDataUnit);
+
+private:
+	MultiDrawBatch(const MultiDrawBatch&);
+	MultiDrawBatch& operator = (const MultiDrawBatch&);
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include "objloader.h"
+
+#include <cassert>
+#include <iostream>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+void loadObjFile(const std::string &fileName, std::vector<VertexPNTBTG> &outVertices, std::vector<unsigned short> &outIndices) {
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string err;
+	bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), NULL, true);
+	if (ret) {
+		for (int i = 0; i < shapes.size(); i++) {
+			for (int j = 0; j < shapes[i].mesh.indices.size(); j++) {
+				unsigned int vertexOffest = shapes[i].mesh.indices[j].vertex_index * 3;
+				unsigned int normalOffest = shapes[i].mesh.indices[j].normal_index * 3;
+				unsigned int texOffset = shapes[i].mesh.indices[j].texcoord_index * 2;
+				VertexPNTBTG v;
+				v.p[0] = attrib.vertices[vertexOffest];
+				v.p[1] = attrib.vertices[vertexOffest + 1];
+				v.p[2] = attrib.vertices[vertexOffest + 2];
+				v.n[0] = attrib.normals[normalOffest];
+				v.n[1] = attrib.normals[normalOffest + 1];
+				v.n[2] = attrib.normals[normalOffest + 2];
+				v.t[0] = attrib.texcoords[texOffset];
+				v.t[1] = 1.0 - attrib.texcoords[texOffset + 1];
+				outVertices.push_back(v);
+				outIndices.push_back(outVertices.size() - 1);
+			}
+		}
+	}
+	else {
+		std::cout << err << std::endl;
+		assert(false);
+	}
+}
+
+void calculateFaceTangent(const Cvec3f &v1, const Cvec3f &v2, const Cvec3f &v3, const Cvec2f &texCoord1, const Cvec2f &texCoord2, const Cvec2f &texCoord3, Cvec3f &tangent, Cvec3f &binormal) {
+	Cvec3f side0 = v1 - v2;
+	Cvec3f side1 = v3 - v1;
+	Cvec3f normal = cross(side1, side0);
+	normalize(normal);
+	float deltaV0 = texCoord1[1] - texCoord2[1];
+	float deltaV1 = texCoord3[1] - texCoord1[1];
+	tangent = side0 * deltaV1 - side1 * deltaV0;
+	normalize(tangent);
+
+	float deltaU0 = texCoord1[0] - texCoord2[0];
+	float deltaU1 = texCoord3[0] - texCoord1[0];
+
+	binormal = side0 * deltaU1 - side1 * deltaU0;
+	normalize(binormal);
+	Cvec3f tangentCross = cross(tangent, binormal);
+
+	if (dot(tangentCross, normal) < 0.0f) {
+		tangent = tangent * -1;
+	}
+}
+
+void fillVertexBTG(std::vector<VertexPNTBTG> &outVertices) {
+	for (int i = 0; i < outVertices.size(); i += 3) {
+		Cvec3f tangent;
+		Cvec3f binormal;
+
+		calculateFaceTangent(outVertices[i].p, outVertices[i + 1].p, outVertices[i + 2].p, outVertices[i].t, outVertices[i + 1].t, outVertices[i + 2].t, tangent, binormal);
+
+		outVertices[i].tg = tangent;
+		outVertices[i + 1].tg = tangent;
+		outVertices[i + 2].tg = tangent;
+
+		outVertices[i].b = binormal;
+		outVertices[i + 1].b = binormal;
+		outVertices[i + 2].b = binormal;
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include <string>
+#include <vector>
+
+#include "cvec.h"
+#include "scene.h"
+
+// Loads every shape of an OBJ file as an unindexed triangle list (one vertex
+// per face corner). Asserts if the file can't be read.
+void loadObjFile(const std::string &fileName, std::vector<VertexPNTBTG> &outVertices, std::vector<unsigned short> &outIndices);
+
+// Tangent and binormal of one triangle from its texture coordinates
+void calculateFaceTangent(const Cvec3f &v1, const Cvec3f &v2, const Cvec3f &v3, const Cvec2f &texCoord1, const Cvec2f &texCoord2, const Cvec2f &texCoord3, Cvec3f &tangent, Cvec3f &binormal);
+
+// Fills in tg and b of a triangle list from loadObjFile, per face
+void fillVertexBTG(std::vector<VertexPNTBTG> &outVertices);
+
+#endif
@@ -0,0 +1,187 @@
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+void DepthPyramid::build(const float* depth, int width, int height, const Matrix4& clipFromWorld) {
+	clipFromWorld_ = clipFromWorld;
+	levels_.resize(1);
+	widths_.assign(1, width);
+	heights_.assign(1, height);
+	levels_[0].assign(depth, depth + width * height);
+
+	// Each level halves the one below, rounding up, and keeps the smallest
+	// (farthest) of the up to 2x2 texels it covers
+	while (width > 1 || height > 1) {
+		const int nextWidth = (width + 1) / 2, nextHeight = (height + 1) / 2;
+		levels_.push_back(std::vector<float>(nextWidth * nextHeight));
+		const std::vector<float>& below = levels_[levels_.size() - 2];
+		std::vector<float>& next = levels_.back();
+		for (int y = 0; y < nextHeight; y++) {
+			const float* row0 = &below[2 * y * width];
+			const float* row1 = &below[std::min(2 * y + 1, height - 1) * width];
+			for (int x = 0; x < nextWidth; x++) {
+				const int x0 = 2 * x, x1 = std::min(2 * x + 1, width - 1);
+				next[y * nextWidth + x] = std::min(std::min(row0[x0], row0[x1]), std::min(row1[x0], row1[x1]));
+			}
+		}
+		width = nextWidth;
+		height = nextHeight;
+		widths_.push_back(width);
+		heights_.push_back(height);
+	}
+}
+
+void DepthPyramid::clear() {
+	levels_.clear();
+	widths_.clear();
+	heights_.clear();
+}
+
+bool DepthPyramid::isOccluded(const Cvec3& boxMin, const Cvec3& boxMax) const {
+	if (empty()) {
+		return false;
+	}
+	// Screen rectangle and nearest depth of the box's corners
+	double xMin = 1e30, yMin = 1e30, xMax = -1e30, yMax = -1e30, nearest = -1e30;
+	for (int i = 0; i < 8; i++) {
+		const Cvec4 corner((i & 1) ? boxMax[0] : boxMin[0], (i & 2) ? boxMax[1] : boxMin[1], (i & 4) ? boxMax[2] : boxMin[2], 1.0);
+		const Cvec4 clip = clipFromWorld_ * corner;
+		if (clip[3] <= CS175_EPS) {
+			return false;
+		}
+		const double x = clip[0] / clip[3], y = clip[1] / clip[3];
+		xMin = std::min(xMin, x);
+		xMax = std::max(xMax, x);
+		yMin = std::min(yMin, y);
+		yMax = std::max(yMax, y);
+		nearest = std::max(nearest, clip[2] / clip[3] * 0.5 + 0.5);
+	}
+	// Whatever is off screen is hidden anyway; boxes wholly off it are left to
+	// frustum culling
+	if (xMax < -1.0 || yMax < -1.0 || xMin > 1.0 || yMin > 1.0) {
+		return false;
+	}
+	xMin = std::max(xMin, -1.0);
+	yMin = std::max(yMin, -1.0);
+	xMax = std::min(xMax, 1.0);
+	yMax = std::min(yMax, 1.0);
+
+	const int width = widths_[0], height = heights_[0];
+	const int x0 = std::min((int)((xMin * 0.5 + 0.5) * width), width - 1);
+	const int x1 = std::min((int)((xMax * 0.5 + 0.5) * width), width - 1);
+	const int y0 = std::min((int)((yMin * 0.5 + 0.5) * height), height - 1);
+	const int y1 = std::min((int)((yMax * 0.5 + 0.5) * height), height - 1);
+
+	// The level whose texels are at least as wide as the rectangle, so it
+	// spans two of them at most each way
+	const int size = std::max(x1 - x0, y1 - y0) + 1;
+	int level = 0;
+	while ((1 << level) < size && level + 1 < levelCount()) {
+		level++;
+	}
+	const int levelWidth = widths_[level];
+	const float* texels = &levels_[level][0];
+	float farthest = 1.0f;
+	for (int y = y0 >> level; y <= (y1 >> level); y++) {
+		for (int x = x0 >> level; x <= (x1 >> level); x++) {
+			farthest = std::min(farthest, texels[y * levelWidth + x]);
+		}
+	}
+	return nearest < farthest;
+}
+
+OcclusionCuller::OcclusionCuller() : nextReadback_(0), tested_(0), occluded_(0) {
+	for (Readback& readback : readbacks_) {
+		readback.buffer = 0;
+		readback.fence = NULL;
+		readback.width = readback.height = 0;
+	}
+}
+
+void OcclusionCuller::init() {
+	for (Readback& readback : readbacks_) {
+		glGenBuffers(1, &readback.buffer);
+	}
+}
+
+void OcclusionCuller::capture(const SceneFramebuffer& scene, const Matrix4& clipFromWorld) {
+	// Overwrites the oldest capture, which a newer one supersedes anyway
+	Readback& readback = readbacks_[nextReadback_];
+	nextReadback_ = (nextReadback_ + 1) % OCCLUSION_READBACK_BUFFERS;
+	if (readback.fence != NULL) {
+		glDeleteSync(readback.fence);
+	}
+	readback.width = scene.renderWidth;
+	readback.height = scene.renderHeight;
+	readback.clipFromWorld = clipFromWorld;
+
+	// Resolved depth is in frameBuffer whether or not the scene was multisampled
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, readback.width * readback.height * sizeof(float), NULL, GL_STREAM_READ);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, scene.frameBuffer);
+	glReadPixels(0, 0, readback.width, readback.height, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void OcclusionCuller::update() {
+	tested_ = 0;
+	occluded_ = 0;
+
+	// Newest first; a zero timeout only asks, and the flush makes sure the
+	// fence is on its way so a later ask can succeed
+	int newestAge = 1;
+	for (; newestAge <= OCCLUSION_READBACK_BUFFERS; newestAge++) {
+		const Readback& readback = readbackAged(newestAge);
+		if (readback.fence == NULL) {
+			continue;
+		}
+		const GLenum status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+			break;
+		}
+	}
+	if (newestAge > OCCLUSION_READBACK_BUFFERS) {
+		return;
+	}
+	const Readback* newest = &readbackAged(newestAge);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, newest->buffer);
+	const float* depth = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, newest->width * newest->height * sizeof(float), GL_MAP_READ_BIT);
+	if (depth != NULL) {
+		pyramid_.build(depth, newest->width, newest->height, newest->clipFromWorld);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else {
+		pyramid_.clear();
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// It and anything older are used up
+	for (int age = newestAge; age <= OCCLUSION_READBACK_BUFFERS; age++) {
+		Readback& readback = readbackAged(age);
+		if (readback.fence != NULL) {
+			glDeleteSync(readback.fence);
+			readback.fence = NULL;
+		}
+	}
+}
+
+void OcclusionCuller::invalidate() {
+	for (Readback& readback : readbacks_) {
+		if (readback.fence != NULL) {
+			glDeleteSync(readback.fence);
+			readback.fence = NULL;
+		}
+	}
+	pyramid_.clear();
+}
+
+bool OcclusionCuller::isOccluded(const Cvec3& boxMin, const Cvec3& boxMax) {
+	tested_++;
+	const bool occluded = pyramid_.isOccluded(boxMin, boxMax);
+	occluded_ += occluded;
+	return occluded;
+}
@@ -0,0 +1,92 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <vector>
+
+#include "glsupport.h"
+#include "cvec.h"
+#include "matrix4.h"
+#include "framebuffer.h"
+
+//--------------------------------------------------------------------------------
+// Hi-Z occlusion culling. The depth of the previous frame is read back and
+// reduced into a mip pyramid whose every texel holds the farthest depth under
+// it; a box is occluded when its nearest point is farther than that over the
+// whole screen rectangle it covers, which one to four texels of the right
+// level answer.
+//
+// Depth follows HW4: cleared to 0 and tested GL_GREATER, so nearer is larger.
+// Since the depth is a frame old or more, something that just came out from
+// behind an occluder can be missing until a newer capture is read.
+//--------------------------------------------------------------------------------
+
+// The pyramid alone, with no GL, built from window depth values
+class DepthPyramid {
+	std::vector<std::vector<float> > levels_;
+	std::vector<int> widths_, heights_;
+	Matrix4 clipFromWorld_;
+
+public:
+	// depth holds width x height values, bottom row first as glReadPixels
+	// returns them, rendered with clipFromWorld
+	void build(const float* depth, int width, int height, const Matrix4& clipFromWorld);
+	void clear();
+
+	bool empty() const { return levels_.empty(); }
+	int levelCount() const { return (int)levels_.size(); }
+	int levelWidth(int level) const { return widths_[level]; }
+	int levelHeight(int level) const { return heights_[level]; }
+	const float* level(int level) const { return &levels_[level][0]; }
+
+	// True only when the world box is certainly hidden behind the depth.
+	// Boxes reaching behind the camera or wholly off screen never are.
+	bool isOccluded(const Cvec3& boxMin, const Cvec3& boxMax) const;
+};
+
+// Reads the scene depth back through a ring of pixel buffers, each fenced, and
+// builds the pyramid from the newest whose read has finished, so the CPU
+// never waits on the GPU. Until one has, the previous pyramid stays in use.
+static const int OCCLUSION_READBACK_BUFFERS = 3;
+
+class OcclusionCuller {
+	struct Readback {
+		GLuint buffer;
+		GLsync fence; // NULL when there is nothing to read
+		int width, height;
+		Matrix4 clipFromWorld;
+	};
+	Readback readbacks_[OCCLUSION_READBACK_BUFFERS];
+	int nextReadback_;
+	DepthPyramid pyramid_;
+	int tested_, occluded_;
+
+	// 1 for the last capture, 2 for the one before it, and so on
+	Readback& readbackAged(int age) {
+		return readbacks_[(nextReadback_ + OCCLUSION_READBACK_BUFFERS - age) % OCCLUSION_READBACK_BUFFERS];
+	}
+
+public:
+	OcclusionCuller();
+
+	// Needs a current GL context
+	void init();
+
+	// Call once scene's depth texture holds the frame drawn with clipFromWorld
+	void capture(const SceneFramebuffer& scene, const Matrix4& clipFromWorld);
+
+	// Builds the pyramid from the newest finished capture, before culling a
+	// new frame
+	void update();
+
+	// Forgets the captured depth, e.g. after a camera cut
+	void invalidate();
+
+	bool isOccluded(const Cvec3& boxMin, const Cvec3& boxMax);
+	const DepthPyramid& pyramid() const { return pyramid_; }
+
+	// Since the last update()
+	int testedCount() const { return tested_; }
+	int occludedCount() const { return occluded_; }
+};
+
+#endif
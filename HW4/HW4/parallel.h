@@ -0,0 +1,150 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------------------------
+// A small pool of worker threads. parallelFor splits an index range into
+// chunks that the workers and the calling thread take in turn; submit queues
+// a job to run in the background. ThreadPool::shared() is sized to the
+// machine and is what the bulk kernels use.
+//--------------------------------------------------------------------------------
+
+class ThreadPool {
+	std::vector<std::thread> workers_;
+	std::deque<std::function<void()> > jobs_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	bool stopping_;
+
+	void workerLoop() {
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+				if (jobs_.empty()) {
+					return;
+				}
+				job = std::move(jobs_.front());
+				jobs_.pop_front();
+			}
+			job();
+		}
+	}
+
+	// The chunks of one parallelFor; shared with the queued helpers, which may
+	// only get to run after the loop has finished
+	struct Loop {
+		std::atomic<int> nextChunk, chunksDone;
+		int chunkCount, count, grain;
+		std::function<void(int, int)> body;
+		std::mutex mutex;
+		std::condition_variable finished;
+
+		// Runs chunks until none are left
+		void work() {
+			int chunk;
+			while ((chunk = nextChunk.fetch_add(1)) < chunkCount) {
+				const int begin = chunk * grain;
+				body(begin, std::min(begin + grain, count));
+				if (chunksDone.fetch_add(1) + 1 == chunkCount) {
+					std::lock_guard<std::mutex> lock(mutex);
+					finished.notify_all();
+				}
+			}
+		}
+	};
+
+public:
+	// threads counts the calling thread, so ThreadPool(1) has no workers and
+	// runs everything inline. 0 uses every hardware thread.
+	explicit ThreadPool(int threads = 0) : stopping_(false) {
+		if (threads <= 0) {
+			threads = std::max((int)std::thread::hardware_concurrency(), 1);
+		}
+		for (int i = 1; i < threads; i++) {
+			workers_.push_back(std::thread(&ThreadPool::workerLoop, this));
+		}
+	}
+
+	// Finishes the queued jobs first
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		wake_.notify_all();
+		for (int i = 0; i < workers_.size(); i++) {
+			workers_[i].join();
+		}
+	}
+
+	int threadCount() const { return (int)workers_.size() + 1; }
+
+	// Runs job on a worker, or right away when there are none
+	void submit(std::function<void()> job) {
+		if (workers_.empty()) {
+			job();
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			jobs_.push_back(std::move(job));
+		}
+		wake_.notify_one();
+	}
+
+	// Calls body(begin, end) over [0, count) in chunks of grain indices and
+	// returns when all of them are done. Chunks run concurrently, so body must
+	// only write what its own range owns. Safe to call from inside a job: the
+	// caller works through the chunks itself rather than waiting on workers.
+	void parallelFor(int count, int grain, const std::function<void(int, int)>& body) {
+		grain = std::max(grain, 1);
+		if (count <= 0) {
+			return;
+		}
+		const int chunkCount = (count + grain - 1) / grain;
+		if (chunkCount == 1 || workers_.empty()) {
+			body(0, count);
+			return;
+		}
+		std::shared_ptr<Loop> loop(new Loop());
+		loop->nextChunk = 0;
+		loop->chunksDone = 0;
+		loop->chunkCount = chunkCount;
+		loop->count = count;
+		loop->grain = grain;
+		loop->body = body;
+		const int helpers = std::min((int)workers_.size(), chunkCount - 1);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			for (int i = 0; i < helpers; i++) {
+				jobs_.push_back([loop] { loop->work(); });
+			}
+		}
+		wake_.notify_all();
+		loop->work();
+		std::unique_lock<std::mutex> lock(loop->mutex);
+		loop->finished.wait(lock, [&loop] { return loop->chunksDone == loop->chunkCount; });
+	}
+
+	static ThreadPool& shared() {
+		static ThreadPool pool;
+		return pool;
+	}
+
+private:
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator = (const ThreadPool&);
+};
+
+#endif
@@ -0,0 +1,357 @@
+#include "postprocess.h"
+
+#include <cassert>
+
+static GLfloat screenTriangleUVs[] = {
+	1.0f, 1.0f,
+	1.0f, 0.0f,
+	0.0f, 0.0f,
+
+	0.0f, 0.0f,
+	0.0f, 1.0f,
+	1.0f, 1.0f
+};
+
+static GLfloat screenTrianglePositions[] = {
+	1.0f, 1.0f,
+	1.0f, -1.0f,
+	-1.0f, -1.0f,
+
+	-1.0f, -1.0f,
+	-1.0f, 1.0f,
+	1.0f, 1.0f
+};
+
+//RENDER TARGET POOL
+RenderTarget* RenderTargetPool::acquire(int width, int height, GLenum internalFormat) {
+	for (std::list<Slot>::iterator it = slots_.begin(); it != slots_.end(); ++it) {
+		if (!it->inUse && it->target.width == width && it->target.height == height && it->target.internalFormat == internalFormat) {
+			it->inUse = true;
+			return &it->target;
+		}
+	}
+
+	Slot slot;
+	slot.inUse = true;
+	slot.target.width = width;
+	slot.target.height = height;
+	slot.target.internalFormat = internalFormat;
+
+	glGenTextures(1, &slot.target.texture);
+	glBindTexture(GL_TEXTURE_2D, slot.target.texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenFramebuffers(1, &slot.target.frameBuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, slot.target.frameBuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, slot.target.texture, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		throw std::runtime_error("post-process render target is incomplete");
+
+	slots_.push_back(slot);
+	return &slots_.back().target;
+}
+
+void RenderTargetPool::release(RenderTarget* target) {
+	for (std::list<Slot>::iterator it = slots_.begin(); it != slots_.end(); ++it) {
+		if (&it->target == target) {
+			it->inUse = false;
+			return;
+		}
+	}
+	assert(false);
+}
+
+void RenderTargetPool::trim() {
+	for (std::list<Slot>::iterator it = slots_.begin(); it != slots_.end();) {
+		if (it->inUse) {
+			++it;
+			continue;
+		}
+		glDeleteFramebuffers(1, &it->target.frameBuffer);
+		glDeleteTextures(1, &it->target.texture);
+		it = slots_.erase(it);
+	}
+}
+
+//POST PROCESS CHAIN
+void PostProcessChain::init(const char* vertexShaderFile, const char* copyFragmentShaderFile) {
+	vertexShaderFile_ = vertexShaderFile;
+	copyFragmentShaderFile_ = copyFragmentShaderFile;
+
+	glGenBuffers(1, &positionBuffer_);
+	glBindBuffer(GL_ARRAY_BUFFER, positionBuffer_);
+	glBufferData(GL_ARRAY_BUFFER, 12 * sizeof(GLfloat), screenTrianglePositions, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &texCoordBuffer_);
+	glBindBuffer(GL_ARRAY_BUFFER, texCoordBuffer_);
+	glBufferData(GL_ARRAY_BUFFER, 12 * sizeof(GLfloat), screenTriangleUVs, GL_STATIC_DRAW);
+
+	dirty_ = true;
+}
+
+int PostProcessChain::addPass(const std::string& name, const std::string& fileName, PostProcessPassKind kind, bool outputsLdr) {
+	assert(findPass(name) < 0);
+	PostProcessPass pass;
+	pass.name = name;
+	pass.fileName = fileName;
+	pass.kind = kind;
+	pass.enabled = true;
+	pass.outputsLdr = outputsLdr;
+	passes_.push_back(pass);
+	dirty_ = true;
+	return (int)passes_.size() - 1;
+}
+
+void PostProcessChain::setParameter(const std::string& passName, const std::string& uniformName, float value) {
+	int index = findPass(passName);
+	assert(index >= 0);
+	std::vector<std::pair<std::string, float> >& parameters = passes_[index].parameters;
+	for (int i = 0; i < parameters.size(); i++) {
+		if (parameters[i].first == uniformName) {
+			parameters[i].second = value;
+			return;
+		}
+	}
+	parameters.push_back(std::make_pair(uniformName, value));
+	dirty_ = true;
+}
+
+void PostProcessChain::setEnabled(const std::string& passName, bool enabled) {
+	int index = findPass(passName);
+	assert(index >= 0);
+	if (passes_[index].enabled != enabled) {
+		passes_[index].enabled = enabled;
+		dirty_ = true;
+	}
+}
+
+bool PostProcessChain::isEnabled(const std::string& passName) const {
+	int index = findPass(passName);
+	return index >= 0 && passes_[index].enabled;
+}
+
+int PostProcessChain::findPass(const std::string& name) const {
+	for (int i = 0; i < passes_.size(); i++) {
+		if (passes_[i].name == name) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+void PostProcessChain::clearStages() {
+	for (int i = 0; i < stages_.size(); i++) {
+		glDeleteProgram(stages_[i].program);
+		stages_[i].timer.destroy();
+	}
+	stages_.clear();
+}
+
+// Groups the enabled passes into stages. A neighborhood pass reads texels other
+// than its own, so it has to start a new full-screen draw; a pointwise pass can
+// always be folded into the stage before it.
+void PostProcessChain::rebuild() {
+	clearStages();
+
+	for (int i = 0; i < passes_.size(); i++) {
+		if (!passes_[i].enabled) {
+			continue;
+		}
+		bool startsStage = stages_.empty() || (passes_[i].kind == POSTPROCESS_NEIGHBORHOOD && !stages_.back().passes.empty());
+		if (startsStage) {
+			PostProcessStage stage;
+			stage.outputsLdr = !stages_.empty() && stages_.back().outputsLdr;
+			stages_.push_back(stage);
+		}
+		PostProcessStage& stage = stages_.back();
+		stage.name += (stage.passes.empty() ? "" : "+") + passes_[i].name;
+		stage.passes.push_back(i);
+		stage.outputsLdr = stage.outputsLdr || passes_[i].outputsLdr;
+	}
+
+	// With nothing enabled the chain is a plain copy to the screen
+	if (stages_.empty()) {
+		PostProcessStage copy;
+		copy.name = "copy";
+		copy.outputsLdr = false;
+		stages_.push_back(copy);
+	}
+
+	for (int i = 0; i < stages_.size(); i++) {
+		compileStage(stages_[i]);
+	}
+	dirty_ = false;
+}
+
+void PostProcessChain::compileStage(PostProcessStage& stage) {
+	std::string source;
+	if (stage.passes.empty()) {
+		source = readTextFileToString(copyFragmentShaderFile_.c_str());
+	}
+	else {
+		source =
+			"uniform sampler2D screenFramebuffer;\n"
+			"uniform vec2 texelSize;\n"
+			"uniform vec2 uvMax;\n"
+			"varying vec2 texCoordVar;\n"
+			// Only the rendered corner of the texture holds this frame; clamp to
+			// edge alone would read stale texels past it
+			"vec4 screenTap(vec2 uv) {\n"
+			"\treturn texture2D(screenFramebuffer, min(uv, uvMax));\n"
+			"}\n";
+		for (int i = 0; i < stage.passes.size(); i++) {
+			source += readTextFileToString(passes_[stage.passes[i]].fileName.c_str()) + "\n";
+		}
+
+		source += "void main() {\n";
+		const PostProcessPass& first = passes_[stage.passes[0]];
+		if (first.kind == POSTPROCESS_NEIGHBORHOOD) {
+			source += "\tvec4 color = " + first.name + "(texCoordVar);\n";
+		}
+		else {
+			source += "\tvec4 color = texture2D(screenFramebuffer, texCoordVar);\n";
+		}
+		for (int i = 0; i < stage.passes.size(); i++) {
+			const PostProcessPass& pass = passes_[stage.passes[i]];
+			if (pass.kind == POSTPROCESS_POINTWISE) {
+				source += "\tcolor.rgb = " + pass.name + "(color.rgb);\n";
+			}
+		}
+		source += "\tgl_FragColor = color;\n}\n";
+	}
+
+	GlShader vs(GL_VERTEX_SHADER);
+	GlShader fs(GL_FRAGMENT_SHADER);
+	readAndCompileSingleShader(vs, vertexShaderFile_.c_str());
+	compileSingleShaderSource(fs, source, stage.name.c_str());
+
+	stage.program = glCreateProgram();
+	linkShader(stage.program, vs, fs);
+
+	stage.screenFramebufferLoc = glGetUniformLocation(stage.program, "screenFramebuffer");
+	stage.texelSizeLoc = glGetUniformLocation(stage.program, "texelSize");
+	stage.uvScaleLoc = glGetUniformLocation(stage.program, "uvScale");
+	stage.uvMaxLoc = glGetUniformLocation(stage.program, "uvMax");
+	stage.positionAttribute = glGetAttribLocation(stage.program, "position");
+	stage.texCoordAttribute = glGetAttribLocation(stage.program, "texCoord");
+
+	stage.parameterLocs.clear();
+	for (int i = 0; i < stage.passes.size(); i++) {
+		const PostProcessPass& pass = passes_[stage.passes[i]];
+		for (int j = 0; j < pass.parameters.size(); j++) {
+			GLint loc = safe_glGetUniformLocation(stage.program, pass.parameters[j].first.c_str());
+			stage.parameterLocs.push_back(std::make_pair(loc, std::make_pair(stage.passes[i], j)));
+		}
+	}
+
+	stage.timer.init();
+	checkGlErrors(__FILE__, __LINE__);
+}
+
+void PostProcessChain::drawStage(PostProcessStage& stage, GLuint inputTexture, int textureWidth, int textureHeight, int renderWidth, int renderHeight) {
+	glUseProgram(stage.program);
+
+	safe_glUniform1i(stage.screenFramebufferLoc, 3);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, inputTexture);
+
+	safe_glUniform2f(stage.texelSizeLoc, 1.0f / textureWidth, 1.0f / textureHeight);
+	safe_glUniform2f(stage.uvScaleLoc, (float)renderWidth / textureWidth, (float)renderHeight / textureHeight);
+	// Centre of the last rendered texel
+	safe_glUniform2f(stage.uvMaxLoc, (renderWidth - 0.5f) / textureWidth, (renderHeight - 0.5f) / textureHeight);
+	for (int i = 0; i < stage.parameterLocs.size(); i++) {
+		const std::pair<int, int>& source = stage.parameterLocs[i].second;
+		safe_glUniform1f(stage.parameterLocs[i].first, passes_[source.first].parameters[source.second].second);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, positionBuffer_);
+	safe_glVertexAttribPointer(stage.positionAttribute, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	safe_glEnableVertexAttribArray(stage.positionAttribute);
+
+	glBindBuffer(GL_ARRAY_BUFFER, texCoordBuffer_);
+	safe_glVertexAttribPointer(stage.texCoordAttribute, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	safe_glEnableVertexAttribArray(stage.texCoordAttribute);
+
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+
+	safe_glDisableVertexAttribArray(stage.positionAttribute);
+	safe_glDisableVertexAttribArray(stage.texCoordAttribute);
+}
+
+void PostProcessChain::render(GLuint sourceTexture, int textureWidth, int textureHeight, int renderWidth, int renderHeight,
+	int screenWidth, int screenHeight, GLuint screenFramebuffer) {
+	if (dirty_) {
+		rebuild();
+	}
+	// Targets of the old size are never handed out again after a resize
+	if (textureWidth != targetWidth_ || textureHeight != targetHeight_) {
+		pool_.trim();
+		targetWidth_ = textureWidth;
+		targetHeight_ = textureHeight;
+	}
+
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_BLEND);
+
+	RenderTarget* input = nullptr;
+	GLuint inputTexture = sourceTexture;
+
+	for (int i = 0; i < stages_.size(); i++) {
+		PostProcessStage& stage = stages_[i];
+		const bool last = i + 1 == stages_.size();
+
+		RenderTarget* output = nullptr;
+		if (last) {
+			glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+			glViewport(0, 0, screenWidth, screenHeight);
+		}
+		else {
+			output = pool_.acquire(textureWidth, textureHeight, stage.outputsLdr ? GL_RGBA8 : GL_RGBA16F);
+			glBindFramebuffer(GL_FRAMEBUFFER, output->frameBuffer);
+			glViewport(0, 0, renderWidth, renderHeight);
+		}
+
+		stage.timer.begin();
+		drawStage(stage, inputTexture, textureWidth, textureHeight, renderWidth, renderHeight);
+		stage.timer.end();
+
+		if (input != nullptr) {
+			pool_.release(input);
+		}
+		input = output;
+		inputTexture = output != nullptr ? output->texture : 0;
+	}
+
+	if (depthTest) glEnable(GL_DEPTH_TEST);
+	if (cullFace) glEnable(GL_CULL_FACE);
+	if (blend) glEnable(GL_BLEND);
+}
+
+double PostProcessChain::lastGpuMs() const {
+	double total = 0.0;
+	for (int i = 0; i < stages_.size(); i++) {
+		total += stages_[i].timer.lastMs();
+	}
+	return total;
+}
+
+void PostProcessChain::printTimings(std::ostream& out) const {
+	out << "post-process: " << passes_.size() << " passes in " << stages_.size() << " full-screen draws, " << pool_.size() << " pooled targets\n";
+	for (int i = 0; i < stages_.size(); i++) {
+		out << "  " << stages_[i].name << ": ";
+		if (stages_[i].timer.supported()) {
+			out << stages_[i].timer.lastMs() << " ms GPU\n";
+		}
+		else {
+			out << "(timer queries unsupported)\n";
+		}
+	}
+}
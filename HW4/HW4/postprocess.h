@@ -0,0 +1,133 @@
+#ifndef POSTPROCESS_H
+#define POSTPROCESS_H
+
+#include <iostream>
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glsupport.h"
+#include "gputimer.h"
+
+//--------------------------------------------------------------------------------
+// Post-processing chain: full-screen passes run on the offscreen scene texture.
+// Consecutive passes are merged into one shader where that is legal, and the
+// remaining full-screen draws ping-pong between pooled render targets.
+//--------------------------------------------------------------------------------
+
+// An offscreen color target: a framebuffer object with one texture attached
+struct RenderTarget {
+	GLuint frameBuffer;
+	GLuint texture;
+	int width, height;
+	GLenum internalFormat;
+};
+
+// Hands out render targets and takes them back once a pass is done reading
+// them, so a chain of any length only owns as many textures as it has live
+// intermediates (two when ping-ponging).
+class RenderTargetPool {
+	struct Slot {
+		RenderTarget target;
+		bool inUse;
+	};
+	std::list<Slot> slots_;
+
+public:
+	RenderTarget* acquire(int width, int height, GLenum internalFormat);
+	void release(RenderTarget* target);
+
+	// Deletes every target that is not currently acquired
+	void trim();
+
+	int size() const { return (int)slots_.size(); }
+};
+
+enum PostProcessPassKind {
+	// Output pixel depends only on the input pixel under it (tone mapping,
+	// color grading). The pass file defines vec3 <name>(vec3 color).
+	POSTPROCESS_POINTWISE,
+	// Samples around the pixel (FXAA, bloom). The pass file defines
+	// vec4 <name>(vec2 uv) and reads through screenTap(uv), which keeps taps
+	// inside the rendered region, with texelSize apart, so it has to see the
+	// finished output of every pass before it.
+	POSTPROCESS_NEIGHBORHOOD
+};
+
+struct PostProcessPass {
+	std::string name;
+	std::string fileName;
+	PostProcessPassKind kind;
+	bool enabled;
+	bool outputsLdr; // color is in [0, 1] after this pass (tone mappers)
+	std::vector<std::pair<std::string, float> > parameters;
+};
+
+// One full-screen draw. Holds at most one neighborhood pass, which must come
+// first, followed by any number of pointwise passes fused into its shader.
+struct PostProcessStage {
+	std::string name;
+	std::vector<int> passes;
+	bool outputsLdr;
+
+	GLuint program;
+	GLint screenFramebufferLoc, texelSizeLoc, uvScaleLoc, uvMaxLoc;
+	GLint positionAttribute, texCoordAttribute;
+	std::vector<std::pair<GLint, std::pair<int, int> > > parameterLocs; // location, (pass, parameter)
+
+	GpuTimer timer;
+};
+
+class PostProcessChain {
+	std::vector<PostProcessPass> passes_;
+	std::vector<PostProcessStage> stages_;
+	RenderTargetPool pool_;
+	bool dirty_;
+
+	std::string vertexShaderFile_, copyFragmentShaderFile_;
+	GLuint positionBuffer_, texCoordBuffer_;
+	int targetWidth_, targetHeight_;
+
+	void rebuild();
+	void clearStages();
+	void compileStage(PostProcessStage& stage);
+	void drawStage(PostProcessStage& stage, GLuint inputTexture, int textureWidth, int textureHeight, int renderWidth, int renderHeight);
+	int findPass(const std::string& name) const;
+
+public:
+	PostProcessChain() : dirty_(true), positionBuffer_(0), texCoordBuffer_(0), targetWidth_(0), targetHeight_(0) {}
+
+	// Needs a current GL context. The vertex shader is the screen-triangle one;
+	// the copy shader is used when no pass is enabled.
+	void init(const char* vertexShaderFile, const char* copyFragmentShaderFile);
+
+	// Passes run in the order they are added. Returns the pass index.
+	int addPass(const std::string& name, const std::string& fileName, PostProcessPassKind kind, bool outputsLdr = false);
+
+	// Sets a float uniform declared by the pass file
+	void setParameter(const std::string& passName, const std::string& uniformName, float value);
+
+	void setEnabled(const std::string& passName, bool enabled);
+	bool isEnabled(const std::string& passName) const;
+
+	// Runs every enabled pass on sourceTexture and writes the result to a
+	// screenWidth x screenHeight viewport of screenFramebuffer (the window by
+	// default). Only the lower-left renderWidth x renderHeight corner of the
+	// textureWidth x textureHeight source holds the image; intermediates are
+	// rendered at that size and the last pass upscales it to the screen.
+	void render(GLuint sourceTexture, int textureWidth, int textureHeight, int renderWidth, int renderHeight,
+		int screenWidth, int screenHeight, GLuint screenFramebuffer = 0);
+
+	int stageCount() const { return (int)stages_.size(); }
+	int passCount() const { return (int)passes_.size(); }
+	const PostProcessPass& pass(int i) const { return passes_[i]; }
+
+	// Sum of the last measured GPU times of all stages
+	double lastGpuMs() const;
+
+	// Prints the full-screen draws actually issued and their last GPU time
+	void printTimings(std::ostream& out) const;
+};
+
+#endif
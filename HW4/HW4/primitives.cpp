@@ -0,0 +1,137 @@
+#include "primitives.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+int coarserPrimitiveResolution(PrimitiveShape shape, int resolution) {
+	switch (shape) {
+	case PRIMITIVE_UV_SPHERE:
+		return resolution / 2 >= 4 ? resolution / 2 : -1;
+	case PRIMITIVE_ICOSPHERE:
+		return resolution > 0 ? resolution - 1 : -1;
+	case PRIMITIVE_CUBE_SPHERE:
+		return resolution > 1 ? resolution / 2 : -1;
+	default:
+		return -1;
+	}
+}
+
+// Sizes of shape at resolution; an icosphere's mesh is built into icosphere
+static void getPrimitiveVbIbLen(PrimitiveShape shape, int resolution, IcosphereMesh& icosphere, int& vbLen, int& ibLen) {
+	vbLen = ibLen = 0;
+	switch (shape) {
+	case PRIMITIVE_UV_SPHERE:
+		getSphereVbIbLen(resolution, resolution / 2, vbLen, ibLen);
+		break;
+	case PRIMITIVE_ICOSPHERE:
+		buildIcosphere(resolution, icosphere);
+		vbLen = (int)icosphere.normals.size();
+		ibLen = (int)icosphere.indices.size();
+		break;
+	case PRIMITIVE_CUBE_SPHERE:
+		getCubeSphereVbIbLen(resolution, vbLen, ibLen);
+		break;
+	case PRIMITIVE_CUBE:
+		getCubeVbIbLen(vbLen, ibLen);
+		break;
+	}
+	assert(vbLen <= 65536);
+}
+
+// Writes shape in whichever layout Vertex is, e.g. Cvec3f for positions alone
+template<typename Vertex>
+static void writePrimitive(PrimitiveShape shape, int resolution, float size, const IcosphereMesh& icosphere,
+	Vertex* vertices, unsigned short* indices) {
+	switch (shape) {
+	case PRIMITIVE_UV_SPHERE:
+		makeSphereParallel(size, resolution, resolution / 2, vertices, indices);
+		break;
+	case PRIMITIVE_ICOSPHERE:
+		makeIcosphere(size, icosphere, vertices, indices);
+		break;
+	case PRIMITIVE_CUBE_SPHERE:
+		makeCubeSphere(size, resolution, vertices, indices);
+		break;
+	case PRIMITIVE_CUBE:
+		makeCube(size, vertices, indices);
+		break;
+	}
+}
+
+static const Cvec3f& positionOf(const VertexPNTBTG& vertex) { return vertex.p; }
+static const Cvec3f& positionOf(const Cvec3f& position) { return position; }
+
+// As makePrimitive() returns it, for any layout with a position
+template<typename Vertex>
+static float primitiveError(PrimitiveShape shape, float size, const std::vector<Vertex>& vertices, const std::vector<unsigned short>& indices) {
+	if (shape == PRIMITIVE_CUBE) {
+		return 0.0f;
+	}
+	// A flat triangle strays furthest where its plane is nearest the center.
+	// The degenerate ones at the poles of a UV sphere have no plane.
+	float nearest = size;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		const Cvec3f& a = positionOf(vertices[indices[i]]);
+		const Cvec3f normal = cross(positionOf(vertices[indices[i + 1]]) - a, positionOf(vertices[indices[i + 2]]) - a);
+		const float length2 = norm2(normal);
+		if (length2 > CS175_EPS2) {
+			nearest = std::min(nearest, dot(normal, a) / std::sqrt(length2));
+		}
+	}
+	return size - nearest;
+}
+
+float makePrimitive(PrimitiveShape shape, int resolution, float size,
+	std::vector<VertexPNTBTG>& vertices, std::vector<unsigned short>& indices) {
+	IcosphereMesh icosphere;
+	int vbLen, ibLen;
+	getPrimitiveVbIbLen(shape, resolution, icosphere, vbLen, ibLen);
+	vertices.resize(vbLen);
+	indices.resize(ibLen);
+	writePrimitive(shape, resolution, size, icosphere, vertices.data(), indices.data());
+	return primitiveError(shape, size, vertices, indices);
+}
+
+const Geometry& PrimitiveCache::get(PrimitiveShape shape, int resolution, float size, int lodLevels) {
+	const Key key = {shape, resolution, size, lodLevels};
+	const auto found = geometries_.find(key);
+	if (found != geometries_.end()) {
+		return found->second;
+	}
+
+	// Only positions and indices are made here, for the error, the bounds and
+	// the packed copy; the full vertices go straight into the mapped pool.
+	// Errors are measured against the full resolution, as from the simplifier.
+	Geometry& geometry = geometries_[key];
+	float baseError = 0.0f;
+	for (int level = 0, levelResolution = resolution; level <= lodLevels && levelResolution >= 0;
+		level++, levelResolution = coarserPrimitiveResolution(shape, levelResolution)) {
+		IcosphereMesh icosphere;
+		int vbLen, ibLen;
+		getPrimitiveVbIbLen(shape, levelResolution, icosphere, vbLen, ibLen);
+		positions_.resize(vbLen);
+		indices_.resize(ibLen);
+		writePrimitive(shape, levelResolution, size, icosphere, positions_.data(), indices_.data());
+		const float error = primitiveError(shape, size, positions_, indices_);
+
+		const auto fill = [&](VertexPNTBTG* vertices, unsigned short* indices) {
+			writePrimitive(shape, levelResolution, size, icosphere, vertices, indices);
+		};
+		if (level == 0) {
+			baseError = error;
+			geometry.uploadMapped(positions_, ibLen, fill);
+		}
+		else {
+			geometry.uploadLodMapped(positions_, ibLen, std::max(error - baseError, 0.0f), fill);
+		}
+	}
+	return geometry;
+}
+
+void PrimitiveCache::clear() {
+	for (auto& entry : geometries_) {
+		entry.second.release();
+	}
+	geometries_.clear();
+}
@@ -0,0 +1,63 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include <map>
+#include <vector>
+
+#include "scene.h"
+
+//--------------------------------------------------------------------------------
+// Generated shapes, made once per set of parameters and shared. Geometry only
+// holds handles to ranges of the geometry pool, so every entity showing the
+// same sphere can copy the one the cache keeps instead of generating and
+// uploading its own.
+//--------------------------------------------------------------------------------
+
+enum PrimitiveShape {
+	PRIMITIVE_UV_SPHERE,   // makeSphere(), resolution slices and half as many stacks
+	PRIMITIVE_ICOSPHERE,   // makeIcosphere(), resolution subdivisions
+	PRIMITIVE_CUBE_SPHERE, // makeCubeSphere(), resolution cells along each cube edge
+	PRIMITIVE_CUBE         // makeCube(), resolution ignored
+};
+
+// The next coarser resolution of shape, or -1 if there is none
+int coarserPrimitiveResolution(PrimitiveShape shape, int resolution);
+
+// Generates shape into vertices and indices. Returns the largest distance
+// of the surface from the exact shape, for spheres how far the flat
+// triangles sink below it, as LodSelector wants it.
+float makePrimitive(PrimitiveShape shape, int resolution, float size,
+	std::vector<VertexPNTBTG>& vertices, std::vector<unsigned short>& indices);
+
+class PrimitiveCache {
+	struct Key {
+		PrimitiveShape shape;
+		int resolution;
+		float size;
+		int lodLevels;
+
+		bool operator < (const Key& other) const {
+			if (shape != other.shape) return shape < other.shape;
+			if (resolution != other.resolution) return resolution < other.resolution;
+			if (size != other.size) return size < other.size;
+			return lodLevels < other.lodLevels;
+		}
+	};
+	std::map<Key, Geometry> geometries_;
+	std::vector<Cvec3f> positions_;
+	std::vector<unsigned short> indices_;
+
+public:
+	// The shape, with up to lodLevels coarser resolutions of it as levels of
+	// detail, generated and uploaded the first time it's asked for. Unit size
+	// scaled by the entity's transform shares best. Needs a current GL context.
+	const Geometry& get(PrimitiveShape shape, int resolution, float size = 1.0f, int lodLevels = 0);
+
+	int size() const { return (int)geometries_.size(); }
+
+	// Gives the ranges of everything made so far back to the pool; no entity may still be
+	// drawing any of it
+	void clear();
+};
+
+#endif
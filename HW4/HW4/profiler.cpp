@@ -0,0 +1,251 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+Profiler::Profiler(int historyFrames, int traceFrames)
+	: historyFrames_(std::max(historyFrames, 1)), traceFrames_(std::max(traceFrames, 0)), enabled_(true),
+	epoch_(Clock::now()), gpuQueryOpen_(false), inFrame_(false) {
+	current_.startUs = current_.durationUs = 0.0;
+}
+
+double Profiler::nowUs() const {
+	return std::chrono::duration<double, std::micro>(Clock::now() - epoch_).count();
+}
+
+void Profiler::setEnabled(bool enabled) {
+	// Dropping out mid-frame would leave queries open
+	assert(open_.empty());
+	enabled_ = enabled;
+	inFrame_ = false;
+}
+
+int Profiler::findSection(const char* name) const {
+	std::map<std::string, int>::const_iterator it = sectionIndex_.find(name);
+	return it == sectionIndex_.end() ? -1 : it->second;
+}
+
+int Profiler::findOrAddSection(const char* name, bool timesGpu) {
+	int section = findSection(name);
+	if (section >= 0) {
+		return section;
+	}
+	Section s;
+	s.name = name;
+	s.timesGpu = timesGpu;
+	s.externalGpuMs = -1.0;
+	s.touched = false;
+	s.queried = false;
+	if (timesGpu) {
+		s.timer.init();
+	}
+	sections_.push_back(s);
+	sectionIndex_[s.name] = (int)sections_.size() - 1;
+	return (int)sections_.size() - 1;
+}
+
+void Profiler::pushSample(std::deque<double>& history, double value, int limit) {
+	history.push_back(value);
+	while (history.size() > limit) {
+		history.pop_front();
+	}
+}
+
+ProfileStats Profiler::statsOf(const std::deque<double>& history) {
+	ProfileStats stats = { 0.0, 0.0, 0.0 };
+	if (history.empty()) {
+		return stats;
+	}
+	stats.min = stats.max = history[0];
+	double sum = 0.0;
+	for (int i = 0; i < history.size(); i++) {
+		stats.min = std::min(stats.min, history[i]);
+		stats.max = std::max(stats.max, history[i]);
+		sum += history[i];
+	}
+	stats.avg = sum / history.size();
+	return stats;
+}
+
+void Profiler::beginFrame() {
+	if (!enabled_) {
+		return;
+	}
+	assert(!inFrame_ && open_.empty());
+	inFrame_ = true;
+	current_.startUs = nowUs();
+	current_.events.clear();
+}
+
+void Profiler::endFrame() {
+	if (!enabled_ || !inFrame_) {
+		return;
+	}
+	assert(open_.empty());
+	inFrame_ = false;
+	current_.durationUs = nowUs() - current_.startUs;
+	pushSample(frameHistory_, current_.durationUs / 1000.0, historyFrames_);
+
+	// CPU samples were taken as sections ended. GPU results arrive a frame
+	// or two late, so every section seen this frame takes its latest one now.
+	std::vector<double> gpuMs(sections_.size(), -1.0);
+	for (int i = 0; i < sections_.size(); i++) {
+		Section& s = sections_[i];
+		if (!s.touched) {
+			continue;
+		}
+		if (s.externalGpuMs >= 0.0) {
+			gpuMs[i] = s.externalGpuMs;
+		}
+		else if (s.queried && s.timer.supported()) {
+			gpuMs[i] = s.timer.lastMs();
+		}
+		if (gpuMs[i] >= 0.0) {
+			pushSample(s.gpuHistory, gpuMs[i], historyFrames_);
+		}
+		s.touched = false;
+		s.queried = false;
+		s.externalGpuMs = -1.0;
+	}
+	for (int i = 0; i < current_.events.size(); i++) {
+		current_.events[i].gpuMs = gpuMs[current_.events[i].section];
+	}
+
+	if (traceFrames_ > 0) {
+		frames_.push_back(current_);
+		while (frames_.size() > traceFrames_) {
+			frames_.pop_front();
+		}
+	}
+}
+
+void Profiler::beginSection(const char* name, bool timesGpu) {
+	if (!enabled_) {
+		return;
+	}
+	OpenSection open;
+	open.section = findOrAddSection(name, timesGpu);
+	open.gpuQuery = sections_[open.section].timesGpu && !gpuQueryOpen_;
+	if (open.gpuQuery) {
+		sections_[open.section].timer.begin();
+		sections_[open.section].queried = true;
+		gpuQueryOpen_ = true;
+	}
+	sections_[open.section].touched = true;
+	open.startUs = nowUs();
+	open_.push_back(open);
+}
+
+void Profiler::endSection() {
+	if (!enabled_) {
+		return;
+	}
+	assert(!open_.empty());
+	const double endUs = nowUs();
+	OpenSection open = open_.back();
+	open_.pop_back();
+	if (open.gpuQuery) {
+		sections_[open.section].timer.end();
+		gpuQueryOpen_ = false;
+	}
+
+	pushSample(sections_[open.section].cpuHistory, (endUs - open.startUs) / 1000.0, historyFrames_);
+	if (inFrame_) {
+		Event event;
+		event.section = open.section;
+		event.startUs = open.startUs;
+		event.durationUs = endUs - open.startUs;
+		event.gpuMs = -1.0;
+		current_.events.push_back(event);
+	}
+}
+
+void Profiler::recordGpuMs(const char* name, double ms) {
+	if (!enabled_) {
+		return;
+	}
+	Section& s = sections_[findOrAddSection(name, false)];
+	s.externalGpuMs = ms;
+	s.touched = true;
+}
+
+double Profiler::lastGpuMs(const char* name) const {
+	int section = findSection(name);
+	if (section < 0 || sections_[section].gpuHistory.empty()) {
+		return 0.0;
+	}
+	return sections_[section].gpuHistory.back();
+}
+
+std::vector<std::string> Profiler::summaryLines() const {
+	std::vector<std::string> lines;
+	char line[160];
+	ProfileStats frame = frameStats();
+	std::snprintf(line, sizeof(line), "%-14s cpu %6.2f %6.2f %6.2f ms", "frame", frame.min, frame.avg, frame.max);
+	lines.push_back(line);
+	for (int i = 0; i < sections_.size(); i++) {
+		ProfileStats cpu = cpuStats(i);
+		int n = std::snprintf(line, sizeof(line), "%-14s cpu %6.2f %6.2f %6.2f", sections_[i].name.c_str(), cpu.min, cpu.avg, cpu.max);
+		if (hasGpuTime(i)) {
+			ProfileStats gpu = gpuStats(i);
+			std::snprintf(line + n, sizeof(line) - n, "  gpu %6.2f %6.2f %6.2f ms", gpu.min, gpu.avg, gpu.max);
+		}
+		else {
+			std::snprintf(line + n, sizeof(line) - n, " ms");
+		}
+		lines.push_back(line);
+	}
+	return lines;
+}
+
+void Profiler::print(std::ostream& out) const {
+	out << "profile over the last " << frameHistory_.size() << " frames (min avg max):\n";
+	std::vector<std::string> lines = summaryLines();
+	for (int i = 0; i < lines.size(); i++) {
+		out << "  " << lines[i] << "\n";
+	}
+}
+
+// Section names are ours, but escape anyway so the file always parses
+static std::string jsonString(const std::string& s) {
+	std::string out = "\"";
+	for (int i = 0; i < s.size(); i++) {
+		if (s[i] == '"' || s[i] == '\\') {
+			out += '\\';
+		}
+		out += s[i];
+	}
+	return out + "\"";
+}
+
+bool Profiler::writeChromeTrace(const char* fileName) const {
+	std::ofstream out(fileName);
+	if (!out) {
+		return false;
+	}
+	std::ostringstream events;
+	events.precision(3);
+	events << std::fixed;
+	bool first = true;
+	for (int f = 0; f < frames_.size(); f++) {
+		const Frame& frame = frames_[f];
+		events << (first ? "" : ",\n") << "{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << frame.startUs << ",\"dur\":" << frame.durationUs << "}";
+		first = false;
+		for (int i = 0; i < frame.events.size(); i++) {
+			const Event& e = frame.events[i];
+			const std::string name = jsonString(sections_[e.section].name);
+			events << ",\n{\"name\":" << name << ",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << e.startUs << ",\"dur\":" << e.durationUs << "}";
+			if (e.gpuMs >= 0.0) {
+				events << ",\n{\"name\":" << name << ",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":" << e.startUs << ",\"dur\":" << e.gpuMs * 1000.0 << "}";
+			}
+		}
+	}
+	out << "{\"traceEvents\":[\n"
+		<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n"
+		<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}"
+		<< (first ? "" : ",\n") << events.str() << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	return (bool)out;
+}
@@ -0,0 +1,137 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "glsupport.h"
+#include "gputimer.h"
+
+//--------------------------------------------------------------------------------
+// Frame profiler: named sections timed on the CPU and, through GpuTimer, on
+// the GPU. Each section keeps a rolling window of samples for min/avg/max, and
+// the last few hundred frames can be written out as a Chrome trace
+// (chrome://tracing or ui.perfetto.dev).
+//--------------------------------------------------------------------------------
+
+struct ProfileStats {
+	double min, avg, max;
+};
+
+class Profiler {
+	struct Section {
+		std::string name;
+		bool timesGpu;
+		GpuTimer timer;
+		double externalGpuMs; // set by recordGpuMs, < 0 when unused
+		bool touched;         // began during the current frame
+		bool queried;         // ran a timer query during the current frame
+		std::deque<double> cpuHistory, gpuHistory;
+	};
+
+	// One completed section in one frame, for the trace
+	struct Event {
+		int section;
+		double startUs, durationUs;
+		double gpuMs; // < 0 when the section has no GPU time
+	};
+
+	struct Frame {
+		double startUs, durationUs;
+		std::vector<Event> events;
+	};
+
+	struct OpenSection {
+		int section;
+		double startUs;
+		bool gpuQuery;
+	};
+
+	typedef std::chrono::steady_clock Clock;
+
+	int historyFrames_, traceFrames_;
+	bool enabled_;
+	Clock::time_point epoch_;
+
+	std::vector<Section> sections_;
+	std::map<std::string, int> sectionIndex_;
+	std::vector<OpenSection> open_;
+	bool gpuQueryOpen_;
+
+	Frame current_;
+	bool inFrame_;
+	std::deque<Frame> frames_;
+	std::deque<double> frameHistory_;
+
+	double nowUs() const;
+	int findOrAddSection(const char* name, bool timesGpu);
+	static void pushSample(std::deque<double>& history, double value, int limit);
+	static ProfileStats statsOf(const std::deque<double>& history);
+
+public:
+	// historyFrames is the window the stats are taken over; traceFrames is how
+	// many frames writeChromeTrace() can go back
+	explicit Profiler(int historyFrames = 120, int traceFrames = 300);
+
+	// A disabled profiler ignores every call, so the sections can stay in
+	// shipping code
+	void setEnabled(bool enabled);
+	bool enabled() const { return enabled_; }
+
+	void beginFrame();
+	void endFrame();
+
+	// Sections may nest on the CPU. Timer queries cannot, so a GPU section
+	// opened inside another GPU section is timed on the CPU only. Needs a
+	// current GL context the first time a GPU section is seen.
+	void beginSection(const char* name, bool timesGpu = true);
+	void endSection();
+
+	// Attaches GPU time measured elsewhere (e.g. by a subsystem's own timers)
+	// to a CPU-only section in the current frame
+	void recordGpuMs(const char* name, double ms);
+
+	int sectionCount() const { return (int)sections_.size(); }
+	const std::string& sectionName(int section) const { return sections_[section].name; }
+	int findSection(const char* name) const;
+
+	ProfileStats cpuStats(int section) const { return statsOf(sections_[section].cpuHistory); }
+	ProfileStats gpuStats(int section) const { return statsOf(sections_[section].gpuHistory); }
+	bool hasGpuTime(int section) const { return !sections_[section].gpuHistory.empty(); }
+	ProfileStats frameStats() const { return statsOf(frameHistory_); }
+	double lastFrameMs() const { return frameHistory_.empty() ? 0.0 : frameHistory_.back(); }
+
+	// Most recent GPU time of a section, 0 if unknown
+	double lastGpuMs(const char* name) const;
+
+	// One line per section: CPU and GPU min/avg/max in milliseconds
+	void print(std::ostream& out) const;
+	std::vector<std::string> summaryLines() const;
+
+	// CPU sections become complete events on one track; GPU times go on a
+	// second track, placed at the CPU start of their section since elapsed
+	// time queries carry no timestamp. Returns false if the file can't be
+	// written.
+	bool writeChromeTrace(const char* fileName) const;
+};
+
+// Times the enclosing scope as one profiler section
+class ProfileScope {
+	Profiler& profiler_;
+
+public:
+	ProfileScope(Profiler& profiler, const char* name, bool timesGpu = true) : profiler_(profiler) {
+		profiler_.beginSection(name, timesGpu);
+	}
+	~ProfileScope() { profiler_.endSection(); }
+
+private:
+	ProfileScope(const ProfileScope&);
+	ProfileScope& operator = (const ProfileScope&);
+};
+
+#endif
@@ -8,136 +8,155 @@
 #include "cvec.h"
 #include "matrix4.h"
 
-// Forward declarations used in the definition of Quat;
-class Quat;
-double dot(const Quat& q, const Quat& p);
-double norm2(const Quat& q);
-Quat inv(const Quat& q);
-Quat normalize(const Quat& q);
-Matrix4 quatToMatrix(const Quat& q);
-
-class Quat {
-  Cvec4 q_;  // layout is: q_[0]==w, q_[1]==x, q_[2]==y, q_[3]==z
+// Quaternion<T> with T the precision of the components: Quat is double,
+// Quatf is float for large arrays of joints. Everything that doesn't need a
+// transcendental function is constexpr.
+template <typename T>
+class Quaternion {
+  Cvec<T, 4> q_;  // layout is: q_[0]==w, q_[1]==x, q_[2]==y, q_[3]==z
 
 public:
-  double operator [] (const int i) const {
+  constexpr T operator [] (const int i) const {
     return q_[i];
   }
 
-  double& operator [] (const int i) {
+  constexpr T& operator [] (const int i) {
     return q_[i];
   }
 
-  double operator () (const int i) const {
+  constexpr T operator () (const int i) const {
     return q_[i];
   }
 
-  double& operator () (const int i) {
+  constexpr T& operator () (const int i) {
     return q_[i];
   }
 
-  Quat() : q_(1,0,0,0) {}
-  Quat(const double w, const Cvec3& v) : q_(w, v[0], v[1], v[2]) {}
-  Quat(const double w, const double x, const double y, const double z) : q_(w, x,y,z) {}
+  constexpr Quaternion() : q_(1,0,0,0) {}
+  constexpr Quaternion(const T w, const Cvec<T, 3>& v) : q_(w, v[0], v[1], v[2]) {}
+  constexpr Quaternion(const T w, const T x, const T y, const T z) : q_(w, x,y,z) {}
+
+  // Between precisions, e.g. Quatf(q)
+  template <typename S>
+  constexpr explicit Quaternion(const Quaternion<S>& q) : q_(T(q[0]), T(q[1]), T(q[2]), T(q[3])) {}
 
-  Quat& operator += (const Quat& a) {
+  constexpr Quaternion& operator += (const Quaternion& a) {
     q_ += a.q_;
     return *this;
   }
 
-  Quat& operator -= (const Quat& a) {
+  constexpr Quaternion& operator -= (const Quaternion& a) {
     q_ -= a.q_;
     return *this;
   }
 
-  Quat& operator *= (const double a) {
+  constexpr Quaternion& operator *= (const T a) {
     q_ *= a;
     return *this;
   }
 
-  Quat& operator /= (const double a) {
+  constexpr Quaternion& operator /= (const T a) {
     q_ /= a;
     return *this;
   }
 
-  Quat operator + (const Quat& a) const {
-    return Quat(*this) += a;
+  constexpr Quaternion operator + (const Quaternion& a) const {
+    return Quaternion(*this) += a;
+  }
+
+  constexpr Quaternion operator - (const Quaternion& a) const {
+    return Quaternion(*this) -= a;
   }
 
-  Quat operator - (const Quat& a) const {
-    return Quat(*this) -= a;
+  constexpr Quaternion operator - () const {
+    return Quaternion(-q_[0], -q_[1], -q_[2], -q_[3]);
   }
 
-  Quat operator - () const {
-    return Quat(-q_[0], -q_[1], -q_[2], -q_[3]);
+  constexpr Quaternion operator * (const T a) const {
+    return Quaternion(*this) *= a;
   }
 
-  Quat operator * (const double a) const {
-    return Quat(*this) *= a;
+  constexpr Quaternion operator / (const T a) const {
+    return Quaternion(*this) /= a;
   }
 
-  Quat operator / (const double a) const {
-    return Quat(*this) /= a;
+  constexpr Quaternion operator * (const Quaternion& a) const {
+    const Cvec<T, 3> u(q_[1], q_[2], q_[3]), v(a.q_[1], a.q_[2], a.q_[3]);
+    return Quaternion(q_[0]*a.q_[0] - dot(u, v), (v*q_[0] + u*a.q_[0]) + cross(u, v));
   }
 
-  Quat operator * (const Quat& a) const {
-    const Cvec3 u(q_[1], q_[2], q_[3]), v(a.q_[1], a.q_[2], a.q_[3]);
-    return Quat(q_[0]*a.q_[0] - dot(u, v), (v*q_[0] + u*a.q_[0]) + cross(u, v));
+  // Rotates a[0..2] and leaves a[3] alone. Same as q * (0, a) * inv(q), but
+  // expanded to v + 2/|q|^2 (w (u x v) + u x (u x v)): two crosses instead of
+  // two quaternion products and an inverse.
+  constexpr Cvec<T, 4> operator * (const Cvec<T, 4>& a) const {
+    const Cvec<T, 3> r = rotate(Cvec<T, 3>(a[0], a[1], a[2]));
+    return Cvec<T, 4>(r[0], r[1], r[2], a[3]);
   }
 
-  Cvec4 operator * (const Cvec4& a) const {
-    const Quat r = *this * (Quat(0, a[0], a[1], a[2]) * inv(*this));
-    return Cvec4(r[1], r[2], r[3], a[3]);
+  constexpr Cvec<T, 3> rotate(const Cvec<T, 3>& v) const {
+    const T n = dot(q_, q_);
+    assert(n > CS175_EPS2);
+    const Cvec<T, 3> u(q_[1], q_[2], q_[3]);
+    const Cvec<T, 3> uv = cross(u, v);
+    return v + (uv * q_[0] + cross(u, uv)) * (T(2) / n);
   }
 
-  static Quat makeXRotation(const double ang) {
-    Quat r;
-    const double h = 0.5 * ang * CS175_PI/180;
+  static Quaternion makeXRotation(const T ang) {
+    Quaternion r;
+    const T h = T(0.5 * ang * CS175_PI/180);
     r.q_[1] = std::sin(h);
     r.q_[0] = std::cos(h);
     return r;
   }
 
-  static Quat makeYRotation(const double ang) {
-    Quat r;
-    const double h = 0.5 * ang * CS175_PI/180;
+  static Quaternion makeYRotation(const T ang) {
+    Quaternion r;
+    const T h = T(0.5 * ang * CS175_PI/180);
     r.q_[2] = std::sin(h);
     r.q_[0] = std::cos(h);
     return r;
   }
 
-  static Quat makeZRotation(const double ang) {
-    Quat r;
-    const double h = 0.5 * ang * CS175_PI/180;
+  static Quaternion makeZRotation(const T ang) {
+    Quaternion r;
+    const T h = T(0.5 * ang * CS175_PI/180);
     r.q_[3] = std::sin(h);
     r.q_[0] = std::cos(h);
     return r;
   }
 };
 
-inline double dot(const Quat& q, const Quat& p) {
-  double s = 0.0;
+typedef Quaternion<double> Quat;
+typedef Quaternion<float> Quatf;
+
+template <typename T>
+inline constexpr T dot(const Quaternion<T>& q, const Quaternion<T>& p) {
+  T s = 0.0;
   for (int i = 0; i < 4; ++i) {
     s += q(i) * p(i);
   }
   return s;
 }
 
-inline double norm2(const Quat& q) {
+template <typename T>
+inline constexpr T norm2(const Quaternion<T>& q) {
   return dot(q, q);
 }
 
-inline Quat inv(const Quat& q) {
-  const double n = norm2(q);
+template <typename T>
+inline constexpr Quaternion<T> inv(const Quaternion<T>& q) {
+  const T n = norm2(q);
   assert(n > CS175_EPS2);
-  return Quat(q(0), -q(1), -q(2), -q(3)) * (1.0/n);
+  return Quaternion<T>(q(0), -q(1), -q(2), -q(3)) * (T(1)/n);
 }
 
-inline Quat normalize(const Quat& q) {
+template <typename T>
+inline Quaternion<T> normalize(const Quaternion<T>& q) {
   return q / std::sqrt(norm2(q));
 }
 
-inline Matrix4 quatToMatrix(const Quat& q) {
+template <typename T>
+inline constexpr Matrix4 quatToMatrix(const Quaternion<T>& q) {
   Matrix4 r;
   const double n = norm2(q);
   if (n < CS175_EPS2)
@@ -158,60 +177,151 @@ inline Matrix4 quatToMatrix(const Quat& q) {
   return r;
 }
 
-inline Quat pow(const Quat& q, double exponent)
+template <typename T>
+inline Quaternion<T> pow(const Quaternion<T>& q, typename CvecScalar<T>::type exponent)
 {
 	// 1. extract the unit axis khat by normalizing the last three entries of the quaternion
 	// first normalize the quaternion
-	Quat unitQuat = normalize(q);
+	Quaternion<T> unitQuat = normalize(q);
 	// magnitude of sin(theta/2) is the norm of the last three entries
-	double sinHalfTheta = std::sqrt(q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+	T sinHalfTheta = std::sqrt(q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
 
 	// 2. extract theta using atan2
-	double halfTheta = std::atan2(sinHalfTheta, q[0]);
+	T halfTheta = std::atan2(sinHalfTheta, q[0]);
 	// return identity if angle is really small to avoid divide by sinPhi
 	if (std::abs(halfTheta) < CS175_EPS)
-		return Quat();
-	double alphaHalfTheta = halfTheta*exponent;
-	double ratio = std::sin(alphaHalfTheta)/sinHalfTheta;
-	return Quat(std::cos(alphaHalfTheta), ratio*q[1], ratio*q[2], ratio*q[3]);
+		return Quaternion<T>();
+	T alphaHalfTheta = halfTheta*exponent;
+	T ratio = std::sin(alphaHalfTheta)/sinHalfTheta;
+	return Quaternion<T>(std::cos(alphaHalfTheta), ratio*q[1], ratio*q[2], ratio*q[3]);
 }
 
-inline Quat shortRotation(const Quat& q)
+template <typename T>
+inline constexpr Quaternion<T> shortRotation(const Quaternion<T>& q)
 {
 	return q[0] < 0 ? -q : q;
 }
 
-inline Quat slerp(const Quat& q0, const Quat& q1, const double t)
+template <typename T>
+inline Quaternion<T> slerp(const Quaternion<T>& q0, const Quaternion<T>& q1, const typename CvecScalar<T>::type t)
 {
-	Quat q1q0Inv = q1*inv(q0);
+	Quaternion<T> q1q0Inv = q1*inv(q0);
 	if (q1q0Inv[0] < 0)
 		q1q0Inv *= -1;
 	return pow(q1q0Inv, t) * q0;
 }
 
-// 3 pts out of 5?
-inline Quat interpolateCatmullRom(const Quat& q0, 
-	const Quat& q1, 
-	const Quat& q2, 
-	const Quat& q3, 
-	const double t)
+// Cheaper stand-ins for slerp between unit quaternions, for per-frame joint
+// blending. Both take the short way round like slerp does and need no
+// transcendental functions. The error bounds are the largest angle, in
+// radians, between the rotation they return and slerp's, over every pair of
+// unit quaternions and t in [0, 1].
+static constexpr double QUAT_NLERP_MAX_ERROR = 8e-3;
+static constexpr double QUAT_FAST_SLERP_MAX_ERROR = 2e-5;
+
+// t warped so that normalizing the lerp lands close to where slerp would:
+// t + k t (t - 1/2) (t - 1), with k = K0 + K1 |dot(q0, q1)| fitted to
+// minimize the worst case. Plain nlerp is off by up to 0.14 rad.
+static constexpr double QUAT_NLERP_K0 = 0.9387102;
+static constexpr double QUAT_NLERP_K1 = -1.1377545;
+
+template <typename T>
+inline constexpr T nlerpCorrection(const T t, const T absDot) {
+  const T k = T(QUAT_NLERP_K0) + T(QUAT_NLERP_K1) * absDot;
+  return t + k * t * (t - T(0.5)) * (t - T(1));
+}
+
+// Normalized lerp with the corrected t; always unit length
+template <typename T>
+inline Quaternion<T> nlerp(const Quaternion<T>& q0, const Quaternion<T>& q1, const typename CvecScalar<T>::type t) {
+  const T d = dot(q0, q1);
+  const T s = nlerpCorrection(T(t), std::abs(d));
+  return normalize(q0 * (T(1) - s) + q1 * (d < 0 ? -s : s));
+}
+
+// Eberly's polynomial fit of the slerp weights sin(t a) / sin(a) with
+// x = cos(a): t (1 + (u1 t^2 - v1)(x - 1)(1 + (u2 t^2 - v2)(x - 1)(...))),
+// u_i = 1/(i (2i + 1)), v_i = i/(2i + 1), and the last pair scaled by 1 + mu
+// to spread the truncation error. Eight terms keep the weights within 2e-5.
+static constexpr int QUAT_FAST_SLERP_TERMS = 8;
+static constexpr double QUAT_FAST_SLERP_MU = 0.852979;
+
+inline constexpr double fastSlerpU(const int i) {
+  return (i == QUAT_FAST_SLERP_TERMS ? 1 + QUAT_FAST_SLERP_MU : 1) / (i * (2.0 * i + 1));
+}
+
+inline constexpr double fastSlerpV(const int i) {
+  return (i == QUAT_FAST_SLERP_TERMS ? 1 + QUAT_FAST_SLERP_MU : 1) * i / (2.0 * i + 1);
+}
+
+template <typename T>
+inline constexpr T fastSlerpWeight(const T t, const T xMinus1) {
+  const T t2 = t * t;
+  T b = T(1);
+  for (int i = QUAT_FAST_SLERP_TERMS; i >= 1; --i) {
+    b = T(1) + (T(fastSlerpU(i)) * t2 - T(fastSlerpV(i))) * xMinus1 * b;
+  }
+  return t * b;
+}
+
+// Within QUAT_FAST_SLERP_MAX_ERROR of slerp, and within 3e-5 of unit length
+template <typename T>
+inline constexpr Quaternion<T> fastSlerp(const Quaternion<T>& q0, const Quaternion<T>& q1, const typename CvecScalar<T>::type t) {
+  const T d = dot(q0, q1);
+  const T xMinus1 = (d < 0 ? -d : d) - T(1);
+  const T w1 = fastSlerpWeight(T(t), xMinus1);
+  return q0 * fastSlerpWeight(T(1) - T(t), xMinus1) + q1 * (d < 0 ? -w1 : w1);
+}
+
+// Inner control points d and e of the Bezier segment from q1 to q2, with q0
+// and q3 the keys either side
+template <typename T>
+inline void catmullRomControlPoints(const Quaternion<T>& q0,
+	const Quaternion<T>& q1,
+	const Quaternion<T>& q2,
+	const Quaternion<T>& q3,
+	Quaternion<T>& d,
+	Quaternion<T>& e)
 {
 	// formula on page 81 with i == 1
 	// interpolating between q1 and q2
 
 	//const Cvec<T,n> d = (v2-v0)/6.0 + v1;
 	//const Cvec<T,n> e = -(v3-v1)/6.0 + v2;
-	const Quat& d = pow(shortRotation(q2*inv(q0)), 1/6.0) * q1;
-	const Quat& e = inv(pow(shortRotation(q3*inv(q1)), 1/6.0)) * q2;
+	d = pow(shortRotation(q2*inv(q0)), 1/6.0) * q1;
+	e = inv(pow(shortRotation(q3*inv(q1)), 1/6.0)) * q2;
+}
+
+// Bezier curve through q1 and q2 with inner control points d and e
+template <typename T>
+inline Quaternion<T> interpolateBezier(const Quaternion<T>& q1,
+	const Quaternion<T>& d,
+	const Quaternion<T>& e,
+	const Quaternion<T>& q2,
+	const typename CvecScalar<T>::type t)
+{
 	// use eq. 9.1 instead
-	const Quat& f = slerp(q1, d, t);
-	const Quat& g = slerp(d, e, t);
-	const Quat& h = slerp(e, q2, t);
-	const Quat& m = slerp(f, g, t);
-	const Quat& n = slerp(h, h, t);
+	const Quaternion<T>& f = slerp(q1, d, t);
+	const Quaternion<T>& g = slerp(d, e, t);
+	const Quaternion<T>& h = slerp(e, q2, t);
+	const Quaternion<T>& m = slerp(f, g, t);
+	const Quaternion<T>& n = slerp(g, h, t);
 
 	return slerp(m, n, t);
 }
 
+// 3 pts out of 5?
+template <typename T>
+inline Quaternion<T> interpolateCatmullRom(const Quaternion<T>& q0,
+	const Quaternion<T>& q1,
+	const Quaternion<T>& q2,
+	const Quaternion<T>& q3,
+	const typename CvecScalar<T>::type t)
+{
+	Quaternion<T> d, e;
+	catmullRomControlPoints(q0, q1, q2, q3, d, e);
+	return interpolateBezier(q1, d, e, q2, t);
+}
+
 
 #endif
@@ -0,0 +1,318 @@
+#ifndef QUATSOA_H
+#define QUATSOA_H
+
+#include <cassert>
+#include <cmath>
+
+#include "cvecsoa.h"
+#include "quat.h"
+
+//--------------------------------------------------------------------------------
+// Batched Quatf kernels over structure-of-arrays storage, for animation work on
+// thousands of joints at once. A QuatfArray is a Cvec4fArray whose streams are
+// w, x, y and z. With SSE each kernel handles four quaternions per step;
+// compilers don't vectorize the plain loops themselves, since the outputs may
+// alias the inputs. Large batches split across ThreadPool::shared().
+//--------------------------------------------------------------------------------
+
+typedef Cvec4fArray QuatfArray;
+
+inline Quatf getQuat(const QuatfArray& q, int index) {
+	return Quatf(q.component(0)[index], q.component(1)[index], q.component(2)[index], q.component(3)[index]);
+}
+
+inline void setQuat(QuatfArray& q, int index, const Quatf& value) {
+	for (int i = 0; i < 4; i++) {
+		q.component(i)[index] = value[i];
+	}
+}
+
+// out[i] = a[i] * b[i]; out may be a or b
+inline void mulAll(const QuatfArray& a, const QuatfArray& b, QuatfArray& out) {
+	assert(a.size() == b.size());
+	out.resize(a.size());
+	const float *aw = a.component(0), *ax = a.component(1), *ay = a.component(2), *az = a.component(3);
+	const float *bw = b.component(0), *bx = b.component(1), *by = b.component(2), *bz = b.component(3);
+	float *ow = out.component(0), *ox = out.component(1), *oy = out.component(2), *oz = out.component(3);
+	soaFor(a.size(), [=](int begin, int end) {
+		int i = begin;
+#if CVEC_SIMD
+		for (; i + 4 <= end; i += 4) {
+			const __m128 w1 = _mm_loadu_ps(aw + i), x1 = _mm_loadu_ps(ax + i), y1 = _mm_loadu_ps(ay + i), z1 = _mm_loadu_ps(az + i);
+			const __m128 w2 = _mm_loadu_ps(bw + i), x2 = _mm_loadu_ps(bx + i), y2 = _mm_loadu_ps(by + i), z2 = _mm_loadu_ps(bz + i);
+			const __m128 w = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(w1, w2), _mm_mul_ps(x1, x2)), _mm_add_ps(_mm_mul_ps(y1, y2), _mm_mul_ps(z1, z2)));
+			const __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w1, x2), _mm_mul_ps(x1, w2)), _mm_sub_ps(_mm_mul_ps(y1, z2), _mm_mul_ps(z1, y2)));
+			const __m128 y = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(w1, y2), _mm_mul_ps(x1, z2)), _mm_add_ps(_mm_mul_ps(y1, w2), _mm_mul_ps(z1, x2)));
+			const __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w1, z2), _mm_mul_ps(x1, y2)), _mm_sub_ps(_mm_mul_ps(z1, w2), _mm_mul_ps(y1, x2)));
+			_mm_storeu_ps(ow + i, w);
+			_mm_storeu_ps(ox + i, x);
+			_mm_storeu_ps(oy + i, y);
+			_mm_storeu_ps(oz + i, z);
+		}
+#endif
+		for (; i < end; i++) {
+			const float w = aw[i] * bw[i] - ax[i] * bx[i] - ay[i] * by[i] - az[i] * bz[i];
+			const float x = aw[i] * bx[i] + ax[i] * bw[i] + ay[i] * bz[i] - az[i] * by[i];
+			const float y = aw[i] * by[i] - ax[i] * bz[i] + ay[i] * bw[i] + az[i] * bx[i];
+			const float z = aw[i] * bz[i] + ax[i] * by[i] - ay[i] * bx[i] + az[i] * bw[i];
+			ow[i] = w;
+			ox[i] = x;
+			oy[i] = y;
+			oz[i] = z;
+		}
+	});
+}
+
+// Scales every quaternion (or any 4-vector) to unit length
+inline void normalizeAll(Cvec4fArray& q) {
+	float *w = q.component(0), *x = q.component(1), *y = q.component(2), *z = q.component(3);
+	soaFor(q.size(), [=](int begin, int end) {
+		int i = begin;
+#if CVEC_SIMD
+		for (; i + 4 <= end; i += 4) {
+			const __m128 vw = _mm_loadu_ps(w + i), vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+			const __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vw, vw), _mm_mul_ps(vx, vx)), _mm_add_ps(_mm_mul_ps(vy, vy), _mm_mul_ps(vz, vz)));
+			const __m128 s = cvecInvSqrt(len2);
+			_mm_storeu_ps(w + i, _mm_mul_ps(vw, s));
+			_mm_storeu_ps(x + i, _mm_mul_ps(vx, s));
+			_mm_storeu_ps(y + i, _mm_mul_ps(vy, s));
+			_mm_storeu_ps(z + i, _mm_mul_ps(vz, s));
+		}
+#endif
+		for (; i < end; i++) {
+			const float s = 1.0f / std::sqrt(w[i] * w[i] + x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+			w[i] *= s;
+			x[i] *= s;
+			y[i] *= s;
+			z[i] *= s;
+		}
+	});
+}
+
+// out[i] = q[i] rotating v[i], with the same expansion as Quaternion::rotate;
+// out may be v
+inline void rotateAll(const QuatfArray& q, const Cvec3fArray& v, Cvec3fArray& out) {
+	assert(q.size() == v.size());
+	out.resize(v.size());
+	const float *qw = q.component(0), *qx = q.component(1), *qy = q.component(2), *qz = q.component(3);
+	const float *vx = v.component(0), *vy = v.component(1), *vz = v.component(2);
+	float *ox = out.component(0), *oy = out.component(1), *oz = out.component(2);
+	soaFor(v.size(), [=](int begin, int end) {
+		int i = begin;
+#if CVEC_SIMD
+		for (; i + 4 <= end; i += 4) {
+			const __m128 w = _mm_loadu_ps(qw + i), x = _mm_loadu_ps(qx + i), y = _mm_loadu_ps(qy + i), z = _mm_loadu_ps(qz + i);
+			const __m128 px = _mm_loadu_ps(vx + i), py = _mm_loadu_ps(vy + i), pz = _mm_loadu_ps(vz + i);
+			const __m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w, w), _mm_mul_ps(x, x)), _mm_add_ps(_mm_mul_ps(y, y), _mm_mul_ps(z, z)));
+			const __m128 s = _mm_div_ps(_mm_set1_ps(2.0f), n);
+			const __m128 tx = _mm_sub_ps(_mm_mul_ps(y, pz), _mm_mul_ps(z, py));
+			const __m128 ty = _mm_sub_ps(_mm_mul_ps(z, px), _mm_mul_ps(x, pz));
+			const __m128 tz = _mm_sub_ps(_mm_mul_ps(x, py), _mm_mul_ps(y, px));
+			_mm_storeu_ps(ox + i, _mm_add_ps(px, _mm_mul_ps(s, _mm_add_ps(_mm_mul_ps(w, tx), _mm_sub_ps(_mm_mul_ps(y, tz), _mm_mul_ps(z, ty))))));
+			_mm_storeu_ps(oy + i, _mm_add_ps(py, _mm_mul_ps(s, _mm_add_ps(_mm_mul_ps(w, ty), _mm_sub_ps(_mm_mul_ps(z, tx), _mm_mul_ps(x, tz))))));
+			_mm_storeu_ps(oz + i, _mm_add_ps(pz, _mm_mul_ps(s, _mm_add_ps(_mm_mul_ps(w, tz), _mm_sub_ps(_mm_mul_ps(x, ty), _mm_mul_ps(y, tx))))));
+		}
+#endif
+		for (; i < end; i++) {
+			const float s = 2.0f / (qw[i] * qw[i] + qx[i] * qx[i] + qy[i] * qy[i] + qz[i] * qz[i]);
+			// t = u x v, then v + s (w t + u x t)
+			const float tx = qy[i] * vz[i] - qz[i] * vy[i];
+			const float ty = qz[i] * vx[i] - qx[i] * vz[i];
+			const float tz = qx[i] * vy[i] - qy[i] * vx[i];
+			const float x = vx[i] + s * (qw[i] * tx + qy[i] * tz - qz[i] * ty);
+			const float y = vy[i] + s * (qw[i] * ty + qz[i] * tx - qx[i] * tz);
+			const float z = vz[i] + s * (qw[i] * tz + qx[i] * ty - qy[i] * tx);
+			ox[i] = x;
+			oy[i] = y;
+			oz[i] = z;
+		}
+	});
+}
+
+// Writes the rotation matrix of each quaternion as 16 floats in column-major
+// order, ready for glUniformMatrix4fv or a joint buffer. out must hold
+// 16 * q.size() floats.
+inline void toMatrixAll(const QuatfArray& q, float* out) {
+	const float *qw = q.component(0), *qx = q.component(1), *qy = q.component(2), *qz = q.component(3);
+	soaFor(q.size(), [=](int begin, int end) {
+		int i = begin;
+#if CVEC_SIMD
+		const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps(), lastColumn = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+		for (; i + 4 <= end; i += 4) {
+			const __m128 w = _mm_loadu_ps(qw + i), x = _mm_loadu_ps(qx + i), y = _mm_loadu_ps(qy + i), z = _mm_loadu_ps(qz + i);
+			const __m128 s = _mm_div_ps(_mm_set1_ps(2.0f), _mm_add_ps(_mm_add_ps(_mm_mul_ps(w, w), _mm_mul_ps(x, x)), _mm_add_ps(_mm_mul_ps(y, y), _mm_mul_ps(z, z))));
+			const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+			const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+			const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+			// cNM is row M of column N for four quaternions, one per lane.
+			// Transposing a column's rows (plus a zero row) splits it into the
+			// columns of the four matrices.
+			__m128 c00 = _mm_sub_ps(one, _mm_mul_ps(_mm_add_ps(yy, zz), s));
+			__m128 c01 = _mm_mul_ps(_mm_add_ps(xy, wz), s);
+			__m128 c02 = _mm_mul_ps(_mm_sub_ps(xz, wy), s);
+			__m128 c03 = zero;
+			__m128 c10 = _mm_mul_ps(_mm_sub_ps(xy, wz), s);
+			__m128 c11 = _mm_sub_ps(one, _mm_mul_ps(_mm_add_ps(xx, zz), s));
+			__m128 c12 = _mm_mul_ps(_mm_add_ps(yz, wx), s);
+			__m128 c13 = zero;
+			__m128 c20 = _mm_mul_ps(_mm_add_ps(xz, wy), s);
+			__m128 c21 = _mm_mul_ps(_mm_sub_ps(yz, wx), s);
+			__m128 c22 = _mm_sub_ps(one, _mm_mul_ps(_mm_add_ps(xx, yy), s));
+			__m128 c23 = zero;
+			_MM_TRANSPOSE4_PS(c00, c01, c02, c03);
+			_MM_TRANSPOSE4_PS(c10, c11, c12, c13);
+			_MM_TRANSPOSE4_PS(c20, c21, c22, c23);
+			const __m128 columns[4][3] = { { c00, c10, c20 }, { c01, c11, c21 }, { c02, c12, c22 }, { c03, c13, c23 } };
+			for (int j = 0; j < 4; j++) {
+				float* m = out + 16 * (i + j);
+				_mm_storeu_ps(m, columns[j][0]);
+				_mm_storeu_ps(m + 4, columns[j][1]);
+				_mm_storeu_ps(m + 8, columns[j][2]);
+				_mm_storeu_ps(m + 12, lastColumn);
+			}
+		}
+#endif
+		for (; i < end; i++) {
+			const float w = qw[i], x = qx[i], y = qy[i], z = qz[i];
+			const float s = 2.0f / (w * w + x * x + y * y + z * z);
+			float* m = out + 16 * i;
+			m[0] = 1.0f - (y * y + z * z) * s;
+			m[1] = (x * y + w * z) * s;
+			m[2] = (x * z - y * w) * s;
+			m[3] = 0.0f;
+			m[4] = (x * y - w * z) * s;
+			m[5] = 1.0f - (x * x + z * z) * s;
+			m[6] = (y * z + x * w) * s;
+			m[7] = 0.0f;
+			m[8] = (x * z + y * w) * s;
+			m[9] = (y * z - x * w) * s;
+			m[10] = 1.0f - (x * x + y * y) * s;
+			m[11] = 0.0f;
+			m[12] = m[13] = m[14] = 0.0f;
+			m[15] = 1.0f;
+		}
+	});
+}
+
+#if CVEC_SIMD
+// |dot(a, b)| for four quaternions, negating b where the dot is negative so
+// the blend takes the short way round
+inline __m128 quatDotFlip(__m128 aw, __m128 ax, __m128 ay, __m128 az, __m128& bw, __m128& bx, __m128& by, __m128& bz) {
+	const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, bw), _mm_mul_ps(ax, bx)), _mm_add_ps(_mm_mul_ps(ay, by), _mm_mul_ps(az, bz)));
+	const __m128 sign = _mm_and_ps(d, _mm_set1_ps(-0.0f));
+	bw = _mm_xor_ps(bw, sign);
+	bx = _mm_xor_ps(bx, sign);
+	by = _mm_xor_ps(by, sign);
+	bz = _mm_xor_ps(bz, sign);
+	return _mm_xor_ps(d, sign);
+}
+#endif
+
+// Blends for every joint at once: nlerpAll and fastSlerpAll match nlerp and
+// fastSlerp in quat.h, to the same error bounds. t is either one parameter for
+// the whole batch (tStride 0) or one per quaternion (tStride 1); out may be a
+// or b.
+inline void nlerpAll(const QuatfArray& a, const QuatfArray& b, const float* t, int tStride, QuatfArray& out) {
+	assert(a.size() == b.size());
+	out.resize(a.size());
+	const float *aw = a.component(0), *ax = a.component(1), *ay = a.component(2), *az = a.component(3);
+	const float *bw = b.component(0), *bx = b.component(1), *by = b.component(2), *bz = b.component(3);
+	float *ow = out.component(0), *ox = out.component(1), *oy = out.component(2), *oz = out.component(3);
+	soaFor(a.size(), [=](int begin, int end) {
+		int i = begin;
+#if CVEC_SIMD
+		const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+		const __m128 k0 = _mm_set1_ps(float(QUAT_NLERP_K0)), k1 = _mm_set1_ps(float(QUAT_NLERP_K1));
+		for (; i + 4 <= end; i += 4) {
+			const __m128 w1 = _mm_loadu_ps(aw + i), x1 = _mm_loadu_ps(ax + i), y1 = _mm_loadu_ps(ay + i), z1 = _mm_loadu_ps(az + i);
+			__m128 w2 = _mm_loadu_ps(bw + i), x2 = _mm_loadu_ps(bx + i), y2 = _mm_loadu_ps(by + i), z2 = _mm_loadu_ps(bz + i);
+			const __m128 d = quatDotFlip(w1, x1, y1, z1, w2, x2, y2, z2);
+			const __m128 tt = tStride ? _mm_loadu_ps(t + i) : _mm_set1_ps(*t);
+			// nlerpCorrection(tt, d)
+			const __m128 k = _mm_add_ps(k0, _mm_mul_ps(k1, d));
+			const __m128 s = _mm_add_ps(tt, _mm_mul_ps(_mm_mul_ps(k, tt), _mm_mul_ps(_mm_sub_ps(tt, half), _mm_sub_ps(tt, one))));
+			const __m128 r = _mm_sub_ps(one, s);
+			const __m128 w = _mm_add_ps(_mm_mul_ps(w1, r), _mm_mul_ps(w2, s));
+			const __m128 x = _mm_add_ps(_mm_mul_ps(x1, r), _mm_mul_ps(x2, s));
+			const __m128 y = _mm_add_ps(_mm_mul_ps(y1, r), _mm_mul_ps(y2, s));
+			const __m128 z = _mm_add_ps(_mm_mul_ps(z1, r), _mm_mul_ps(z2, s));
+			const __m128 n = cvecInvSqrt(_mm_add_ps(_mm_add_ps(_mm_mul_ps(w, w), _mm_mul_ps(x, x)), _mm_add_ps(_mm_mul_ps(y, y), _mm_mul_ps(z, z))));
+			_mm_storeu_ps(ow + i, _mm_mul_ps(w, n));
+			_mm_storeu_ps(ox + i, _mm_mul_ps(x, n));
+			_mm_storeu_ps(oy + i, _mm_mul_ps(y, n));
+			_mm_storeu_ps(oz + i, _mm_mul_ps(z, n));
+		}
+#endif
+		for (; i < end; i++) {
+			const Quatf q = nlerp(Quatf(aw[i], ax[i], ay[i], az[i]), Quatf(bw[i], bx[i], by[i], bz[i]), t[i * tStride]);
+			ow[i] = q[0];
+			ox[i] = q[1];
+			oy[i] = q[2];
+			oz[i] = q[3];
+		}
+	});
+}
+
+inline void fastSlerpAll(const QuatfArray& a, const QuatfArray& b, const float* t, int tStride, QuatfArray& out) {
+	assert(a.size() == b.size());
+	out.resize(a.size());
+	const float *aw = a.component(0), *ax = a.component(1), *ay = a.component(2), *az = a.component(3);
+	const float *bw = b.component(0), *bx = b.component(1), *by = b.component(2), *bz = b.component(3);
+	float *ow = out.component(0), *ox = out.component(1), *oy = out.component(2), *oz = out.component(3);
+	soaFor(a.size(), [=](int begin, int end) {
+		int i = begin;
+#if CVEC_SIMD
+		const __m128 one = _mm_set1_ps(1.0f);
+		for (; i + 4 <= end; i += 4) {
+			const __m128 w1 = _mm_loadu_ps(aw + i), x1 = _mm_loadu_ps(ax + i), y1 = _mm_loadu_ps(ay + i), z1 = _mm_loadu_ps(az + i);
+			__m128 w2 = _mm_loadu_ps(bw + i), x2 = _mm_loadu_ps(bx + i), y2 = _mm_loadu_ps(by + i), z2 = _mm_loadu_ps(bz + i);
+			const __m128 xMinus1 = _mm_sub_ps(quatDotFlip(w1, x1, y1, z1, w2, x2, y2, z2), one);
+			const __m128 t1 = tStride ? _mm_loadu_ps(t + i) : _mm_set1_ps(*t), t0 = _mm_sub_ps(one, t1);
+			// Both weights of fastSlerpWeight side by side
+			const __m128 t0t0 = _mm_mul_ps(t0, t0), t1t1 = _mm_mul_ps(t1, t1);
+			__m128 b0 = one, b1 = one;
+			// Two levels of the nesting at a time, 1 + c1 (1 + c2 b) being
+			// (1 + c1) + c1 c2 b, which halves the chain of dependent steps
+			static_assert(QUAT_FAST_SLERP_TERMS % 2 == 0, "fastSlerpAll nests terms in pairs");
+			for (int term = QUAT_FAST_SLERP_TERMS - 1; term >= 1; term -= 2) {
+				const __m128 u1 = _mm_set1_ps(float(fastSlerpU(term))), v1 = _mm_set1_ps(float(fastSlerpV(term)));
+				const __m128 u2 = _mm_set1_ps(float(fastSlerpU(term + 1))), v2 = _mm_set1_ps(float(fastSlerpV(term + 1)));
+				const __m128 c01 = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u1, t0t0), v1), xMinus1), c02 = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u2, t0t0), v2), xMinus1);
+				const __m128 c11 = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u1, t1t1), v1), xMinus1), c12 = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u2, t1t1), v2), xMinus1);
+				b0 = _mm_add_ps(_mm_add_ps(one, c01), _mm_mul_ps(_mm_mul_ps(c01, c02), b0));
+				b1 = _mm_add_ps(_mm_add_ps(one, c11), _mm_mul_ps(_mm_mul_ps(c11, c12), b1));
+			}
+			const __m128 s0 = _mm_mul_ps(t0, b0), s1 = _mm_mul_ps(t1, b1);
+			_mm_storeu_ps(ow + i, _mm_add_ps(_mm_mul_ps(w1, s0), _mm_mul_ps(w2, s1)));
+			_mm_storeu_ps(ox + i, _mm_add_ps(_mm_mul_ps(x1, s0), _mm_mul_ps(x2, s1)));
+			_mm_storeu_ps(oy + i, _mm_add_ps(_mm_mul_ps(y1, s0), _mm_mul_ps(y2, s1)));
+			_mm_storeu_ps(oz + i, _mm_add_ps(_mm_mul_ps(z1, s0), _mm_mul_ps(z2, s1)));
+		}
+#endif
+		for (; i < end; i++) {
+			const Quatf q = fastSlerp(Quatf(aw[i], ax[i], ay[i], az[i]), Quatf(bw[i], bx[i], by[i], bz[i]), t[i * tStride]);
+			ow[i] = q[0];
+			ox[i] = q[1];
+			oy[i] = q[2];
+			oz[i] = q[3];
+		}
+	});
+}
+
+inline void nlerpAll(const QuatfArray& a, const QuatfArray& b, float t, QuatfArray& out) {
+	nlerpAll(a, b, &t, 0, out);
+}
+
+inline void nlerpAll(const QuatfArray& a, const QuatfArray& b, const float* t, QuatfArray& out) {
+	nlerpAll(a, b, t, 1, out);
+}
+
+inline void fastSlerpAll(const QuatfArray& a, const QuatfArray& b, float t, QuatfArray& out) {
+	fastSlerpAll(a, b, &t, 0, out);
+}
+
+inline void fastSlerpAll(const QuatfArray& a, const QuatfArray& b, const float* t, QuatfArray& out) {
+	fastSlerpAll(a, b, t, 1, out);
+}
+
+#endif
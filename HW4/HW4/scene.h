@@ -0,0 +1,360 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "glsupport.h"
+#include "cvec.h"
+#include "cvecsoa.h"
+#include "matrix4.h"
+#include "quat.h"
+#include "geometrymaker.h"
+#include "uniforms.h"
+#include "geometrypool.h"
+
+//--------------------------------------------------------------------------------
+// Scene objects shared by the renderer and the subsystems built on it
+//--------------------------------------------------------------------------------
+
+struct VertexPNTBTG {
+	Cvec3f p, n, b, tg;
+	Cvec2f t;
+
+	constexpr VertexPNTBTG() {};
+	constexpr VertexPNTBTG(float x, float y, float z, float nx, float ny, float nz) : p(x, y, z), n(nx, ny, nz) {}
+
+	constexpr VertexPNTBTG& operator = (const GenericVertex& v) {
+		p = v.pos;
+		n = v.normal;
+		t = v.tex;
+		b = v.binormal;
+		tg = v.tangent;
+		return *this;
+	}
+};
+
+// Lets the make* functions fill VertexPNTBTG without a GenericVertex between
+template<>
+struct VertexWriter<VertexPNTBTG> {
+	static constexpr void write(VertexPNTBTG& v, const Cvec3f& pos, const Cvec3f& normal, const Cvec2f& tex,
+		const Cvec3f& tangent, const Cvec3f& binormal) {
+		v.p = pos;
+		v.n = normal;
+		v.t = tex;
+		v.b = binormal;
+		v.tg = tangent;
+	}
+};
+
+struct Transform {
+	Cvec3 translation;
+	Quat rotation;
+	Cvec3 scale;
+
+	Transform() : scale(1.0, 1.0, 1.0) {}
+
+	Matrix4 createMatrix() {
+		Matrix4 transformMatrix;
+		transformMatrix = transformMatrix.makeTranslation(translation) * quatToMatrix(rotation) * transformMatrix.makeScale(scale);
+		return transformMatrix;
+	}
+};
+
+// A mesh is ranges of GeometryPool::shared(): vertices, with a tightly packed
+// copy of their positions in step for depth-only passes, and indices relative
+// to the first of them.
+struct Geometry {
+	int vertexRange, indexRange; // handles, -1 until uploaded
+	int numIndeces;
+
+	// Object space bounding sphere and box, from the vertices given to upload()
+	Cvec3f boundsCenter;
+	float boundsRadius;
+	Cvec3f boundsMin, boundsMax;
+
+	// Coarser versions of the mesh, e.g. from buildLodChain(), each with the
+	// largest object space distance it strays from the full mesh. Level 0 is
+	// the mesh given to upload(), level i > 0 is lods[i - 1].
+	struct Lod {
+		int vertexRange, indexRange;
+		int numIndeces;
+		float error;
+	};
+	std::vector<Lod> lods;
+
+	Geometry() : vertexRange(-1), indexRange(-1), numIndeces(0), boundsRadius(0) {}
+
+	void upload(const std::vector<VertexPNTBTG>& vertices, const std::vector<unsigned short>& indices) {
+		uploadVertices(vertices);
+		indexRange = uploadIndices(indices);
+		numIndeces = indices.size();
+	}
+
+	// The vertices and bounds alone, for geometry drawn with index ranges
+	// its owner shares between many, e.g. terrain chunks. indexRange and
+	// numIndeces are left to the owner.
+	void uploadVertices(const std::vector<VertexPNTBTG>& vertices) {
+		Cvec3fArray soaPositions;
+		vertexRange = uploadVertexRange(vertices, soaPositions);
+		setBounds(soaPositions);
+	}
+
+	// Has fill(VertexPNTBTG* vertices, unsigned short* indices) write the
+	// vertices and ibLen indices straight into the mapped ranges, e.g. with
+	// makeSphereParallel(), so they are never copied on the way. The memory
+	// is write only: fill must not read back what it wrote. positions are
+	// those of the vertices fill writes, e.g. from the same make* function
+	// into Cvec3f; they become the packed copy and give the bounds.
+	template<typename Fill>
+	void uploadMapped(const std::vector<Cvec3f>& positions, int ibLen, Fill fill) {
+		GeometryPool& pool = GeometryPool::shared();
+		vertexRange = pool.vertices.allocate((int)positions.size());
+		indexRange = pool.indices.allocate(ibLen);
+		numIndeces = ibLen;
+		writeMapped(vertexRange, indexRange, positions, fill);
+
+		Cvec3fArray soaPositions;
+		gather(positions, soaPositions);
+		setBounds(soaPositions);
+	}
+
+	// Adds the next coarser level. Its vertices should lie within the bounds
+	// of the full mesh, as simplified ones do.
+	void uploadLod(const std::vector<VertexPNTBTG>& vertices, const std::vector<unsigned short>& indices, float error) {
+		Lod lod;
+		Cvec3fArray soaPositions;
+		lod.vertexRange = uploadVertexRange(vertices, soaPositions);
+		lod.indexRange = uploadIndices(indices);
+		lod.numIndeces = indices.size();
+		lod.error = error;
+		lods.push_back(lod);
+	}
+
+	// uploadLod() as uploadMapped() does it
+	template<typename Fill>
+	void uploadLodMapped(const std::vector<Cvec3f>& positions, int ibLen, float error, Fill fill) {
+		GeometryPool& pool = GeometryPool::shared();
+		Lod lod;
+		lod.vertexRange = pool.vertices.allocate((int)positions.size());
+		lod.indexRange = pool.indices.allocate(ibLen);
+		lod.numIndeces = ibLen;
+		lod.error = error;
+		lods.push_back(lod);
+		writeMapped(lod.vertexRange, lod.indexRange, positions, fill);
+	}
+
+	// Gives every range back to the pool. Not for geometry whose index ranges
+	// belong to someone else, e.g. terrain chunks.
+	void release() {
+		GeometryPool& pool = GeometryPool::shared();
+		for (int level = 0; level < lodCount(); level++) {
+			if (lodVertexRange(level) >= 0) {
+				pool.vertices.free(lodVertexRange(level));
+			}
+			if (lodIndexRange(level) >= 0) {
+				pool.indices.free(lodIndexRange(level));
+			}
+		}
+		vertexRange = indexRange = -1;
+		numIndeces = 0;
+		lods.clear();
+	}
+
+	int lodCount() const { return 1 + (int)lods.size(); }
+	float lodError(int level) const { return level == 0 ? 0.0f : lods[level - 1].error; }
+	int lodIndexCount(int level) const { return level == 0 ? numIndeces : lods[level - 1].numIndeces; }
+	int lodVertexRange(int level) const { return level == 0 ? vertexRange : lods[level - 1].vertexRange; }
+	int lodIndexRange(int level) const { return level == 0 ? indexRange : lods[level - 1].indexRange; }
+
+	// Where the level starts in the pool's buffers, as glDrawElementsBaseVertex
+	// and indirect draws take them
+	int baseVertex(int level) const { return GeometryPool::shared().vertices.first(lodVertexRange(level)); }
+	int firstIndex(int level) const { return GeometryPool::shared().indices.first(lodIndexRange(level)); }
+
+	void Draw(GLuint positionAttribute, GLuint texCoordAttribute, GLuint normalAttribute, GLuint binormalAttribute, GLuint tangentAttribute, int lod = 0) {
+		const GeometryPool& pool = GeometryPool::shared();
+
+		//BIND BUFFER OBJECTS AND DRAW
+		glBindBuffer(GL_ARRAY_BUFFER, pool.vertices.buffer(GEOMETRY_VERTEX_DATA));
+		glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, p));
+		glEnableVertexAttribArray(positionAttribute);
+
+		glVertexAttribPointer(texCoordAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, t));
+		glEnableVertexAttribArray(texCoordAttribute);
+
+		glVertexAttribPointer(normalAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, n));
+		glEnableVertexAttribArray(normalAttribute);
+
+		glVertexAttribPointer(binormalAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, b));
+		glEnableVertexAttribArray(binormalAttribute);
+
+		glVertexAttribPointer(tangentAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNTBTG), (void*)offsetof(VertexPNTBTG, tg));
+		glEnableVertexAttribArray(tangentAttribute);
+
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indices.buffer());
+		glDrawElementsBaseVertex(GL_TRIANGLES, lodIndexCount(lod), GL_UNSIGNED_SHORT,
+			(void*)(sizeof(unsigned short) * firstIndex(lod)), baseVertex(lod));
+
+		glDisableVertexAttribArray(positionAttribute);
+		glDisableVertexAttribArray(texCoordAttribute);
+		glDisableVertexAttribArray(normalAttribute);
+		glDisableVertexAttribArray(binormalAttribute);
+		glDisableVertexAttribArray(tangentAttribute);
+	}
+
+	// Position-only draw for depth passes
+	void DrawPositions(GLuint positionAttribute, int lod = 0) {
+		const GeometryPool& pool = GeometryPool::shared();
+		glBindBuffer(GL_ARRAY_BUFFER, pool.vertices.buffer(GEOMETRY_POSITION_DATA));
+		glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(Cvec3f), 0);
+		glEnableVertexAttribArray(positionAttribute);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indices.buffer());
+		glDrawElementsBaseVertex(GL_TRIANGLES, lodIndexCount(lod), GL_UNSIGNED_SHORT,
+			(void*)(sizeof(unsigned short) * firstIndex(lod)), baseVertex(lod));
+
+		glDisableVertexAttribArray(positionAttribute);
+	}
+
+private:
+	// Sphere around the box center; not minimal but cheap and good enough to cull with
+	void setBounds(const Cvec3fArray& soaPositions) {
+		boundsCenter = boundsMin = boundsMax = Cvec3f();
+		boundsRadius = 0;
+		if (soaPositions.size() > 0) {
+			minMax(soaPositions, boundsMin, boundsMax);
+			boundsCenter = (boundsMin + boundsMax) * 0.5f;
+			boundsRadius = std::sqrt(maxDistance2(soaPositions, boundsCenter));
+		}
+	}
+
+	// Copies positions to the packed stream and has fill write the rest
+	template<typename Fill>
+	static void writeMapped(int vertexRange, int indexRange, const std::vector<Cvec3f>& positions, Fill fill) {
+		GeometryPool& pool = GeometryPool::shared();
+		pool.vertices.write(vertexRange, GEOMETRY_POSITION_DATA, positions.data());
+
+		VertexPNTBTG* vertices = (VertexPNTBTG*)pool.vertices.map(vertexRange, GEOMETRY_VERTEX_DATA);
+		unsigned short* indices = (unsigned short*)pool.indices.map(indexRange, 0);
+		if (vertices == NULL || indices == NULL) {
+			if (vertices != NULL) pool.vertices.unmap(GEOMETRY_VERTEX_DATA);
+			if (indices != NULL) pool.indices.unmap(0);
+			throw std::runtime_error("Unable to map geometry buffers");
+		}
+		fill(vertices, indices);
+		// Either unmap can report the contents lost, e.g. to a mode switch
+		const bool verticesKept = pool.vertices.unmap(GEOMETRY_VERTEX_DATA);
+		const bool indicesKept = pool.indices.unmap(0);
+		if (!verticesKept || !indicesKept) {
+			throw std::runtime_error("Geometry buffers were lost while mapped");
+		}
+	}
+
+	// The full vertices and a tightly packed copy of their positions;
+	// soaPositions is left holding the positions
+	static int uploadVertexRange(const std::vector<VertexPNTBTG>& vertices, Cvec3fArray& soaPositions) {
+		GeometryArena& arena = GeometryPool::shared().vertices;
+		const int range = arena.allocate((int)vertices.size());
+		arena.write(range, GEOMETRY_VERTEX_DATA, vertices.data());
+
+		gather(vertices, &VertexPNTBTG::p, soaPositions);
+		std::vector<Cvec3f> positions;
+		scatter(soaPositions, positions);
+		arena.write(range, GEOMETRY_POSITION_DATA, positions.data());
+		return range;
+	}
+
+	static int uploadIndices(const std::vector<unsigned short>& indices) {
+		GeometryArena& arena = GeometryPool::shared().indices;
+		const int range = arena.allocate((int)indices.size());
+		arena.write(range, 0, indices.data());
+		return range;
+	}
+};
+
+struct Entity {
+	Transform transform;
+	Geometry geometry;
+	Entity *parent;
+
+	// Static entities never move, which lets shadow maps be cached
+	bool isStatic;
+
+	// Level of detail of geometry to draw, e.g. from a LodSelector
+	int lod;
+
+	// Object to world matrix and world space bounds as of the last
+	// updateWorld(), for culling and drawing
+	Matrix4 worldMatrix;
+	Cvec3 worldCenter;
+	double worldRadius;
+	Cvec3 worldMin, worldMax;
+
+	Entity() : parent(nullptr), isStatic(false), lod(0), worldRadius(0) {}
+
+	// Call once the transforms of the entity and its parents are final for the frame
+	void updateWorld() {
+		worldMatrix = getModelViewMatrix();
+		getWorldBounds(worldCenter, worldRadius);
+
+		// The box around the transformed box: each world extent sums the
+		// object extents weighted by the absolute matrix entries
+		const Cvec3 center = (Cvec3(geometry.boundsMin[0], geometry.boundsMin[1], geometry.boundsMin[2]) + Cvec3(geometry.boundsMax[0], geometry.boundsMax[1], geometry.boundsMax[2])) * 0.5;
+		const Cvec3 extent = Cvec3(geometry.boundsMax[0], geometry.boundsMax[1], geometry.boundsMax[2]) - center;
+		for (int i = 0; i < 3; i++) {
+			double c = worldMatrix(i, 3), e = 0;
+			for (int j = 0; j < 3; j++) {
+				c += worldMatrix(i, j) * center[j];
+				e += std::abs(worldMatrix(i, j)) * extent[j];
+			}
+			worldMin[i] = c - e;
+			worldMax[i] = c + e;
+		}
+	}
+
+	// Object to world transform, parents included
+	Matrix4 getModelViewMatrix() {
+		Matrix4 modelViewMatrix = transform.createMatrix();
+		if (parent != nullptr) {
+			return parent->getModelViewMatrix() * modelViewMatrix;
+		}
+		return modelViewMatrix;
+	}
+
+	// World space bounding sphere
+	void getWorldBounds(Cvec3& center, double& radius) {
+		Matrix4 modelMatrix = getModelViewMatrix();
+		Cvec4 c = modelMatrix * Cvec4(boundsCenter(), 1.0);
+		center = Cvec3(c[0], c[1], c[2]);
+
+		double maxScale2 = 0;
+		for (int j = 0; j < 3; j++) {
+			maxScale2 = std::max(maxScale2, modelMatrix(0, j) * modelMatrix(0, j) + modelMatrix(1, j) * modelMatrix(1, j) + modelMatrix(2, j) * modelMatrix(2, j));
+		}
+		radius = geometry.boundsRadius * std::sqrt(maxScale2);
+	}
+
+	// The ObjectUniforms block for the world matrix from the last updateWorld()
+	void getObjectUniforms(const Matrix4& eyeInverse, ObjectUniforms& uniforms) const {
+		const Matrix4 modelViewMatrix = eyeInverse * worldMatrix;
+		modelViewMatrix.writeToColumnMajorMatrix(uniforms.modelViewMatrix);
+		normalMatrix(modelViewMatrix).writeToColumnMajorMatrix(uniforms.normalMatrix);
+	}
+
+	// Draws with the entity's ObjectUniforms already bound
+	void Draw(GLuint positionAttribute, GLuint texCoordAttribute, GLuint normalAttribute, GLuint binormalAttribute, GLuint tangentAttribute) {
+		geometry.Draw(positionAttribute, texCoordAttribute, normalAttribute, binormalAttribute, tangentAttribute, lod);
+	}
+
+private:
+	Cvec3 boundsCenter() const {
+		return Cvec3(geometry.boundsCenter[0], geometry.boundsCenter[1], geometry.boundsCenter[2]);
+	}
+};
+
+#endif
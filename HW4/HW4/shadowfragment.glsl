@@ -0,0 +1,16 @@
+uniform vec3 lightPosition;
+uniform float farPlane;
+uniform float linearDepth;
+
+varying vec3 worldPosition;
+
+void main() {
+	// Point lights store distance to the light, which cube map lookups can
+	// compare against directly; cascades keep the ordinary window depth
+	if (linearDepth > 0.5) {
+		gl_FragDepth = distance(worldPosition, lightPosition) / farPlane;
+	}
+	else {
+		gl_FragDepth = gl_FragCoord.z;
+	}
+}
@@ -0,0 +1,398 @@
+#include "shadows.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+static const double SHADOW_NEAR_PLANE = 0.05;
+
+// Depth range kept behind a cascade towards the light, so casters outside the
+// camera frustum still shadow what is inside it
+static const double CASCADE_CASTER_DISTANCE = 50.0;
+
+// Camera at eye looking along forward, in the usual GL convention (-z forward)
+static Matrix4 makeLookAt(const Cvec3& eye, const Cvec3& forward, const Cvec3& up) {
+	Cvec3 f = normalize(forward);
+	Cvec3 s = normalize(cross(f, up));
+	Cvec3 u = cross(s, f);
+	Matrix4 r;
+	for (int j = 0; j < 3; j++) {
+		r(0, j) = s[j];
+		r(1, j) = u[j];
+		r(2, j) = -f[j];
+	}
+	r(0, 3) = -dot(s, eye);
+	r(1, 3) = -dot(u, eye);
+	r(2, 3) = dot(f, eye);
+	return r;
+}
+
+static constexpr Matrix4 makeOrthographic(double left, double right, double bottom, double top, double nearDist, double farDist) {
+	Matrix4 r;
+	r(0, 0) = 2.0 / (right - left);
+	r(0, 3) = -(right + left) / (right - left);
+	r(1, 1) = 2.0 / (top - bottom);
+	r(1, 3) = -(top + bottom) / (top - bottom);
+	r(2, 2) = -2.0 / (farDist - nearDist);
+	r(2, 3) = -(farDist + nearDist) / (farDist - nearDist);
+	return r;
+}
+
+// Face order matches GL_TEXTURE_CUBE_MAP_POSITIVE_X + i
+static const double cubeFaceDirections[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+static const double cubeFaceUps[6][3] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+
+// Sphere against the 90 degree frustum of one cube face
+static bool sphereInCubeFace(int face, const Cvec3& fromLight, double radius) {
+	const int axis = face / 2;
+	const double forward = (face % 2 == 0 ? 1 : -1) * fromLight[axis];
+	const double margin = radius * std::sqrt(2.0);
+	for (int j = 0; j < 3; j++) {
+		if (j != axis && std::abs(fromLight[j]) - forward > margin) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool sameMatrix(const Matrix4& a, const Matrix4& b) {
+	return norm2(a - b) < CS175_EPS2;
+}
+
+void ShadowMapSystem::init(int cubeSize, int cascadeSize, const char* vertexShaderFile, const char* fragmentShaderFile) {
+	cubeSize_ = cubeSize;
+	cascadeSize_ = cascadeSize;
+
+	program_ = glCreateProgram();
+	readAndCompileShader(program_, vertexShaderFile, fragmentShaderFile);
+	positionAttribute_ = glGetAttribLocation(program_, "position");
+	modelMatrixLoc_ = glGetUniformLocation(program_, "modelMatrix");
+	lightViewProjectionLoc_ = glGetUniformLocation(program_, "lightViewProjectionMatrix");
+	lightPositionLoc_ = glGetUniformLocation(program_, "lightPosition");
+	farPlaneLoc_ = glGetUniformLocation(program_, "farPlane");
+	linearDepthLoc_ = glGetUniformLocation(program_, "linearDepth");
+
+	// Depth-only framebuffers; attachments are swapped per face/cascade
+	glGenFramebuffers(1, &frameBuffer_);
+	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer_);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glGenFramebuffers(1, &copyFrameBuffer_);
+	glBindFramebuffer(GL_FRAMEBUFFER, copyFrameBuffer_);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GLuint ShadowMapSystem::createCubeMap() {
+	GLuint cubeMap;
+	glGenTextures(1, &cubeMap);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+	for (int face = 0; face < 6; face++) {
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, cubeSize_, cubeSize_, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	return cubeMap;
+}
+
+int ShadowMapSystem::addPointLight(double farPlane) {
+	PointLightShadow light;
+	light.farPlane = farPlane;
+	light.staticCubeMap = createCubeMap();
+	light.cubeMap = createCubeMap();
+	light.staticValid = false;
+	light.usesDynamicMap = false;
+	pointLights_.push_back(light);
+	return (int)pointLights_.size() - 1;
+}
+
+void ShadowMapSystem::setPointLightPosition(int light, const Cvec3& worldPosition) {
+	PointLightShadow& shadow = pointLights_[light];
+	if (norm2(shadow.position - worldPosition) > CS175_EPS2) {
+		shadow.position = worldPosition;
+		shadow.staticValid = false;
+	}
+}
+
+GLuint ShadowMapSystem::pointShadowMap(int light) const {
+	const PointLightShadow& shadow = pointLights_[light];
+	return shadow.usesDynamicMap ? shadow.cubeMap : shadow.staticCubeMap;
+}
+
+void ShadowMapSystem::setDirectionalLight(const Cvec3& direction, int cascadeCount) {
+	assert(cascadeCount >= 0 && cascadeCount <= 4);
+	// Leave the caller's texture bindings alone; this can run mid-frame
+	GLint previousTexture = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+	if (cascadeCount > 0 && cascadeMap_ == 0) {
+		glGenTextures(1, &cascadeMap_);
+		glBindTexture(GL_TEXTURE_2D, cascadeMap_);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	if (cascadeCount > 0 && cascadeCount != cascades_.size()) {
+		// All cascades share one atlas texture, side by side
+		glBindTexture(GL_TEXTURE_2D, cascadeMap_);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, cascadeSize_ * cascadeCount, cascadeSize_, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	}
+	glBindTexture(GL_TEXTURE_2D, previousTexture);
+	sunDirection_ = normalize(direction);
+	cascades_.assign(cascadeCount, ShadowCascade());
+	for (int i = 0; i < cascades_.size(); i++) {
+		cascades_[i].valid = false;
+	}
+}
+
+void ShadowMapSystem::drawCaster(Entity* entity) {
+	GLfloat glmatrix[16];
+	entity->getModelViewMatrix().writeToColumnMajorMatrix(glmatrix);
+	glUniformMatrix4fv(modelMatrixLoc_, 1, false, glmatrix);
+	entity->geometry.DrawPositions(positionAttribute_);
+}
+
+void ShadowMapSystem::renderCubeMap(PointLightShadow& light, GLuint cubeMap, const std::vector<Entity*>& casters, bool clear) {
+	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer_);
+	glViewport(0, 0, cubeSize_, cubeSize_);
+	glUniform3f(lightPositionLoc_, light.position[0], light.position[1], light.position[2]);
+	glUniform1f(farPlaneLoc_, light.farPlane);
+	glUniform1f(linearDepthLoc_, 1.0f);
+
+	const Matrix4 projection = Matrix4::makeProjection(90.0, 1.0, -SHADOW_NEAR_PLANE, -light.farPlane);
+	for (int face = 0; face < 6; face++) {
+		std::vector<Entity*> visible;
+		for (int i = 0; i < casters.size(); i++) {
+			Cvec3 center;
+			double radius;
+			casters[i]->getWorldBounds(center, radius);
+			if (sphereInCubeFace(face, center - light.position, radius)) {
+				visible.push_back(casters[i]);
+			}
+		}
+		// A face with nothing new in it is already correct
+		if (visible.empty() && !clear) {
+			continue;
+		}
+
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubeMap, 0);
+		if (clear) {
+			glClear(GL_DEPTH_BUFFER_BIT);
+		}
+
+		const Cvec3 direction(cubeFaceDirections[face][0], cubeFaceDirections[face][1], cubeFaceDirections[face][2]);
+		const Cvec3 up(cubeFaceUps[face][0], cubeFaceUps[face][1], cubeFaceUps[face][2]);
+		GLfloat glmatrix[16];
+		(projection * makeLookAt(light.position, direction, up)).writeToColumnMajorMatrix(glmatrix);
+		glUniformMatrix4fv(lightViewProjectionLoc_, 1, false, glmatrix);
+
+		for (int i = 0; i < visible.size(); i++) {
+			drawCaster(visible[i]);
+		}
+		passesRendered_++;
+	}
+}
+
+void ShadowMapSystem::copyCubeMap(GLuint from, GLuint to) {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFrameBuffer_);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameBuffer_);
+	for (int face = 0; face < 6; face++) {
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, from, 0);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, to, 0);
+		glBlitFramebuffer(0, 0, cubeSize_, cubeSize_, 0, 0, cubeSize_, cubeSize_, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	}
+}
+
+// Fits an orthographic box around the bounding sphere of the camera frustum
+// slice. A sphere does not change size as the camera turns, and snapping its
+// center to whole shadow texels keeps the map from shimmering (and from being
+// re-rendered) while the camera stands still.
+void ShadowMapSystem::fitCascade(int cascade, double splitNear, double splitFar, const ShadowCamera& camera) {
+	const double tanHalfFovy = std::tan(camera.fovy * 0.5 * CS175_PI / 180.0);
+	Cvec3 corners[8];
+	Cvec3 center;
+	for (int i = 0; i < 8; i++) {
+		const double d = i < 4 ? splitNear : splitFar;
+		const double h = d * tanHalfFovy;
+		const double w = h * camera.aspectRatio;
+		Cvec4 corner = camera.eyeMatrix * Cvec4((i & 1) ? w : -w, (i & 2) ? h : -h, -d, 1.0);
+		corners[i] = Cvec3(corner[0], corner[1], corner[2]);
+		center += corners[i] * (1.0 / 8.0);
+	}
+	double radius = 0;
+	for (int i = 0; i < 8; i++) {
+		radius = std::max(radius, norm(corners[i] - center));
+	}
+	radius = std::ceil(radius * 16.0) / 16.0;
+
+	const Cvec3 up = std::abs(sunDirection_[1]) > 0.99 ? Cvec3(0, 0, 1) : Cvec3(0, 1, 0);
+	const Matrix4 lightView = makeLookAt(Cvec3(), sunDirection_, up);
+	Cvec4 lightCenter = lightView * Cvec4(center, 1.0);
+	const double texel = 2.0 * radius / cascadeSize_;
+	lightCenter[0] = std::floor(lightCenter[0] / texel) * texel;
+	lightCenter[1] = std::floor(lightCenter[1] / texel) * texel;
+
+	const Matrix4 projection = makeOrthographic(
+		lightCenter[0] - radius, lightCenter[0] + radius,
+		lightCenter[1] - radius, lightCenter[1] + radius,
+		-lightCenter[2] - radius - CASCADE_CASTER_DISTANCE, -lightCenter[2] + radius);
+
+	ShadowCascade& c = cascades_[cascade];
+	const Matrix4 lightViewProjection = projection * lightView;
+	if (!sameMatrix(lightViewProjection, c.lightViewProjection)) {
+		c.valid = false;
+	}
+	c.lightViewProjection = lightViewProjection;
+	c.splitFar = splitFar;
+	c.boundsCenter = center;
+	c.boundsRadius = radius;
+}
+
+void ShadowMapSystem::renderCascade(int cascade, const std::vector<Entity*>& casters) {
+	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer_);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, cascadeMap_, 0);
+	glViewport(cascade * cascadeSize_, 0, cascadeSize_, cascadeSize_);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(cascade * cascadeSize_, 0, cascadeSize_, cascadeSize_);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+
+	glUniform1f(linearDepthLoc_, 0.0f);
+	GLfloat glmatrix[16];
+	cascades_[cascade].lightViewProjection.writeToColumnMajorMatrix(glmatrix);
+	glUniformMatrix4fv(lightViewProjectionLoc_, 1, false, glmatrix);
+
+	for (int i = 0; i < casters.size(); i++) {
+		drawCaster(casters[i]);
+	}
+	cascades_[cascade].valid = true;
+	passesRendered_++;
+}
+
+Matrix4 ShadowMapSystem::cascadeMatrix(int cascade, const Matrix4& eyeMatrix) const {
+	// Clip space [-1, 1] to this cascade's tile of the atlas, depth to [0, 1]
+	const double count = (double)cascades_.size();
+	Matrix4 bias;
+	bias(0, 0) = 0.5 / count;
+	bias(0, 3) = (0.5 + cascade) / count;
+	bias(1, 1) = bias(1, 3) = 0.5;
+	bias(2, 2) = bias(2, 3) = 0.5;
+	return bias * cascades_[cascade].lightViewProjection * eyeMatrix;
+}
+
+void ShadowMapSystem::update(const std::vector<Entity*>& entities, const ShadowCamera& camera) {
+	passesRendered_ = 0;
+
+	// Which casters moved since the last update
+	std::vector<bool> moved(entities.size());
+	std::vector<Cvec3> centers(entities.size());
+	std::vector<double> radii(entities.size());
+	std::map<Entity*, Matrix4> world;
+	for (int i = 0; i < entities.size(); i++) {
+		const Matrix4 matrix = entities[i]->getModelViewMatrix();
+		std::map<Entity*, Matrix4>::iterator last = lastWorld_.find(entities[i]);
+		moved[i] = last == lastWorld_.end() || !sameMatrix(last->second, matrix);
+		world[entities[i]] = matrix;
+		entities[i]->getWorldBounds(centers[i], radii[i]);
+	}
+	// Entities no longer given are forgotten
+	lastWorld_.swap(world);
+
+	GLint previousFrameBuffer = 0, previousDepthFunc = GL_LESS;
+	GLfloat previousClearDepth = 1.0f;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFrameBuffer);
+	glGetIntegerv(GL_DEPTH_FUNC, &previousDepthFunc);
+	glGetFloatv(GL_DEPTH_CLEAR_VALUE, &previousClearDepth);
+	GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glClearDepth(1.0);
+	glUseProgram(program_);
+
+	for (int l = 0; l < pointLights_.size(); l++) {
+		PointLightShadow& light = pointLights_[l];
+
+		// A static caster that left the range, or the list, changes
+		// staticCasters, so only those moving or arriving within it are checked
+		std::vector<Entity*> staticCasters, dynamicCasters;
+		bool staticMoved = false, dynamicMoved = false;
+		for (int i = 0; i < entities.size(); i++) {
+			if (norm(centers[i] - light.position) > radii[i] + light.farPlane) {
+				continue;
+			}
+			if (entities[i]->isStatic) {
+				staticCasters.push_back(entities[i]);
+				staticMoved = staticMoved || moved[i];
+			}
+			else {
+				dynamicCasters.push_back(entities[i]);
+				dynamicMoved = dynamicMoved || moved[i];
+			}
+		}
+
+		bool staticRendered = false;
+		if (!light.staticValid || staticMoved || staticCasters != light.staticCasters) {
+			renderCubeMap(light, light.staticCubeMap, staticCasters, true);
+			light.staticValid = true;
+			light.staticCasters = staticCasters;
+			staticRendered = true;
+		}
+
+		if (dynamicCasters.empty()) {
+			light.usesDynamicMap = false;
+			light.dynamicCasters.clear();
+			continue;
+		}
+		if (staticRendered || dynamicMoved || !light.usesDynamicMap || dynamicCasters != light.dynamicCasters) {
+			copyCubeMap(light.staticCubeMap, light.cubeMap);
+			renderCubeMap(light, light.cubeMap, dynamicCasters, false);
+		}
+		light.usesDynamicMap = true;
+		light.dynamicCasters = dynamicCasters;
+	}
+
+	// Practical split scheme: halfway between uniform and logarithmic splits
+	const int count = (int)cascades_.size();
+	double splitNear = camera.zNear;
+	for (int c = 0; c < count; c++) {
+		const double t = (c + 1) / (double)count;
+		const double splitFar = 0.75 * camera.zNear * std::pow(camera.zFar / camera.zNear, t) + 0.25 * (camera.zNear + (camera.zFar - camera.zNear) * t);
+		fitCascade(c, splitNear, splitFar, camera);
+		splitNear = splitFar;
+
+		ShadowCascade& cascade = cascades_[c];
+		std::vector<Entity*> casters;
+		bool casterMoved = false;
+		for (int i = 0; i < entities.size(); i++) {
+			// Anything up to CASCADE_CASTER_DISTANCE towards the sun may shadow the slice
+			Cvec3 toCaster = centers[i] - cascade.boundsCenter;
+			double along = dot(toCaster, sunDirection_);
+			Cvec3 across = toCaster - sunDirection_ * along;
+			if (norm(across) > cascade.boundsRadius + radii[i] || along > cascade.boundsRadius + radii[i] || along < -(cascade.boundsRadius + radii[i] + CASCADE_CASTER_DISTANCE)) {
+				continue;
+			}
+			casters.push_back(entities[i]);
+			casterMoved = casterMoved || moved[i];
+		}
+		if (!cascade.valid || casterMoved || casters != cascade.casters) {
+			renderCascade(c, casters);
+		}
+		cascade.casters = casters;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFrameBuffer);
+	glDepthFunc(previousDepthFunc);
+	glClearDepth(previousClearDepth);
+	if (cullFace) {
+		glEnable(GL_CULL_FACE);
+	}
+	if (!depthTest) {
+		glDisable(GL_DEPTH_TEST);
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include <map>
+#include <vector>
+
+#include "glsupport.h"
+#include "scene.h"
+
+//--------------------------------------------------------------------------------
+// Shadow maps: a depth cube map per point light and an optional cascaded map
+// for one directional light. Maps are only re-rendered when the light or a
+// caster inside its range moved; static casters are kept in a separate cached
+// map that moving casters are composited over.
+//--------------------------------------------------------------------------------
+
+// The camera the cascades are fitted to. eyeMatrix is camera to world, near
+// and far are positive distances.
+struct ShadowCamera {
+	Matrix4 eyeMatrix;
+	double fovy, aspectRatio;
+	double zNear, zFar;
+};
+
+struct PointLightShadow {
+	Cvec3 position;
+	double farPlane;
+
+	GLuint staticCubeMap;  // static casters only
+	GLuint cubeMap;        // static map with the moving casters drawn over it
+	bool staticValid;      // staticCubeMap matches the light and static casters
+	bool usesDynamicMap;   // whether cubeMap (rather than staticCubeMap) is current
+	std::vector<Entity*> dynamicCasters; // moving casters drawn into cubeMap
+	std::vector<Entity*> staticCasters;  // static casters drawn into staticCubeMap
+};
+
+struct ShadowCascade {
+	Matrix4 lightViewProjection; // world to light clip space
+	double splitFar;             // eye space distance the cascade reaches
+	Cvec3 boundsCenter;          // world space sphere the cascade covers
+	double boundsRadius;
+	bool valid;
+	std::vector<Entity*> casters; // casters drawn at the last render
+};
+
+class ShadowMapSystem {
+	int cubeSize_, cascadeSize_;
+	GLuint program_;
+	GLint positionAttribute_, modelMatrixLoc_, lightViewProjectionLoc_, lightPositionLoc_, farPlaneLoc_, linearDepthLoc_;
+	GLuint frameBuffer_, copyFrameBuffer_;
+
+	std::vector<PointLightShadow> pointLights_;
+
+	Cvec3 sunDirection_;
+	std::vector<ShadowCascade> cascades_;
+	GLuint cascadeMap_;
+
+	// World matrices of the entities given to the last update, to tell which
+	// casters moved
+	std::map<Entity*, Matrix4> lastWorld_;
+	int passesRendered_;
+
+	GLuint createCubeMap();
+	void renderCubeMap(PointLightShadow& light, GLuint cubeMap, const std::vector<Entity*>& casters, bool clear);
+	void copyCubeMap(GLuint from, GLuint to);
+	void fitCascade(int cascade, double splitNear, double splitFar, const ShadowCamera& camera);
+	void renderCascade(int cascade, const std::vector<Entity*>& casters);
+	void drawCaster(Entity* entity);
+
+public:
+	ShadowMapSystem() : cubeSize_(0), cascadeSize_(0), program_(0), frameBuffer_(0), copyFrameBuffer_(0), cascadeMap_(0), passesRendered_(0) {}
+
+	// Needs a current GL context
+	void init(int cubeSize, int cascadeSize, const char* vertexShaderFile, const char* fragmentShaderFile);
+
+	// Returns the light index. Casters farther than farPlane cast no shadow.
+	int addPointLight(double farPlane);
+	void setPointLightPosition(int light, const Cvec3& worldPosition);
+
+	// direction is the way the light travels, in world space. cascadeCount of
+	// 0 turns the directional light off; at most 4 are supported.
+	void setDirectionalLight(const Cvec3& direction, int cascadeCount);
+
+	// Re-renders whatever is out of date. Expects the entities' transforms for
+	// this frame to be final.
+	void update(const std::vector<Entity*>& entities, const ShadowCamera& camera);
+
+	int pointLightCount() const { return (int)pointLights_.size(); }
+	GLuint pointShadowMap(int light) const;
+	double pointShadowFarPlane(int light) const { return pointLights_[light].farPlane; }
+
+	int cascadeCount() const { return (int)cascades_.size(); }
+	GLuint cascadeShadowMap() const { return cascadeMap_; }
+	const Cvec3& sunDirection() const { return sunDirection_; }
+	double cascadeSplit(int cascade) const { return cascades_[cascade].splitFar; }
+	// Eye space to (atlas texture coordinates, depth) for the lighting shader
+	Matrix4 cascadeMatrix(int cascade, const Matrix4& eyeMatrix) const;
+
+	// Cube faces and cascades drawn by the last update
+	int passesRenderedLastUpdate() const { return passesRendered_; }
+};
+
+#endif
@@ -0,0 +1,13 @@
+attribute vec4 position;
+
+uniform mat4 modelMatrix;
+uniform mat4 lightViewProjectionMatrix;
+
+varying vec3 worldPosition;
+
+void main()
+{
+	vec4 p = modelMatrix * position;
+	worldPosition = p.xyz;
+	gl_Position = lightViewProjectionMatrix * p;
+}
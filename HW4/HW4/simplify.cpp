@@ -0,0 +1,479 @@
+#include "simplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+// Hash of a run of floats by their bits, for welding exact duplicates
+template <int n>
+struct FloatKey {
+	unsigned int bits[n];
+
+	bool operator == (const FloatKey& other) const {
+		return std::memcmp(bits, other.bits, sizeof(bits)) == 0;
+	}
+};
+
+template <int n>
+struct FloatKeyHash {
+	size_t operator () (const FloatKey<n>& key) const {
+		size_t h = 0;
+		for (int i = 0; i < n; i++) {
+			h = h * 0x9E3779B1u + key.bits[i];
+		}
+		return h ^ (h >> 16);
+	}
+};
+
+static FloatKey<3> positionKey(const VertexPNTBTG& v) {
+	FloatKey<3> key;
+	std::memcpy(key.bits, &v.p[0], sizeof(key.bits));
+	return key;
+}
+
+static FloatKey<8> wedgeKey(const VertexPNTBTG& v) {
+	FloatKey<8> key;
+	std::memcpy(key.bits, &v.p[0], 3 * sizeof(float));
+	std::memcpy(key.bits + 3, &v.n[0], 3 * sizeof(float));
+	std::memcpy(key.bits + 6, &v.t[0], 2 * sizeof(float));
+	return key;
+}
+
+void weldVertices(const std::vector<VertexPNTBTG>& vertices, const std::vector<unsigned short>& indices,
+	std::vector<VertexPNTBTG>& outVertices, std::vector<unsigned short>& outIndices) {
+	std::unordered_map<FloatKey<8>, int, FloatKeyHash<8> > welded;
+	std::vector<int> remap(vertices.size());
+	outVertices.clear();
+	for (int i = 0; i < vertices.size(); i++) {
+		auto found = welded.insert(std::make_pair(wedgeKey(vertices[i]), (int)outVertices.size()));
+		if (found.second) {
+			outVertices.push_back(vertices[i]);
+			outVertices.back().b = Cvec3f();
+			outVertices.back().tg = Cvec3f();
+		}
+		remap[i] = found.first->second;
+		outVertices[remap[i]].b += vertices[i].b;
+		outVertices[remap[i]].tg += vertices[i].tg;
+	}
+	// Corners whose tangents cancel out keep the first one's
+	for (int i = (int)vertices.size() - 1; i >= 0; i--) {
+		VertexPNTBTG& v = outVertices[remap[i]];
+		if (norm2(v.b) < CS175_EPS2 || norm2(v.tg) < CS175_EPS2) {
+			v.b = vertices[i].b;
+			v.tg = vertices[i].tg;
+		}
+	}
+	for (int i = 0; i < outVertices.size(); i++) {
+		normalize(outVertices[i].b);
+		normalize(outVertices[i].tg);
+	}
+	outIndices.resize(indices.size());
+	for (int i = 0; i < indices.size(); i++) {
+		outIndices[i] = (unsigned short)remap[indices[i]];
+	}
+}
+
+void compactVertices(const std::vector<VertexPNTBTG>& vertices, const std::vector<unsigned short>& indices,
+	std::vector<VertexPNTBTG>& outVertices, std::vector<unsigned short>& outIndices) {
+	std::vector<int> remap(vertices.size(), -1);
+	outVertices.clear();
+	outIndices.resize(indices.size());
+	for (int i = 0; i < indices.size(); i++) {
+		if (remap[indices[i]] < 0) {
+			remap[indices[i]] = (int)outVertices.size();
+			outVertices.push_back(vertices[indices[i]]);
+		}
+		outIndices[i] = (unsigned short)remap[indices[i]];
+	}
+}
+
+// Sum of squared distances to planes, weighted by the area of the triangle
+// each came from: the symmetric 4x4 matrix by its upper triangle
+struct Quadric {
+	double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+	double weight;
+
+	Quadric() : xx(0), xy(0), xz(0), xw(0), yy(0), yz(0), yw(0), zz(0), zw(0), ww(0), weight(0) {}
+
+	void addPlane(const Cvec3& n, double d, double w) {
+		xx += w * n[0] * n[0]; xy += w * n[0] * n[1]; xz += w * n[0] * n[2]; xw += w * n[0] * d;
+		yy += w * n[1] * n[1]; yz += w * n[1] * n[2]; yw += w * n[1] * d;
+		zz += w * n[2] * n[2]; zw += w * n[2] * d;
+		ww += w * d * d;
+		weight += w;
+	}
+
+	Quadric& operator += (const Quadric& q) {
+		xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+		yy += q.yy; yz += q.yz; yw += q.yw;
+		zz += q.zz; zw += q.zw;
+		ww += q.ww;
+		weight += q.weight;
+		return *this;
+	}
+
+	// Mean squared distance of p from the planes
+	double error(const Cvec3f& p) const {
+		const double x = p[0], y = p[1], z = p[2];
+		const double e = xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x
+			+ yy * y * y + 2 * yz * y * z + 2 * yw * y
+			+ zz * z * z + 2 * zw * z
+			+ ww;
+		return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+	}
+};
+
+// How a position may move: anywhere, only along its open border, only along
+// the seam between its two wedges, or not at all
+enum VertexKind {
+	VERTEX_MANIFOLD,
+	VERTEX_BORDER,
+	VERTEX_SEAM,
+	VERTEX_LOCKED
+};
+
+struct Collapse {
+	int from, to; // position classes
+	double error;
+
+	bool operator < (const Collapse& other) const { return error < other.error; }
+};
+
+static unsigned long long edgeKey(unsigned long long a, unsigned long long b) {
+	return std::min(a, b) << 32 | std::max(a, b);
+}
+
+// A collapse is left for a later pass once this far above the error of the
+// cheapest ones that would reach the target, so the order stays close to
+// one collapse at a time
+static const double SIMPLIFY_PASS_ERROR_SLACK = 1.5 * 1.5;
+
+// Rejects collapses that turn a triangle by more than about 75 degrees
+static const double SIMPLIFY_MIN_NORMAL_COS = 0.25;
+
+// Weight, per squared length, of the planes that hold borders and seams in
+// place, against the area weight of the faces
+static const double SIMPLIFY_EDGE_WEIGHT = 10.0;
+
+float simplifyMesh(const std::vector<VertexPNTBTG>& vertices, const std::vector<unsigned short>& indices, int targetIndexCount,
+	std::vector<unsigned short>& outIndices) {
+	const int vertexCount = (int)vertices.size();
+	outIndices = indices;
+
+	// Vertices at the same position are wedges of one position class
+	std::vector<int> classOf(vertexCount);
+	std::vector<int> firstWedge(1, 0), wedges(vertexCount);
+	int classCount = 0;
+	{
+		std::unordered_map<FloatKey<3>, int, FloatKeyHash<3> > classes;
+		for (int i = 0; i < vertexCount; i++) {
+			classOf[i] = classes.insert(std::make_pair(positionKey(vertices[i]), classCount)).first->second;
+			if (classOf[i] == classCount) {
+				classCount++;
+				firstWedge.push_back(0);
+			}
+			firstWedge[classOf[i] + 1]++;
+		}
+		for (int i = 0; i < classCount; i++) {
+			firstWedge[i + 1] += firstWedge[i];
+		}
+		std::vector<int> fill(firstWedge.begin(), firstWedge.end() - 1);
+		for (int i = 0; i < vertexCount; i++) {
+			wedges[fill[classOf[i]]++] = i;
+		}
+	}
+
+	// Edges between positions used by one triangle are on a border; by more
+	// than two, non-manifold
+	std::unordered_map<unsigned long long, int> edgeUses;
+	for (int i = 0; i < indices.size(); i += 3) {
+		for (int j = 0; j < 3; j++) {
+			edgeUses[edgeKey(classOf[indices[i + j]], classOf[indices[i + (j + 1) % 3]])]++;
+		}
+	}
+	std::vector<unsigned char> kind(classCount);
+	{
+		std::vector<int> borderEdges(classCount, 0);
+		std::vector<unsigned char> nonManifold(classCount, 0);
+		for (auto it = edgeUses.begin(); it != edgeUses.end(); ++it) {
+			const int a = (int)(it->first >> 32), b = (int)(it->first & 0xffffffffu);
+			if (it->second == 1) {
+				borderEdges[a]++;
+				borderEdges[b]++;
+			}
+			else if (it->second > 2) {
+				nonManifold[a] = nonManifold[b] = 1;
+			}
+		}
+		for (int i = 0; i < classCount; i++) {
+			const int wedgeCount = firstWedge[i + 1] - firstWedge[i];
+			if (nonManifold[i] || wedgeCount > 2 || (wedgeCount == 2 && borderEdges[i] > 0)) {
+				kind[i] = VERTEX_LOCKED;
+			}
+			else if (wedgeCount == 2) {
+				kind[i] = VERTEX_SEAM;
+			}
+			else if (borderEdges[i] == 0) {
+				kind[i] = VERTEX_MANIFOLD;
+			}
+			else {
+				kind[i] = borderEdges[i] == 2 ? VERTEX_BORDER : VERTEX_LOCKED;
+			}
+		}
+	}
+
+	// Face planes, plus planes standing on every border and seam edge so
+	// moving off those lines costs as much as moving off the surface
+	std::vector<Quadric> quadrics(classCount);
+	{
+		std::unordered_map<unsigned long long, int> vertexEdges;
+		for (int i = 0; i < indices.size(); i += 3) {
+			for (int j = 0; j < 3; j++) {
+				vertexEdges[edgeKey(indices[i + j], indices[i + (j + 1) % 3])]++;
+			}
+		}
+		for (int i = 0; i < indices.size(); i += 3) {
+			const Cvec3f& p0 = vertices[indices[i]].p, & p1 = vertices[indices[i + 1]].p, & p2 = vertices[indices[i + 2]].p;
+			const Cvec3f n = cross(p1 - p0, p2 - p0);
+			const double length = norm(n);
+			if (length < CS175_EPS2) {
+				continue;
+			}
+			const Cvec3 unit = Cvec3(n[0], n[1], n[2]) / length;
+			for (int j = 0; j < 3; j++) {
+				const Cvec3f& p = vertices[indices[i + j]].p;
+				quadrics[classOf[indices[i + j]]].addPlane(unit, -(unit[0] * p[0] + unit[1] * p[1] + unit[2] * p[2]), length * 0.5);
+			}
+			for (int j = 0; j < 3; j++) {
+				const int a = indices[i + j], b = indices[i + (j + 1) % 3];
+				if (vertexEdges[edgeKey(a, b)] != 1) {
+					continue;
+				}
+				const Cvec3f edge = vertices[b].p - vertices[a].p;
+				const double length2 = norm2(edge);
+				Cvec3 side = cross(Cvec3(edge[0], edge[1], edge[2]), unit);
+				if (length2 < CS175_EPS2 || norm2(side) < CS175_EPS2) {
+					continue;
+				}
+				side = side / norm(side);
+				const Cvec3f& p = vertices[a].p;
+				const double d = -(side[0] * p[0] + side[1] * p[1] + side[2] * p[2]);
+				quadrics[classOf[a]].addPlane(side, d, length2 * SIMPLIFY_EDGE_WEIGHT);
+				quadrics[classOf[b]].addPlane(side, d, length2 * SIMPLIFY_EDGE_WEIGHT);
+			}
+		}
+	}
+
+	double maxError = 0.0;
+	std::vector<int> firstTriangle(vertexCount + 1), triangles;
+	std::vector<int> remap(vertexCount), target(2);
+	std::vector<unsigned char> locked(classCount);
+	std::vector<Collapse> collapses;
+	std::vector<int> neighbours;
+	while (outIndices.size() > targetIndexCount) {
+		// Triangles around each vertex
+		const int triangleCount = (int)outIndices.size() / 3;
+		std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+		for (int i = 0; i < outIndices.size(); i++) {
+			firstTriangle[outIndices[i] + 1]++;
+		}
+		for (int i = 0; i < vertexCount; i++) {
+			firstTriangle[i + 1] += firstTriangle[i];
+		}
+		triangles.resize(outIndices.size());
+		{
+			std::vector<int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+			for (int i = 0; i < outIndices.size(); i++) {
+				triangles[fill[outIndices[i]]++] = i / 3;
+			}
+		}
+		edgeUses.clear();
+		for (int i = 0; i < outIndices.size(); i += 3) {
+			for (int j = 0; j < 3; j++) {
+				edgeUses[edgeKey(classOf[outIndices[i + j]], classOf[outIndices[i + (j + 1) % 3]])]++;
+			}
+		}
+
+		// Both ways along every edge whose first end may move at all; whether
+		// it may move that way is checked once it comes up
+		collapses.clear();
+		for (int i = 0; i < outIndices.size(); i += 3) {
+			for (int j = 0; j < 3; j++) {
+				const int a = classOf[outIndices[i + j]], b = classOf[outIndices[i + (j + 1) % 3]];
+				const Cvec3f& pa = vertices[outIndices[i + j]].p, & pb = vertices[outIndices[i + (j + 1) % 3]].p;
+				if (kind[a] != VERTEX_LOCKED && (kind[a] != VERTEX_BORDER || edgeUses[edgeKey(a, b)] == 1)) {
+					Collapse c = { a, b, quadrics[a].error(pb) };
+					collapses.push_back(c);
+				}
+				if (kind[b] != VERTEX_LOCKED && (kind[b] != VERTEX_BORDER || edgeUses[edgeKey(a, b)] == 1)) {
+					Collapse c = { b, a, quadrics[b].error(pa) };
+					collapses.push_back(c);
+				}
+			}
+		}
+		if (collapses.empty()) {
+			break;
+		}
+		std::sort(collapses.begin(), collapses.end());
+		// Each collapse takes about two triangles, and most come up twice
+		const int wanted = triangleCount - targetIndexCount / 3;
+		double errorLimit = collapses[std::min(wanted, (int)collapses.size() - 1)].error * SIMPLIFY_PASS_ERROR_SLACK;
+
+		for (int i = 0; i < vertexCount; i++) {
+			remap[i] = i;
+		}
+		std::fill(locked.begin(), locked.end(), 0);
+		int removed = 0, collapsed = 0;
+		for (int c = 0; c < collapses.size() && triangleCount - removed > targetIndexCount / 3; c++) {
+			const int from = collapses[c].from, to = collapses[c].to;
+			if (collapses[c].error > errorLimit && collapsed > 0) {
+				break;
+			}
+			if (locked[from] || locked[to]) {
+				continue;
+			}
+
+			// Each wedge of from goes to the one wedge of to it shares
+			// triangles with; a seam moves along itself, so its two wedges
+			// must go to different ones
+			const int wedgeCount = firstWedge[from + 1] - firstWedge[from];
+			bool valid = true;
+			int dropping = 0;
+			for (int w = 0; w < wedgeCount && valid; w++) {
+				const int wedge = wedges[firstWedge[from] + w];
+				target[w] = -1;
+				for (int t = firstTriangle[wedge]; t < firstTriangle[wedge + 1] && valid; t++) {
+					const unsigned short* corner = &outIndices[3 * triangles[t]];
+					for (int k = 0; k < 3; k++) {
+						if (classOf[corner[k]] == to) {
+							valid = target[w] < 0 || target[w] == corner[k];
+							target[w] = corner[k];
+						}
+					}
+				}
+				valid = valid && target[w] >= 0;
+			}
+			if (!valid || (wedgeCount == 2 && target[0] == target[1])) {
+				continue;
+			}
+
+			// Every triangle kept must keep facing the same way
+			for (int w = 0; w < wedgeCount && valid; w++) {
+				const int wedge = wedges[firstWedge[from] + w];
+				const Cvec3f& pFrom = vertices[wedge].p, & pTo = vertices[target[w]].p;
+				for (int t = firstTriangle[wedge]; t < firstTriangle[wedge + 1] && valid; t++) {
+					const unsigned short* corner = &outIndices[3 * triangles[t]];
+					int k = 0;
+					while (corner[k] != wedge) {
+						k++;
+					}
+					const int a = corner[(k + 1) % 3], b = corner[(k + 2) % 3];
+					if (a == target[w] || b == target[w]) {
+						dropping++;
+						continue;
+					}
+					const Cvec3f& pa = vertices[a].p, & pb = vertices[b].p;
+					const Cvec3f before = cross(pa - pFrom, pb - pFrom);
+					const Cvec3f after = cross(pa - pTo, pb - pTo);
+					valid = dot(before, after) >= SIMPLIFY_MIN_NORMAL_COS * std::sqrt(norm2(before) * norm2(after));
+				}
+			}
+			if (!valid || dropping == 0) {
+				continue;
+			}
+
+			// Only the corners of the dropped triangles may neighbour both ends,
+			// or the collapse would pinch the surface into a non-manifold edge
+			neighbours.clear();
+			for (int w = firstWedge[from]; w < firstWedge[from + 1]; w++) {
+				for (int t = firstTriangle[wedges[w]]; t < firstTriangle[wedges[w] + 1]; t++) {
+					for (int k = 0; k < 3; k++) {
+						const int n = classOf[outIndices[3 * triangles[t] + k]];
+						if (n != from && n != to && std::find(neighbours.begin(), neighbours.end(), n) == neighbours.end()) {
+							neighbours.push_back(n);
+						}
+					}
+				}
+			}
+			int shared = 0;
+			for (int w = firstWedge[to]; w < firstWedge[to + 1]; w++) {
+				for (int t = firstTriangle[wedges[w]]; t < firstTriangle[wedges[w] + 1]; t++) {
+					for (int k = 0; k < 3; k++) {
+						std::vector<int>::iterator n = std::find(neighbours.begin(), neighbours.end(), classOf[outIndices[3 * triangles[t] + k]]);
+						if (n != neighbours.end()) {
+							*n = -1;
+							shared++;
+						}
+					}
+				}
+			}
+			if (shared > dropping) {
+				continue;
+			}
+
+			for (int w = 0; w < wedgeCount; w++) {
+				const int wedge = wedges[firstWedge[from] + w];
+				remap[wedge] = target[w];
+				// Everything around the wedge changes shape
+				for (int t = firstTriangle[wedge]; t < firstTriangle[wedge + 1]; t++) {
+					for (int k = 0; k < 3; k++) {
+						locked[classOf[outIndices[3 * triangles[t] + k]]] = 1;
+					}
+				}
+			}
+			quadrics[to] += quadrics[from];
+			// The cheapest ones may all have been invalid
+			if (collapsed == 0) {
+				errorLimit = std::max(errorLimit, collapses[c].error * SIMPLIFY_PASS_ERROR_SLACK);
+			}
+			maxError = std::max(maxError, collapses[c].error);
+			removed += dropping;
+			collapsed++;
+		}
+		if (collapsed == 0) {
+			break;
+		}
+
+		// Triangles with two corners at one position have no area left
+		int kept = 0;
+		for (int i = 0; i < outIndices.size(); i += 3) {
+			const int a = remap[outIndices[i]], b = remap[outIndices[i + 1]], c = remap[outIndices[i + 2]];
+			if (classOf[a] == classOf[b] || classOf[b] == classOf[c] || classOf[c] == classOf[a]) {
+				continue;
+			}
+			outIndices[kept++] = (unsigned short)a;
+			outIndices[kept++] = (unsigned short)b;
+			outIndices[kept++] = (unsigned short)c;
+		}
+		outIndices.resize(kept);
+	}
+	return (float)std::sqrt(maxError);
+}
+
+// A level smaller than this fraction of the one before isn't worth keeping
+static const float LOD_MIN_REDUCTION = 0.9f;
+
+void buildLodChain(const std::vector<VertexPNTBTG>& vertices, const std::vector<unsigned short>& indices, int levels, float ratio,
+	std::vector<MeshLod>& lods) {
+	std::vector<VertexPNTBTG> welded;
+	std::vector<unsigned short> weldedIndices, simplified;
+	weldVertices(vertices, indices, welded, weldedIndices);
+
+	// Each level starts over from the full mesh, so its error is measured
+	// against that rather than the level before
+	lods.clear();
+	int previousCount = (int)indices.size();
+	float target = (float)indices.size();
+	for (int level = 0; level < levels; level++) {
+		target *= ratio;
+		const float error = simplifyMesh(welded, weldedIndices, (int)target / 3 * 3, simplified);
+		if (simplified.size() > previousCount * LOD_MIN_REDUCTION) {
+			break;
+		}
+		lods.push_back(MeshLod());
+		compactVertices(welded, simplified, lods.back().vertices, lods.back().indices);
+		lods.back().error = error;
+		previousCount = (int)simplified.size();
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <vector>
+
+#include "scene.h"
+
+//--------------------------------------------------------------------------------
+// Mesh simplification for levels of detail. simplifyMesh() collapses edges
+// in order of their quadric error (Garland and Heckbert), always moving one
+// vertex onto the other so no new vertices, and no new attributes, are ever
+// made up. Interior vertices move freely and vertices on an open border only
+// slide along it. A vertex split into two wedges by a UV or normal seam slides
+// along the seam, both wedges together, so the seam stays closed. Vertices
+// with more than two wedges, on a non-manifold edge, or on a seam that meets
+// a border stay where they are.
+//--------------------------------------------------------------------------------
+
+// Merges vertices with equal position, normal and texture coordinates, which
+// loadObjFile() keeps apart per face corner, and averages their tangents and
+// binormals. The simplifier needs the corners shared to see which faces meet.
+void weldVertices(const std::vector<VertexPNTBTG>& vertices, const std::vector<unsigned short>& indices,
+	std::vector<VertexPNTBTG>& outVertices, std::vector<unsigned short>& outIndices);
+
+// Drops the vertices indices doesn't use and renumbers the rest
+void compactVertices(const std::vector<VertexPNTBTG>& vertices, const std::vector<unsigned short>& indices,
+	std::vector<VertexPNTBTG>& outVertices, std::vector<unsigned short>& outIndices);
+
+// Collapses edges of a welded triangle list until no more than
+// targetIndexCount indices are left or nothing else can go. outIndices still
+// refer to vertices. Returns the largest error of a collapse made, as an
+// object space distance.
+float simplifyMesh(const std::vector<VertexPNTBTG>& vertices, const std::vector<unsigned short>& indices, int targetIndexCount,
+	std::vector<unsigned short>& outIndices);
+
+struct MeshLod {
+	std::vector<VertexPNTBTG> vertices;
+	std::vector<unsigned short> indices;
+	float error;
+};
+
+// Up to levels coarser versions of a triangle list as loadObjFile() and
+// fillVertexBTG() make them, each with about ratio times the triangles of the
+// one before. Stops early once a level no longer gets meaningfully smaller.
+void buildLodChain(const std::vector<VertexPNTBTG>& vertices, const std::vector<unsigned short>& indices, int levels, float ratio,
+	std::vector<MeshLod>& lods);
+
+#endif
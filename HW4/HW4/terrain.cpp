@@ -0,0 +1,317 @@
+#include "terrain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "stb_image.h"
+
+void Heightfield::generate(int width, int depth, const std::function<float(float, float)>& height) {
+	assert(width >= 2 && depth >= 2);
+	width_ = width;
+	depth_ = depth;
+	heights_.resize(width * depth);
+	for (int z = 0; z < depth; z++) {
+		for (int x = 0; x < width; x++) {
+			heights_[z * width + x] = height(float(x) / (width - 1), float(z) / (depth - 1));
+		}
+	}
+}
+
+void Heightfield::load(const char* filePath) {
+	int width, depth, components;
+	unsigned char* image = stbi_load(filePath, &width, &depth, &components, 1);
+	if (image == nullptr) {
+		throw std::runtime_error(std::string("Unable to load heightfield ") + filePath);
+	}
+	if (width < 2 || depth < 2) {
+		stbi_image_free(image);
+		throw std::runtime_error(std::string("Heightfield too small: ") + filePath);
+	}
+	width_ = width;
+	depth_ = depth;
+	heights_.resize(width * depth);
+	for (int i = 0; i < width * depth; i++) {
+		heights_[i] = image[i] / 255.0f;
+	}
+	stbi_image_free(image);
+}
+
+float Heightfield::sample(double x, double z) const {
+	x = std::min(std::max(x, 0.0), width_ - 1.0);
+	z = std::min(std::max(z, 0.0), depth_ - 1.0);
+	const int x0 = std::min((int)x, width_ - 2), z0 = std::min((int)z, depth_ - 2);
+	const float fx = x - x0, fz = z - z0;
+	const float h0 = at(x0, z0) + (at(x0 + 1, z0) - at(x0, z0)) * fx;
+	const float h1 = at(x0, z0 + 1) + (at(x0 + 1, z0 + 1) - at(x0, z0 + 1)) * fx;
+	return h0 + (h1 - h0) * fz;
+}
+
+void makeTerrainChunkIndices(int level, int stitchMask, std::vector<unsigned short>& indices) {
+	assert(0 <= level && level < TERRAIN_LEVELS);
+	const int step = 1 << level, side = TERRAIN_CHUNK_CELLS + 1;
+	// Nothing is coarser than the last level
+	if (level == TERRAIN_LEVELS - 1) {
+		stitchMask = 0;
+	}
+	const auto vertex = [=](int x, int z) {
+		// Chunk corners are even on the levels left, so at most one of these applies
+		if (((stitchMask & TERRAIN_STITCH_NEG_Z) && z == 0) || ((stitchMask & TERRAIN_STITCH_POS_Z) && z == TERRAIN_CHUNK_CELLS)) {
+			x -= (x / step & 1) * step;
+		}
+		if (((stitchMask & TERRAIN_STITCH_NEG_X) && x == 0) || ((stitchMask & TERRAIN_STITCH_POS_X) && x == TERRAIN_CHUNK_CELLS)) {
+			z -= (z / step & 1) * step;
+		}
+		return z * side + x;
+	};
+	// Moving a vertex collapses the triangles along that side into a fan
+	const auto triangle = [&indices](int a, int b, int c) {
+		if (a != b && b != c && c != a) {
+			indices.push_back(a);
+			indices.push_back(b);
+			indices.push_back(c);
+		}
+	};
+
+	indices.clear();
+	for (int z = 0; z < TERRAIN_CHUNK_CELLS; z += step) {
+		for (int x = 0; x < TERRAIN_CHUNK_CELLS; x += step) {
+			// Split as makeGrid() does
+			triangle(vertex(x, z), vertex(x, z + step), vertex(x + step, z + step));
+			triangle(vertex(x, z), vertex(x + step, z + step), vertex(x + step, z));
+		}
+	}
+}
+
+void makeTerrainChunkVertices(const Heightfield& heightfield, int chunksX, int chunksZ, float cellSize, float heightScale,
+	int chunkX, int chunkZ, std::vector<VertexPNTBTG>& vertices, float errors[TERRAIN_LEVELS]) {
+	const int cellsX = chunksX * TERRAIN_CHUNK_CELLS, cellsZ = chunksZ * TERRAIN_CHUNK_CELLS;
+	const int side = TERRAIN_CHUNK_CELLS + 1;
+
+	// Everything depends only on the terrain wide vertex, so vertices two
+	// chunks share come out the same in both
+	const auto height = [&](int x, int z) {
+		x = std::min(std::max(x, 0), cellsX);
+		z = std::min(std::max(z, 0), cellsZ);
+		return heightScale * heightfield.sample(double(x) * (heightfield.width() - 1) / cellsX, double(z) * (heightfield.depth() - 1) / cellsZ);
+	};
+
+	std::vector<float> heights(side * side);
+	vertices.resize(side * side);
+	for (int j = 0; j < side; j++) {
+		for (int i = 0; i < side; i++) {
+			const int x = chunkX * TERRAIN_CHUNK_CELLS + i, z = chunkZ * TERRAIN_CHUNK_CELLS + j;
+			const float h = heights[j * side + i] = height(x, z);
+
+			// Central differences, one sided at the terrain's edges
+			const int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, cellsX);
+			const int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, cellsZ);
+			const float slopeX = (height(x1, z) - height(x0, z)) / ((x1 - x0) * cellSize);
+			const float slopeZ = (height(x, z1) - height(x, z0)) / ((z1 - z0) * cellSize);
+
+			VertexPNTBTG& v = vertices[j * side + i];
+			v.p = Cvec3f((x - cellsX * 0.5f) * cellSize, h, (z - cellsZ * 0.5f) * cellSize);
+			v.n = normalize(Cvec3f(-slopeX, 1, -slopeZ));
+			v.tg = normalize(Cvec3f(1, slopeX, 0));
+			v.b = cross(v.n, v.tg);
+			// The texture repeats once a chunk
+			v.t = Cvec2f(float(x) / TERRAIN_CHUNK_CELLS, float(z) / TERRAIN_CHUNK_CELLS);
+		}
+	}
+
+	// How far each vertex is above or below the triangles of the level,
+	// split the same way as makeTerrainChunkIndices() does
+	errors[0] = 0;
+	for (int level = 1; level < TERRAIN_LEVELS; level++) {
+		const int step = 1 << level;
+		float error = errors[level - 1];
+		for (int j = 0; j < side; j++) {
+			const int z0 = std::min(j / step * step, TERRAIN_CHUNK_CELLS - step);
+			const float fz = float(j - z0) / step;
+			for (int i = 0; i < side; i++) {
+				const int x0 = std::min(i / step * step, TERRAIN_CHUNK_CELLS - step);
+				const float fx = float(i - x0) / step;
+				const float h00 = heights[z0 * side + x0], h10 = heights[z0 * side + x0 + step];
+				const float h01 = heights[(z0 + step) * side + x0], h11 = heights[(z0 + step) * side + x0 + step];
+				const float h = fz >= fx ? h00 + (h11 - h01) * fx + (h01 - h00) * fz : h00 + (h10 - h00) * fx + (h11 - h10) * fz;
+				error = std::max(error, std::abs(heights[j * side + i] - h));
+			}
+		}
+		errors[level] = error;
+	}
+}
+
+Terrain::~Terrain() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	generatedOne_.wait(lock, [this] { return generating_ == 0; });
+}
+
+void Terrain::init(const Heightfield& heightfield, int chunksX, int chunksZ, float cellSize, float heightScale, ThreadPool& pool) {
+	assert(chunks_.empty());
+	heightfield_ = heightfield;
+	chunksX_ = chunksX;
+	chunksZ_ = chunksZ;
+	cellSize_ = cellSize;
+	heightScale_ = heightScale;
+
+	std::vector<unsigned short> indices;
+	for (int level = 0; level < TERRAIN_LEVELS; level++) {
+		for (int mask = 0; mask < TERRAIN_STITCH_MASKS; mask++) {
+			makeTerrainChunkIndices(level, mask, indices);
+			indexRanges_[level][mask] = GeometryPool::shared().indices.allocate((int)indices.size());
+			GeometryPool::shared().indices.write(indexRanges_[level][mask], 0, indices.data());
+			indexCounts_[level][mask] = (int)indices.size();
+		}
+	}
+
+	// Sized once: the jobs write into their chunks while this runs on
+	chunks_.resize(chunksX * chunksZ);
+	generating_ = (int)chunks_.size();
+	for (int c = 0; c < chunks_.size(); c++) {
+		Chunk& chunk = chunks_[c];
+		chunk.entity.parent = &root;
+		chunk.entity.isStatic = true;
+		chunk.level = 0;
+		chunk.uploaded = false;
+		pool.submit([this, c] {
+			Chunk& chunk = chunks_[c];
+			makeTerrainChunkVertices(heightfield_, chunksX_, chunksZ_, cellSize_, heightScale_, c % chunksX_, c / chunksX_,
+				chunk.vertices, chunk.errors);
+			std::lock_guard<std::mutex> lock(mutex_);
+			generated_.push_back(c);
+			generating_--;
+			generatedOne_.notify_all();
+		});
+	}
+}
+
+void Terrain::upload(int c) {
+	Chunk& chunk = chunks_[c];
+	Geometry& geometry = chunk.entity.geometry;
+	geometry.uploadVertices(chunk.vertices);
+	geometry.indexRange = indexRanges_[0][0];
+	geometry.numIndeces = indexCounts_[0][0];
+	for (int level = 1; level < TERRAIN_LEVELS; level++) {
+		Geometry::Lod lod;
+		lod.vertexRange = geometry.vertexRange;
+		lod.indexRange = indexRanges_[level][0];
+		lod.numIndeces = indexCounts_[level][0];
+		lod.error = chunk.errors[level];
+		geometry.lods.push_back(lod);
+	}
+	std::vector<VertexPNTBTG>().swap(chunk.vertices);
+	chunk.uploaded = true;
+	uploadedCount_++;
+}
+
+int Terrain::uploadGenerated(int maxChunks) {
+	std::vector<int> ready;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		const int count = std::min(maxChunks, (int)generated_.size());
+		ready.assign(generated_.begin(), generated_.begin() + count);
+		generated_.erase(generated_.begin(), generated_.begin() + count);
+	}
+	for (int i = 0; i < ready.size(); i++) {
+		upload(ready[i]);
+	}
+	if (!ready.empty()) {
+		stitch();
+	}
+	return (int)ready.size();
+}
+
+void Terrain::finishGenerating() {
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		generatedOne_.wait(lock, [this] { return generating_ == 0; });
+	}
+	uploadGenerated((int)chunks_.size());
+}
+
+void Terrain::appendEntities(std::vector<Entity*>& entities) {
+	for (int c = 0; c < chunks_.size(); c++) {
+		if (chunks_[c].uploaded) {
+			entities.push_back(&chunks_[c].entity);
+		}
+	}
+}
+
+void Terrain::selectLods(const LodSelector& selector) {
+	for (int c = 0; c < chunks_.size(); c++) {
+		if (chunks_[c].uploaded) {
+			chunks_[c].level = selector.select(chunks_[c].entity, chunks_[c].level);
+		}
+	}
+	stitch();
+}
+
+void Terrain::clearLods() {
+	for (int c = 0; c < chunks_.size(); c++) {
+		chunks_[c].level = 0;
+	}
+	stitch();
+}
+
+void Terrain::stitch() {
+	// Neighbours still being generated don't count
+	const auto neighbour = [this](int c, int dx, int dz) -> const Chunk* {
+		const int x = c % chunksX_ + dx, z = c / chunksX_ + dz;
+		if (x < 0 || x >= chunksX_ || z < 0 || z >= chunksZ_ || !chunks_[z * chunksX_ + x].uploaded) {
+			return nullptr;
+		}
+		return &chunks_[z * chunksX_ + x];
+	};
+	static const int sides[4][3] = {
+		{-1, 0, TERRAIN_STITCH_NEG_X}, {1, 0, TERRAIN_STITCH_POS_X}, {0, -1, TERRAIN_STITCH_NEG_Z}, {0, 1, TERRAIN_STITCH_POS_Z}
+	};
+
+	// Refining a chunk can force its neighbours finer in turn
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int c = 0; c < chunks_.size(); c++) {
+			for (int s = 0; s < 4; s++) {
+				const Chunk* other = neighbour(c, sides[s][0], sides[s][1]);
+				if (chunks_[c].uploaded && other != nullptr && chunks_[c].level > other->level + 1) {
+					chunks_[c].level = other->level + 1;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	for (int c = 0; c < chunks_.size(); c++) {
+		Chunk& chunk = chunks_[c];
+		if (!chunk.uploaded) {
+			continue;
+		}
+		int mask = 0;
+		for (int s = 0; s < 4; s++) {
+			const Chunk* other = neighbour(c, sides[s][0], sides[s][1]);
+			if (other != nullptr && other->level > chunk.level) {
+				mask |= sides[s][2];
+			}
+		}
+		Geometry& geometry = chunk.entity.geometry;
+		chunk.entity.lod = chunk.level;
+		if (chunk.level == 0) {
+			geometry.indexRange = indexRanges_[0][mask];
+			geometry.numIndeces = indexCounts_[0][mask];
+		}
+		else {
+			geometry.lods[chunk.level - 1].indexRange = indexRanges_[chunk.level][mask];
+			geometry.lods[chunk.level - 1].numIndeces = indexCounts_[chunk.level][mask];
+		}
+	}
+}
+
+int Terrain::triangleCount() const {
+	int triangles = 0;
+	for (int c = 0; c < chunks_.size(); c++) {
+		if (chunks_[c].uploaded) {
+			triangles += chunks_[c].entity.geometry.lodIndexCount(chunks_[c].entity.lod) / 3;
+		}
+	}
+	return triangles;
+}
@@ -0,0 +1,140 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "glsupport.h"
+#include "scene.h"
+#include "lod.h"
+#include "parallel.h"
+
+//--------------------------------------------------------------------------------
+// Heightfield terrain drawn with geomipmapping. The terrain is cut into square
+// chunks of TERRAIN_CHUNK_CELLS cells, each with its own vertices and bounds,
+// so the BVH culls them like any other entity. A chunk's levels of detail only
+// differ in which of its vertices their triangles use, so every chunk at a
+// level shares one range of indices. Chunks next to one a level coarser leave
+// the odd vertices along that side out, which closes the cracks between them.
+//--------------------------------------------------------------------------------
+
+static const int TERRAIN_CHUNK_CELLS = 32;
+
+// Level i uses every (1 << i)th vertex, down to two triangles per chunk
+static const int TERRAIN_LEVELS = 6;
+
+// The sides of a chunk bordering a coarser one
+enum TerrainStitch {
+	TERRAIN_STITCH_NEG_X = 1,
+	TERRAIN_STITCH_POS_X = 2,
+	TERRAIN_STITCH_NEG_Z = 4,
+	TERRAIN_STITCH_POS_Z = 8,
+	TERRAIN_STITCH_MASKS = 16
+};
+
+// Heights on a regular grid of samples
+class Heightfield {
+	int width_, depth_;
+	std::vector<float> heights_;
+
+public:
+	Heightfield() : width_(0), depth_(0) {}
+
+	// width x depth samples of height(x, z), with x and z going 0 to 1 across
+	void generate(int width, int depth, const std::function<float(float, float)>& height);
+
+	// The grey levels of an image, 0 to 1, its top row at z = 0. Throws
+	// runtime_error if the file can't be read.
+	void load(const char* filePath);
+
+	int width() const { return width_; }
+	int depth() const { return depth_; }
+	float at(int x, int z) const { return heights_[z * width_ + x]; }
+
+	// Bilinear between the samples, x in [0, width - 1] and z in [0, depth - 1]
+	float sample(double x, double z) const;
+};
+
+// Indices into the (TERRAIN_CHUNK_CELLS + 1)^2 vertices of a chunk, row by
+// row along x, for level with the odd vertices on the sides in stitchMask
+// moved onto the even ones before them
+void makeTerrainChunkIndices(int level, int stitchMask, std::vector<unsigned short>& indices);
+
+// The vertices of chunk (chunkX, chunkZ) of a terrain chunksX x chunksZ chunks
+// spread over heightfield, centered on the origin, cellSize apart and a
+// height of 1 heightScale high. errors[i] gets how far level i strays from
+// the full chunk at most.
+void makeTerrainChunkVertices(const Heightfield& heightfield, int chunksX, int chunksZ, float cellSize, float heightScale,
+	int chunkX, int chunkZ, std::vector<VertexPNTBTG>& vertices, float errors[TERRAIN_LEVELS]);
+
+class Terrain {
+	struct Chunk {
+		Entity entity;
+		int level;
+		float errors[TERRAIN_LEVELS];
+		std::vector<VertexPNTBTG> vertices; // generated, not yet uploaded
+		bool uploaded;
+	};
+
+	Heightfield heightfield_;
+	int chunksX_, chunksZ_;
+	float cellSize_, heightScale_;
+	std::vector<Chunk> chunks_;
+	int indexRanges_[TERRAIN_LEVELS][TERRAIN_STITCH_MASKS];
+	int indexCounts_[TERRAIN_LEVELS][TERRAIN_STITCH_MASKS];
+	int uploadedCount_;
+
+	// Chunks generated in the background and waiting for upload
+	std::mutex mutex_;
+	std::condition_variable generatedOne_;
+	std::vector<int> generated_;
+	int generating_;
+
+	void upload(int chunk);
+	void stitch();
+
+public:
+	// Parent of every chunk; its transform places the terrain
+	Entity root;
+
+	Terrain() : chunksX_(0), chunksZ_(0), cellSize_(1), heightScale_(1), uploadedCount_(0), generating_(0) {}
+
+	// Waits for chunks still being generated
+	~Terrain();
+
+	// Copies heightfield and starts generating the chunks on pool. Needs a
+	// current GL context, for the shared index ranges.
+	void init(const Heightfield& heightfield, int chunksX, int chunksZ, float cellSize, float heightScale,
+		ThreadPool& pool = ThreadPool::shared());
+
+	// Uploads up to maxChunks generated chunks, so they can come in over a
+	// few frames; returns how many it did
+	int uploadGenerated(int maxChunks);
+
+	// Waits for every chunk to be generated and uploads them
+	void finishGenerating();
+
+	// Adds the uploaded chunks
+	void appendEntities(std::vector<Entity*>& entities);
+
+	// Picks each chunk's level with selector, keeps neighbours at most one
+	// level apart and stitches them. Needs current world bounds.
+	void selectLods(const LodSelector& selector);
+
+	// Draws every chunk in full
+	void clearLods();
+
+	int chunkCount() const { return (int)chunks_.size(); }
+	int uploadedChunkCount() const { return uploadedCount_; }
+
+	// Triangles the chunks' current levels draw
+	int triangleCount() const;
+
+private:
+	Terrain(const Terrain&);
+	Terrain& operator = (const Terrain&);
+};
+
+#endif
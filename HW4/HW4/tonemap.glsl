@@ -0,0 +1,7 @@
+uniform float tonemapExposure;
+
+// Narkowicz's fit of the ACES filmic curve
+vec3 tonemap(vec3 color) {
+	vec3 x = color * tonemapExposure;
+	return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
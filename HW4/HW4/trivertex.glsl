@@ -1,10 +1,12 @@
 attribute vec4 position;
 attribute vec2 texCoord;
 
+uniform vec2 uvScale;
+
 varying vec2 texCoordVar;
 
 void main()
 {
 	gl_Position =  position;
-	texCoordVar = texCoord;
+	texCoordVar = texCoord * uvScale;
 }
\ No newline at end of file
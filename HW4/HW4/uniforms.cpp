@@ -0,0 +1,65 @@
+#include "uniforms.h"
+
+#include <algorithm>
+#include <cstring>
+
+void bindUniformBlocks(GLuint program) {
+	const GLuint frameBlock = glGetUniformBlockIndex(program, "FrameUniforms");
+	if (frameBlock != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, frameBlock, UNIFORM_BINDING_FRAME);
+	}
+	const GLuint objectBlock = glGetUniformBlockIndex(program, "ObjectUniforms");
+	if (objectBlock != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, objectBlock, UNIFORM_BINDING_OBJECT);
+	}
+}
+
+void UniformRing::init(int size) {
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	alignment_ = std::max((int)alignment, 1);
+	size_ = size;
+	head_ = 0;
+	glGenBuffers(1, &buffer_);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+	glBufferData(GL_UNIFORM_BUFFER, size_, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+int UniformRing::stage(const void* data, int size) {
+	const int offset = (int)(staged_.size() + alignment_ - 1) / alignment_ * alignment_;
+	staged_.resize(offset + size);
+	std::memcpy(&staged_[offset], data, size);
+	return offset;
+}
+
+int UniformRing::upload() {
+	const int size = (int)staged_.size();
+	if (size == 0) {
+		return head_;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+	if (head_ + size > size_) {
+		// Orphaning hands the old storage to the draws still using it
+		while (size > size_) {
+			size_ *= 2;
+		}
+		glBufferData(GL_UNIFORM_BUFFER, size_, NULL, GL_STREAM_DRAW);
+		head_ = 0;
+	}
+	// Nothing drawn since the last orphaning reads past head_
+	void* memory = glMapBufferRange(GL_UNIFORM_BUFFER, head_, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (memory != NULL) {
+		std::memcpy(memory, &staged_[0], size);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}
+	else {
+		glBufferSubData(GL_UNIFORM_BUFFER, head_, size, &staged_[0]);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	const int start = head_;
+	head_ = (head_ + size + alignment_ - 1) / alignment_ * alignment_;
+	staged_.clear();
+	return start;
+}
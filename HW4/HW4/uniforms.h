@@ -0,0 +1,75 @@
+#ifndef UNIFORMS_H
+#define UNIFORMS_H
+
+#include <vector>
+
+#include "glsupport.h"
+
+//--------------------------------------------------------------------------------
+// Uniform blocks of the scene shaders. FrameUniforms changes once a frame and
+// is uploaded whole; ObjectUniforms of every entity drawn are gathered into
+// one upload through a UniformRing, and each draw only binds its own range.
+// The structs follow the std140 layout vertex.glsl and fragment.glsl declare.
+//--------------------------------------------------------------------------------
+
+// Binding points the blocks are attached to
+static const GLuint UNIFORM_BINDING_FRAME = 0;
+static const GLuint UNIFORM_BINDING_OBJECT = 1;
+
+struct FrameUniforms {
+	GLfloat projectionMatrix[16];
+	GLfloat eyeToWorldMatrix[16];
+	GLfloat cascadeMatrices[4][16];
+	struct Light {
+		GLfloat lightPosition[3];
+		GLfloat shadowFarPlane; // 0 when the light casts no shadow
+		GLfloat lightColor[3];
+		GLfloat pad0;
+		GLfloat specularLightColor[3];
+		GLfloat pad1;
+	} lights[3];
+	GLfloat cascadeSplits[4];
+	GLfloat sunDirection[4]; // eye space, pointing towards the light
+	GLfloat sunColor[3];
+	GLint cascadeCount; // packed after sunColor, as std140 does
+};
+static_assert(sizeof(FrameUniforms) == 576, "FrameUniforms must match the std140 block");
+
+struct ObjectUniforms {
+	GLfloat modelViewMatrix[16];
+	GLfloat normalMatrix[16];
+};
+
+// Attaches the blocks program declares to their binding points
+void bindUniformBlocks(GLuint program);
+
+// A uniform buffer written front to back, a frame's worth at a time. Once
+// full it starts over in fresh storage, so nothing still being drawn from is
+// ever written over and no write waits on the GPU.
+class UniformRing {
+	GLuint buffer_;
+	int size_, head_, alignment_;
+	std::vector<unsigned char> staged_;
+
+public:
+	UniformRing() : buffer_(0), size_(0), head_(0), alignment_(256) {}
+
+	// size bytes to start with; needs a current GL context
+	void init(int size);
+
+	// Copies size bytes for the next upload() and returns their offset from
+	// where that upload starts, aligned for glBindBufferRange
+	int stage(const void* data, int size);
+
+	// Writes everything staged since the last upload into the buffer and
+	// returns the offset it starts at
+	int upload();
+
+	void bindRange(GLuint bindingPoint, int offset, int size) const {
+		glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, buffer_, offset, size);
+	}
+
+	GLuint buffer() const { return buffer_; }
+};
+
+#endif
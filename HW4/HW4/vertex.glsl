@@ -1,3 +1,5 @@
+#version 140
+
 attribute vec4 position;
 attribute vec2 texCoord;
 
@@ -5,9 +7,30 @@ attribute vec4 normal;
 attribute vec4 binormal;
 attribute vec4 tangent;
 
-uniform mat4 modelViewMatrix;
-uniform mat4 projectionMatrix;
-uniform mat4 normalMatrix;
+struct Light {
+	vec3 lightPosition;
+	float shadowFarPlane; // 0 when the light casts no shadow
+	vec3 lightColor;
+	vec3 specularLightColor;
+};
+
+// Set once a frame, see uniforms.h
+layout(std140) uniform FrameUniforms {
+	mat4 projectionMatrix;
+	mat4 eyeToWorldMatrix;
+	mat4 cascadeMatrices[4];
+	Light lights[3];
+	vec4 cascadeSplits;
+	vec3 sunDirection; // eye space, pointing towards the light
+	vec3 sunColor;
+	int cascadeCount; // directional light with cascaded shadows off when 0
+};
+
+// Set for every draw
+layout(std140) uniform ObjectUniforms {
+	mat4 modelViewMatrix;
+	mat4 normalMatrix;
+};
 
 varying vec3 varyingPosition;
 varying vec2 varyingTexCoord;
@@ -0,0 +1,831 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cvec.h"
+#include "matrix4.h"
+#include "quat.h"
+#include "objloader.h"
+#include "cvecsoa.h"
+#include "quatsoa.h"
+
+//--------------------------------------------------------------------------------
+// Throughput of the math templates over large randomized batches, with
+// regression checks:
+//
+//   bench_math --thresholds=math_thresholds.txt   fail below absolute floors
+//   bench_math --save-baseline=before.txt         record this machine's numbers
+//   bench_math --baseline=before.txt [--tolerance=0.1]
+//                                                 fail if anything got slower
+//
+// Every benchmark reports items_per_second, one item being one operation on
+// one batch element. Batches are regenerated from a fixed seed, so runs see
+// the same data. Before any timing, the approximations in the headers are
+// held to their documented error bounds, and a broken bound fails the run.
+//--------------------------------------------------------------------------------
+
+// The headers promise these are usable in constant expressions; keep them so
+static_assert(dot(cross(Cvec3(1, 0, 0), Cvec3(0, 1, 0)), Cvec3(0, 0, 1)) == 1, "cross/dot at compile time");
+static_assert((Cvec3f(1, 2, 3) * 2.0f - Cvec3f(1, 1, 1))[2] == 5.0f, "Cvec expressions at compile time");
+static_assert(dot(Cvec4f(1, 2, 3, 4), Cvec4f(4, 3, 2, 1)) == 20.0f, "the SSE dot falls back at compile time");
+static_assert(inv(Matrix4::makeTranslation(Cvec3(1, 2, 3)) * Matrix4::makeScale(Cvec3(2, 2, 2)))(2, 3) == -1.5, "Matrix4 inverse at compile time");
+static_assert(normalMatrix(Matrix4::makeScale(Cvec3(2, 4, 8)))(1, 1) == 0.25, "normalMatrix at compile time");
+static_assert(quatToMatrix(Quat(0, 0, 1, 0))(0, 0) == -1, "quatToMatrix at compile time");
+static_assert((Quat(0, 1, 0, 0) * Quat(0, 0, 1, 0))[3] == 1, "Quat product at compile time");
+
+static const int BATCH_SIZE = 4096;
+
+static std::mt19937& rng() {
+	static std::mt19937 generator(6533);
+	return generator;
+}
+
+static double randomDouble(double low, double high) {
+	return std::uniform_real_distribution<double>(low, high)(rng());
+}
+
+static Cvec3 randomCvec3() {
+	return Cvec3(randomDouble(-10, 10), randomDouble(-10, 10), randomDouble(-10, 10));
+}
+
+static Cvec3f randomCvec3f() {
+	return Cvec3f((float)randomDouble(-10, 10), (float)randomDouble(-10, 10), (float)randomDouble(-10, 10));
+}
+
+static Cvec4f randomCvec4f() {
+	return Cvec4f((float)randomDouble(-10, 10), (float)randomDouble(-10, 10), (float)randomDouble(-10, 10), (float)randomDouble(-10, 10));
+}
+
+static Quat randomQuat() {
+	return normalize(Quat(randomDouble(-1, 1), randomDouble(-1, 1), randomDouble(-1, 1), randomDouble(-1, 1)));
+}
+
+// Random rigid body transform with scale, the kind every entity carries
+static Matrix4 randomAffine() {
+	return Matrix4::makeTranslation(randomCvec3()) * quatToMatrix(randomQuat()) * Matrix4::makeScale(Cvec3(randomDouble(0.5, 2), randomDouble(0.5, 2), randomDouble(0.5, 2)));
+}
+
+template<typename T, typename Make>
+static std::vector<T> makeBatch(Make make) {
+	std::vector<T> batch;
+	batch.reserve(BATCH_SIZE);
+	for (int i = 0; i < BATCH_SIZE; i++) {
+		batch.push_back(make());
+	}
+	return batch;
+}
+
+static void finishBatch(benchmark::State& state) {
+	state.SetItemsProcessed(state.iterations() * BATCH_SIZE);
+}
+
+// Cvec ----------------------------------------------------------------------------
+
+static void BM_Cvec3MultiplyAdd(benchmark::State& state) {
+	std::vector<Cvec3> a = makeBatch<Cvec3>(randomCvec3), b = makeBatch<Cvec3>(randomCvec3), out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = a[i] + b[i] * 0.5 - a[i] / 3.0;
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Cvec3MultiplyAdd);
+
+static void BM_Cvec3fMultiplyAdd(benchmark::State& state) {
+	std::vector<Cvec3f> a = makeBatch<Cvec3f>(randomCvec3f), b = makeBatch<Cvec3f>(randomCvec3f), out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = a[i] + b[i] * 0.5f - a[i] / 3.0f;
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Cvec3fMultiplyAdd);
+
+static void BM_Cvec3DotCross(benchmark::State& state) {
+	std::vector<Cvec3> a = makeBatch<Cvec3>(randomCvec3), b = makeBatch<Cvec3>(randomCvec3);
+	for (auto _ : state) {
+		double sum = 0;
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			sum += dot(cross(a[i], b[i]), a[i] + b[i]);
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Cvec3DotCross);
+
+static void BM_Cvec3Normalize(benchmark::State& state) {
+	std::vector<Cvec3> a = makeBatch<Cvec3>(randomCvec3), out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = normalize(a[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Cvec3Normalize);
+
+static void BM_Cvec3fDotCross(benchmark::State& state) {
+	std::vector<Cvec3f> a = makeBatch<Cvec3f>(randomCvec3f), b = makeBatch<Cvec3f>(randomCvec3f);
+	for (auto _ : state) {
+		float sum = 0;
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			sum += dot(cross(a[i], b[i]), a[i]);
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Cvec3fDotCross);
+
+static void BM_Cvec3fNormalize(benchmark::State& state) {
+	std::vector<Cvec3f> a = makeBatch<Cvec3f>(randomCvec3f), out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = normalize(a[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Cvec3fNormalize);
+
+static void BM_Cvec4fDot(benchmark::State& state) {
+	std::vector<Cvec4f> a = makeBatch<Cvec4f>(randomCvec4f), b = makeBatch<Cvec4f>(randomCvec4f);
+	for (auto _ : state) {
+		float sum = 0;
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			sum += dot(a[i], b[i]);
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Cvec4fDot);
+
+static void BM_Cvec4fNormalize(benchmark::State& state) {
+	std::vector<Cvec4f> a = makeBatch<Cvec4f>(randomCvec4f), out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = normalize(a[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Cvec4fNormalize);
+
+// calculateFaceTangent over a batch of random triangles
+static void BM_FaceTangent(benchmark::State& state) {
+	std::vector<Cvec3f> p = makeBatch<Cvec3f>(randomCvec3f);
+	std::vector<Cvec2f> t = makeBatch<Cvec2f>([] { return Cvec2f((float)randomDouble(0, 1), (float)randomDouble(0, 1)); });
+	std::vector<Cvec3f> tangents(BATCH_SIZE), binormals(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i + 2 < BATCH_SIZE; i++) {
+			calculateFaceTangent(p[i], p[i + 1], p[i + 2], t[i], t[i + 1], t[i + 2], tangents[i], binormals[i]);
+		}
+		benchmark::DoNotOptimize(tangents.data());
+		benchmark::DoNotOptimize(binormals.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_FaceTangent);
+
+// Blinn-Phong for one light, as fragment.glsl does it, per vertex on the CPU
+static void BM_Cvec3fLighting(benchmark::State& state) {
+	std::vector<Cvec3f> p = makeBatch<Cvec3f>(randomCvec3f), n(BATCH_SIZE), out(BATCH_SIZE);
+	for (int i = 0; i < BATCH_SIZE; i++) {
+		n[i] = normalize(randomCvec3f());
+	}
+	const Cvec3f lightPosition(4.0f, 12.0f, 6.0f), eyePosition(0.0f, 12.0f, 20.0f);
+	const Cvec3f albedo(0.8f, 0.6f, 0.5f), lightColor(1.0f, 0.95f, 0.9f);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			const Cvec3f toLight = normalize(lightPosition - p[i]);
+			const Cvec3f toEye = normalize(eyePosition - p[i]);
+			const Cvec3f halfway = normalize(toLight + toEye);
+			const float diffuse = std::max(dot(n[i], toLight), 0.0f);
+			float specular = std::max(dot(n[i], halfway), 0.0f);
+			specular *= specular;
+			specular *= specular;
+			out[i] = albedo * diffuse + lightColor * (specular * specular) + albedo * 0.05f;
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Cvec3fLighting);
+
+// AoS vs SoA ------------------------------------------------------------------------
+
+// A mesh-sized array, past the caches so the passes are bandwidth bound
+static const int MESH_VERTICES = 1 << 20;
+
+static std::vector<VertexPNTBTG> makeMesh() {
+	std::vector<VertexPNTBTG> vertices(MESH_VERTICES);
+	for (int i = 0; i < MESH_VERTICES; i++) {
+		vertices[i].p = randomCvec3f();
+		vertices[i].n = randomCvec3f();
+	}
+	return vertices;
+}
+
+static void finishMesh(benchmark::State& state) {
+	state.SetItemsProcessed(state.iterations() * MESH_VERTICES);
+}
+
+static void BM_AosNormalizeNormals(benchmark::State& state) {
+	std::vector<VertexPNTBTG> vertices = makeMesh();
+	for (auto _ : state) {
+		for (int i = 0; i < MESH_VERTICES; i++) {
+			vertices[i].n.normalize();
+		}
+		benchmark::ClobberMemory();
+	}
+	finishMesh(state);
+}
+BENCHMARK(BM_AosNormalizeNormals)->Unit(benchmark::kMillisecond);
+
+static void BM_SoaNormalizeNormals(benchmark::State& state) {
+	std::vector<VertexPNTBTG> vertices = makeMesh();
+	Cvec3fArray normals;
+	gather(vertices, &VertexPNTBTG::n, normals);
+	for (auto _ : state) {
+		normalizeAll(normals);
+		benchmark::ClobberMemory();
+	}
+	finishMesh(state);
+}
+BENCHMARK(BM_SoaNormalizeNormals)->Unit(benchmark::kMillisecond);
+
+static void BM_AosBounds(benchmark::State& state) {
+	std::vector<VertexPNTBTG> vertices = makeMesh();
+	for (auto _ : state) {
+		Cvec3f minCorner(1e30f), maxCorner(-1e30f);
+		for (int i = 0; i < MESH_VERTICES; i++) {
+			for (int j = 0; j < 3; j++) {
+				minCorner[j] = std::min(minCorner[j], vertices[i].p[j]);
+				maxCorner[j] = std::max(maxCorner[j], vertices[i].p[j]);
+			}
+		}
+		benchmark::DoNotOptimize(minCorner);
+		benchmark::DoNotOptimize(maxCorner);
+	}
+	finishMesh(state);
+}
+BENCHMARK(BM_AosBounds)->Unit(benchmark::kMillisecond);
+
+static void BM_SoaBounds(benchmark::State& state) {
+	std::vector<VertexPNTBTG> vertices = makeMesh();
+	Cvec3fArray positions;
+	gather(vertices, &VertexPNTBTG::p, positions);
+	for (auto _ : state) {
+		Cvec3f minCorner, maxCorner;
+		minMax(positions, minCorner, maxCorner);
+		benchmark::DoNotOptimize(minCorner);
+		benchmark::DoNotOptimize(maxCorner);
+	}
+	finishMesh(state);
+}
+BENCHMARK(BM_SoaBounds)->Unit(benchmark::kMillisecond);
+
+// The conversion both directions, which a one-off pass has to pay for
+static void BM_SoaGatherScatter(benchmark::State& state) {
+	std::vector<VertexPNTBTG> vertices = makeMesh();
+	Cvec3fArray normals;
+	for (auto _ : state) {
+		gather(vertices, &VertexPNTBTG::n, normals);
+		scatter(normals, &VertexPNTBTG::n, vertices);
+		benchmark::ClobberMemory();
+	}
+	finishMesh(state);
+}
+BENCHMARK(BM_SoaGatherScatter)->Unit(benchmark::kMillisecond);
+
+// Matrix4 -------------------------------------------------------------------------
+
+static void BM_Matrix4Multiply(benchmark::State& state) {
+	std::vector<Matrix4> a = makeBatch<Matrix4>(randomAffine), b = makeBatch<Matrix4>(randomAffine), out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = a[i] * b[i];
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Matrix4Multiply);
+
+static void BM_Matrix4TransformPoint(benchmark::State& state) {
+	std::vector<Matrix4> m = makeBatch<Matrix4>(randomAffine);
+	std::vector<Cvec4> out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = m[i] * Cvec4(1.0, 2.0, 3.0, 1.0);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Matrix4TransformPoint);
+
+static void BM_Matrix4Inverse(benchmark::State& state) {
+	std::vector<Matrix4> a = makeBatch<Matrix4>(randomAffine), out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = inv(a[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Matrix4Inverse);
+
+static void BM_Matrix4NormalMatrix(benchmark::State& state) {
+	std::vector<Matrix4> a = makeBatch<Matrix4>(randomAffine), out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = normalMatrix(a[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_Matrix4NormalMatrix);
+
+// Quat ----------------------------------------------------------------------------
+
+static void BM_QuatMultiply(benchmark::State& state) {
+	std::vector<Quat> a = makeBatch<Quat>(randomQuat), b = makeBatch<Quat>(randomQuat), out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = a[i] * b[i];
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_QuatMultiply);
+
+static void BM_QuatToMatrix(benchmark::State& state) {
+	std::vector<Quat> a = makeBatch<Quat>(randomQuat);
+	std::vector<Matrix4> out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = quatToMatrix(a[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_QuatToMatrix);
+
+static void BM_QuatRotateVector(benchmark::State& state) {
+	std::vector<Quat> q = makeBatch<Quat>(randomQuat);
+	std::vector<Cvec4> v(BATCH_SIZE), out(BATCH_SIZE);
+	for (int i = 0; i < BATCH_SIZE; i++) {
+		v[i] = Cvec4(randomCvec3(), 0.0);
+	}
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = q[i] * v[i];
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_QuatRotateVector);
+
+static void BM_QuatSlerp(benchmark::State& state) {
+	std::vector<Quat> a = makeBatch<Quat>(randomQuat), b = makeBatch<Quat>(randomQuat), out(BATCH_SIZE);
+	std::vector<double> t = makeBatch<double>([] { return randomDouble(0, 1); });
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = slerp(a[i], b[i], t[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_QuatSlerp);
+
+static void BM_QuatCatmullRom(benchmark::State& state) {
+	std::vector<Quat> q = makeBatch<Quat>(randomQuat), out(BATCH_SIZE);
+	std::vector<double> t = makeBatch<double>([] { return randomDouble(0, 1); });
+	for (auto _ : state) {
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			out[i] = interpolateCatmullRom(q[i], q[(i + 1) % BATCH_SIZE], q[(i + 2) % BATCH_SIZE], q[(i + 3) % BATCH_SIZE], t[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishBatch(state);
+}
+BENCHMARK(BM_QuatCatmullRom);
+
+// Quatf, one at a time and batched ---------------------------------------------------
+
+static const int JOINT_COUNT = 16384;
+
+static void makeJoints(std::vector<Quatf>& joints, QuatfArray& batch) {
+	joints.resize(JOINT_COUNT);
+	batch.resize(JOINT_COUNT);
+	for (int i = 0; i < JOINT_COUNT; i++) {
+		joints[i] = Quatf(randomQuat());
+		setQuat(batch, i, joints[i]);
+	}
+}
+
+static void finishJoints(benchmark::State& state) {
+	state.SetItemsProcessed(state.iterations() * JOINT_COUNT);
+}
+
+static void BM_QuatfMultiply(benchmark::State& state) {
+	std::vector<Quatf> a, b, out(JOINT_COUNT);
+	QuatfArray unused;
+	makeJoints(a, unused);
+	makeJoints(b, unused);
+	for (auto _ : state) {
+		for (int i = 0; i < JOINT_COUNT; i++) {
+			out[i] = a[i] * b[i];
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishJoints(state);
+}
+BENCHMARK(BM_QuatfMultiply);
+
+static void BM_QuatfMultiplyBatch(benchmark::State& state) {
+	std::vector<Quatf> unused;
+	QuatfArray a, b, out;
+	makeJoints(unused, a);
+	makeJoints(unused, b);
+	for (auto _ : state) {
+		mulAll(a, b, out);
+		benchmark::ClobberMemory();
+	}
+	finishJoints(state);
+}
+BENCHMARK(BM_QuatfMultiplyBatch);
+
+static void BM_QuatfRotate(benchmark::State& state) {
+	std::vector<Quatf> q;
+	QuatfArray unused;
+	makeJoints(q, unused);
+	std::vector<Cvec3f> v = makeBatch<Cvec3f>(randomCvec3f), out(BATCH_SIZE);
+	for (auto _ : state) {
+		for (int i = 0; i < JOINT_COUNT; i++) {
+			out[i % BATCH_SIZE] = q[i].rotate(v[i % BATCH_SIZE]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishJoints(state);
+}
+BENCHMARK(BM_QuatfRotate);
+
+static void BM_QuatfRotateBatch(benchmark::State& state) {
+	std::vector<Quatf> unused;
+	QuatfArray q;
+	makeJoints(unused, q);
+	Cvec3fArray v, out;
+	for (int i = 0; i < JOINT_COUNT; i++) {
+		v.push_back(randomCvec3f());
+	}
+	for (auto _ : state) {
+		rotateAll(q, v, out);
+		benchmark::ClobberMemory();
+	}
+	finishJoints(state);
+}
+BENCHMARK(BM_QuatfRotateBatch);
+
+static void BM_QuatfNormalizeBatch(benchmark::State& state) {
+	std::vector<Quatf> unused;
+	QuatfArray q;
+	makeJoints(unused, q);
+	for (auto _ : state) {
+		normalizeAll(q);
+		benchmark::ClobberMemory();
+	}
+	finishJoints(state);
+}
+BENCHMARK(BM_QuatfNormalizeBatch);
+
+static void BM_QuatfToMatrixBatch(benchmark::State& state) {
+	std::vector<Quatf> unused;
+	QuatfArray q;
+	makeJoints(unused, q);
+	std::vector<float> matrices(16 * JOINT_COUNT);
+	for (auto _ : state) {
+		toMatrixAll(q, matrices.data());
+		benchmark::ClobberMemory();
+	}
+	finishJoints(state);
+}
+BENCHMARK(BM_QuatfToMatrixBatch);
+
+// Blending two poses: slerp against its stand-ins, each joint with its own t
+static void makeBlend(std::vector<Quatf>& a, std::vector<Quatf>& b, std::vector<float>& t, QuatfArray& aBatch, QuatfArray& bBatch) {
+	makeJoints(a, aBatch);
+	makeJoints(b, bBatch);
+	t.resize(JOINT_COUNT);
+	for (int i = 0; i < JOINT_COUNT; i++) {
+		t[i] = (float)randomDouble(0, 1);
+	}
+}
+
+static void BM_QuatfSlerp(benchmark::State& state) {
+	std::vector<Quatf> a, b, out(JOINT_COUNT);
+	std::vector<float> t;
+	QuatfArray unused;
+	makeBlend(a, b, t, unused, unused);
+	for (auto _ : state) {
+		for (int i = 0; i < JOINT_COUNT; i++) {
+			out[i] = slerp(a[i], b[i], t[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishJoints(state);
+}
+BENCHMARK(BM_QuatfSlerp);
+
+static void BM_QuatfNlerp(benchmark::State& state) {
+	std::vector<Quatf> a, b, out(JOINT_COUNT);
+	std::vector<float> t;
+	QuatfArray unused;
+	makeBlend(a, b, t, unused, unused);
+	for (auto _ : state) {
+		for (int i = 0; i < JOINT_COUNT; i++) {
+			out[i] = nlerp(a[i], b[i], t[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishJoints(state);
+}
+BENCHMARK(BM_QuatfNlerp);
+
+static void BM_QuatfFastSlerp(benchmark::State& state) {
+	std::vector<Quatf> a, b, out(JOINT_COUNT);
+	std::vector<float> t;
+	QuatfArray unused;
+	makeBlend(a, b, t, unused, unused);
+	for (auto _ : state) {
+		for (int i = 0; i < JOINT_COUNT; i++) {
+			out[i] = fastSlerp(a[i], b[i], t[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	finishJoints(state);
+}
+BENCHMARK(BM_QuatfFastSlerp);
+
+static void BM_QuatfNlerpBatch(benchmark::State& state) {
+	std::vector<Quatf> unused;
+	std::vector<float> t;
+	QuatfArray a, b, out;
+	makeBlend(unused, unused, t, a, b);
+	for (auto _ : state) {
+		nlerpAll(a, b, t.data(), out);
+		benchmark::ClobberMemory();
+	}
+	finishJoints(state);
+}
+BENCHMARK(BM_QuatfNlerpBatch);
+
+static void BM_QuatfFastSlerpBatch(benchmark::State& state) {
+	std::vector<Quatf> unused;
+	std::vector<float> t;
+	QuatfArray a, b, out;
+	makeBlend(unused, unused, t, a, b);
+	for (auto _ : state) {
+		fastSlerpAll(a, b, t.data(), out);
+		benchmark::ClobberMemory();
+	}
+	finishJoints(state);
+}
+BENCHMARK(BM_QuatfFastSlerpBatch);
+
+// Accuracy checks --------------------------------------------------------------------
+
+// Rotation angle between two quaternions, in radians
+static double angleBetween(const Quat& p, const Quat& q) {
+	return 2 * std::acos(std::min(std::abs(dot(p, q)) / std::sqrt(norm2(p) * norm2(q)), 1.0));
+}
+
+// The slerp stand-ins promise error bounds in quat.h; hold them to it, in
+// float and through the batched kernels, against double slerp. Random pairs
+// plus nearby ones, where the relative error of a fit is largest. Returns the
+// number of broken bounds.
+static int checkInterpolation() {
+	const int count = 1 << 16;
+	std::vector<Quat> a(count), b(count);
+	std::vector<float> t(count);
+	QuatfArray aBatch, bBatch, nlerped, fastSlerped, fastSlerpedHalf;
+	for (int i = 0; i < count; i++) {
+		a[i] = randomQuat();
+		b[i] = i % 4 == 0 ? normalize(a[i] + randomQuat() * 0.01) : randomQuat();
+		t[i] = (float)randomDouble(0, 1);
+		aBatch.push_back(Cvec4f(float(a[i][0]), float(a[i][1]), float(a[i][2]), float(a[i][3])));
+		bBatch.push_back(Cvec4f(float(b[i][0]), float(b[i][1]), float(b[i][2]), float(b[i][3])));
+	}
+	nlerpAll(aBatch, bBatch, t.data(), nlerped);
+	fastSlerpAll(aBatch, bBatch, t.data(), fastSlerped);
+	fastSlerpAll(aBatch, bBatch, 0.5f, fastSlerpedHalf);
+
+	double nlerpError = 0, fastSlerpError = 0;
+	for (int i = 0; i < count; i++) {
+		const Quat exact = slerp(a[i], b[i], t[i]);
+		const Quatf af(a[i]), bf(b[i]);
+		nlerpError = std::max(nlerpError, angleBetween(exact, Quat(nlerp(af, bf, t[i]))));
+		nlerpError = std::max(nlerpError, angleBetween(exact, Quat(getQuat(nlerped, i))));
+		fastSlerpError = std::max(fastSlerpError, angleBetween(exact, Quat(fastSlerp(af, bf, t[i]))));
+		fastSlerpError = std::max(fastSlerpError, angleBetween(exact, Quat(getQuat(fastSlerped, i))));
+		fastSlerpError = std::max(fastSlerpError, angleBetween(slerp(a[i], b[i], 0.5), Quat(getQuat(fastSlerpedHalf, i))));
+	}
+	std::cout << "nlerp error " << nlerpError << " rad (bound " << QUAT_NLERP_MAX_ERROR << "), fastSlerp error " << fastSlerpError << " rad (bound " << QUAT_FAST_SLERP_MAX_ERROR << ")\n";
+	int failures = 0;
+	if (nlerpError > QUAT_NLERP_MAX_ERROR) {
+		std::cerr << "ACCURACY nlerp is off by " << nlerpError << " rad\n";
+		failures++;
+	}
+	if (fastSlerpError > QUAT_FAST_SLERP_MAX_ERROR) {
+		std::cerr << "ACCURACY fastSlerp is off by " << fastSlerpError << " rad\n";
+		failures++;
+	}
+	return failures;
+}
+
+// Regression checks -----------------------------------------------------------------
+
+// Passes everything through to the console and keeps items_per_second per
+// benchmark (the median when --benchmark_repetitions is used)
+class ThroughputReporter : public benchmark::ConsoleReporter {
+public:
+	std::map<std::string, double> opsPerSecond;
+
+	void ReportRuns(const std::vector<Run>& runs) override {
+		for (int i = 0; i < runs.size(); i++) {
+			const Run& run = runs[i];
+			benchmark::UserCounters::const_iterator counter = run.counters.find("items_per_second");
+			if (counter == run.counters.end() || run.error_occurred) {
+				continue;
+			}
+			if (run.run_type == Run::RT_Iteration) {
+				opsPerSecond[run.benchmark_name()] = counter->second;
+			}
+			else if (run.aggregate_name == "median") {
+				opsPerSecond[run.run_name.str()] = counter->second;
+			}
+		}
+		ConsoleReporter::ReportRuns(runs);
+	}
+};
+
+// "name value" per line; # starts a comment
+static bool readValues(const char* fileName, std::map<std::string, double>& values) {
+	std::ifstream in(fileName);
+	if (!in) {
+		return false;
+	}
+	std::string line;
+	while (std::getline(in, line)) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream fields(line);
+		std::string name;
+		double value;
+		if (fields >> name >> value) {
+			values[name] = value;
+		}
+	}
+	return true;
+}
+
+static bool writeValues(const char* fileName, const std::map<std::string, double>& values) {
+	std::ofstream out(fileName);
+	out << "# items_per_second from bench_math\n";
+	for (std::map<std::string, double>::const_iterator it = values.begin(); it != values.end(); ++it) {
+		out << it->first << " " << (long long)it->second << "\n";
+	}
+	return (bool)out;
+}
+
+// Returns the number of benchmarks slower than allowed
+static int checkAgainst(const std::map<std::string, double>& measured, const std::map<std::string, double>& reference, double allowedRatio, const char* what) {
+	int failures = 0;
+	for (std::map<std::string, double>::const_iterator it = reference.begin(); it != reference.end(); ++it) {
+		std::map<std::string, double>::const_iterator m = measured.find(it->first);
+		if (m == measured.end()) {
+			continue; // filtered out of this run
+		}
+		const double ratio = m->second / it->second;
+		if (ratio < allowedRatio) {
+			std::cerr << "REGRESSION " << it->first << ": " << m->second / 1e6 << " M ops/s is " << ratio * 100.0 << "% of the " << what << " (" << it->second / 1e6 << " M ops/s)\n";
+			failures++;
+		}
+	}
+	return failures;
+}
+
+static const char* flagValue(const char* arg, const char* flag) {
+	const size_t length = std::strlen(flag);
+	return std::strncmp(arg, flag, length) == 0 ? arg + length : NULL;
+}
+
+int main(int argc, char** argv) {
+	const char* thresholdsFile = NULL;
+	const char* baselineFile = NULL;
+	const char* saveBaselineFile = NULL;
+	double tolerance = 0.1;
+
+	// Take our flags out before Google Benchmark sees the rest
+	std::vector<char*> args;
+	for (int i = 0; i < argc; i++) {
+		const char* value;
+		if ((value = flagValue(argv[i], "--thresholds=")) != NULL) {
+			thresholdsFile = value;
+		}
+		else if ((value = flagValue(argv[i], "--baseline=")) != NULL) {
+			baselineFile = value;
+		}
+		else if ((value = flagValue(argv[i], "--save-baseline=")) != NULL) {
+			saveBaselineFile = value;
+		}
+		else if ((value = flagValue(argv[i], "--tolerance=")) != NULL) {
+			tolerance = std::atof(value);
+		}
+		else {
+			args.push_back(argv[i]);
+		}
+	}
+	int benchmarkArgc = (int)args.size();
+	benchmark::Initialize(&benchmarkArgc, &args[0]);
+	if (benchmark::ReportUnrecognizedArguments(benchmarkArgc, &args[0])) {
+		return 1;
+	}
+
+	int failures = checkInterpolation();
+
+	ThroughputReporter reporter;
+	benchmark::RunSpecifiedBenchmarks(&reporter);
+	benchmark::Shutdown();
+
+	if (thresholdsFile != NULL) {
+		std::map<std::string, double> thresholds;
+		if (!readValues(thresholdsFile, thresholds)) {
+			std::cerr << "cannot read " << thresholdsFile << "\n";
+			return 1;
+		}
+		failures += checkAgainst(reporter.opsPerSecond, thresholds, 1.0, "threshold");
+	}
+	if (baselineFile != NULL) {
+		std::map<std::string, double> baseline;
+		if (!readValues(baselineFile, baseline)) {
+			std::cerr << "cannot read " << baselineFile << "\n";
+			return 1;
+		}
+		failures += checkAgainst(reporter.opsPerSecond, baseline, 1.0 - tolerance, "baseline");
+	}
+	if (saveBaselineFile != NULL && !writeValues(saveBaselineFile, reporter.opsPerSecond)) {
+		std::cerr << "cannot write " << saveBaselineFile << "\n";
+		return 1;
+	}
+	if (failures > 0) {
+		std::cerr << failures << " check(s) failed\n";
+		return 1;
+	}
+	return 0;
+}
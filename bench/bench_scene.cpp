@@ -0,0 +1,570 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "cvec.h"
+#include "matrix4.h"
+#include "quat.h"
+#include "geometrymaker.h"
+#include "objloader.h"
+#include "animation.h"
+#include "culling.h"
+#include "bvh.h"
+#include "occlusion.h"
+#include "simplify.h"
+#include "lod.h"
+#include "primitives.h"
+#include "terrain.h"
+#include "geometrypool.h"
+
+//--------------------------------------------------------------------------------
+// Scene-level benchmarks: the transforms every entity goes through each
+// frame, keyframe animation, frustum culling, geometry generation, and OBJ
+// loading
+//--------------------------------------------------------------------------------
+
+static Matrix4 makeModelMatrix(double angle) {
+	return Matrix4::makeTranslation(Cvec3(1.0, 2.0, -5.0)) * quatToMatrix(Quat::makeYRotation(angle)) * Matrix4::makeScale(Cvec3(1.5, 1.5, 1.5));
+}
+
+static void BM_Matrix4Multiply(benchmark::State& state) {
+	Matrix4 a = makeModelMatrix(30.0), b = makeModelMatrix(75.0);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(a);
+		benchmark::DoNotOptimize(b);
+		Matrix4 c = a * b;
+		benchmark::DoNotOptimize(c);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Matrix4Multiply);
+
+static void BM_Matrix4Inverse(benchmark::State& state) {
+	Matrix4 a = makeModelMatrix(30.0);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(a);
+		Matrix4 c = inv(a);
+		benchmark::DoNotOptimize(c);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Matrix4Inverse);
+
+// What Entity::Draw does per object: model, model view and normal matrices
+static void BM_EntityMatrices(benchmark::State& state) {
+	Matrix4 eyeInverse = inv(Matrix4::makeTranslation(Cvec3(0.0, 12.0, 20.0)) * Matrix4::makeXRotation(-15.0));
+	double angle = 0.0;
+	for (auto _ : state) {
+		Matrix4 modelView = eyeInverse * makeModelMatrix(angle);
+		Matrix4 normal = normalMatrix(modelView);
+		GLfloat glmatrix[16];
+		normal.writeToColumnMajorMatrix(glmatrix);
+		benchmark::DoNotOptimize(glmatrix);
+		angle += 1.0;
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EntityMatrices);
+
+static void BM_QuatMultiply(benchmark::State& state) {
+	Quat a = Quat::makeXRotation(20.0), b = Quat::makeYRotation(40.0);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(a);
+		benchmark::DoNotOptimize(b);
+		Quat c = a * b;
+		benchmark::DoNotOptimize(c);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QuatMultiply);
+
+static void BM_QuatToMatrix(benchmark::State& state) {
+	Quat q = normalize(Quat::makeXRotation(20.0) * Quat::makeYRotation(40.0));
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(q);
+		Matrix4 m = quatToMatrix(q);
+		benchmark::DoNotOptimize(m);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QuatToMatrix);
+
+static void BM_QuatRotateVector(benchmark::State& state) {
+	Quat q = normalize(Quat::makeXRotation(20.0) * Quat::makeYRotation(40.0));
+	Cvec4 v(1.0, 2.0, 3.0, 0.0);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(q);
+		Cvec4 r = q * v;
+		benchmark::DoNotOptimize(r);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QuatRotateVector);
+
+// One frame of AnimationSystem::update over range(0) entities, all playing a
+// looping Catmull-Rom clip from different start times, on range(1) threads
+static void BM_AnimationUpdate(benchmark::State& state) {
+	const int entityCount = (int)state.range(0);
+	AnimationClip clip;
+	clip.translation.interpolation = clip.rotation.interpolation = clip.scale.interpolation = KEYFRAME_CATMULL_ROM;
+	for (int i = 0; i <= 32; i++) {
+		const double angle = (i % 32) * 360.0 / 32;
+		clip.translation.addKey(i * 0.25, Cvec3(std::sin(angle), 0.1 * (i % 32), std::cos(angle)));
+		clip.rotation.addKey(i * 0.25, Quat::makeYRotation(angle) * Quat::makeXRotation(10.0 * (i % 32)));
+		clip.scale.addKey(i * 0.25, Cvec3(1.0, 1.0 + 0.01 * (i % 32), 1.0));
+	}
+	clip.looping = true;
+
+	ThreadPool pool((int)state.range(1));
+	AnimationSystem animations(pool);
+	std::vector<Entity> entities(entityCount);
+	for (int i = 0; i < entityCount; i++) {
+		animations.play(&entities[i], &clip, -0.001 * i);
+	}
+	double time = 0.0;
+	for (auto _ : state) {
+		animations.update(time);
+		benchmark::ClobberMemory();
+		time += 1.0 / 60.0;
+	}
+	state.SetItemsProcessed(state.iterations() * entityCount);
+	state.SetLabel("entities");
+}
+BENCHMARK(BM_AnimationUpdate)->Args({ 1000, 1 })->Args({ 10000, 1 })->Args({ 10000, 0 })->Unit(benchmark::kMicrosecond);
+
+// 16384 bounds scattered around the HW4 camera, about a tenth of them in view:
+// one at a time through Frustum, and all at once through FrustumCuller
+static const int CULL_COUNT = 16384;
+
+static Matrix4 makeCullMatrix() {
+	const Matrix4 eyeMatrix = Matrix4::makeTranslation(Cvec3(0.0, 12.0, 20.0)) * Matrix4::makeXRotation(-15.0);
+	return Matrix4::makeProjection(45.0, 1.0, -0.1, -100.0) * inv(eyeMatrix);
+}
+
+static Frustum makeCullFrustum() {
+	return Frustum::fromMatrix(makeCullMatrix());
+}
+
+static void makeCullBounds(std::vector<Cvec3>& centers, std::vector<double>& radii) {
+	centers.resize(CULL_COUNT);
+	radii.resize(CULL_COUNT);
+	unsigned int seed = 6533;
+	for (int i = 0; i < CULL_COUNT; i++) {
+		for (int j = 0; j < 3; j++) {
+			seed = seed * 1664525u + 1013904223u;
+			centers[i][j] = (seed >> 8) / double(1 << 24) * 120.0 - 60.0;
+		}
+		radii[i] = 0.5 + (i % 8) * 0.5;
+	}
+}
+
+static void BM_FrustumCullEach(benchmark::State& state) {
+	const Frustum frustum = makeCullFrustum();
+	std::vector<Cvec3> centers;
+	std::vector<double> radii;
+	makeCullBounds(centers, radii);
+	std::vector<unsigned char> visible(CULL_COUNT);
+	for (auto _ : state) {
+		for (int i = 0; i < CULL_COUNT; i++) {
+			const Cvec3 extent(radii[i], radii[i], radii[i]);
+			visible[i] = frustum.intersectsSphere(centers[i], radii[i]) && frustum.intersectsBox(centers[i] - extent, centers[i] + extent);
+		}
+		benchmark::DoNotOptimize(visible.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * CULL_COUNT);
+}
+BENCHMARK(BM_FrustumCullEach);
+
+static void BM_FrustumCullBatch(benchmark::State& state) {
+	const Frustum frustum = makeCullFrustum();
+	std::vector<Cvec3> centers;
+	std::vector<double> radii;
+	makeCullBounds(centers, radii);
+	FrustumCuller culler;
+	for (int i = 0; i < CULL_COUNT; i++) {
+		const Cvec3 extent(radii[i], radii[i], radii[i]);
+		culler.add(centers[i], radii[i], centers[i] - extent, centers[i] + extent);
+	}
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(culler.cull(frustum));
+	}
+	state.SetItemsProcessed(state.iterations() * CULL_COUNT);
+	state.SetLabel(std::to_string(culler.visibleCount()) + " visible");
+}
+BENCHMARK(BM_FrustumCullBatch);
+
+// n unit-ish boxes at the density of the culling bounds, so the world grows
+// with n and the HW4 frustum sees a shrinking share of it
+static void makeBvhBounds(int n, std::vector<Cvec3f>& boxMin, std::vector<Cvec3f>& boxMax) {
+	boxMin.resize(n);
+	boxMax.resize(n);
+	const float halfWidth = 60.0f * std::cbrt(n / float(CULL_COUNT));
+	unsigned int seed = 6533;
+	for (int i = 0; i < n; i++) {
+		Cvec3f center;
+		for (int j = 0; j < 3; j++) {
+			seed = seed * 1664525u + 1013904223u;
+			center[j] = (seed >> 8) / float(1 << 24) * 2.0f * halfWidth - halfWidth;
+		}
+		const float radius = 0.5f + (i % 8) * 0.5f;
+		boxMin[i] = center - Cvec3f(radius);
+		boxMax[i] = center + Cvec3f(radius);
+	}
+}
+
+static void BM_BvhBuild(benchmark::State& state) {
+	std::vector<Cvec3f> boxMin, boxMax;
+	makeBvhBounds((int)state.range(0), boxMin, boxMax);
+	Bvh bvh;
+	for (auto _ : state) {
+		bvh.build(boxMin, boxMax);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetLabel(std::to_string(bvh.nodeCount()) + " nodes");
+}
+BENCHMARK(BM_BvhBuild)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// Every box nudged each frame, then refit and rebuildDegraded as in HW4
+static void BM_BvhRefit(benchmark::State& state) {
+	const int n = (int)state.range(0);
+	std::vector<Cvec3f> boxMin, boxMax;
+	makeBvhBounds(n, boxMin, boxMax);
+	Bvh bvh;
+	bvh.build(boxMin, boxMax);
+	int frame = 0, rebuilt = 0;
+	for (auto _ : state) {
+		const Cvec3f offset(0.01f * std::sin(frame * 0.1f), 0.01f, 0.0f);
+		for (int i = 0; i < n; i++) {
+			boxMin[i] += offset;
+			boxMax[i] += offset;
+			bvh.setItemBounds(i, boxMin[i], boxMax[i]);
+		}
+		bvh.refit();
+		rebuilt += bvh.rebuildDegraded();
+		frame++;
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+	state.SetLabel(std::to_string(rebuilt) + " subtrees rebuilt");
+}
+BENCHMARK(BM_BvhRefit)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+static void BM_BvhCull(benchmark::State& state) {
+	std::vector<Cvec3f> boxMin, boxMax;
+	makeBvhBounds((int)state.range(0), boxMin, boxMax);
+	Bvh bvh;
+	bvh.build(boxMin, boxMax);
+	const Frustum frustum = makeCullFrustum();
+	std::vector<int> visible;
+	for (auto _ : state) {
+		visible.clear();
+		bvh.cull(frustum, visible);
+		benchmark::DoNotOptimize(visible.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetLabel(std::to_string(visible.size()) + " visible");
+}
+BENCHMARK(BM_BvhCull)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMicrosecond);
+
+// Rays from the HW4 camera through a grid over the view, then nearest and
+// range queries at the same number of scattered points
+static const int BVH_QUERY_COUNT = 1024;
+
+static void BM_BvhRaycast(benchmark::State& state) {
+	std::vector<Cvec3f> boxMin, boxMax;
+	makeBvhBounds((int)state.range(0), boxMin, boxMax);
+	Bvh bvh;
+	bvh.build(boxMin, boxMax);
+	const Cvec3 origin(0.0, 12.0, 20.0);
+	int hits = 0;
+	for (auto _ : state) {
+		hits = 0;
+		for (int i = 0; i < BVH_QUERY_COUNT; i++) {
+			const Cvec3 direction((i % 32) / 32.0 - 0.5, (i / 32) / 32.0 - 0.75, -1.0);
+			double t;
+			hits += bvh.raycast(origin, direction, 1000.0, t) >= 0;
+		}
+		benchmark::DoNotOptimize(hits);
+	}
+	state.SetItemsProcessed(state.iterations() * BVH_QUERY_COUNT);
+	state.SetLabel(std::to_string(hits) + " hits");
+}
+BENCHMARK(BM_BvhRaycast)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMicrosecond);
+
+static void BM_BvhNearest(benchmark::State& state) {
+	std::vector<Cvec3f> boxMin, boxMax;
+	makeBvhBounds((int)state.range(0), boxMin, boxMax);
+	Bvh bvh;
+	bvh.build(boxMin, boxMax);
+	for (auto _ : state) {
+		for (int i = 0; i < BVH_QUERY_COUNT; i++) {
+			const Cvec3f& corner = boxMin[i * 7 % boxMin.size()];
+			double distance;
+			benchmark::DoNotOptimize(bvh.nearest(Cvec3(corner[0] - 1.0, corner[1], corner[2]), distance));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * BVH_QUERY_COUNT);
+}
+BENCHMARK(BM_BvhNearest)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMicrosecond);
+
+static void BM_BvhQueryRange(benchmark::State& state) {
+	std::vector<Cvec3f> boxMin, boxMax;
+	makeBvhBounds((int)state.range(0), boxMin, boxMax);
+	Bvh bvh;
+	bvh.build(boxMin, boxMax);
+	std::vector<int> found;
+	for (auto _ : state) {
+		found.clear();
+		for (int i = 0; i < BVH_QUERY_COUNT; i++) {
+			const Cvec3f& corner = boxMin[i * 7 % boxMin.size()];
+			bvh.queryRange(Cvec3(corner[0], corner[1], corner[2]), 5.0, found);
+		}
+		benchmark::DoNotOptimize(found.data());
+	}
+	state.SetItemsProcessed(state.iterations() * BVH_QUERY_COUNT);
+	state.SetLabel(std::to_string(found.size()) + " found");
+}
+BENCHMARK(BM_BvhQueryRange)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMicrosecond);
+
+// A 750x750 depth buffer from the HW4 camera that is a wall 30 units ahead
+// over its right three quarters, with the culling bounds tested against it
+static std::vector<float> makeWallDepth(int size) {
+	const Cvec4 wall = Matrix4::makeProjection(45.0, 1.0, -0.1, -100.0) * Cvec4(0.0, 0.0, -30.0, 1.0);
+	std::vector<float> depth(size * size, float(wall[2] / wall[3] * 0.5 + 0.5));
+	for (int y = 0; y < size; y++) {
+		std::fill(depth.begin() + y * size, depth.begin() + y * size + size / 4, 0.0f);
+	}
+	return depth;
+}
+
+static void BM_DepthPyramidBuild(benchmark::State& state) {
+	const Matrix4 clipFromWorld = makeCullMatrix();
+	const std::vector<float> depth = makeWallDepth(750);
+	DepthPyramid pyramid;
+	for (auto _ : state) {
+		pyramid.build(&depth[0], 750, 750, clipFromWorld);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * 750 * 750);
+}
+BENCHMARK(BM_DepthPyramidBuild)->Unit(benchmark::kMicrosecond);
+
+static void BM_DepthPyramidTest(benchmark::State& state) {
+	const Matrix4 clipFromWorld = makeCullMatrix();
+	const std::vector<float> depth = makeWallDepth(750);
+	DepthPyramid pyramid;
+	pyramid.build(&depth[0], 750, 750, clipFromWorld);
+	const Frustum frustum = makeCullFrustum();
+	std::vector<Cvec3> centers;
+	std::vector<double> radii;
+	makeCullBounds(centers, radii);
+	// Only what frustum culling leaves, as in HW4
+	std::vector<Cvec3> boxMin, boxMax;
+	for (int i = 0; i < CULL_COUNT; i++) {
+		const Cvec3 extent(radii[i], radii[i], radii[i]);
+		if (frustum.intersectsBox(centers[i] - extent, centers[i] + extent)) {
+			boxMin.push_back(centers[i] - extent);
+			boxMax.push_back(centers[i] + extent);
+		}
+	}
+	int occluded = 0;
+	for (auto _ : state) {
+		occluded = 0;
+		for (int i = 0; i < boxMin.size(); i++) {
+			occluded += pyramid.isOccluded(boxMin[i], boxMax[i]);
+		}
+		benchmark::DoNotOptimize(occluded);
+	}
+	state.SetItemsProcessed(state.iterations() * boxMin.size());
+	state.SetLabel(std::to_string(occluded) + " of " + std::to_string(boxMin.size()) + " occluded");
+}
+BENCHMARK(BM_DepthPyramidTest);
+
+static void BM_MakeSphere(benchmark::State& state) {
+	const int slices = (int)state.range(0), stacks = slices / 2;
+	int vbLen, ibLen;
+	getSphereVbIbLen(slices, stacks, vbLen, ibLen);
+	std::vector<VertexPNTBTG> vertices(vbLen);
+	std::vector<unsigned short> indices(ibLen);
+	for (auto _ : state) {
+		makeSphere(1.0f, slices, stacks, vertices.begin(), indices.begin());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * vbLen);
+	state.SetLabel("vertices");
+}
+BENCHMARK(BM_MakeSphere)->Arg(16)->Arg(64)->Arg(180)->Arg(360);
+
+// Same spheres split across the shared pool
+static void BM_MakeSphereParallel(benchmark::State& state) {
+	const int slices = (int)state.range(0), stacks = slices / 2;
+	int vbLen, ibLen;
+	getSphereVbIbLen(slices, stacks, vbLen, ibLen);
+	std::vector<VertexPNTBTG> vertices(vbLen);
+	std::vector<unsigned short> indices(ibLen);
+	for (auto _ : state) {
+		makeSphereParallel(1.0f, slices, stacks, vertices.data(), indices.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * vbLen);
+	state.SetLabel(std::to_string(ThreadPool::shared().threadCount()) + " threads");
+}
+BENCHMARK(BM_MakeSphereParallel)->Arg(64)->Arg(180)->Arg(360);
+
+static void BM_MakeGrid(benchmark::State& state) {
+	const int cells = (int)state.range(0);
+	int vbLen, ibLen;
+	getGridVbIbLen(cells, cells, vbLen, ibLen);
+	std::vector<VertexPNTBTG> vertices(vbLen);
+	std::vector<unsigned short> indices(ibLen);
+	for (auto _ : state) {
+		if (state.range(1)) {
+			makeGridParallel(1.0f, cells, cells, vertices.data(), indices.data());
+		}
+		else {
+			makeGrid(1.0f, cells, cells, vertices.begin(), indices.begin());
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * vbLen);
+}
+BENCHMARK(BM_MakeGrid)->Args({64, 0})->Args({255, 0})->Args({64, 1})->Args({255, 1});
+
+// Spheres of about the same error, 0.001 of the radius: the label shows how
+// many triangles each kind of sphere needs for it
+static void BM_MakePrimitive(benchmark::State& state) {
+	const PrimitiveShape shape = (PrimitiveShape)state.range(0);
+	const int resolution = (int)state.range(1);
+	std::vector<VertexPNTBTG> vertices;
+	std::vector<unsigned short> indices;
+	float error = 0;
+	for (auto _ : state) {
+		error = makePrimitive(shape, resolution, 1.0f, vertices, indices);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * vertices.size());
+	state.SetLabel(std::to_string(indices.size() / 3) + " triangles, error " + std::to_string(error));
+}
+BENCHMARK(BM_MakePrimitive)->Args({PRIMITIVE_UV_SPHERE, 100})->Args({PRIMITIVE_ICOSPHERE, 4})->Args({PRIMITIVE_CUBE_SPHERE, 30});
+
+// One chunk of an 8 x 8 chunk terrain: heights, normals, tangents and the
+// error of every level
+static void BM_TerrainChunk(benchmark::State& state) {
+	Heightfield heightfield;
+	heightfield.generate(257, 257, [](float x, float z) { return 0.5f + 0.25f * std::sin(x * 17.0f) * std::cos(z * 11.0f); });
+	std::vector<VertexPNTBTG> vertices;
+	float errors[TERRAIN_LEVELS];
+	for (auto _ : state) {
+		makeTerrainChunkVertices(heightfield, 8, 8, 0.25f, 8.0f, 3, 4, vertices, errors);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * vertices.size());
+}
+BENCHMARK(BM_TerrainChunk);
+
+// Meshes of mixed sizes coming and going in a pool state.range(0) ranges deep
+static void BM_RangeAllocator(benchmark::State& state) {
+	const int live = state.range(0);
+	RangeAllocator allocator;
+	allocator.reset(live * 4096, 0);
+	std::vector<std::pair<int, int> > ranges;
+	unsigned int seed = 1;
+	const auto next = [&seed] { seed = seed * 1664525u + 1013904223u; return (int)(seed >> 8); };
+	for (int i = 0; i < live; i++) {
+		const int count = 1 + next() % 4000;
+		ranges.push_back(std::make_pair(allocator.allocate(count), count));
+	}
+	for (auto _ : state) {
+		std::pair<int, int>& range = ranges[next() % live];
+		allocator.free(range.first, range.second);
+		range.second = 1 + next() % 4000;
+		range.first = allocator.allocate(range.second);
+		if (range.first < 0) {
+			state.SkipWithError("no free range long enough");
+			break;
+		}
+	}
+	state.counters["freeRanges"] = allocator.freeRangeCount();
+}
+BENCHMARK(BM_RangeAllocator)->Arg(100)->Arg(1000);
+
+static void BM_MakeCube(benchmark::State& state) {
+	int vbLen, ibLen;
+	getCubeVbIbLen(vbLen, ibLen);
+	std::vector<VertexPNTBTG> vertices(vbLen);
+	std::vector<unsigned short> indices(ibLen);
+	for (auto _ : state) {
+		makeCube(1.0f, vertices.begin(), indices.begin());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * vbLen);
+}
+BENCHMARK(BM_MakeCube);
+
+// The same cube generated at compile time: all that's left is the copy
+static void BM_CopyBakedCube(benchmark::State& state) {
+	static constexpr BakedGeometry<VertexPNTBTG, 24, 36> cube = bakeCube<VertexPNTBTG>(1.0f);
+	static_assert(cube.indices[35] == 23 && cube.vertices[2].p[0] == 0.5f, "cube baked at compile time");
+	std::vector<VertexPNTBTG> vertices(24);
+	std::vector<unsigned short> indices(36);
+	for (auto _ : state) {
+		std::copy(cube.vertices, cube.vertices + 24, vertices.begin());
+		std::copy(cube.indices, cube.indices + 36, indices.begin());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * 24);
+}
+BENCHMARK(BM_CopyBakedCube);
+
+static const std::string monkPath = std::string(CS6533_ASSET_DIR) + "/Monk_Giveaway_Fixed.obj";
+
+static void BM_LoadObj(benchmark::State& state) {
+	size_t vertexCount = 0;
+	for (auto _ : state) {
+		std::vector<VertexPNTBTG> vertices;
+		std::vector<unsigned short> indices;
+		loadObjFile(monkPath, vertices, indices);
+		vertexCount = vertices.size();
+		benchmark::DoNotOptimize(vertices.data());
+	}
+	state.SetItemsProcessed(state.iterations() * vertexCount);
+	state.SetLabel("vertices");
+}
+BENCHMARK(BM_LoadObj)->Unit(benchmark::kMillisecond);
+
+static void BM_FillVertexBTG(benchmark::State& state) {
+	std::vector<VertexPNTBTG> vertices;
+	std::vector<unsigned short> indices;
+	loadObjFile(monkPath, vertices, indices);
+	for (auto _ : state) {
+		fillVertexBTG(vertices);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * vertices.size());
+	state.SetLabel("vertices");
+}
+BENCHMARK(BM_FillVertexBTG)->Unit(benchmark::kMillisecond);
+
+// The four halvings HW4 builds for the monk at startup
+static void BM_BuildLodChain(benchmark::State& state) {
+	std::vector<VertexPNTBTG> vertices;
+	std::vector<unsigned short> indices;
+	loadObjFile(monkPath, vertices, indices);
+	fillVertexBTG(vertices);
+	std::vector<MeshLod> lods;
+	for (auto _ : state) {
+		buildLodChain(vertices, indices, 4, 0.5f, lods);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * indices.size() / 3);
+	std::string label;
+	for (int i = 0; i < lods.size(); i++) {
+		label += std::to_string(lods[i].indices.size() / 3) + (i + 1 < lods.size() ? "/" : " triangles");
+	}
+	state.SetLabel(label);
+}
+BENCHMARK(BM_BuildLodChain)->Unit(benchmark::kMillisecond);
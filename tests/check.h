@@ -0,0 +1,42 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+
+//--------------------------------------------------------------------------------
+// The tests are plain executables run by ctest. CHECK counts a failure and
+// carries on, so one run reports every broken expectation; assert() would
+// vanish in the optimized builds the tests mostly run in.
+//--------------------------------------------------------------------------------
+
+static int checkFailures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+			checkFailures++; \
+		} \
+	} while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+	do { \
+		const auto checkActual = (actual); \
+		const auto checkExpected = (expected); \
+		if (!(checkActual == checkExpected)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQUAL(" #actual ", " #expected ") failed: " \
+				<< checkActual << " != " << checkExpected << std::endl; \
+			checkFailures++; \
+		} \
+	} while (0)
+
+// What main() returns
+inline int checkResult() {
+	if (checkFailures > 0) {
+		std::cerr << checkFailures << " checks failed" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,199 @@
+// Bvh queries against a brute force scan of every item, over random boxes,
+// before and after the boxes move and the tree is refit and partly rebuilt
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "bvh.h"
+#include "culling.h"
+#include "matrix4.h"
+
+#include "check.h"
+
+// The BVH works in float and the scan in double; items this close to a plane
+// or tie may go either way
+static const double BVH_TEST_EPS = 1e-3;
+
+static void makeBoxes(std::mt19937& random, int count, std::vector<Cvec3f>& boxMin, std::vector<Cvec3f>& boxMax) {
+	std::uniform_real_distribution<float> position(-60.0f, 60.0f), size(0.1f, 4.0f);
+	boxMin.resize(count);
+	boxMax.resize(count);
+	for (int i = 0; i < count; i++) {
+		for (int j = 0; j < 3; j++) {
+			boxMin[i][j] = position(random);
+			boxMax[i][j] = boxMin[i][j] + size(random);
+		}
+	}
+}
+
+// frustum with every plane moved outwards by distance
+static Frustum grow(const Frustum& frustum, double distance) {
+	Frustum grown = frustum;
+	for (int i = 0; i < 6; i++) {
+		grown.planes[i][3] += distance;
+	}
+	return grown;
+}
+
+// Bvh::cull() needs the box and the sphere around it inside
+static bool isInside(const Frustum& frustum, const Cvec3f& boxMin, const Cvec3f& boxMax) {
+	const Cvec3 lo(boxMin[0], boxMin[1], boxMin[2]), hi(boxMax[0], boxMax[1], boxMax[2]);
+	return frustum.intersectsBox(lo, hi) && frustum.intersectsSphere((lo + hi) * 0.5, norm(hi - lo) * 0.5);
+}
+
+static void checkCull(const Bvh& bvh, const Matrix4& clipFromWorld, const std::vector<Cvec3f>& boxMin, const std::vector<Cvec3f>& boxMax) {
+	const Frustum frustum = Frustum::fromMatrix(clipFromWorld);
+	std::vector<int> visible;
+	bvh.cull(frustum, visible);
+
+	std::vector<bool> found(boxMin.size(), false);
+	for (int item : visible) {
+		CHECK(!found[item]);
+		found[item] = true;
+	}
+	const Frustum shrunk = grow(frustum, -BVH_TEST_EPS), grown = grow(frustum, BVH_TEST_EPS);
+	for (int i = 0; i < boxMin.size(); i++) {
+		if (isInside(shrunk, boxMin[i], boxMax[i])) {
+			CHECK(found[i]);
+		}
+		else if (!isInside(grown, boxMin[i], boxMax[i])) {
+			CHECK(!found[i]);
+		}
+	}
+}
+
+// Where the ray enters the box within [0, maxT], or -1 if it misses
+static double rayEntersBox(const Cvec3& origin, const Cvec3& direction, double maxT, const Cvec3f& boxMin, const Cvec3f& boxMax) {
+	double enter = 0.0, exit = maxT;
+	for (int i = 0; i < 3; i++) {
+		if (direction[i] == 0.0) {
+			if (origin[i] < boxMin[i] || origin[i] > boxMax[i]) {
+				return -1.0;
+			}
+			continue;
+		}
+		double a = (boxMin[i] - origin[i]) / direction[i], b = (boxMax[i] - origin[i]) / direction[i];
+		if (a > b) {
+			std::swap(a, b);
+		}
+		enter = std::max(enter, a);
+		exit = std::min(exit, b);
+		if (enter > exit) {
+			return -1.0;
+		}
+	}
+	return enter;
+}
+
+static void checkRaycast(const Bvh& bvh, const Cvec3& origin, const Cvec3& direction, double maxT,
+	const std::vector<Cvec3f>& boxMin, const std::vector<Cvec3f>& boxMax) {
+	double nearest = -1.0;
+	for (int i = 0; i < boxMin.size(); i++) {
+		const double t = rayEntersBox(origin, direction, maxT, boxMin[i], boxMax[i]);
+		if (t >= 0 && (nearest < 0 || t < nearest)) {
+			nearest = t;
+		}
+	}
+	double t = 0;
+	const int hit = bvh.raycast(origin, direction, maxT, t);
+	if (nearest < 0) {
+		CHECK_EQUAL(hit, -1);
+		return;
+	}
+	CHECK(hit >= 0);
+	if (hit >= 0) {
+		// Ties may pick either item, but both are entered where the scan says
+		CHECK(std::abs(t - nearest) < BVH_TEST_EPS);
+		CHECK(std::abs(rayEntersBox(origin, direction, maxT, boxMin[hit], boxMax[hit]) - nearest) < BVH_TEST_EPS);
+	}
+}
+
+static double distanceToBox(const Cvec3& p, const Cvec3f& boxMin, const Cvec3f& boxMax) {
+	double d2 = 0;
+	for (int i = 0; i < 3; i++) {
+		const double d = std::max(std::max(boxMin[i] - p[i], p[i] - boxMax[i]), 0.0);
+		d2 += d * d;
+	}
+	return std::sqrt(d2);
+}
+
+static void checkNearest(const Bvh& bvh, const Cvec3& point, const std::vector<Cvec3f>& boxMin, const std::vector<Cvec3f>& boxMax) {
+	double nearest = DBL_MAX;
+	for (int i = 0; i < boxMin.size(); i++) {
+		nearest = std::min(nearest, distanceToBox(point, boxMin[i], boxMax[i]));
+	}
+	double distance = -1;
+	const int item = bvh.nearest(point, distance);
+	CHECK(item >= 0);
+	if (item >= 0) {
+		CHECK(std::abs(distance - nearest) < BVH_TEST_EPS);
+		CHECK(std::abs(distanceToBox(point, boxMin[item], boxMax[item]) - nearest) < BVH_TEST_EPS);
+	}
+}
+
+static void checkQueries(const Bvh& bvh, std::mt19937& random, const std::vector<Cvec3f>& boxMin, const std::vector<Cvec3f>& boxMax) {
+	CHECK_EQUAL(bvh.itemCount(), (int)boxMin.size());
+	std::uniform_real_distribution<double> position(-80.0, 80.0), angle(-CS175_PI, CS175_PI), unit(-1.0, 1.0);
+
+	for (int i = 0; i < 20; i++) {
+		const Matrix4 eyeMatrix = Matrix4::makeTranslation(Cvec3(position(random), position(random), position(random)))
+			* Matrix4::makeYRotation(angle(random)) * Matrix4::makeXRotation(angle(random) * 0.5);
+		checkCull(bvh, Matrix4::makeProjection(45.0, 1.5, -0.1, -100.0) * inv(eyeMatrix), boxMin, boxMax);
+	}
+	for (int i = 0; i < 200; i++) {
+		const Cvec3 origin(position(random), position(random), position(random));
+		Cvec3 direction(unit(random), unit(random), unit(random));
+		// Some rays along an axis, where the slab test divides by zero
+		if (i % 10 == 0) {
+			direction[i % 3] = direction[(i + 1) % 3] = 0.0;
+		}
+		if (norm2(direction) < CS175_EPS2) {
+			continue;
+		}
+		checkRaycast(bvh, origin, normalize(direction), 150.0, boxMin, boxMax);
+	}
+	for (int i = 0; i < 200; i++) {
+		checkNearest(bvh, Cvec3(position(random), position(random), position(random)), boxMin, boxMax);
+	}
+}
+
+int main() {
+	std::mt19937 random(6533);
+	std::vector<Cvec3f> boxMin, boxMax;
+	Bvh bvh;
+
+	// Empty, then a single item
+	bvh.build(boxMin, boxMax);
+	std::vector<int> visible;
+	bvh.cull(Frustum::fromMatrix(Matrix4::makeProjection(45.0, 1.0, -0.1, -100.0)), visible);
+	CHECK(visible.empty());
+	double t = 0, distance = 0;
+	CHECK_EQUAL(bvh.raycast(Cvec3(), Cvec3(0, 0, -1), 100.0, t), -1);
+	CHECK_EQUAL(bvh.nearest(Cvec3(), distance), -1);
+
+	makeBoxes(random, 1, boxMin, boxMax);
+	bvh.build(boxMin, boxMax);
+	checkQueries(bvh, random, boxMin, boxMax);
+
+	makeBoxes(random, 3000, boxMin, boxMax);
+	bvh.build(boxMin, boxMax);
+	checkQueries(bvh, random, boxMin, boxMax);
+
+	// Half the boxes jump far enough that some subtrees outgrow their build
+	std::uniform_real_distribution<float> jump(-40.0f, 40.0f);
+	for (int i = 0; i < boxMin.size(); i += 2) {
+		const Cvec3f offset(jump(random), jump(random), jump(random));
+		boxMin[i] += offset;
+		boxMax[i] += offset;
+		bvh.setItemBounds(i, boxMin[i], boxMax[i]);
+	}
+	bvh.refit();
+	checkQueries(bvh, random, boxMin, boxMax);
+	CHECK(bvh.rebuildDegraded() > 0);
+	checkQueries(bvh, random, boxMin, boxMax);
+
+	return checkResult();
+}
@@ -0,0 +1,221 @@
+// RangeAllocator against its contract and a brute force model, and
+// GeometryArena's compaction on a headless GL context where there is one
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "geometrypool.h"
+#include "headless.h"
+
+#include "check.h"
+
+static void testAllocateAndMerge() {
+	RangeAllocator allocator;
+	allocator.reset(100, 0);
+	CHECK_EQUAL(allocator.capacity(), 100);
+	CHECK_EQUAL(allocator.used(), 0);
+	CHECK_EQUAL(allocator.freeRangeCount(), 1);
+	CHECK_EQUAL(allocator.largestFreeRange(), 100);
+
+	// First fit hands out ranges front to back
+	const int a = allocator.allocate(10), b = allocator.allocate(20), c = allocator.allocate(30);
+	CHECK_EQUAL(a, 0);
+	CHECK_EQUAL(b, 10);
+	CHECK_EQUAL(c, 30);
+	CHECK_EQUAL(allocator.used(), 60);
+	CHECK_EQUAL(allocator.freeRangeCount(), 1);
+	CHECK_EQUAL(allocator.largestFreeRange(), 40);
+	CHECK_EQUAL(allocator.allocate(41), -1);
+	CHECK_EQUAL(allocator.used(), 60);
+
+	// A hole, then the first fit reusing the front of it
+	allocator.free(b, 20);
+	CHECK_EQUAL(allocator.used(), 40);
+	CHECK_EQUAL(allocator.freeRangeCount(), 2);
+	const int d = allocator.allocate(15);
+	CHECK_EQUAL(d, 10);
+	CHECK_EQUAL(allocator.freeRangeCount(), 2);
+
+	// Merging with the next range, then the previous, then both
+	allocator.free(d, 15);
+	CHECK_EQUAL(allocator.freeRangeCount(), 2);
+	CHECK_EQUAL(allocator.largestFreeRange(), 40);
+	allocator.free(a, 10);
+	CHECK_EQUAL(allocator.freeRangeCount(), 2);
+	CHECK_EQUAL(allocator.largestFreeRange(), 40);
+	const int e = allocator.allocate(30);
+	CHECK_EQUAL(e, 0);
+	allocator.free(c, 30);
+	CHECK_EQUAL(allocator.freeRangeCount(), 1);
+	CHECK_EQUAL(allocator.largestFreeRange(), 70);
+	allocator.free(e, 30);
+	CHECK_EQUAL(allocator.used(), 0);
+	CHECK_EQUAL(allocator.freeRangeCount(), 1);
+	CHECK_EQUAL(allocator.largestFreeRange(), 100);
+}
+
+static void testReset() {
+	// What GeometryArena does after packing the live ranges to the front
+	RangeAllocator allocator;
+	allocator.reset(64, 0);
+	std::vector<int> firsts;
+	for (int i = 0; i < 8; i++) {
+		firsts.push_back(allocator.allocate(8));
+	}
+	for (int i = 0; i < 8; i += 2) {
+		allocator.free(firsts[i], 8);
+	}
+	CHECK_EQUAL(allocator.used(), 32);
+	CHECK_EQUAL(allocator.freeRangeCount(), 4);
+	CHECK_EQUAL(allocator.allocate(16), -1);
+
+	allocator.reset(64, allocator.used());
+	CHECK_EQUAL(allocator.used(), 32);
+	CHECK_EQUAL(allocator.freeRangeCount(), 1);
+	CHECK_EQUAL(allocator.largestFreeRange(), 32);
+	CHECK_EQUAL(allocator.allocate(32), 32);
+	CHECK_EQUAL(allocator.freeRangeCount(), 0);
+	CHECK_EQUAL(allocator.allocate(1), -1);
+
+	allocator.reset(10, 10);
+	CHECK_EQUAL(allocator.freeRangeCount(), 0);
+	CHECK_EQUAL(allocator.largestFreeRange(), 0);
+}
+
+// Random allocations and frees checked unit by unit against a map of which
+// units are taken
+static void testAgainstModel() {
+	const int capacity = 1000;
+	RangeAllocator allocator;
+	allocator.reset(capacity, 0);
+	std::vector<bool> taken(capacity, false);
+	std::vector<std::pair<int, int> > live;
+	std::mt19937 random(6533);
+
+	for (int step = 0; step < 5000; step++) {
+		if (live.empty() || random() % 3 != 0) {
+			const int count = 1 + (int)(random() % 40);
+			// The first run of free units long enough is where first fit must go
+			int expected = -1;
+			for (int first = 0, run = 0; first < capacity; first++) {
+				run = taken[first] ? 0 : run + 1;
+				if (run == count) {
+					expected = first - count + 1;
+					break;
+				}
+			}
+			const int first = allocator.allocate(count);
+			CHECK_EQUAL(first, expected);
+			if (first >= 0) {
+				std::fill(taken.begin() + first, taken.begin() + first + count, true);
+				live.push_back(std::make_pair(first, count));
+			}
+		}
+		else {
+			const int i = (int)(random() % live.size());
+			allocator.free(live[i].first, live[i].second);
+			std::fill(taken.begin() + live[i].first, taken.begin() + live[i].first + live[i].second, false);
+			live[i] = live.back();
+			live.pop_back();
+		}
+
+		int used = 0, runs = 0, largest = 0;
+		for (int unit = 0, run = 0; unit < capacity; unit++) {
+			used += taken[unit];
+			run = taken[unit] ? 0 : run + 1;
+			runs += run == 1;
+			largest = std::max(largest, run);
+		}
+		CHECK_EQUAL(allocator.used(), used);
+		CHECK_EQUAL(allocator.freeRangeCount(), runs);
+		CHECK_EQUAL(allocator.largestFreeRange(), largest);
+		if (checkFailures > 0) {
+			return;
+		}
+	}
+}
+
+// The arena's contents as they are in buffer 0, one int per element
+static std::vector<int> readRange(const GeometryArena& arena, int handle) {
+	std::vector<int> data(arena.count(handle));
+	glBindBuffer(GL_COPY_READ_BUFFER, arena.buffer(0));
+	glGetBufferSubData(GL_COPY_READ_BUFFER, sizeof(int) * arena.first(handle), sizeof(int) * data.size(), data.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	return data;
+}
+
+static std::vector<int> sequence(int first, int count) {
+	std::vector<int> data(count);
+	for (int i = 0; i < count; i++) {
+		data[i] = first + i;
+	}
+	return data;
+}
+
+static void testArena() {
+	GeometryArena arena(64, { (int)sizeof(int) });
+	int handles[4];
+	for (int i = 0; i < 4; i++) {
+		handles[i] = arena.allocate(16);
+		arena.write(handles[i], 0, sequence(100 * i, 16).data());
+	}
+	CHECK_EQUAL(arena.capacity(), 64);
+	CHECK_EQUAL(arena.used(), 64);
+
+	arena.free(handles[0]);
+	arena.free(handles[2]);
+	CHECK_EQUAL(arena.used(), 32);
+	CHECK_EQUAL(arena.freeRangeCount(), 2);
+
+	// Moves the survivors to the front, keeping their handles and contents
+	arena.defragment();
+	CHECK_EQUAL(arena.capacity(), 64);
+	CHECK_EQUAL(arena.freeRangeCount(), 1);
+	CHECK_EQUAL(arena.first(handles[1]), 0);
+	CHECK_EQUAL(arena.first(handles[3]), 16);
+	CHECK(readRange(arena, handles[1]) == sequence(100, 16));
+	CHECK(readRange(arena, handles[3]) == sequence(300, 16));
+
+	// Fragmented again, an allocation that fits only once packed compacts
+	// rather than grows; one that doesn't fit at all doubles the storage
+	const int a = arena.allocate(16), b = arena.allocate(16);
+	arena.write(b, 0, sequence(500, 16).data());
+	arena.free(handles[1]);
+	arena.free(a);
+	CHECK_EQUAL(arena.freeRangeCount(), 2);
+	const int c = arena.allocate(32);
+	CHECK_EQUAL(arena.capacity(), 64);
+	CHECK_EQUAL(arena.freeRangeCount(), 0);
+	CHECK(readRange(arena, handles[3]) == sequence(300, 16));
+	CHECK(readRange(arena, b) == sequence(500, 16));
+
+	const int d = arena.allocate(8);
+	CHECK_EQUAL(arena.capacity(), 128);
+	CHECK_EQUAL(arena.used(), 72);
+	CHECK(readRange(arena, b) == sequence(500, 16));
+	arena.free(c);
+	arena.free(d);
+	CHECK_EQUAL(arena.used(), 32);
+}
+
+int main() {
+	testAllocateAndMerge();
+	testReset();
+	testAgainstModel();
+
+	HeadlessContext context;
+	std::string error;
+	if (context.create(error)) {
+#ifndef CS6533_NO_GLEW
+		glewInit();
+#endif
+		testArena();
+		context.destroy();
+	}
+	else {
+		std::cout << "GeometryArena not tested: " << error << std::endl;
+	}
+	return checkResult();
+}